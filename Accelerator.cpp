@@ -0,0 +1,519 @@
+/************************************************************************************************
+ File: Accelerator.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "Accelerator.h"
+#include <string.h>
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+
+thread_local TraversalCounts traversalCounts = { 0, 0 };
+thread_local bool traversalCounting = false;
+
+/* Splits [0, count) into one contiguous chunk per thread */
+static void parallelChunks(int count, int threadCount, const std::function<void(int, int)>& body)
+{
+    int chunks = std::max(1, std::min(threadCount, count));
+    std::vector<std::thread> workers;
+
+    for (int i = 1; i < chunks; i++) {
+        workers.push_back( std::thread(body, (int) ((int64_t) count * i / chunks), (int) ((int64_t) count * (i + 1) / chunks)) );
+    }
+
+    body(0, (int) ((int64_t) count / chunks));
+
+    for (int i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+Accelerator* createAccelerator(AcceleratorType type, const std::vector<Surface*>& surfaces, int threadCount)
+{
+    if (type == ACCELERATOR_AUTO) {
+        float boundsMin[3], boundsMax[3];
+        int bounded = 0;
+
+        for (int i = 0; i < surfaces.size(); i++) {
+            bounded += surfaces[i]->getBounds(boundsMin, boundsMax) ? 1 : 0;
+        }
+
+        type = (bounded >= GRID_MIN_SURFACES) ? ACCELERATOR_GRID : ACCELERATOR_BRUTE_FORCE;
+    }
+
+    Accelerator* accelerator;
+
+    if (type == ACCELERATOR_GRID) {
+        accelerator = new GridAccelerator();
+    } else {
+        accelerator = new BruteForceAccelerator();
+    }
+
+    accelerator->build(surfaces, threadCount);
+
+    return accelerator;
+}
+
+bool parseAcceleratorType(const char* name, AcceleratorType& type)
+{
+    if (strcmp(name, "auto") == 0) {
+        type = ACCELERATOR_AUTO;
+    } else if (strcmp(name, "brute") == 0) {
+        type = ACCELERATOR_BRUTE_FORCE;
+    } else if (strcmp(name, "grid") == 0) {
+        type = ACCELERATOR_GRID;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+
+
+Surface* BruteForceAccelerator::intersectAll(const std::vector<Surface*>& surfaces, Ray& ray, float& closest, Ray& normal)
+{
+    Surface* closestSurface = NULL;
+
+    for (int i = 0; i < surfaces.size(); i++) {
+        Ray surfaceNormal;
+        float intersection = surfaces[i]->intersect(ray, surfaceNormal);
+
+        if (intersection < 1) { /* No intersection or intersection not visible */
+            continue;
+        } else if (intersection < closest) {    /* Store intersection information */
+            closest = intersection;
+            closestSurface = surfaces[i];
+            normal = surfaceNormal;
+        }
+    }
+
+    countTraversal(surfaces.size(), 0);
+
+    return closestSurface;
+}
+
+Accelerator* BruteForceAccelerator::update(const std::vector<Surface*>& _surfaces, const std::vector<uint32_t>& changed) const
+{
+    BruteForceAccelerator* updated = new BruteForceAccelerator();
+    updated->surfaces = _surfaces;
+
+    return updated;
+}
+
+bool BruteForceAccelerator::occludedByAny(const std::vector<Surface*>& surfaces, Ray& ray, float maxDistance)
+{
+    for (int i = 0; i < surfaces.size(); i++) {
+        Ray surfaceNormal;
+        float intersection = surfaces[i]->intersect(ray, surfaceNormal);
+
+        if (intersection > 1 && intersection < maxDistance) {
+            countTraversal(i + 1, 0);
+            return true;
+        }
+    }
+
+    countTraversal(surfaces.size(), 0);
+
+    return false;
+}
+
+
+
+GridAccelerator::GridAccelerator()
+{
+    for (int i = 0; i < 3; i++) {
+        gridMin[i] = gridMax[i] = 0.0;
+        cellSize[i] = 1.0;
+        resolution[i] = 1;
+    }
+
+    /* One empty cell until built */
+    std::shared_ptr<GridCells> empty = std::make_shared<GridCells>();
+    empty->cellStart.assign(2, 0);
+    cells = empty;
+    cellStarts = cells->cellStart.data();
+    cellSurfaces = cells->cellSurfaces.data();
+}
+
+void GridAccelerator::build(const std::vector<Surface*>& _surfaces, int threadCount)
+{
+    surfaces = _surfaces;
+    unbounded.clear();
+    moved.clear();
+    bounds.assign(surfaces.size() * 6, 0.0);
+
+    for (int s = 0; s < surfaces.size(); s++) {
+        if (!surfaces[s]->getBounds(&bounds[s * 6], &bounds[s * 6 + 3])) {
+            unbounded.push_back(s);
+        }
+    }
+
+    buildCells((int) surfaces.size(), threadCount);
+}
+
+void GridAccelerator::buildFromBounds(const std::vector<float>& boxes, int threadCount)
+{
+    surfaces.clear();
+    unbounded.clear();
+    moved.clear();
+    bounds = boxes;
+
+    buildCells((int) (bounds.size() / 6), threadCount);
+}
+
+/* Everything past gathering 'bounds' and 'unbounded' for 'boxCount' entries */
+void GridAccelerator::buildCells(int boxCount, int threadCount)
+{
+    int boundedCount = 0;
+
+    for (int i = 0; i < 3; i++) {
+        gridMin[i] = INFINITY;
+        gridMax[i] = -INFINITY;
+    }
+
+    for (int s = 0, u = 0; s < boxCount; s++) {
+        if (u < unbounded.size() && unbounded[u] == s) {
+            u++;
+            continue;
+        }
+
+        boundedCount++;
+
+        for (int i = 0; i < 3; i++) {
+            gridMin[i] = std::min(gridMin[i], bounds[s * 6 + i]);
+            gridMax[i] = std::max(gridMax[i], bounds[s * 6 + 3 + i]);
+        }
+    }
+
+    if (boundedCount == 0) {
+        for (int i = 0; i < 3; i++) {
+            gridMin[i] = gridMax[i] = 0.0;
+            resolution[i] = 1;
+        }
+    }
+
+    /* Pad the grid so that rounding in the hit distances never puts a hit just outside its cells, and
+        give flat scenes some depth so every cell has a volume */
+    float extent[3], largest = 0.0;
+
+    for (int i = 0; i < 3; i++) {
+        largest = std::max(largest, gridMax[i] - gridMin[i]);
+    }
+
+    float padding = 1e-4f * std::max(largest, 1.0f);
+
+    for (int i = 0; i < 3; i++) {
+        gridMin[i] -= padding;
+        gridMax[i] += padding;
+        extent[i] = gridMax[i] - gridMin[i];
+    }
+
+    /* Cubic cells, GRID_CELLS_PER_SURFACE of them per surface */
+    float cellsPerUnit = cbrtf( GRID_CELLS_PER_SURFACE * std::max(boundedCount, 1) / (extent[0] * extent[1] * extent[2]) );
+
+    for (int i = 0; i < 3; i++) {
+        resolution[i] = std::min(std::max((int) (extent[i] * cellsPerUnit + 0.5f), 1), GRID_MAX_RESOLUTION);
+        cellSize[i] = extent[i] / resolution[i];
+    }
+
+    int cellCount = resolution[0] * resolution[1] * resolution[2];
+    std::vector<std::atomic<uint32_t> > counts(cellCount);
+
+    for (int c = 0; c < cellCount; c++) {
+        counts[c] = 0;
+    }
+
+    std::vector<uint32_t> bounded;
+
+    for (int s = 0, u = 0; s < boxCount; s++) {
+        if (u < unbounded.size() && unbounded[u] == s) {
+            u++;
+        } else {
+            bounded.push_back(s);
+        }
+    }
+
+    /* Pass 1: count the surfaces overlapping each cell */
+    parallelChunks((int) bounded.size(), threadCount, [this, &bounded, &counts](int begin, int end) {
+        int low[3], high[3];
+
+        for (int b = begin; b < end; b++) {
+            getCellRange(bounded[b], low, high);
+
+            for (int z = low[2]; z <= high[2]; z++) {
+                for (int y = low[1]; y <= high[1]; y++) {
+                    for (int x = low[0]; x <= high[0]; x++) {
+                        counts[(z * resolution[1] + y) * resolution[0] + x].fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            }
+        }
+    });
+
+    std::shared_ptr<GridCells> built = std::make_shared<GridCells>();
+    std::vector<uint32_t>& cellStart = built->cellStart;
+    std::vector<uint32_t>& cellSurfaces = built->cellSurfaces;
+
+    cellStart.assign(cellCount + 1, 0);
+
+    for (int c = 0; c < cellCount; c++) {
+        cellStart[c + 1] = cellStart[c] + counts[c];
+        counts[c] = cellStart[c];   /* Reused as each cell's fill cursor */
+    }
+
+    cellSurfaces.assign(cellStart[cellCount], 0);
+
+    /* Pass 2: fill the cells. Threads interleave within a cell, so each cell is sorted afterwards to keep
+        the test order, and with it the result for equal hit distances, independent of the thread count */
+    parallelChunks((int) bounded.size(), threadCount, [this, &bounded, &counts, &cellSurfaces](int begin, int end) {
+        int low[3], high[3];
+
+        for (int b = begin; b < end; b++) {
+            getCellRange(bounded[b], low, high);
+
+            for (int z = low[2]; z <= high[2]; z++) {
+                for (int y = low[1]; y <= high[1]; y++) {
+                    for (int x = low[0]; x <= high[0]; x++) {
+                        uint32_t slot = counts[(z * resolution[1] + y) * resolution[0] + x].fetch_add(1, std::memory_order_relaxed);
+                        cellSurfaces[slot] = bounded[b];
+                    }
+                }
+            }
+        }
+    });
+
+    parallelChunks(cellCount, threadCount, [&cellStart, &cellSurfaces](int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            std::sort(cellSurfaces.begin() + cellStart[c], cellSurfaces.begin() + cellStart[c + 1]);
+        }
+    });
+
+    cells = built;
+    this->cellStarts = cells->cellStart.data();
+    this->cellSurfaces = cells->cellSurfaces.data();
+}
+
+/* The lists are trusted to describe a grid over '_surfaces'; SceneCache validates the ones it stores */
+void GridAccelerator::adopt(const std::vector<Surface*>& _surfaces, const float _gridMin[3], const float _gridMax[3],
+                            const int _resolution[3], const uint32_t* _cellStarts, const uint32_t* _cellSurfaces, bool copy)
+{
+    float unusedMin[3], unusedMax[3];
+
+    surfaces = _surfaces;
+    unbounded.clear();
+    moved.clear();
+    bounds.clear();
+
+    for (int s = 0; s < surfaces.size(); s++) {
+        if (!surfaces[s]->getBounds(unusedMin, unusedMax)) {
+            unbounded.push_back(s);
+        }
+    }
+
+    /* Same arithmetic as build(), so the cells line up with the ones the lists were built for */
+    for (int i = 0; i < 3; i++) {
+        gridMin[i] = _gridMin[i];
+        gridMax[i] = _gridMax[i];
+        resolution[i] = _resolution[i];
+        cellSize[i] = (gridMax[i] - gridMin[i]) / resolution[i];
+    }
+
+    int cellCount = getCellCount();
+    std::shared_ptr<GridCells> adopted = std::make_shared<GridCells>();
+
+    if (copy) {
+        adopted->cellStart.assign(_cellStarts, _cellStarts + cellCount + 1);
+        adopted->cellSurfaces.assign(_cellSurfaces, _cellSurfaces + _cellStarts[cellCount]);
+        cellStarts = adopted->cellStart.data();
+        cellSurfaces = adopted->cellSurfaces.data();
+    } else {
+        cellStarts = _cellStarts;
+        cellSurfaces = _cellSurfaces;
+    }
+
+    cells = adopted;
+}
+
+/* Only the surface pointers and the moved list are copied; the cells stay shared */
+Accelerator* GridAccelerator::update(const std::vector<Surface*>& _surfaces, const std::vector<uint32_t>& changed) const
+{
+    std::vector<uint32_t> allMoved;
+
+    std::set_union(moved.begin(), moved.end(), changed.begin(), changed.end(), std::back_inserter(allMoved));
+
+    if (_surfaces.size() != surfaces.size() || allMoved.size() > GRID_MAX_MOVED) {
+        return NULL;
+    }
+
+    GridAccelerator* updated = new GridAccelerator();
+    updated->surfaces = _surfaces;
+    updated->unbounded = unbounded;
+    updated->moved = allMoved;
+    updated->cells = cells;
+    updated->cellStarts = cellStarts;
+    updated->cellSurfaces = cellSurfaces;
+
+    for (int i = 0; i < 3; i++) {
+        updated->gridMin[i] = gridMin[i];
+        updated->gridMax[i] = gridMax[i];
+        updated->cellSize[i] = cellSize[i];
+        updated->resolution[i] = resolution[i];
+    }
+
+    return updated;
+}
+
+void GridAccelerator::getCellRange(int surface, int low[3], int high[3]) const
+{
+    for (int i = 0; i < 3; i++) {
+        low[i] = std::min(std::max((int) ((bounds[surface * 6 + i] - gridMin[i]) / cellSize[i]), 0), resolution[i] - 1);
+        high[i] = std::min(std::max((int) ((bounds[surface * 6 + 3 + i] - gridMin[i]) / cellSize[i]), 0), resolution[i] - 1);
+    }
+}
+
+size_t GridAccelerator::getMemoryBytes() const
+{
+    return (surfaces.capacity() * sizeof(Surface*)) + ((unbounded.capacity() + moved.capacity()) * sizeof(uint32_t)) +
+           (bounds.capacity() * sizeof(float)) + (cells->cellStart.capacity() * sizeof(uint32_t)) +
+           (cells->cellSurfaces.capacity() * sizeof(uint32_t));
+}
+
+/* Amanatides & Woo: 'tNext' is the distance at which the ray crosses into the next cell along each
+    axis and 'tDelta' the distance between two such crossings */
+bool GridAccelerator::startTraversal(Ray& ray, float tMax, int cell[3], int step[3], float tNext[3], float tDelta[3],
+                                     float& tExit) const
+{
+    std::vector<float> direction = ray.normalize();
+    Point start = ray.getStartPoint();
+    float origin[3] = { start.getX(), start.getY(), start.getZ() };
+    float tEnter = 0.0;
+
+    tExit = tMax;
+
+    for (int i = 0; i < 3; i++) {
+        float inverse = 1.0f / direction[i];
+        float t0 = (gridMin[i] - origin[i]) * inverse;
+        float t1 = (gridMax[i] - origin[i]) * inverse;
+
+        if (direction[i] == 0.0) {  /* Parallel to this slab: inside it or never */
+            if (origin[i] < gridMin[i] || origin[i] > gridMax[i]) {
+                return false;
+            }
+            continue;
+        }
+
+        tEnter = std::max(tEnter, std::min(t0, t1));
+        tExit = std::min(tExit, std::max(t0, t1));
+    }
+
+    if (tEnter > tExit) {
+        return false;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        float position = origin[i] + direction[i] * tEnter;
+        cell[i] = std::min(std::max((int) ((position - gridMin[i]) / cellSize[i]), 0), resolution[i] - 1);
+
+        if (direction[i] > 0.0) {
+            step[i] = 1;
+            tNext[i] = (gridMin[i] + (cell[i] + 1) * cellSize[i] - origin[i]) / direction[i];
+            tDelta[i] = cellSize[i] / direction[i];
+        } else if (direction[i] < 0.0) {
+            step[i] = -1;
+            tNext[i] = (gridMin[i] + cell[i] * cellSize[i] - origin[i]) / direction[i];
+            tDelta[i] = -cellSize[i] / direction[i];
+        } else {
+            step[i] = 0;
+            tNext[i] = INFINITY;
+            tDelta[i] = INFINITY;
+        }
+    }
+
+    return true;
+}
+
+static inline void testSurface(const std::vector<Surface*>& surfaces, uint32_t s, Ray& ray, float& closest, Ray& normal,
+                               Surface*& closestSurface, uint32_t& closestIndex)
+{
+    Ray surfaceNormal;
+    float intersection = surfaces[s]->intersect(ray, surfaceNormal);
+
+    if (intersection >= 1 && (intersection < closest || (intersection == closest && closestSurface != NULL && s < closestIndex))) {
+        closest = intersection;
+        closestSurface = surfaces[s];
+        closestIndex = s;
+        normal = surfaceNormal;
+    }
+}
+
+/* A hit found in a cell may lie in a later cell, so the walk only stops once the closest hit so far is
+    no farther than the current cell's far side. Equal distances go to the lowest surface index, the
+    one the loop over all surfaces would keep */
+Surface* GridAccelerator::intersect(Ray& ray, float& closest, Ray& normal) const
+{
+    Surface* closestSurface = NULL;
+    uint32_t closestIndex = 0;
+
+    for (int u = 0; u < unbounded.size(); u++) {
+        testSurface(surfaces, unbounded[u], ray, closest, normal, closestSurface, closestIndex);
+    }
+
+    for (int m = 0; m < moved.size(); m++) {
+        testSurface(surfaces, moved[m], ray, closest, normal, closestSurface, closestIndex);
+    }
+
+    countTraversal(unbounded.size() + moved.size(), 0);
+
+    walkCells(ray, closest, [&](const uint32_t* first, const uint32_t* last) -> float {
+        for (const uint32_t* k = first; k < last; k++) {
+            testSurface(surfaces, *k, ray, closest, normal, closestSurface, closestIndex);
+        }
+        countTraversal(last - first, 1);
+        return closest;
+    });
+
+    return closestSurface;
+}
+
+bool GridAccelerator::occluded(Ray& ray, float maxDistance) const
+{
+    for (int u = 0; u < unbounded.size() + moved.size(); u++) {
+        Ray surfaceNormal;
+        uint32_t s = (u < unbounded.size()) ? unbounded[u] : moved[u - unbounded.size()];
+        float intersection = surfaces[s]->intersect(ray, surfaceNormal);
+
+        if (intersection > 1 && intersection < maxDistance) {
+            countTraversal(u + 1, 0);
+            return true;
+        }
+    }
+
+    bool hit = false;
+
+    countTraversal(unbounded.size() + moved.size(), 0);
+
+    walkCells(ray, maxDistance, [&](const uint32_t* first, const uint32_t* last) -> float {
+        for (const uint32_t* k = first; k < last; k++) {
+            Ray surfaceNormal;
+            float intersection = surfaces[*k]->intersect(ray, surfaceNormal);
+
+            if (intersection > 1 && intersection < maxDistance) {
+                countTraversal(k - first + 1, 1);
+                hit = true;
+                return -INFINITY;
+            }
+        }
+        countTraversal(last - first, 1);
+        return INFINITY;
+    });
+
+    return hit;
+}
@@ -0,0 +1,207 @@
+/************************************************************************************************
+ File: Accelerator.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____Accelerator__
+#define __Ray_Tracer__C_____Accelerator__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include "Surface.h"
+
+#define GRID_MIN_SURFACES 64        /* Below this many bounded surfaces the loop beats building a grid */
+#define GRID_CELLS_PER_SURFACE 2.0  /* Target grid density */
+#define GRID_MAX_RESOLUTION 256     /* Cells per axis */
+#define GRID_MAX_MOVED 64           /* Changed surfaces an updated grid tests on every query before it is rebuilt */
+
+enum AcceleratorType { ACCELERATOR_AUTO, ACCELERATOR_BRUTE_FORCE, ACCELERATOR_GRID };
+
+/* Answers the two visibility queries of the ray tracer over a fixed list of surfaces. Every backend
+    returns exactly what testing all surfaces in list order would, ties included, so switching
+    backends never changes the image */
+class Accelerator {
+public:
+    virtual ~Accelerator() {}
+
+    virtual void build(const std::vector<Surface*>& _surfaces, int threadCount) = 0;
+
+    /* Closest surface hit by 'ray' with 1 <= t < 'closest'. Updates 'closest' and 'normal' and returns
+     the surface, or NULL if there is none */
+    virtual Surface* intersect(Ray& ray, float& closest, Ray& normal) const = 0;
+
+    /* True if any surface is hit by 'ray' with 1 < t < 'maxDistance' */
+    virtual bool occluded(Ray& ray, float maxDistance) const = 0;
+
+    /* A new accelerator over '_surfaces', a list of the same length that differs from the one this
+     accelerator was built over only at the ascending indices in 'changed'. Returns NULL when the backend cannot
+     update, or when a full build would serve better */
+    virtual Accelerator* update(const std::vector<Surface*>& _surfaces, const std::vector<uint32_t>& changed) const { return NULL; }
+
+    virtual size_t getMemoryBytes() const = 0;
+    virtual const char* getName() const = 0;
+    virtual AcceleratorType getType() const = 0;
+};
+
+/* Work done by the calling thread's intersect() and occluded() queries while it has counting on:
+    surfaces tested, whether bounded or not, and grid cells visited. Counting is off by default so renders
+    do not pay for it; the renderer's cost prepass switches it on around the rays it samples */
+struct TraversalCounts {
+    uint64_t surfaceTests;
+    uint64_t cellVisits;
+};
+
+extern thread_local TraversalCounts traversalCounts;
+extern thread_local bool traversalCounting;
+
+inline TraversalCounts getTraversalCounts() { return traversalCounts; }
+inline void setTraversalCounting(bool counting) { traversalCounting = counting; }
+inline bool getTraversalCounting() { return traversalCounting; }
+
+inline void countTraversal(uint64_t surfaceTests, uint64_t cellVisits) {
+    if (traversalCounting) {
+        traversalCounts.surfaceTests += surfaceTests;
+        traversalCounts.cellVisits += cellVisits;
+    }
+}
+
+/* Builds the backend 'type' over 'surfaces'. ACCELERATOR_AUTO picks the grid once there are at least
+    GRID_MIN_SURFACES bounded surfaces and the loop otherwise */
+Accelerator* createAccelerator(AcceleratorType type, const std::vector<Surface*>& surfaces, int threadCount);
+
+/* Parses "auto", "brute" or "grid"; returns false for anything else */
+bool parseAcceleratorType(const char* name, AcceleratorType& type);
+
+
+
+/* Tests every surface, as the ray tracer originally did */
+class BruteForceAccelerator : public Accelerator {
+public:
+    void build(const std::vector<Surface*>& _surfaces, int threadCount) { surfaces = _surfaces; }
+    Surface* intersect(Ray& ray, float& closest, Ray& normal) const { return intersectAll(surfaces, ray, closest, normal); }
+    bool occluded(Ray& ray, float maxDistance) const { return occludedByAny(surfaces, ray, maxDistance); }
+    Accelerator* update(const std::vector<Surface*>& _surfaces, const std::vector<uint32_t>& changed) const;
+    size_t getMemoryBytes() const { return surfaces.capacity() * sizeof(Surface*); }
+    const char* getName() const { return "brute force"; }
+    AcceleratorType getType() const { return ACCELERATOR_BRUTE_FORCE; }
+
+    /* The loops themselves, shared with scenes that have no accelerator built */
+    static Surface* intersectAll(const std::vector<Surface*>& surfaces, Ray& ray, float& closest, Ray& normal);
+    static bool occludedByAny(const std::vector<Surface*>& surfaces, Ray& ray, float maxDistance);
+
+private:
+    std::vector<Surface*> surfaces;
+};
+
+
+
+/* Uniform grid over the surfaces that have bounds, traversed cell by cell with a 3D-DDA. Cells list
+    their surfaces in a compressed array (cellStart[c] .. cellStart[c + 1] in cellSurfaces), built in
+    two parallel passes: count the cells each surface overlaps, then fill them. Unbounded surfaces
+    such as planes are tested on every query.
+    An update shares the cell lists of the grid it came from and tests the changed surfaces on every
+    query too. Their old cell entries now name the new surfaces, which only costs redundant tests.
+    A grid can also take over cells stored elsewhere, such as in a scene cache (see SceneCache), either
+    copying them or reading them where they lie */
+class GridAccelerator : public Accelerator {
+public:
+    GridAccelerator();
+
+    void build(const std::vector<Surface*>& _surfaces, int threadCount);
+    Surface* intersect(Ray& ray, float& closest, Ray& normal) const;
+    bool occluded(Ray& ray, float maxDistance) const;
+    Accelerator* update(const std::vector<Surface*>& _surfaces, const std::vector<uint32_t>& changed) const;
+    size_t getMemoryBytes() const;
+    const char* getName() const { return "grid"; }
+
+    /* Builds the cells over boxes that are not surfaces, six floats (min xyz, max xyz) each, such as the
+     pages of PagedGeometry. The cell lists hold box indices; only walkCells() may be used */
+    void buildFromBounds(const std::vector<float>& boxes, int threadCount);
+    AcceleratorType getType() const { return ACCELERATOR_GRID; }
+
+    /* Takes over a grid built earlier over '_surfaces': its padded bounds, resolution and cell lists
+     (getCellStarts(), getCellSurfaces()). With 'copy' false the cell lists are used in place and must
+     outlive the grid and its updates */
+    void adopt(const std::vector<Surface*>& _surfaces, const float _gridMin[3], const float _gridMax[3],
+               const int _resolution[3], const uint32_t* _cellStarts, const uint32_t* _cellSurfaces, bool copy);
+
+    int getResolution(int axis) const { return resolution[axis]; }
+    int getMovedCount() const { return (int) moved.size(); }
+    const float* getGridMin() const { return gridMin; }
+    const float* getGridMax() const { return gridMax; }
+    int getCellCount() const { return resolution[0] * resolution[1] * resolution[2]; }
+    const uint32_t* getCellStarts() const { return cellStarts; }          /* getCellCount() + 1 entries */
+    const uint32_t* getCellSurfaces() const { return cellSurfaces; }      /* getCellStarts()[getCellCount()] entries */
+
+    /* Walks the cells 'ray' crosses before 'tMax', nearest first, calling visit(first, last) with the
+     surface indices listed in each. visit() returns the distance up to which the walk must go on: the
+     closest hit so far, INFINITY to go on regardless, or -INFINITY to stop */
+    template <typename CellVisitor>
+    void walkCells(Ray& ray, float tMax, CellVisitor visit) const;
+
+private:
+    /* Sizes the grid to the first 'boxCount' entries of 'bounds', leaving out those in 'unbounded', and
+     fills the cells */
+    void buildCells(int boxCount, int threadCount);
+
+    /* Range of cells overlapped by 'surface' along each axis */
+    void getCellRange(int surface, int low[3], int high[3]) const;
+
+    /* Clips 'ray' to the grid and sets up the DDA. Returns false if the ray misses the grid */
+    bool startTraversal(Ray& ray, float tMax, int cell[3], int step[3], float tNext[3], float tDelta[3], float& tExit) const;
+
+    /* Immutable once built, so updated grids can share them */
+    struct GridCells {
+        std::vector<uint32_t> cellStart;
+        std::vector<uint32_t> cellSurfaces;     /* Indices into 'surfaces', ascending within each cell */
+    };
+
+    std::vector<Surface*> surfaces;
+    std::vector<uint32_t> unbounded;        /* Indices into 'surfaces' tested on every query */
+    std::vector<uint32_t> moved;            /* Indices changed since the cells were built, ascending, also tested on every query */
+    std::vector<float> bounds;              /* Six floats (min xyz, max xyz) per surface, at build time */
+    std::shared_ptr<const GridCells> cells;     /* Empty when the lists are used in place */
+    const uint32_t* cellStarts;             /* Into 'cells' or the adopted lists */
+    const uint32_t* cellSurfaces;
+
+    float gridMin[3], gridMax[3];
+    float cellSize[3];
+    int resolution[3];
+};
+
+template <typename CellVisitor>
+void GridAccelerator::walkCells(Ray& ray, float tMax, CellVisitor visit) const
+{
+    int cell[3], step[3];
+    float tNext[3], tDelta[3], tExit;
+
+    if (!startTraversal(ray, tMax, cell, step, tNext, tDelta, tExit)) {
+        return;
+    }
+
+    while (true) {
+        int c = (cell[2] * resolution[1] + cell[1]) * resolution[0] + cell[0];
+        float reach = visit(cellSurfaces + cellStarts[c], cellSurfaces + cellStarts[c + 1]);
+
+        int axis = (tNext[0] < tNext[1]) ? ((tNext[0] < tNext[2]) ? 0 : 2) : ((tNext[1] < tNext[2]) ? 1 : 2);
+
+        if (reach < tNext[axis] || tNext[axis] > tExit) {
+            break;
+        }
+
+        cell[axis] += step[axis];
+
+        if (cell[axis] < 0 || cell[axis] >= resolution[axis]) {
+            break;
+        }
+
+        tNext[axis] += tDelta[axis];
+    }
+}
+
+#endif /* defined(__Ray_Tracer__C_____Accelerator__) */
@@ -14,12 +14,6 @@
 #include "Point.h"
 #include "Ray.h"
 
-/* Clears framebuffer to black */
-void clearFramebuffer();
-
-/* Sets pixel x,y to the color RGB */
-void setFramebuffer(int x, int y, float R, float G, float B);
-
 inline float dotProduct(Point p1, Point p2) {
     return ( (p1.getX() * p2.getX()) + (p1.getY() * p2.getY()) + (p1.getZ() * p2.getZ()) );
 }
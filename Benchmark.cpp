@@ -0,0 +1,2143 @@
+/************************************************************************************************
+ File: Benchmark.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "Benchmark.h"
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <set>
+#include <map>
+#include <mutex>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "Shading.h"
+#include "Random.h"
+#include "SceneCache.h"
+#include "Accelerator.h"
+#include "FastMath.h"
+#include "PagedGeometry.h"
+#include "Texture.h"
+#include "TextureCache.h"
+#include "Renderer.h"
+#include "SceneStore.h"
+#include "PerfCounters.h"
+#include "Trace.h"
+#include "Denoiser.h"
+#include "RayTracerAPI.h"
+#include "Precision.h"
+#include "EnvironmentMap.h"
+#include "Numa.h"
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Returns the wall-clock time of 'repeats' passes of 'kernel' over 'points' and adds the results to 'sink'
+    so the work cannot be optimized away */
+static double timeKernel(ShadingKernel kernel, const Surface& surface, const std::vector<ShadingPoint>& points,
+                         const Light& light, int repeats, float& sink)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int r = 0; r < repeats; r++) {
+        for (int i = 0; i < points.size(); i++) {
+            Color color = kernel(surface, points[i], light);
+            sink += color.getR() + color.getG() + color.getB();
+        }
+    }
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void runShadingBenchmark()
+{
+    const int pointCount = 1 << 16;
+    const int repeats = 64;
+    std::vector<ShadingPoint> points(pointCount);
+    Light light(Point(1.0, 3.0, 2.0), Color(1.0, 1.0, 1.0));
+    float sink = 0.0;
+
+    /* Random hit points on a unit sphere around the origin, seen from the default eye position */
+    for (int i = 0; i < pointCount; i++) {
+        RandomStream random(1, i, 0);
+        float z = 1.0f - 2.0f * random.get(0, 0);
+        float r = sqrtf(1.0f - z * z);
+        float phi = 2.0f * M_PI * random.get(0, 1);
+        float eye[3] = { 0.0, 0.0, -5.0 };
+        float length = 0.0;
+
+        points[i].albedo = Color(1.0, 1.0, 1.0);
+        points[i].normal[0] = r * cosf(phi);
+        points[i].normal[1] = r * sinf(phi);
+        points[i].normal[2] = z;
+
+        for (int k = 0; k < 3; k++) {
+            points[i].position[k] = points[i].normal[k];
+            points[i].toEye[k] = eye[k] - points[i].position[k];
+            length += points[i].toEye[k] * points[i].toEye[k];
+        }
+
+        for (int k = 0; k < 3; k++) {
+            points[i].toEye[k] /= sqrtf(length);
+        }
+    }
+
+    int exponents[5] = { 0, 5, 16, 50, 7 };     /* 0 = diffuse-only, 7 has no specialization */
+
+    printf("Shading kernels, %d points x %d passes\n", pointCount, repeats);
+    printf("  %-14s %12s %12s %9s\n", "material", "generic ns", "special ns", "speedup");
+
+    for (int e = 0; e < 5; e++) {
+        Color specular = (exponents[e] == 0) ? Color(0.0, 0.0, 0.0) : Color(0.75, 0.75, 0.75);
+        Sphere sphere(Point(0.0, 0.0, 0.0), 1.0, Color(0.1, 0.0, 0.0), Color(0.7, 0.0, 0.0), specular, 0.0);
+
+        if (exponents[e] != 0) {
+            sphere.setSpecularExponent(exponents[e]);
+        }
+
+        /* The generic kernel always pays for the specular term, as the old code did */
+        double generic = timeKernel(genericShadingKernel(), sphere, points, light, repeats, sink);
+        double special = timeKernel(sphere.getShadingKernel(), sphere, points, light, repeats, sink);
+        double calls = (double) pointCount * repeats;
+        char name[32];
+
+        if (exponents[e] == 0) {
+            snprintf(name, sizeof(name), "diffuse-only");
+        } else {
+            snprintf(name, sizeof(name), "specular n=%d", exponents[e]);
+        }
+
+        printf("  %-14s %12.2f %12.2f %8.2fx\n", name, 1e9 * generic / calls, 1e9 * special / calls, generic / special);
+    }
+
+    printf("  (checksum %g)\n", sink);
+}
+
+/* Every path ends with the same ray traced through a grid, so each time is the time until the first
+    hit is known: built from scratch, traced straight from the mapping, or traced after instantiating
+    the surfaces with the stored grid as their accelerator */
+void runSceneCacheBenchmark()
+{
+    const int sphereCount = 1000000;
+    const char* path = "scene_cache_benchmark.rtsc";
+    int threadCount = std::max(1, (int) std::thread::hardware_concurrency());
+    Ray firstRay = Camera().getPrimaryRay(400, 400);
+
+    printf("Scene cache, %d spheres, %d threads, time to the first traced ray\n", sphereCount, threadCount);
+
+    /* Cold path: build every surface from its description and a grid over them, as init() does */
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Scene scene;
+    scene.addLight( Light( Point(1.0, 3.0, 2.0), Color(1.0, 1.0, 1.0) ) );
+
+    for (int i = 0; i < sphereCount; i++) {
+        RandomStream random(2, i, 0);
+        Point center(20.0f * random.get(0, 0) - 10.0f, 20.0f * random.get(0, 1) - 10.0f, 10.0f + 20.0f * random.get(0, 2));
+        scene.addSphere( new Sphere(center, 0.01f + 0.04f * random.get(0, 3), Color(0.1, 0.0, 0.0),
+                                    Color(0.7, 0.0, 0.0), Color(0.75, 0.75, 0.75), 0.0) );
+    }
+
+    scene.buildAccelerator(ACCELERATOR_AUTO, threadCount);
+
+    Ray ray = firstRay, normal;
+    float coldDistance = INFINITY;
+    Surface* coldHit = scene.intersect(ray, coldDistance, normal);
+    double coldSeconds = secondsSince(start);
+
+    std::vector<Surface*> surfaces = scene.getSurfaces();
+    int coldIndex = (coldHit == NULL) ? -1 : (int) (std::find(surfaces.begin(), surfaces.end(), coldHit) - surfaces.begin());
+
+    start = std::chrono::steady_clock::now();
+    PackedScene packed(scene);
+    uint64_t hash = packed.getContentHash();
+    packed.buildGrid(threadCount);
+    bool written = SceneCache::write(path, packed);
+    double writeSeconds = secondsSince(start);
+
+    if (!written) {
+        printf("  could not write %s\n", path);
+        return;
+    }
+
+    /* Warm path, in place: map the cache and trace through the mapped grid and records */
+    start = std::chrono::steady_clock::now();
+    SceneCache cache;
+    bool opened = cache.open(path, hash);
+    double openSeconds = secondsSince(start);
+
+    if (!opened) {
+        printf("  could not open %s\n", path);
+        return;
+    }
+
+    ray = firstRay;
+    float inPlaceDistance = INFINITY;
+    int inPlaceIndex = cache.intersect(ray, inPlaceDistance);
+    double inPlaceSeconds = secondsSince(start);
+
+    cache.close();
+
+    /* Warm path, render-ready: map the cache, instantiate the surfaces and adopt the stored grid */
+    start = std::chrono::steady_clock::now();
+    cache.open(path, hash);
+    Scene cachedScene = cache.buildScene(ACCELERATOR_AUTO);
+
+    ray = firstRay;
+    float readyDistance = INFINITY;
+    Surface* readyHit = cachedScene.intersect(ray, readyDistance, normal);
+    double readySeconds = secondsSince(start);
+
+    std::vector<Surface*> cachedSurfaces = cachedScene.getSurfaces();
+    int readyIndex = (readyHit == NULL) ? -1 :
+                     (int) (std::find(cachedSurfaces.begin(), cachedSurfaces.end(), readyHit) - cachedSurfaces.begin());
+    bool agree = (inPlaceIndex == coldIndex) && (readyIndex == coldIndex) &&
+                 (inPlaceDistance == coldDistance) && (readyDistance == coldDistance);
+
+    printf("  build + grid + first ray:         %8.3f s\n", coldSeconds);
+    printf("  pack + hash + grid + write:       %8.3f s  (once)\n", writeSeconds);
+    printf("  map + validate:                   %8.3f s  (%u spheres, %u cell entries)\n", openSeconds,
+           cache.getSphereCount(), (unsigned) packed.cellSurfaces.size());
+    printf("  map + first ray in place:         %8.3f s  (%.1fx faster than building)\n", inPlaceSeconds,
+           coldSeconds / inPlaceSeconds);
+    printf("  map + instantiate + first ray:    %8.3f s  (%.1fx, stored grid adopted: %s)\n", readySeconds,
+           coldSeconds / readySeconds, cachedScene.getAccelerator() ? "yes" : "no");
+    printf("  first hit: sphere %d at t=%g, all paths agree: %s\n", coldIndex, coldDistance, agree ? "yes" : "NO");
+    printf("  stale hash rejected:               %s\n", SceneCache().open(path, hash + 1) ? "no" : "yes");
+
+    for (int i = 0; i < cachedSurfaces.size(); i++) {
+        delete cachedSurfaces[i];
+    }
+
+    cache.close();
+
+    /* Damaged files whose header and hash still match: one cut short, one naming a missing material */
+    bool truncatedRejected = truncate(path, 4096) == 0 && !SceneCache().open(path, hash);
+
+    packed.spheres[0].material = (uint32_t) packed.materials.size();
+    bool corruptRejected = SceneCache::write(path, packed) && !SceneCache().open(path, packed.getContentHash());
+
+    printf("  truncated file rejected:           %s\n", truncatedRejected ? "yes" : "NO");
+    printf("  bad material index rejected:       %s\n", corruptRejected ? "yes" : "NO");
+    remove(path);
+}
+
+/* Renders 'scene' with 'geometry' opened under 'budget' bytes and returns the seconds taken */
+static double renderPaged(Scene& scene, PagedGeometry& geometry, const char* path, size_t budget,
+                          const Camera& camera, FrameBuffer& framebuffer)
+{
+    geometry.open(path, budget);
+    scene.setPagedGeometry(&geometry);
+
+    Renderer renderer(&scene, camera);
+    renderer.setThreadCount(std::thread::hardware_concurrency());
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    renderer.render(framebuffer);
+
+    return secondsSince(start);
+}
+
+void runOutOfCoreBenchmark()
+{
+    const int sphereCount = 40000;
+    const int spheresPerPage = 128;
+    const char* path = "out_of_core_benchmark.rtpg";
+    std::vector<PackedSphere> spheres(sphereCount);
+    std::vector<PackedMaterial> materials(2);
+
+    memset(&spheres[0], 0, spheres.size() * sizeof(PackedSphere));
+    memset(&materials[0], 0, materials.size() * sizeof(PackedMaterial));
+
+    for (int m = 0; m < 2; m++) {
+        materials[m].ambient[m] = 0.1f;
+        materials[m].diffuse[m] = 0.7f;
+        materials[m].specular[0] = materials[m].specular[1] = materials[m].specular[2] = 0.5f;
+        materials[m].reflectivity = 0.3f * m;
+        materials[m].specularExponent = DEFAULT_SPECULAR_EXPONENT;
+    }
+
+    for (int i = 0; i < sphereCount; i++) {
+        RandomStream random(3, i, 0);
+        spheres[i].center[0] = 20.0f * random.get(0, 0) - 10.0f;
+        spheres[i].center[1] = 20.0f * random.get(0, 1) - 10.0f;
+        spheres[i].center[2] = 5.0f + 40.0f * random.get(0, 2);
+        spheres[i].radius = 0.02f + 0.06f * random.get(0, 3);
+        spheres[i].material = i % 2;
+    }
+
+    if (!PagedGeometry::write(path, spheres, materials, spheresPerPage)) {
+        printf("  could not write %s\n", path);
+        return;
+    }
+
+    Scene scene;
+    scene.addLight( Light( Point(1.0, 3.0, 2.0), Color(1.0, 1.0, 1.0) ) );
+
+    Camera camera;
+    camera.setResolution(128, 128);
+    camera.setFieldOfView(60.0);
+
+    /* Reference: the second render of an unlimited budget, with every page already resident */
+    PagedGeometry resident;
+    FrameBuffer reference(128, 128);
+    renderPaged(scene, resident, path, SIZE_MAX, camera, reference);
+
+    Renderer renderer(&scene, camera);
+    renderer.setThreadCount(std::thread::hardware_concurrency());
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    renderer.render(reference);
+    double residentSeconds = secondsSince(start);
+    size_t totalBytes = resident.getResidentBytes();
+
+    printf("Out-of-core geometry, %d spheres in %u pages of %d, %.1f MB resident when fully loaded\n",
+           sphereCount, resident.getPageCount(), spheresPerPage, totalBytes / 1e6);
+    printf("  fully resident:  %8.3f s\n", residentSeconds);
+
+    const int budgetPercent[] = { 50, 10, 2 };
+
+    for (int b = 0; b < 3; b++) {
+        PagedGeometry streamed;
+        FrameBuffer framebuffer(128, 128);
+        size_t budget = totalBytes * budgetPercent[b] / 100;
+        double seconds = renderPaged(scene, streamed, path, budget, camera, framebuffer);
+        double lookups = (double) (streamed.getPageHits() + streamed.getPageFaults());
+
+        printf("  budget %3d%%:     %8.3f s  fault rate %.4f%%, %llu evictions, %.1f MB read at %.0f MB/s, image %s\n",
+               budgetPercent[b], seconds, lookups > 0 ? 100.0 * streamed.getPageFaults() / lookups : 0.0,
+               (unsigned long long) streamed.getEvictions(), streamed.getBytesRead() / 1e6,
+               streamed.getReadSeconds() > 0 ? streamed.getBytesRead() / 1e6 / streamed.getReadSeconds() : 0.0,
+               framebuffer.getHash() == reference.getHash() ? "identical" : "DIFFERENT");
+    }
+
+    bool truncatedRejected = truncate(path, GEOMETRY_PAGE_ALIGNMENT) == 0 && !PagedGeometry().open(path, SIZE_MAX);
+
+    printf("  truncated file rejected: %s\n", truncatedRejected ? "yes" : "NO");
+    remove(path);
+}
+
+void runTextureCacheBenchmark()
+{
+    const int size = 2048;
+    const size_t budget = 1 << 20;
+    const char* imagePath = "texture_benchmark.ppm";
+    std::string tiledPath = std::string(imagePath) + TEXTURE_FILE_EXTENSION;
+
+    /* Fine random detail everywhere, the worst case for a cache that samples the full-resolution level */
+    FILE* file = fopen(imagePath, "wb");
+
+    if (file == NULL) {
+        printf("  could not write %s\n", imagePath);
+        return;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", size, size);
+
+    for (int y = 0; y < size; y++) {
+        std::vector<unsigned char> row(size * 3);
+
+        for (int x = 0; x < size; x++) {
+            uint32_t bits = hashCounters(4, x, y, 0);
+            row[x * 3 + 0] = bits & 0xff;
+            row[x * 3 + 1] = (bits >> 8) & 0xff;
+            row[x * 3 + 2] = (((x / 64) + (y / 64)) % 2) ? 230 : 40;
+        }
+
+        fwrite(&row[0], 1, row.size(), file);
+    }
+
+    fclose(file);
+
+    TextureCache cache(budget);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int texture = cache.load(imagePath);
+    double convertSeconds = secondsSince(start);
+
+    if (texture < 0) {
+        printf("  could not convert %s\n", imagePath);
+        remove(imagePath);
+        return;
+    }
+
+    ImageTexture image(&cache, texture);
+    Scene scene;
+    scene.addLight( Light( Point(0.0, 4.0, 0.0), Color(1.0, 1.0, 1.0) ) );
+
+    InfinitePlane* floor = new InfinitePlane(Point(0.0, -1.0, 0.0), Ray(Point(0.0, -1.0, 0.0), Point(0.0, 0.0, 0.0)),
+                                             Color(0.2, 0.2, 0.2), Color(0.8, 0.8, 0.8), Color(0.0, 0.0, 0.0), 0.0);
+    floor->setTexture(&image);
+    scene.addInfinitePlane(floor);
+
+    /* Looking along the floor, so the texture shrinks to a few pixels per repeat towards the horizon */
+    Camera camera(Point(0.0, 0.0, -5.0), Point(0.0, -0.5, 10.0), Point(0.0, 1.0, 0.0), 60.0, 192, 192);
+
+    printf("Texture cache, %dx%d texture, %.1f MB budget, %dx%d render (converted in %.3f s)\n", size, size,
+           budget / 1048576.0, camera.getWidth(), camera.getHeight(), convertSeconds);
+
+    for (int mip = 1; mip >= 0; mip--) {
+        TextureCache* renderCache = &cache;
+        FrameBuffer framebuffer(camera.getWidth(), camera.getHeight());
+        Renderer renderer(&scene, camera);
+
+        renderCache->setMipMapping(mip == 1);
+        renderCache->resetStatistics();
+
+        start = std::chrono::steady_clock::now();
+        renderer.render(framebuffer);
+        double seconds = secondsSince(start);
+
+        printf("  %-17s %8.3f s  hit rate %6.2f%%, %8llu tiles read, %8llu evictions, %.2f MB resident\n",
+               mip ? "mip selection:" : "full resolution:", seconds, 100.0 * renderCache->getHitRate(),
+               (unsigned long long) renderCache->getMisses(), (unsigned long long) renderCache->getEvictions(),
+               renderCache->getResidentBytes() / 1048576.0);
+    }
+
+    /* A level of zero width would divide by zero in every lookup */
+    TextureLevelEntry damaged;
+    FILE* tiled = fopen(tiledPath.c_str(), "r+b");
+    bool damagedRejected = false;
+
+    if (tiled != NULL && fseek(tiled, sizeof(TextureFileHeader), SEEK_SET) == 0 &&
+        fread(&damaged, sizeof(damaged), 1, tiled) == 1) {
+        damaged.width = 0;
+        fseek(tiled, sizeof(TextureFileHeader), SEEK_SET);
+        damagedRejected = fwrite(&damaged, sizeof(damaged), 1, tiled) == 1 && fflush(tiled) == 0 &&
+                          TextureCache(budget).open(tiledPath.c_str()) < 0;
+    }
+
+    if (tiled != NULL) {
+        fclose(tiled);
+    }
+
+    printf("  zero-width level rejected: %s\n", damagedRejected ? "yes" : "NO");
+
+    delete floor;
+    remove(imagePath);
+    remove(tiledPath.c_str());
+}
+
+/* Sphere sets within the default camera's view. Distribution 0 is uniform, 1 gathers the spheres in
+    eight clusters and 2 packs nearly all of them into a small box inside a large, sparse volume */
+static void addBenchmarkSpheres(Scene& scene, int distribution, int count, float scale = 1.0)
+{
+    for (int i = 0; i < count; i++) {
+        RandomStream random(5, i, distribution);
+        float position[3], spread = 1.0, offset[3] = { 0.0, 0.0, 3.0 };
+
+        if (distribution == 1) {
+            RandomStream cluster(6, i % 8, 0);
+            spread = 0.15f;
+            offset[0] = 2.0f * cluster.get(0, 0) - 1.0f;
+            offset[1] = 2.0f * cluster.get(0, 1) - 1.0f;
+            offset[2] = 2.0f + 2.0f * cluster.get(0, 2);
+        } else if (distribution == 2) {
+            spread = (i % 20 == 0) ? 1.5f : 0.1f;
+        }
+
+        for (int k = 0; k < 3; k++) {
+            position[k] = offset[k] + scale * spread * (2.0f * random.get(0, k) - 1.0f);
+        }
+
+        scene.addSphere( new Sphere(Point(position[0], position[1], position[2]), 0.01f + 0.03f * random.get(0, 3),
+                                    Color(0.1, 0.0, 0.0), Color(0.7, 0.2, 0.1), Color(0.5, 0.5, 0.5), 0.0) );
+    }
+}
+
+void runAcceleratorBenchmark()
+{
+    const int sphereCount = 2000;
+    const char* distributions[] = { "uniform", "clustered", "teapot in a stadium" };
+    const AcceleratorType types[] = { ACCELERATOR_BRUTE_FORCE, ACCELERATOR_GRID };
+    int threadCount = std::max(1, (int) std::thread::hardware_concurrency());
+
+    Camera camera;
+    camera.setResolution(128, 128);
+
+    printf("Accelerators, %d spheres and a floor plane, %dx%d render, %d threads\n", sphereCount,
+           camera.getWidth(), camera.getHeight(), threadCount);
+
+    for (int d = 0; d < 3; d++) {
+        Scene scene;
+        scene.addLight( Light( Point(1.0, 3.0, -2.0), Color(1.0, 1.0, 1.0) ) );
+        scene.addInfinitePlane( new InfinitePlane(Point(0.0, -1.5, 0.0), Ray(Point(0.0, -1.5, 0.0), Point(0.0, 0.0, 0.0)),
+                                                  Color(0.1, 0.1, 0.1), Color(0.6, 0.6, 0.6), Color(0.0, 0.0, 0.0), 0.0) );
+        addBenchmarkSpheres(scene, d, sphereCount);
+
+        uint64_t hashes[2];
+        double renderSeconds[2];
+
+        printf("  %s\n", distributions[d]);
+
+        for (int t = 0; t < 2; t++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            scene.buildAccelerator(types[t], threadCount);
+            double buildSeconds = secondsSince(start);
+
+            FrameBuffer framebuffer(camera.getWidth(), camera.getHeight());
+            Renderer renderer(&scene, camera);
+            renderer.setThreadCount(threadCount);
+
+            start = std::chrono::steady_clock::now();
+            renderer.render(framebuffer);
+            renderSeconds[t] = secondsSince(start);
+            hashes[t] = framebuffer.getHash();
+
+            printf("    %-12s build %8.3f ms  %8.1f KB  render %7.3f s  %9.0f pixels/s\n", scene.getAccelerator()->getName(),
+                   buildSeconds * 1e3, scene.getAccelerator()->getMemoryBytes() / 1024.0, renderSeconds[t],
+                   camera.getWidth() * camera.getHeight() / renderSeconds[t]);
+        }
+
+        printf("    grid speedup %.1fx, images %s\n", renderSeconds[0] / renderSeconds[1],
+               (hashes[0] == hashes[1]) ? "identical" : "DIFFERENT");
+
+        std::vector<Surface*> surfaces = scene.getSurfaces();
+
+        for (int i = 0; i < surfaces.size(); i++) {
+            delete surfaces[i];
+        }
+    }
+
+    /* Grid construction is linear in the number of spheres at a fixed sphere density */
+    for (int count = 25000; count <= 400000; count *= 4) {
+        Scene scene;
+        addBenchmarkSpheres(scene, 0, count, cbrtf(count / 25000.0f));
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        scene.buildAccelerator(ACCELERATOR_GRID, threadCount);
+        double buildSeconds = secondsSince(start);
+
+        printf("  grid build, %6d spheres at constant density: %8.3f ms, %8.1f KB\n", count, buildSeconds * 1e3,
+               scene.getAccelerator()->getMemoryBytes() / 1024.0);
+
+        std::vector<Surface*> surfaces = scene.getSurfaces();
+
+        for (int i = 0; i < surfaces.size(); i++) {
+            delete surfaces[i];
+        }
+    }
+}
+
+/* Peak signal-to-noise ratio in dB between two images of the same size, over their 8-bit encodings */
+static double imagePSNR(const FrameBuffer& first, const FrameBuffer& second)
+{
+    std::vector<unsigned char> a, b;
+    first.encodePPM(a);
+    second.encodePPM(b);
+
+    double squaredError = 0.0;
+
+    for (int i = 0; i < a.size(); i++) {
+        double difference = (double) a[i] - (double) b[i];
+        squaredError += difference * difference;
+    }
+
+    return (squaredError == 0.0) ? INFINITY : 10.0 * log10(255.0 * 255.0 / (squaredError / a.size()));
+}
+
+/* Best of 'repeats' renders of 'scene' into 'framebuffer' */
+static double timeBenchmarkRender(const Scene& scene, const Camera& camera, FrameBuffer& framebuffer, int repeats)
+{
+    double best = INFINITY;
+
+    for (int i = 0; i < repeats; i++) {
+        Renderer renderer(&scene, camera);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        renderer.render(framebuffer);
+        best = std::min(best, secondsSince(start));
+    }
+
+    return best;
+}
+
+bool runFastMathBenchmark()
+{
+    const int count = 1 << 20;
+    std::vector<float> inputs(count), exponents(count);
+    float sink = 0.0;
+
+    for (int i = 0; i < count; i++) {
+        RandomStream random(7, i, 0);
+        inputs[i] = 1e-3f + random.get(0, 0);
+        exponents[i] = 1.0f + 127.0f * random.get(0, 1);
+    }
+
+    double rsqrtError = 0.0, powError = 0.0, powErrorPerExponent = 0.0;
+
+    for (int i = 0; i < count; i++) {
+        double exactRsqrt = 1.0 / sqrt((double) inputs[i]);
+        double exactPow = pow((double) inputs[i], (double) exponents[i]);
+
+        rsqrtError = std::max(rsqrtError, fabs(fastReciprocalSqrt(inputs[i]) - exactRsqrt) / exactRsqrt);
+
+        if (exactPow > 1e-30) {     /* Well above the flush-to-zero limit */
+            double error = fabs(fastPow(inputs[i], exponents[i]) - exactPow) / exactPow;
+            powError = std::max(powError, error);
+            powErrorPerExponent = std::max(powErrorPerExponent, error / exponents[i]);
+        }
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) sink += 1.0f / sqrtf(inputs[i]);
+    double exactRsqrtSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) sink += fastReciprocalSqrt(inputs[i]);
+    double fastRsqrtSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) sink += powf(inputs[i], exponents[i]);
+    double exactPowSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) sink += fastPow(inputs[i], exponents[i]);
+    double fastPowSeconds = secondsSince(start);
+
+    printf("Fast math, %d inputs\n", count);
+    printf("  reciprocal sqrt: %6.2f ns exact, %6.2f ns fast, max relative error %.2e\n", exactRsqrtSeconds * 1e9 / count,
+           fastRsqrtSeconds * 1e9 / count, rsqrtError);
+    printf("  pow, y in [1, 128]: %6.2f ns exact, %6.2f ns fast, max relative error %.2e (%.2e per unit of y)\n",
+           exactPowSeconds * 1e9 / count, fastPowSeconds * 1e9 / count, powError, powErrorPerExponent);
+
+    /* A sphere field with an exponent that has no specialized kernel, so every term goes through the
+        fast paths */
+    Scene scene;
+    scene.addLight( Light( Point(1.0, 3.0, -2.0), Color(1.0, 1.0, 1.0) ) );
+    scene.addInfinitePlane( new InfinitePlane(Point(0.0, -1.5, 0.0), Ray(Point(0.0, -1.5, 0.0), Point(0.0, 0.0, 0.0)),
+                                              Color(0.1, 0.1, 0.1), Color(0.6, 0.6, 0.6), Color(0.3, 0.3, 0.3), 0.3) );
+    addBenchmarkSpheres(scene, 0, 300);
+
+    std::vector<Surface*> surfaces = scene.getSurfaces();
+
+    for (int i = 0; i < surfaces.size(); i++) {
+        surfaces[i]->setSpecularExponent(7);
+    }
+
+    scene.buildAccelerator(ACCELERATOR_GRID, 1);
+
+    Camera camera;
+    camera.setResolution(256, 256);
+    FrameBuffer exact(256, 256), fast(256, 256);
+
+    setFastMath(false);
+    double exactSeconds = timeBenchmarkRender(scene, camera, exact, 3);
+    setFastMath(true);
+    double fastSeconds = timeBenchmarkRender(scene, camera, fast, 3);
+    setFastMath(false);
+
+    double psnr = imagePSNR(exact, fast);
+    bool pass = psnr >= FAST_MATH_MIN_PSNR;
+
+    printf("  render %dx%d: %.3f s exact, %.3f s fast, speedup %.2fx\n", camera.getWidth(), camera.getHeight(),
+           exactSeconds, fastSeconds, exactSeconds / fastSeconds);
+    printf("  %s: PSNR %.2f dB against the exact image (threshold %.1f dB)\n", pass ? "PASS" : "FAIL", psnr,
+           FAST_MATH_MIN_PSNR);
+
+    for (int i = 0; i < surfaces.size(); i++) {
+        delete surfaces[i];
+    }
+
+    return (sink != 0.0) && pass;
+}
+
+/* Mean of all color channels of 'framebuffer', to show whether a termination scheme darkens the image */
+static double meanIntensity(const FrameBuffer& framebuffer)
+{
+    std::vector<float> values;
+    double sum = 0.0;
+
+    framebuffer.toScanlines(values, false);
+
+    for (int i = 0; i < values.size(); i++) {
+        sum += values[i];
+    }
+
+    return sum / values.size();
+}
+
+void runRouletteBenchmark()
+{
+    const int samples = 16;
+    const char* names[] = { "exhaustive", "cutoff 0.05", "roulette 0.5" };
+    const float cutoffs[] = { 0.0f, 0.05f, 0.0f };
+    const float thresholds[] = { 0.0f, 0.0f, 0.5f };
+
+    /* A row of mirrors facing a second row, with reflectivities from 0.01 to 0.95, over a dim mirror floor */
+    Scene scene;
+    scene.addLight( Light( Point(1.0, 3.0, -1.0), Color(1.0, 1.0, 1.0) ) );
+    scene.addInfinitePlane( new InfinitePlane(Point(0.0, -1.0, 0.0), Ray(Point(0.0, -1.0, 0.0), Point(0.0, 0.0, 0.0)),
+                                              Color(0.1, 0.1, 0.1), Color(0.5, 0.5, 0.5), Color(0.2, 0.2, 0.2), 0.1) );
+
+    for (int i = 0; i < 36; i++) {
+        RandomStream random(11, i, 0);
+        float x = -1.25f + 0.5f * (i % 6), y = -0.7f + 0.3f * ((i / 6) % 3);
+        float z = (i < 18) ? 3.5f : 4.5f;
+        float reflectivity = 0.01f + 0.94f * random.get(0, 0);
+
+        scene.addSphere( new Sphere(Point(x, y, z), 0.2f, Color(0.05, 0.05, 0.1), Color(0.2f, 0.3f, 0.6f * random.get(0, 1)),
+                                    Color(0.6, 0.6, 0.6), reflectivity) );
+    }
+
+    scene.buildAccelerator(ACCELERATOR_AUTO, 1);
+
+    Camera camera;
+    camera.setResolution(128, 128);
+    FrameBuffer reference(128, 128), framebuffer(128, 128);
+    uint64_t exhaustiveRays = 0;
+    double exhaustiveSeconds = 0.0;
+
+    printf("Path termination, %dx%d, %d samples per pixel, up to %d reflections\n", camera.getWidth(), camera.getHeight(),
+           samples, DEPTH_LIMIT + 1);
+
+    for (int mode = 0; mode < 3; mode++) {
+        Renderer renderer(&scene, camera);
+        renderer.setSamplesPerPixel(samples);
+        renderer.setContributionCutoff(cutoffs[mode]);
+        renderer.setRouletteThreshold(thresholds[mode]);
+
+        FrameBuffer& output = (mode == 0) ? reference : framebuffer;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        renderer.render(output);
+        double seconds = secondsSince(start);
+
+        if (mode == 0) {
+            exhaustiveRays = renderer.getRayCount();
+            exhaustiveSeconds = seconds;
+            printf("  %-13s %8.3f s  %10llu rays  mean %.5f\n", names[mode], seconds,
+                   (unsigned long long) renderer.getRayCount(), meanIntensity(output));
+        } else {
+            printf("  %-13s %8.3f s  %10llu rays (%5.1f%% saved, %.2fx faster)  mean %.5f  PSNR %.2f dB\n", names[mode],
+                   seconds, (unsigned long long) renderer.getRayCount(),
+                   100.0 * (1.0 - (double) renderer.getRayCount() / exhaustiveRays), exhaustiveSeconds / seconds,
+                   meanIntensity(output), imagePSNR(reference, output));
+        }
+    }
+
+    std::vector<Surface*> surfaces = scene.getSurfaces();
+
+    for (int i = 0; i < surfaces.size(); i++) {
+        delete surfaces[i];
+    }
+}
+
+/* Edit 'number' of the stress test: moves one sphere to a new random position. The sphere is cloned
+    and replaced, since older versions still show the original. Returns the replaced sphere */
+static Surface* moveBenchmarkSphere(Scene& scene, uint64_t number)
+{
+    std::vector<Surface*> surfaces = scene.getSurfaces();
+    RandomStream random(13, (uint32_t) number, 0);
+    int index = 1 + (int) (hashCounters(13, (uint32_t) number, 0, 0) % (surfaces.size() - 1));   /* 0 is the floor */
+    Sphere* moved = (Sphere*) surfaces[index]->Clone();
+
+    moved->setCenter( Point(2.0f * random.get(0, 0) - 1.0f, 2.0f * random.get(0, 1) - 1.0f, 2.0f + 2.0f * random.get(0, 2)) );
+    scene.replaceSurface(index, moved);
+
+    return surfaces[index];
+}
+
+bool runSceneUpdateStress()
+{
+    const int renderThreads = 3, workersPerRender = 2, rendersPerThread = 16;
+
+    Scene base;
+    base.addLight( Light( Point(1.0, 3.0, -2.0), Color(1.0, 1.0, 1.0) ) );
+    base.addInfinitePlane( new InfinitePlane(Point(0.0, -1.5, 0.0), Ray(Point(0.0, -1.5, 0.0), Point(0.0, 0.0, 0.0)),
+                                             Color(0.1, 0.1, 0.1), Color(0.6, 0.6, 0.6), Color(0.3, 0.3, 0.3), 0.3) );
+    addBenchmarkSpheres(base, 0, 400);
+
+    std::vector<Surface*> originals = base.getSurfaces();
+
+    for (int i = 1; i < originals.size(); i++) {
+        ((Sphere*) originals[i])->setRadius(0.08f);
+    }
+
+    Scene replay(base);     /* Copied before any accelerator exists, so the replay always builds from scratch */
+    base.buildAccelerator(ACCELERATOR_GRID, 1);
+
+    Camera camera;
+    camera.setResolution(64, 64);
+
+    std::set<Surface*> original(originals.begin(), originals.end());
+    std::mutex hashesMutex;
+    std::multimap<uint64_t, uint64_t> hashes;   /* Version -> hash of an image rendered from it */
+    std::atomic<bool> rendering(true);
+    uint64_t edits = 0, retiredCount, reclaimedCount;
+    int pending;
+    std::vector<Surface*> live;
+
+    printf("Scene updates: %d render threads of %d workers each, one editor moving spheres\n", renderThreads,
+           workersPerRender);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    {
+        SceneStore store(base, ACCELERATOR_GRID, 1);
+
+        /* The editor retires the spheres it created itself; the originals belong to 'base' */
+        std::thread editor([&store, &original, &rendering, &edits]() {
+            while (rendering) {
+                store.edit([&store, &original](Scene& next, std::vector<Surface*>& retired) {
+                    Surface* replaced = moveBenchmarkSphere(next, store.getVersion() + 1);
+
+                    if (original.count(replaced) == 0) {
+                        retired.push_back(replaced);
+                    }
+                });
+                edits++;
+            }
+        });
+
+        std::vector<std::thread> renderers;
+
+        for (int t = 0; t < renderThreads; t++) {
+            renderers.push_back( std::thread([&store, &camera, &hashesMutex, &hashes]() {
+                FrameBuffer framebuffer(camera.getWidth(), camera.getHeight());
+
+                for (int r = 0; r < rendersPerThread; r++) {
+                    SceneSnapshot snapshot(store);
+                    Renderer renderer(snapshot.get(), camera);
+                    renderer.setThreadCount(workersPerRender);
+                    renderer.render(framebuffer);
+
+                    std::lock_guard<std::mutex> lock(hashesMutex);
+                    hashes.insert( std::make_pair(snapshot.getVersion(), framebuffer.getHash()) );
+                }
+            }) );
+        }
+
+        for (int t = 0; t < renderThreads; t++) {
+            renderers[t].join();
+        }
+
+        rendering = false;
+        editor.join();
+        store.reclaim();
+
+        retiredCount = store.getRetiredCount();
+        reclaimedCount = store.getReclaimedCount();
+        pending = store.getPendingCount();
+
+        SceneSnapshot last(store);
+        live = last.get()->getSurfaces();
+    }
+
+    printf("  %llu edits published and %d renders in %.2f s\n", (unsigned long long) edits,
+           renderThreads * rendersPerThread, secondsSince(start));
+    printf("  %llu versions retired, %llu reclaimed while running, %d still pinned at the end\n",
+           (unsigned long long) retiredCount, (unsigned long long) reclaimedCount, pending);
+
+    /* Replay the edits on one thread and render every version a render thread saw again, each with a
+        freshly built grid instead of the incrementally updated one */
+    FrameBuffer framebuffer(camera.getWidth(), camera.getHeight());
+    uint64_t replayVersion = 0;
+    int versions = 0, mismatches = 0;
+
+    for (std::multimap<uint64_t, uint64_t>::iterator entry = hashes.begin(); entry != hashes.end();
+         entry = hashes.upper_bound(entry->first)) {
+        while (replayVersion < entry->first) {
+            Surface* replaced = moveBenchmarkSphere(replay, ++replayVersion);
+
+            if (original.count(replaced) == 0) {
+                delete replaced;
+            }
+        }
+
+        Scene frozen(replay);
+        frozen.buildAccelerator(ACCELERATOR_GRID, 1);
+
+        Renderer renderer(&frozen, camera);
+        renderer.render(framebuffer);
+        versions++;
+
+        std::pair<std::multimap<uint64_t, uint64_t>::iterator, std::multimap<uint64_t, uint64_t>::iterator> seen =
+            hashes.equal_range(entry->first);
+
+        for (std::multimap<uint64_t, uint64_t>::iterator image = seen.first; image != seen.second; image++) {
+            mismatches += (image->second != framebuffer.getHash()) ? 1 : 0;
+        }
+    }
+
+    bool pass = (mismatches == 0) && (pending == 0) && (reclaimedCount == retiredCount);
+
+    printf("  %d distinct versions rendered, %d images differ from the replay\n", versions, mismatches);
+    printf("  %s\n", pass ? "PASS: every render saw a complete version and every retired version was reclaimed" :
+                             "FAIL");
+
+    /* Spheres the editor and the replay created that their final versions still hold, then the originals */
+    std::vector<Surface*> replayed = replay.getSurfaces();
+
+    for (int i = 0; i < live.size(); i++) {
+        if (original.count(live[i]) == 0) {
+            delete live[i];
+        }
+
+        if (original.count(replayed[i]) == 0) {
+            delete replayed[i];
+        }
+    }
+
+    for (int i = 0; i < originals.size(); i++) {
+        delete originals[i];
+    }
+
+    return pass;
+}
+
+void runTraversalBenchmark()
+{
+    const int sphereCount = 20000;
+    const char* distributions[] = { "uniform", "clustered" };
+    const TraversalOrder orders[] = { TRAVERSAL_SCANLINE, TRAVERSAL_MORTON, TRAVERSAL_HILBERT };
+    int threadCount = std::max(1, (int) std::thread::hardware_concurrency());
+
+    Camera camera;
+    camera.setResolution(512, 512);
+
+    PerfCounters counters;
+    bool counting = counters.open() > 0;
+
+    printf("Traversal orders, %d spheres and a floor plane in a grid, %dx%d render, %d threads\n", sphereCount,
+           camera.getWidth(), camera.getHeight(), threadCount);
+
+    if (!counting) {
+        printf("  hardware counters unavailable, timing only\n");
+    }
+
+    for (int d = 0; d < 2; d++) {
+        Scene scene;
+        scene.addLight( Light( Point(1.0, 3.0, -2.0), Color(1.0, 1.0, 1.0) ) );
+        scene.addInfinitePlane( new InfinitePlane(Point(0.0, -1.5, 0.0), Ray(Point(0.0, -1.5, 0.0), Point(0.0, 0.0, 0.0)),
+                                                  Color(0.1, 0.1, 0.1), Color(0.6, 0.6, 0.6), Color(0.3, 0.3, 0.3), 0.3) );
+        addBenchmarkSpheres(scene, d, sphereCount);
+        scene.buildAccelerator(ACCELERATOR_GRID, threadCount);
+
+        uint64_t hashes[3];
+        double renderSeconds[3];
+        int fastest = 0;
+
+        printf("  %s\n", distributions[d]);
+
+        for (int o = 0; o < 3; o++) {
+            FrameBuffer framebuffer(camera.getWidth(), camera.getHeight());
+            renderSeconds[o] = INFINITY;
+
+            /* Best of three, counting the last one; the first pass also warms the caches for the others */
+            for (int repeat = 0; repeat < 3; repeat++) {
+                Renderer renderer(&scene, camera);
+                renderer.setThreadCount(threadCount);
+                renderer.setTileOrder(orders[o]);
+                renderer.setPixelOrder(orders[o]);
+
+                counters.start();
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                renderer.render(framebuffer);
+                renderSeconds[o] = std::min(renderSeconds[o], secondsSince(start));
+                counters.stop();
+            }
+
+            hashes[o] = framebuffer.getHash();
+            fastest = (renderSeconds[o] < renderSeconds[fastest]) ? o : fastest;
+
+            printf("    %-9s render %7.3f s", getTraversalOrderName(orders[o]), renderSeconds[o]);
+
+            for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+                PerfEvent event = (PerfEvent) e;
+
+                if (counters.isAvailable(event)) {
+                    printf("  %s %.3e", PerfCounters::getName(event), (double) counters.getCount(event));
+                } else if (counting) {
+                    printf("  %s n/a", PerfCounters::getName(event));
+                }
+            }
+
+            if (counters.isAvailable(PERF_CACHE_MISSES) && counters.isAvailable(PERF_CACHE_REFERENCES) &&
+                counters.getCount(PERF_CACHE_REFERENCES) > 0) {
+                printf("  miss rate %.2f%%", 100.0 * counters.getCount(PERF_CACHE_MISSES) /
+                       counters.getCount(PERF_CACHE_REFERENCES));
+            }
+
+            printf("\n");
+        }
+
+        printf("    fastest %s, %.1f%% ahead of scanline, images %s\n", getTraversalOrderName(orders[fastest]),
+               100.0 * (renderSeconds[0] / renderSeconds[fastest] - 1.0),
+               (hashes[0] == hashes[1] && hashes[1] == hashes[2]) ? "identical" : "DIFFERENT");
+
+        std::vector<Surface*> surfaces = scene.getSurfaces();
+
+        for (int i = 0; i < surfaces.size(); i++) {
+            delete surfaces[i];
+        }
+    }
+}
+
+void runTracingBenchmark()
+{
+    Scene scene;
+    scene.addLight( Light( Point(1.0, 3.0, -2.0), Color(1.0, 1.0, 1.0) ) );
+    scene.addInfinitePlane( new InfinitePlane(Point(0.0, -1.5, 0.0), Ray(Point(0.0, -1.5, 0.0), Point(0.0, 0.0, 0.0)),
+                                              Color(0.1, 0.1, 0.1), Color(0.6, 0.6, 0.6), Color(0.3, 0.3, 0.3), 0.3) );
+    addBenchmarkSpheres(scene, 0, 2000);
+    scene.buildAccelerator(ACCELERATOR_GRID, 1);
+
+    Camera camera;
+    camera.setResolution(256, 256);
+    FrameBuffer framebuffer(256, 256);
+
+    double offSeconds = timeBenchmarkRender(scene, camera, framebuffer, 5);
+    uint64_t hash = framebuffer.getHash();
+
+    startTracing(false);
+    double onSeconds = timeBenchmarkRender(scene, camera, framebuffer, 1);
+    stopTracing();
+
+    printf("Tracing, 2000 spheres and a floor plane, %dx%d render, 1 thread\n", camera.getWidth(), camera.getHeight());
+    printf("  tracing off      %8.3f s\n", offSeconds);
+    printf("  tracing on       %8.3f s  (%+.1f%%), image %s\n", onSeconds, 100.0 * (onSeconds / offSeconds - 1.0),
+           (framebuffer.getHash() == hash) ? "identical" : "DIFFERENT");
+    printTraceSummary();
+
+    startTracing(true);
+    double countedSeconds = timeBenchmarkRender(scene, camera, framebuffer, 1);
+    stopTracing();
+
+    printf("  with counters    %8.3f s  (%+.1f%%)\n", countedSeconds, 100.0 * (countedSeconds / offSeconds - 1.0));
+    printTraceSummary();
+
+    std::vector<Surface*> surfaces = scene.getSurfaces();
+
+    for (int i = 0; i < surfaces.size(); i++) {
+        delete surfaces[i];
+    }
+}
+
+/* Renders 'scene' 'runs' times and returns the best render time, with the shadow rays per pixel in
+    'shadowRaysPerPixel'. The soft to hard ratios are within a few tenths only as the best of several */
+static double renderShadows(const Scene& scene, const Camera& camera, FrameBuffer& framebuffer, int probes,
+                            int maxSamples, int budget, double& shadowRaysPerPixel, int runs = 3)
+{
+    Renderer renderer(&scene, camera);
+    renderer.setShadowProbes(probes);
+    renderer.setMaxShadowSamples(maxSamples);
+    renderer.setShadowRayBudget(budget);
+
+    double seconds = INFINITY;
+
+    for (int r = 0; r < runs; r++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        renderer.render(framebuffer);
+        seconds = std::min(seconds, secondsSince(start));
+    }
+
+    shadowRaysPerPixel = (double) renderer.getShadowRayCount() / (camera.getWidth() * camera.getHeight());
+
+    return seconds;
+}
+
+void runSoftShadowBenchmark()
+{
+    const char* shapes[] = { "rectangle", "disk", "sphere" };
+    Point lightCenter(0.0, 2.0, 3.5);
+    Color white(1.0, 1.0, 1.0);
+    Light lights[] = { Light::rectangle(lightCenter, Point(1.2, 0.0, 0.0), Point(0.0, 0.0, 1.2), white),
+                       Light::disk(lightCenter, Point(0.0, -1.0, 0.0), 0.6, white),
+                       Light::sphere(lightCenter, 0.6, white) };
+
+    Camera camera;
+    camera.setResolution(256, 256);
+
+    printf("Soft shadows, spheres on a floor, %dx%d render, 1 sample per pixel, best of 3\n", camera.getWidth(), camera.getHeight());
+
+    for (int l = 0; l < 3; l++) {
+        Scene hardScene, softScene;
+        Scene* scenes[2] = { &hardScene, &softScene };
+
+        hardScene.addLight( Light(lightCenter, white) );
+        softScene.addLight(lights[l]);
+
+        for (int s = 0; s < 2; s++) {
+            scenes[s]->addInfinitePlane( new InfinitePlane(Point(0.0, -1.0, 0.0), Ray(Point(0.0, -1.0, 0.0), Point(0.0, 0.0, 0.0)),
+                                                           Color(0.1, 0.1, 0.1), Color(0.7, 0.7, 0.7), Color(0.0, 0.0, 0.0), 0.0) );
+
+            for (int i = 0; i < 5; i++) {
+                float x = -1.2f + 0.6f * i, radius = 0.15f + 0.05f * i;
+                scenes[s]->addSphere( new Sphere(Point(x, -1.0f + radius + 0.3f * (i % 2), 3.0f + 0.3f * (i % 3)), radius,
+                                                 Color(0.1, 0.0, 0.0), Color(0.7, 0.2, 0.1), Color(0.5, 0.5, 0.5), 0.0) );
+            }
+        }
+
+        FrameBuffer reference(256, 256), image(256, 256);
+        double raysPerPixel;
+
+        renderShadows(softScene, camera, reference, 256, 256, 256, raysPerPixel, 1);
+
+        double hardSeconds = renderShadows(hardScene, camera, image, 1, 1, 1, raysPerPixel);
+        printf("  %s light\n", shapes[l]);
+        printf("    %-22s %7.3f s  %6.2f shadow rays/pixel\n", "hard (point light)", hardSeconds, raysPerPixel);
+
+        const char* names[] = { "adaptive 4 + 12", "fixed 16", "fixed 64" };
+        const int probes[] = { SHADOW_PROBES, 16, 64 };
+        const int maxSamples[] = { SHADOW_MAX_SAMPLES, 16, 64 };
+
+        for (int c = 0; c < 3; c++) {
+            double seconds = renderShadows(softScene, camera, image, probes[c], maxSamples[c], SHADOW_RAY_BUDGET, raysPerPixel);
+
+            printf("    %-22s %7.3f s  %6.2f shadow rays/pixel  %5.1fx hard cost  PSNR %5.1f dB vs 256 samples\n", names[c],
+                   seconds, raysPerPixel, seconds / hardSeconds, imagePSNR(image, reference));
+        }
+
+        for (int s = 0; s < 2; s++) {
+            std::vector<Surface*> surfaces = scenes[s]->getSurfaces();
+
+            for (int i = 0; i < surfaces.size(); i++) {
+                delete surfaces[i];
+            }
+        }
+    }
+}
+
+void runDenoiseBenchmark()
+{
+    const int size = 128, referenceSamples = 256, maxSamples = 64;
+    int threadCount = std::max(1, (int) std::thread::hardware_concurrency());
+
+    /* Spheres on a checkered floor under a rectangle light, traced with a single shadow ray per sample
+        so the penumbrae only converge with samples per pixel */
+    Scene scene;
+    scene.addLight( Light::rectangle(Point(0.0, 1.5, 3.5), Point(3.0, 0.0, 0.0), Point(0.0, 0.0, 3.0), Color(1.0, 1.0, 1.0)) );
+
+    InfinitePlane* floor = new InfinitePlane(Point(0.0, -1.0, 0.0), Ray(Point(0.0, -1.0, 0.0), Point(0.0, 0.0, 0.0)),
+                                             Color(0.1, 0.1, 0.1), Color(0.7, 0.7, 0.7), Color(0.0, 0.0, 0.0), 0.0);
+    floor->setTexture( new CheckerTexture(Color(0.9, 0.9, 0.9), Color(0.5, 0.5, 0.5), 0.5) );
+    scene.addInfinitePlane(floor);
+
+    for (int i = 0; i < 5; i++) {
+        float x = -1.2f + 0.6f * i, radius = 0.15f + 0.05f * i;
+        scene.addSphere( new Sphere(Point(x, -1.0f + radius + 0.3f * (i % 2), 3.0f + 0.3f * (i % 3)), radius,
+                                    Color(0.1, 0.0, 0.0), Color(0.7, 0.2, 0.1), Color(0.5, 0.5, 0.5), 0.0) );
+    }
+
+    Camera camera;
+    camera.setResolution(size, size);
+
+    Renderer renderer(&scene, camera);
+    renderer.setThreadCount(threadCount);
+    renderer.setShadowProbes(1);
+    renderer.setMaxShadowSamples(1);
+    renderer.setShadowRayBudget(1 << 20);
+
+    FrameBuffer reference(size, size), image(size, size), denoised(size, size);
+    FeatureBuffer features(size, size);
+    Denoiser denoiser;
+    denoiser.setThreadCount(threadCount);
+
+    renderer.setSeed(99);
+    renderer.setSamplesPerPixel(referenceSamples);
+    renderer.render(reference);
+    renderer.setSeed(0);
+
+    printf("Denoising, soft shadows with one shadow ray per sample, %dx%d, %d threads, reference %d spp\n", size, size,
+           threadCount, referenceSamples);
+    printf("  %4s  %9s  %9s  %11s  %9s\n", "spp", "render s", "raw dB", "denoised dB", "filter s");
+
+    std::vector<double> rawPSNR, denoisedPSNR;
+
+    for (int samples = 1; samples <= maxSamples; samples *= 2) {
+        renderer.setSamplesPerPixel(samples);
+        renderer.setFeatureBuffer(&features);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        renderer.render(image);
+        double renderSeconds = secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        denoiser.denoise(image, features, denoised);
+        double filterSeconds = secondsSince(start);
+
+        rawPSNR.push_back(imagePSNR(image, reference));
+        denoisedPSNR.push_back(imagePSNR(denoised, reference));
+
+        printf("  %4d  %9.3f  %9.2f  %11.2f  %9.4f\n", samples, renderSeconds, rawPSNR.back(), denoisedPSNR.back(),
+               filterSeconds);
+    }
+
+    /* Fewest raw samples that reach the PSNR of each denoised level */
+    for (int d = 0; d < denoisedPSNR.size(); d++) {
+        int match = -1;
+
+        for (int r = 0; r < rawPSNR.size() && match < 0; r++) {
+            match = (rawPSNR[r] >= denoisedPSNR[d]) ? r : -1;
+        }
+
+        if (match < 0) {
+            printf("  denoised %2d spp beats every raw level up to %d spp\n", 1 << d, maxSamples);
+        } else {
+            printf("  denoised %2d spp matches raw %2d spp: %gx fewer samples\n", 1 << d, 1 << match,
+                   (double) (1 << match) / (1 << d));
+        }
+    }
+
+    std::vector<Surface*> surfaces = scene.getSurfaces();
+
+    for (int i = 0; i < surfaces.size(); i++) {
+        delete surfaces[i]->getTexture();
+        delete surfaces[i];
+    }
+}
+
+void runCompactFormatBenchmark()
+{
+    const PixelFormat formats[] = { PIXEL_RGB_FLOAT, PIXEL_RGBA_FLOAT, PIXEL_RGBA_HALF, PIXEL_RGB9E5 };
+    int threadCount = std::max(1, (int) std::thread::hardware_concurrency());
+
+    Scene scene;
+    scene.addLight( Light( Point(1.0, 3.0, -2.0), Color(1.0, 1.0, 1.0) ) );
+    scene.addInfinitePlane( new InfinitePlane(Point(0.0, -1.5, 0.0), Ray(Point(0.0, -1.5, 0.0), Point(0.0, 0.0, 0.0)),
+                                              Color(0.1, 0.1, 0.1), Color(0.6, 0.6, 0.6), Color(0.3, 0.3, 0.3), 0.3) );
+    addBenchmarkSpheres(scene, 0, 20000);
+    scene.buildAccelerator(ACCELERATOR_GRID, threadCount);
+
+    Camera camera;
+    camera.setResolution(768, 768);
+
+    printf("Framebuffer formats, 20000 spheres, %dx%d render, %d threads\n", camera.getWidth(), camera.getHeight(),
+           threadCount);
+    printf("  %-7s %8s %8s %9s %10s %11s %9s %9s\n", "format", "B/pixel", "MB", "render s", "Mrays/s", "decode ms",
+           "max diff", "PSNR dB");
+
+    FrameBuffer full;
+    std::vector<float> scanlines;
+
+    for (int f = 0; f < 4; f++) {
+        FrameBuffer framebuffer(camera.getWidth(), camera.getHeight(), formats[f]);
+        Renderer renderer(&scene, camera);
+        renderer.setThreadCount(threadCount);
+        double renderSeconds = INFINITY;
+
+        for (int repeat = 0; repeat < 2; repeat++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            renderer.render(framebuffer);
+            renderSeconds = std::min(renderSeconds, secondsSince(start));
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for (int repeat = 0; repeat < 10; repeat++) {
+            framebuffer.toScanlines(scanlines, false);
+        }
+
+        double decodeSeconds = secondsSince(start) / 10;
+
+        if (f == 0) {
+            full = framebuffer;
+        }
+
+        /* Largest difference of the 8-bit output from the float image */
+        std::vector<unsigned char> a, b;
+        framebuffer.encodePPM(a);
+        full.encodePPM(b);
+        int maxDifference = 0;
+
+        for (int i = 0; i < a.size(); i++) {
+            maxDifference = std::max(maxDifference, abs((int) a[i] - (int) b[i]));
+        }
+
+        printf("  %-7s %8d %8.2f %9.3f %10.2f %11.3f %9d %9.2f\n", getPixelFormatName(formats[f]),
+               framebuffer.getPixelBytes(), framebuffer.getMemoryBytes() / 1e6, renderSeconds,
+               renderer.getRayCount() / renderSeconds / 1e6, decodeSeconds * 1e3, maxDifference, imagePSNR(framebuffer, full));
+    }
+
+    /* A sphere field streamed from disk where every sphere has a material of its own, so the material
+        table that stays resident is as long as the sphere list */
+    const int sphereCount = 40000;
+    const char* path = "compact_format_benchmark.rtpg";
+    std::vector<PackedSphere> spheres(sphereCount);
+    std::vector<PackedMaterial> materials(sphereCount);
+
+    memset(&spheres[0], 0, spheres.size() * sizeof(PackedSphere));
+    memset(&materials[0], 0, materials.size() * sizeof(PackedMaterial));
+
+    for (int i = 0; i < sphereCount; i++) {
+        RandomStream random(3, i, 0);
+        spheres[i].center[0] = 20.0f * random.get(0, 0) - 10.0f;
+        spheres[i].center[1] = 20.0f * random.get(0, 1) - 10.0f;
+        spheres[i].center[2] = 5.0f + 40.0f * random.get(0, 2);
+        spheres[i].radius = 0.02f + 0.06f * random.get(0, 3);
+        spheres[i].material = i;
+
+        for (int c = 0; c < 3; c++) {
+            materials[i].ambient[c] = 0.1f * random.get(1, c);
+            materials[i].diffuse[c] = 0.8f * random.get(2, c);
+            materials[i].specular[c] = 0.5f;
+        }
+
+        materials[i].reflectivity = 0.3f * random.get(3, 0);
+        materials[i].specularExponent = DEFAULT_SPECULAR_EXPONENT;
+    }
+
+    if (!PagedGeometry::write(path, spheres, materials, 128)) {
+        printf("  could not write %s\n", path);
+        return;
+    }
+
+    Scene pagedScene;
+    pagedScene.addLight( Light( Point(1.0, 3.0, 2.0), Color(1.0, 1.0, 1.0) ) );
+
+    Camera pagedCamera;
+    pagedCamera.setResolution(64, 64);
+    pagedCamera.setFieldOfView(60.0);
+
+    printf("Paged geometry, %d spheres with a material each, %dx%d render, half the pages resident\n", sphereCount,
+           pagedCamera.getWidth(), pagedCamera.getHeight());
+    printf("  %-9s %12s %13s %9s %10s %9s\n", "materials", "table MB", "peak res. MB", "render s", "Mrays/s", "PSNR dB");
+
+    /* Half of what the field takes once every page is loaded */
+    PagedGeometry loaded;
+    FrameBuffer fullPaged(pagedCamera.getWidth(), pagedCamera.getHeight());
+    renderPaged(pagedScene, loaded, path, SIZE_MAX, pagedCamera, fullPaged);
+    size_t budget = loaded.getResidentBytes() / 2;
+    loaded.close();
+
+    for (int quantized = 0; quantized < 2; quantized++) {
+        PagedGeometry geometry;
+        FrameBuffer framebuffer(pagedCamera.getWidth(), pagedCamera.getHeight());
+
+        if (!geometry.open(path, budget, quantized == 1)) {
+            printf("  could not open %s\n", path);
+            break;
+        }
+
+        pagedScene.setPagedGeometry(&geometry);
+
+        Renderer renderer(&pagedScene, pagedCamera);
+        renderer.setThreadCount(threadCount);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        renderer.render(framebuffer);
+        double seconds = secondsSince(start);
+
+        printf("  %-9s %12.2f %13.2f %9.3f %10.3f %9.2f\n", quantized ? "compact" : "full", geometry.getMaterialBytes() / 1e6,
+               (geometry.getMaterialBytes() + budget) / 1e6, seconds, renderer.getRayCount() / seconds / 1e6,
+               imagePSNR(framebuffer, fullPaged));
+
+        pagedScene.setPagedGeometry(NULL);
+    }
+
+    remove(path);
+}
+
+
+/* Library Check */
+
+/* A floor and a grid of spheres in two materials, shifted and lit differently per variant */
+static rt_scene* buildLibraryScene(int variant, int gridSize)
+{
+    const float ambient[3] = { 0.1f, 0.1f, 0.1f };
+    const rt_material materials[2] = {
+        { { 0.1f, 0.1f, 0.1f }, { 0.6f, 0.6f, 0.6f }, { 0.3f, 0.3f, 0.3f }, 0.3f, 16 },
+        { { 0.1f, 0.0f, 0.0f }, { 0.7f, 0.2f, 0.1f }, { 0.5f, 0.5f, 0.5f }, 0.0f, 64 }
+    };
+    const rt_plane floor = { { 0.0f, -1.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, 0 };
+
+    std::vector<rt_sphere> spheres;
+
+    for (int z = 0; z < gridSize; z++) {
+        for (int x = 0; x < gridSize; x++) {
+            rt_sphere sphere = { { (x - gridSize / 2) * 0.5f + variant * 0.25f, -0.8f, 3.0f + z * 0.5f },
+                                 0.2f, (uint32_t) ((x + z + variant) % 2) };
+            spheres.push_back(sphere);
+        }
+    }
+
+    rt_light light = { { 1.0f, 3.0f, 0.0f }, { 1.0f, 1.0f, 1.0f }, RT_LIGHT_POINT,
+                       { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, 0.0f };
+    if (variant == 1) {
+        light.shape = RT_LIGHT_RECTANGLE;
+        light.u_axis[0] = 1.0f;
+        light.v_axis[2] = 1.0f;
+    }
+
+    rt_scene* scene = rt_scene_create(ambient);
+    rt_scene_add_planes(scene, &floor, 1, materials, 2);
+    rt_scene_add_spheres(scene, &spheres[0], (uint32_t) spheres.size(), materials, 2);
+    rt_scene_add_lights(scene, &light, 1);
+    return scene;
+}
+
+static rt_camera libraryCamera(int width, int height)
+{
+    rt_camera camera = { { 0.0f, 0.5f, -1.0f }, { 0.0f, -0.5f, 4.0f }, { 0.0f, 1.0f, 0.0f }, 60.0f, width, height };
+    return camera;
+}
+
+/* The bytes of 'width' pixels of every row of both images match */
+static bool sameRows(const std::vector<unsigned char>& first, const std::vector<unsigned char>& second,
+                     int height, size_t rowBytes, size_t pixelRowBytes)
+{
+    for (int y = 0; y < height; y++) {
+        if (memcmp(&first[y * rowBytes], &second[y * rowBytes], pixelRowBytes) != 0)
+            return false;
+    }
+    return true;
+}
+
+void runEnvironmentBenchmark()
+{
+    const float sunDirection[3] = { -0.4f, 0.7f, -0.6f };
+    const Color sunRadiance(600.0, 560.0, 500.0);
+    const int sampleCounts[] = { 4, 16, 64 };
+    const int referenceSamples = 512;
+    int threadCount = std::max(1, (int) std::thread::hardware_concurrency());
+
+    printf("Environment map lighting, sky with a sun 0.04 rad across\n");
+
+    for (int width = 1024; width <= 4096; width *= 2) {
+        EnvironmentMap map;
+        double seconds[2] = { INFINITY, INFINITY };
+        map.makeSky(width, sunDirection, 0.04f, sunRadiance);
+
+        for (int t = 0; t < 2; t++) {
+            for (int r = 0; r < 3; r++) {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                map.build((t == 0) ? 1 : threadCount);
+                seconds[t] = std::min(seconds[t], secondsSince(start));
+            }
+        }
+
+        printf("  build %4dx%-4d %8.2f ms on 1 thread, %8.2f ms on %d, tables %6.1f MB for a %6.1f MB image\n",
+               map.getWidth(), map.getHeight(), seconds[0] * 1e3, seconds[1] * 1e3, threadCount,
+               map.getTableBytes() / 1048576.0, (double) map.getWidth() * map.getHeight() * 3 * sizeof(float) / 1048576.0);
+    }
+
+    EnvironmentMap sky;
+    sky.makeSky(1024, sunDirection, 0.04f, sunRadiance);
+    sky.build(threadCount);
+
+    Scene scene;
+    scene.setEnvironment(&sky);
+    scene.addInfinitePlane( new InfinitePlane(Point(0.0, -1.0, 0.0), Ray(Point(0.0, -1.0, 0.0), Point(0.0, 0.0, 0.0)),
+                                              Color(0.1, 0.1, 0.1), Color(0.7, 0.7, 0.7), Color(0.0, 0.0, 0.0), 0.0) );
+
+    for (int i = 0; i < 5; i++) {
+        float x = -1.2f + 0.6f * i, radius = 0.15f + 0.05f * i;
+        scene.addSphere( new Sphere(Point(x, -1.0f + radius + 0.3f * (i % 2), 3.0f + 0.3f * (i % 3)), radius,
+                                    Color(0.1, 0.0, 0.0), Color(0.7, 0.2, 0.1), Color(0.5, 0.5, 0.5), 0.0) );
+    }
+
+    scene.buildAccelerator(ACCELERATOR_AUTO, threadCount);
+
+    Camera camera;
+    camera.setResolution(160, 160);
+    FrameBuffer reference(camera.getWidth(), camera.getHeight());
+
+    Renderer referenceRenderer(&scene, camera);
+    referenceRenderer.setThreadCount(threadCount);
+    referenceRenderer.setEnvironmentSamples(referenceSamples);
+    referenceRenderer.setSeed(1);   /* Independent of the samples it judges */
+    referenceRenderer.render(reference);
+
+    printf("  render %dx%d, map light only, against %d importance samples per pixel:\n", camera.getWidth(),
+           camera.getHeight(), referenceSamples);
+    printf("  %8s %10s %10s %12s %12s\n", "samples", "uniform s", "uniform dB", "importance s", "importance dB");
+
+    for (int c = 0; c < 3; c++) {
+        double seconds[2], psnr[2];
+
+        for (int importance = 0; importance < 2; importance++) {
+            FrameBuffer framebuffer(camera.getWidth(), camera.getHeight());
+            Renderer renderer(&scene, camera);
+            renderer.setThreadCount(threadCount);
+            renderer.setEnvironmentSamples(sampleCounts[c]);
+            sky.setImportanceSampling(importance == 1);
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            renderer.render(framebuffer);
+            seconds[importance] = secondsSince(start);
+            psnr[importance] = imagePSNR(reference, framebuffer);
+        }
+
+        printf("  %8d %10.3f %10.2f %12.3f %12.2f\n", sampleCounts[c], seconds[0], psnr[0], seconds[1], psnr[1]);
+    }
+
+    sky.setImportanceSampling(true);
+
+    std::vector<Surface*> surfaces = scene.getSurfaces();
+
+    for (int i = 0; i < surfaces.size(); i++) {
+        delete surfaces[i];
+    }
+}
+
+/* The expanded quadratic Sphere::intersect() used before Precision.h, tangent tolerance included */
+static bool solveSphereTextbook(const float origin[3], const float direction[3], const float center[3], float radius,
+                                float& nearRoot, float& farRoot)
+{
+    float a = (direction[0] * direction[0]) + (direction[1] * direction[1]) + (direction[2] * direction[2]);
+    float b = 2.0f * ((direction[0] * (origin[0] - center[0])) + (direction[1] * (origin[1] - center[1])) +
+                      (direction[2] * (origin[2] - center[2])));
+    float c = (center[0] * center[0]) + (center[1] * center[1]) + (center[2] * center[2]) + (origin[0] * origin[0]) +
+              (origin[1] * origin[1]) + (origin[2] * origin[2]) -
+              (2 * (center[0] * origin[0] + center[1] * origin[1] + center[2] * origin[2])) - (radius * radius);
+    float determinant = (b * b) - (4 * a * c);
+
+    if (determinant < 0 && fabsf(determinant) > 0.0001f) {
+        return false;
+    }
+
+    float root = sqrtf(fabsf(determinant));
+    nearRoot = (-b - root) / (2 * a);
+    farRoot = (-b + root) / (2 * a);
+
+    return true;
+}
+
+struct PrecisionTest {
+    float origin[3], direction[3], center[3], radius;
+};
+
+/* Rays from 'distance' radii away at offsets from the center of up to 1.5 radii, half of them within 1e-4
+    radii of tangent, or from just above the surface when 'distance' is 0; everything shifted by 'shift' */
+static void makePrecisionTests(int count, float shift, float radius, float distance, std::vector<PrecisionTest>& tests)
+{
+    tests.resize(count);
+
+    for (int i = 0; i < count; i++) {
+        RandomStream random(8, i, 0);
+        PrecisionTest& test = tests[i];
+        float axis[3], side[3], up[3], target[3];
+        float z = 2.0f * random.get(0, 0) - 1.0f, phi = 2.0f * (float) M_PI * random.get(0, 1);
+        float ring = sqrtf(1.0f - z * z);
+
+        axis[0] = ring * cosf(phi);
+        axis[1] = ring * sinf(phi);
+        axis[2] = z;
+
+        /* Two directions perpendicular to the axis */
+        float seed[3] = { 0.0f, 0.0f, 0.0f };
+        seed[(fabsf(axis[0]) < 0.9f) ? 0 : 1] = 1.0f;
+        side[0] = seed[1] * axis[2] - seed[2] * axis[1];
+        side[1] = seed[2] * axis[0] - seed[0] * axis[2];
+        side[2] = seed[0] * axis[1] - seed[1] * axis[0];
+        float length = sqrtf( (side[0] * side[0]) + (side[1] * side[1]) + (side[2] * side[2]) );
+        up[0] = axis[1] * side[2] - axis[2] * side[1];
+        up[1] = axis[2] * side[0] - axis[0] * side[2];
+        up[2] = axis[0] * side[1] - axis[1] * side[0];
+
+        float miss = (i % 2 == 0) ? 1.5f * random.get(0, 2) : 1.0f + 2e-4f * (random.get(0, 2) - 0.5f);
+        float angle = 2.0f * (float) M_PI * random.get(0, 3);
+        float start = (distance > 0) ? distance : 1.0f + 1e-5f;
+
+        for (int k = 0; k < 3; k++) {
+            test.center[k] = shift + 0.1f * k;
+            test.origin[k] = test.center[k] + start * radius * axis[k];
+            target[k] = test.center[k] + miss * radius * (cosf(angle) * side[k] / length + sinf(angle) * up[k] / length);
+        }
+
+        if (distance <= 0) {    /* From the surface, aimed across the sphere */
+            for (int k = 0; k < 3; k++) {
+                target[k] = test.center[k] + (target[k] - test.center[k]) - radius * axis[k];
+            }
+        }
+
+        float direction[3] = { target[0] - test.origin[0], target[1] - test.origin[1], target[2] - test.origin[2] };
+        float norm = sqrtf( (direction[0] * direction[0]) + (direction[1] * direction[1]) + (direction[2] * direction[2]) );
+
+        for (int k = 0; k < 3; k++) {
+            test.direction[k] = direction[k] / norm;
+        }
+
+        test.radius = radius;
+    }
+}
+
+bool runPrecisionBenchmark()
+{
+    const char* names[] = { "unit scale", "coordinates 1e4", "radius 1e-4", "from the surface" };
+    const float shifts[] = { 0.0f, 1e4f, 0.0f, 0.0f };
+    const float radii[] = { 0.5f, 0.5f, 1e-4f, 0.5f };
+    const float distances[] = { 10.0f, 10.0f, 1e4f, 0.0f };
+    const char* modes[] = { "textbook", "float", "mixed", "double" };
+    const int count = 1 << 18;
+    float sink = 0.0f;
+    bool pass = true;
+
+    printf("Sphere intersection precision, %d rays per case, half of them within 1e-4 radii of tangent\n", count);
+    printf("  %-18s %-9s %12s %14s %10s %9s\n", "case", "kernel", "wrong hits", "root error", "fallbacks", "ns/test");
+
+    for (int t = 0; t < 4; t++) {
+        std::vector<PrecisionTest> tests;
+        makePrecisionTests(count, shifts[t], radii[t], distances[t], tests);
+
+        std::vector<char> exactHits(count);
+        std::vector<float> exactRoots(count);
+
+        for (int i = 0; i < count; i++) {
+            float farRoot;
+            exactRoots[i] = 0.0f;
+            exactHits[i] = solveSphereDouble(tests[i].origin, tests[i].direction, tests[i].center, tests[i].radius,
+                                             exactRoots[i], farRoot);
+        }
+
+        for (int m = 0; m < 4; m++) {
+            std::vector<char> hits(count);
+            std::vector<float> roots(count);
+            int wrong = 0;
+            double rootError = 0.0;
+
+            setIntersectionPrecision((m == 3) ? PRECISION_DOUBLE : (m == 2) ? PRECISION_MIXED : PRECISION_FLOAT);
+            setPrecisionCounting(true);
+            resetPrecisionCounts();
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            for (int i = 0; i < count; i++) {
+                float farRoot;
+                roots[i] = 0.0f;
+                hits[i] = (m == 0) ? solveSphereTextbook(tests[i].origin, tests[i].direction, tests[i].center,
+                                                         tests[i].radius, roots[i], farRoot)
+                                   : solveSphere(tests[i].origin, tests[i].direction, tests[i].center, tests[i].radius,
+                                                 roots[i], farRoot);
+            }
+
+            double seconds = secondsSince(start);
+            PrecisionCounts counts = getPrecisionCounts();
+            setPrecisionCounting(false);
+
+            for (int i = 0; i < count; i++) {
+                if (hits[i] != exactHits[i]) {
+                    wrong++;
+                } else if (hits[i]) {
+                    rootError = std::max(rootError, fabs((double) roots[i] - exactRoots[i]) / tests[i].radius);
+                }
+
+                sink += roots[i];
+            }
+
+            if (m == 2 && wrong > 0) {
+                pass = false;
+            }
+
+            printf("  %-18s %-9s %11.3f%% %8.1e radii %9.3f%% %9.2f\n", (m == 0) ? names[t] : "", modes[m],
+                   100.0 * wrong / count, rootError, (m == 0) ? 0.0 : 100.0 * counts.fallbacks / counts.tests,
+                   seconds * 1e9 / count);
+        }
+    }
+
+    Scene scene;
+    scene.addLight( Light( Point(1.0, 3.0, -2.0), Color(1.0, 1.0, 1.0) ) );
+    scene.addInfinitePlane( new InfinitePlane(Point(0.0, -1.5, 0.0), Ray(Point(0.0, -1.5, 0.0), Point(0.0, 0.0, 0.0)),
+                                              Color(0.1, 0.1, 0.1), Color(0.6, 0.6, 0.6), Color(0.3, 0.3, 0.3), 0.3) );
+    addBenchmarkSpheres(scene, 0, 2000);
+    scene.buildAccelerator(ACCELERATOR_GRID, 1);
+
+    Camera camera;
+    camera.setResolution(256, 256);
+    FrameBuffer images[3] = { FrameBuffer(256, 256), FrameBuffer(256, 256), FrameBuffer(256, 256) };
+    const IntersectionPrecision precisions[] = { PRECISION_FLOAT, PRECISION_MIXED, PRECISION_DOUBLE };
+
+    printf("  render %dx%d, 2000 spheres, 1 thread, best of 3 without and with counting the tests:\n",
+           camera.getWidth(), camera.getHeight());
+
+    for (int p = 2; p >= 0; p--) {
+        double best[2] = { INFINITY, INFINITY };
+        PrecisionCounts counts;
+
+        setIntersectionPrecision(precisions[p]);
+
+        /* Interleaved, so that drift in the machine's speed hits both the same */
+        for (int r = 0; r < 6; r++) {
+            Renderer renderer(&scene, camera);
+            renderer.setThreadCount(1);
+            setPrecisionCounting(r % 2 == 1);
+            resetPrecisionCounts();
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            renderer.render(images[p]);
+            best[r % 2] = std::min(best[r % 2], secondsSince(start));
+            counts = getPrecisionCounts();
+        }
+
+        setPrecisionCounting(false);
+
+        printf("    %-7s %.3f s (%.3f s counting), %llu sphere tests, %.4f%% in double",
+               getIntersectionPrecisionName(precisions[p]), best[0], best[1], (unsigned long long) counts.tests,
+               (p == 0) ? 0.0 : (p == 2) ? 100.0 : 100.0 * counts.fallbacks / std::max((uint64_t) 1, counts.tests));
+
+        if (p < 2) {
+            printf(", PSNR %.2f dB against double\n", imagePSNR(images[2], images[p]));
+        } else {
+            printf("\n");
+        }
+    }
+
+    setIntersectionPrecision(PRECISION_MIXED);
+
+    std::vector<Surface*> surfaces = scene.getSurfaces();
+
+    for (int i = 0; i < surfaces.size(); i++) {
+        delete surfaces[i];
+    }
+
+    printf("  (checksum %g)\n", sink);
+    printf("  %s: mixed precision decides every test as double does\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+bool runLibraryCheck()
+{
+    const unsigned char padding = 0xA5;
+    const int widths[2] = { 96, 80 }, heights[2] = { 72, 80 };
+    const int formats[2] = { RT_PIXEL_RGBA8, RT_PIXEL_RGB_FLOAT };
+    const size_t pixelBytes[2] = { 4, 3 * sizeof(float) };
+    const rt_render_settings settings = { 2, 2, 7 };
+    bool pass = true;
+
+    rt_scene* scenes[2] = { buildLibraryScene(0, 12), buildLibraryScene(1, 16) };
+    size_t rowBytes[2];
+    std::vector<unsigned char> concurrent[2], alone[2];
+
+    printf("Library: two scenes built through the C interface, rendered at once into caller memory\n");
+
+    /* RGBA8 rows packed back to back, float rows padded to catch writes past the row */
+    for (int i = 0; i < 2; i++) {
+        rowBytes[i] = widths[i] * pixelBytes[i] + (i == 1 ? 40 : 0);
+        concurrent[i].assign(rowBytes[i] * heights[i], padding);
+        alone[i].assign(rowBytes[i] * heights[i], padding);
+    }
+
+    rt_camera cameras[2] = { libraryCamera(widths[0], heights[0]), libraryCamera(widths[1], heights[1]) };
+    rt_render* renders[2];
+    float lastProgress[2] = { 0.0f, 0.0f };
+    int polls = 0;
+    bool monotonic = true;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < 2; i++) {
+        renders[i] = rt_render_start(scenes[i], &cameras[i], &settings, &concurrent[i][0], rowBytes[i], formats[i]);
+    }
+
+    while (!rt_render_is_done(renders[0]) || !rt_render_is_done(renders[1])) {
+        for (int i = 0; i < 2; i++) {
+            float progress = rt_render_progress(renders[i]);
+            monotonic = monotonic && (progress >= lastProgress[i]);
+            lastProgress[i] = progress;
+        }
+        polls++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    bool finished = rt_render_wait(renders[0]) && rt_render_wait(renders[1]);
+    bool complete = rt_render_progress(renders[0]) == 1.0f && rt_render_progress(renders[1]) == 1.0f;
+    double together = secondsSince(start);
+
+    for (int i = 0; i < 2; i++) {
+        rt_render_destroy(renders[i]);
+    }
+
+    start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < 2; i++) {
+        rt_render* render = rt_render_start(scenes[i], &cameras[i], &settings, &alone[i][0], rowBytes[i], formats[i]);
+        rt_render_wait(render);
+        rt_render_destroy(render);
+    }
+
+    double oneByOne = secondsSince(start);
+
+    printf("  %.3f s together, %.3f s one after the other, %d progress polls\n", together, oneByOne, polls);
+
+    for (int i = 0; i < 2; i++) {
+        bool same = sameRows(concurrent[i], alone[i], heights[i], rowBytes[i], widths[i] * pixelBytes[i]);
+        bool untouched = true;
+
+        for (int y = 0; y < heights[i]; y++) {
+            for (size_t b = widths[i] * pixelBytes[i]; b < rowBytes[i]; b++) {
+                untouched = untouched && (concurrent[i][y * rowBytes[i] + b] == padding);
+            }
+        }
+
+        printf("  %-6s %dx%d, rows of %zu bytes: %s as rendered alone, row padding %s\n",
+               formats[i] == RT_PIXEL_RGBA8 ? "rgba8" : "float", widths[i], heights[i], rowBytes[i],
+               same ? "same" : "DIFFERENT", untouched ? "untouched" : "OVERWRITTEN");
+        pass = pass && same && untouched;
+    }
+
+    printf("  progress %s, ends at 1 %s, both renders %s\n", monotonic ? "only rises" : "WENT BACK",
+           complete ? "yes" : "NO", finished ? "report finished" : "REPORT CANCELLED");
+    pass = pass && monotonic && complete && finished;
+
+    /* A render too long to finish before the cancel reaches it */
+    rt_camera large = libraryCamera(512, 512);
+    rt_render_settings slow = { 1, 64, 0 };
+    std::vector<unsigned char> pixels(512 * 512 * 4);
+    rt_render* cancelled = rt_render_start(scenes[1], &large, &slow, &pixels[0], 512 * 4, RT_PIXEL_RGBA8);
+
+    rt_render_cancel(cancelled);
+    bool stopped = (rt_render_wait(cancelled) == 0) && (rt_render_progress(cancelled) < 1.0f);
+    rt_render_destroy(cancelled);
+
+    /* Rejected input leaves no render or surface behind */
+    const rt_material material = { { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 0.0f }, 0.0f, 1 };
+    const rt_sphere stray = { { 0.0f, 0.0f, 0.0f }, 1.0f, 1 };
+    const rt_light unknown = { { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f }, 9,
+                               { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, 0.0f };
+    bool rejected = !rt_scene_add_spheres(scenes[0], &stray, 1, &material, 1) &&
+                    !rt_scene_add_lights(scenes[0], &unknown, 1) &&
+                    rt_render_start(scenes[0], &cameras[0], NULL, &pixels[0], 4, RT_PIXEL_RGBA8) == NULL &&
+                    rt_render_start(scenes[0], &cameras[0], NULL, &pixels[0], 512 * 4, 17) == NULL;
+
+    printf("  cancel %s, bad records and targets %s\n", stopped ? "stops the render" : "DID NOT STOP IT",
+           rejected ? "rejected" : "ACCEPTED");
+    pass = pass && stopped && rejected;
+
+    for (int i = 0; i < 2; i++) {
+        rt_scene_destroy(scenes[i]);
+    }
+
+    printf("  %s\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+
+/* Frustum Culling Benchmark */
+
+void runFrustumBenchmark()
+{
+    const char* names[] = { "sparse, 40 spheres", "sparse, 400 spheres", "clustered, 2000 spheres",
+                            "dense, 20000 spheres", "dense, area light" };
+    const int counts[] = { 40, 400, 2000, 20000, 20000 };
+    const int distributions[] = { 0, 0, 1, 0, 0 };
+    int threadCount = std::max(1, (int) std::thread::hardware_concurrency());
+
+    Camera camera;
+    camera.setResolution(256, 256);
+
+    printf("Frustum culling, spheres over a floor, %dx%d render, %d threads, best of 3\n", camera.getWidth(),
+           camera.getHeight(), threadCount);
+    printf("  %-24s %9s %9s %8s %11s %11s %11s %11s\n", "scene", "per-ray s", "culled s", "speedup", "tiles culled",
+           "kept/tile", "shadow lists", "kept/list");
+
+    for (int s = 0; s < 5; s++) {
+        Scene scene;
+
+        if (s == 4) {
+            scene.addLight( Light::rectangle(Point(1.0, 3.0, -2.0), Point(1.0, 0.0, 0.0), Point(0.0, 0.0, 1.0),
+                                             Color(1.0, 1.0, 1.0)) );
+        } else {
+            scene.addLight( Light( Point(1.0, 3.0, -2.0), Color(1.0, 1.0, 1.0) ) );
+        }
+
+        scene.addInfinitePlane( new InfinitePlane(Point(0.0, -1.5, 0.0), Ray(Point(0.0, -1.5, 0.0), Point(0.0, 0.0, 0.0)),
+                                                  Color(0.1, 0.1, 0.1), Color(0.6, 0.6, 0.6), Color(0.0, 0.0, 0.0), 0.0) );
+        addBenchmarkSpheres(scene, distributions[s], counts[s], (counts[s] < 1000) ? 1.0f : 1.5f);
+        scene.buildAccelerator(ACCELERATOR_AUTO, threadCount);
+
+        double seconds[2] = { INFINITY, INFINITY };
+        uint64_t hashes[2];
+        FrustumStats stats;
+
+        for (int culled = 0; culled < 2; culled++) {
+            FrameBuffer framebuffer(camera.getWidth(), camera.getHeight());
+
+            for (int r = 0; r < 3; r++) {
+                Renderer renderer(&scene, camera);
+                renderer.setThreadCount(threadCount);
+                renderer.setFrustumCulling(culled == 1);
+
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                renderer.render(framebuffer);
+                seconds[culled] = std::min(seconds[culled], secondsSince(start));
+                stats = renderer.getFrustumStats();
+            }
+
+            hashes[culled] = framebuffer.getHash();
+        }
+
+        printf("  %-24s %9.3f %9.3f %7.2fx %11.0f%% %11.1f %11.0f%% %11.1f  %s\n", names[s], seconds[0], seconds[1],
+               seconds[0] / seconds[1], 100.0 * stats.primaryTiles / stats.tiles,
+               (double) stats.primaryKept / std::max((uint64_t) 1, stats.primaryTiles),
+               100.0 * stats.shadowCulledLists / std::max((uint64_t) 1, stats.shadowLists),
+               (double) stats.shadowKept / std::max((uint64_t) 1, stats.shadowCulledLists),
+               (hashes[0] == hashes[1]) ? "identical" : "DIFFERENT");
+
+        std::vector<Surface*> surfaces = scene.getSurfaces();
+
+        for (int i = 0; i < surfaces.size(); i++) {
+            delete surfaces[i];
+        }
+    }
+
+    printf("  kept: surfaces left per culled tile and per culled tile and light pair. Lists over %d surfaces\n"
+           "  are given up for the grid, except in scenes too small to have one\n", FRUSTUM_MAX_CANDIDATES);
+}
+
+bool runNumaBenchmark()
+{
+    int threadCount = std::max(4, (int) std::thread::hardware_concurrency());
+    const int simulatedNodes[2] = { 2, 4 };
+    bool identical = true;
+
+    NumaTopology machine;
+    bool detected = machine.detect();
+
+    printf("NUMA: %s, %d node%s:", detected ? "detected from sysfs" : "no NUMA information", machine.getNodeCount(),
+           (machine.getNodeCount() == 1) ? "" : "s");
+
+    for (int n = 0; n < machine.getNodeCount(); n++) {
+        printf(" node %d has %d CPU%s", machine.getNodeId(n), (int) machine.getCpus(n).size(),
+               (machine.getCpus(n).size() == 1) ? "" : "s");
+    }
+
+    printf("\n");
+
+    if (machine.getNodeCount() == 1) {
+        printf("  one node: renders leave threads and memory where they are; simulated nodes follow\n");
+    }
+
+    Scene scene;
+    scene.addLight( Light( Point(1.0, 3.0, -2.0), Color(1.0, 1.0, 1.0) ) );
+    scene.addInfinitePlane( new InfinitePlane(Point(0.0, -1.5, 0.0), Ray(Point(0.0, -1.5, 0.0), Point(0.0, 0.0, 0.0)),
+                                              Color(0.1, 0.1, 0.1), Color(0.6, 0.6, 0.6), Color(0.0, 0.0, 0.0), 0.0) );
+    addBenchmarkSpheres(scene, 1, 4000, 1.5f);
+    scene.buildAccelerator(ACCELERATOR_AUTO, threadCount);
+
+    Camera camera;
+    camera.setResolution(256, 256);
+    FrameBuffer framebuffer(camera.getWidth(), camera.getHeight());
+
+    /* Flat first, for the reference image; then every topology with and without replicas */
+    std::vector<NumaTopology> topologies;
+    std::vector<std::string> names;
+
+    topologies.push_back(NumaTopology());
+    names.push_back("flat");
+
+    if (machine.getNodeCount() > 1) {
+        topologies.push_back(machine);
+        names.push_back("machine");
+    }
+
+    for (int i = 0; i < 2; i++) {
+        NumaTopology simulated(machine);
+        simulated.simulate(simulatedNodes[i]);
+        topologies.push_back(simulated);
+        names.push_back("simulated");
+    }
+
+    printf("4000 clustered spheres over a floor, %dx%d, %d threads, best of 3\n", camera.getWidth(), camera.getHeight(),
+           threadCount);
+    printf("  %-10s %5s %9s %8s %10s %9s %9s\n", "topology", "nodes", "replicas", "render s", "build ms", "stolen",
+           "image");
+
+    uint64_t reference = 0;
+
+    for (int t = 0; t < topologies.size(); t++) {
+        for (int replicate = 0; replicate < ((t == 0) ? 1 : 2); replicate++) {
+            std::unique_ptr<SceneReplicas> replicas(replicate ? new SceneReplicas(scene, topologies[t]) : NULL);
+            Renderer renderer(&scene, camera);
+            double best = INFINITY;
+
+            renderer.setThreadCount(threadCount);
+            renderer.setNumaTopology(&topologies[t]);
+            renderer.setSceneReplicas(replicas.get());
+
+            for (int r = 0; r < 3; r++) {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                renderer.render(framebuffer);
+                best = std::min(best, secondsSince(start));
+            }
+
+            uint64_t hash = framebuffer.getHash();
+            int tiles = camera.getTileCountX() * camera.getTileCountY();
+            bool same = (t == 0) || (hash == reference);
+
+            reference = (t == 0) ? hash : reference;
+            identical = identical && same;
+
+            printf("  %-10s %5d %9s %8.3f %10s %8.1f%% %9s\n", names[t].c_str(), topologies[t].getNodeCount(),
+                   replicate ? "per node" : "shared", best,
+                   replicate ? std::to_string((int) (replicas->getBuildSeconds() * 1000.0 + 0.5)).c_str() : "-",
+                   100.0 * renderer.getStolenTileCount() / tiles, (t == 0) ? "reference" : (same ? "identical" : "DIFFERENT"));
+        }
+    }
+
+    std::vector<Surface*> surfaces = scene.getSurfaces();
+
+    for (int i = 0; i < surfaces.size(); i++) {
+        delete surfaces[i];
+    }
+
+    printf("  stolen: tiles run by another node than the one whose range held them\n");
+    printf("%s\n", identical ? "PASS: every placement renders the reference image" : "FAIL: images differ");
+
+    return identical;
+}
+
+/* Greedy list scheduling of tiles taking 'seconds' on 'workers' threads that each take the next tile in
+    'order' when free. Returns the makespan; 'tail' is the time from when the last tile was taken to the
+    end, while threads sit idle */
+static double simulateTileSchedule(const std::vector<int>& order, const std::vector<float>& seconds, int workers,
+                                   double& tail)
+{
+    std::vector<double> free(workers, 0.0);
+    double lastStart = 0.0;
+
+    for (int n = 0; n < order.size(); n++) {
+        std::vector<double>::iterator worker = std::min_element(free.begin(), free.end());
+        lastStart = *worker;
+        *worker += seconds[order[n]];
+    }
+
+    double makespan = *std::max_element(free.begin(), free.end());
+    tail = makespan - lastStart;
+
+    return makespan;
+}
+
+static double correlation(const std::vector<float>& first, const std::vector<float>& second)
+{
+    double meanFirst = 0.0, meanSecond = 0.0, covariance = 0.0, varianceFirst = 0.0, varianceSecond = 0.0;
+    int count = (int) first.size();
+
+    for (int i = 0; i < count; i++) {
+        meanFirst += first[i] / count;
+        meanSecond += second[i] / count;
+    }
+
+    for (int i = 0; i < count; i++) {
+        covariance += (first[i] - meanFirst) * (second[i] - meanSecond);
+        varianceFirst += (first[i] - meanFirst) * (first[i] - meanFirst);
+        varianceSecond += (second[i] - meanSecond) * (second[i] - meanSecond);
+    }
+
+    return covariance / sqrt(varianceFirst * varianceSecond);
+}
+
+void runTileCostBenchmark()
+{
+    const int workerCounts[3] = { 4, 16, 64 };
+    int threadCount = std::max(1, (int) std::thread::hardware_concurrency());
+
+    /* Mostly background, with a corner crowded by mirrors under one point and two area lights */
+    Scene scene;
+    scene.addLight( Light( Point(1.0, 3.0, -2.0), Color(0.6, 0.6, 0.6) ) );
+    scene.addLight( Light::rectangle(Point(-1.0, 2.5, -1.0), Point(0.8, 0.0, 0.0), Point(0.0, 0.0, 0.8),
+                                     Color(0.4, 0.4, 0.4)) );
+    scene.addLight( Light::sphere(Point(-2.0, 0.5, -1.5), 0.3, Color(0.3, 0.3, 0.3)) );
+
+    for (int i = 0; i < 600; i++) {
+        RandomStream random(9, i, 0);
+        float x = -0.55f + 0.35f * (2.0f * random.get(0, 0) - 1.0f);
+        float y = 0.55f + 0.35f * (2.0f * random.get(0, 1) - 1.0f);
+        float z = 0.3f * (2.0f * random.get(0, 2) - 1.0f);
+
+        scene.addSphere( new Sphere(Point(x, y, z), 0.02f + 0.04f * random.get(0, 3), Color(0.1, 0.1, 0.1),
+                                    Color(0.3, 0.5, 0.7), Color(0.8, 0.8, 0.8), 0.8) );
+    }
+
+    for (int i = 0; i < 40; i++) {
+        RandomStream random(9, i, 1);
+
+        scene.addSphere( new Sphere(Point(1.8f * random.get(0, 0) - 0.9f, 1.8f * random.get(0, 1) - 0.9f, 1.0),
+                                    0.03, Color(0.1, 0.0, 0.0), Color(0.7, 0.2, 0.1), Color(0.0, 0.0, 0.0), 0.0) );
+    }
+
+    scene.buildAccelerator(ACCELERATOR_AUTO, threadCount);
+
+    Camera camera;
+    camera.setResolution(512, 512);
+    FrameBuffer framebuffer(camera.getWidth(), camera.getHeight());
+    int tiles = camera.getTileCountX() * camera.getTileCountY();
+
+    /* Tile times on one thread, the least of three renders each */
+    Renderer renderer(&scene, camera);
+    std::vector<float> seconds(tiles, INFINITY);
+
+    for (int r = 0; r < 3; r++) {
+        renderer.render(framebuffer);
+
+        for (int t = 0; t < tiles; t++) {
+            seconds[t] = std::min(seconds[t], renderer.getTileSeconds()[t]);
+        }
+    }
+
+    uint64_t hash = framebuffer.getHash();
+
+    renderer.setCostOrdering(true);
+    renderer.render(framebuffer);
+
+    std::vector<float> costs = renderer.getTileCosts();
+    std::vector<float> sorted(seconds);
+    double total = 0.0;
+
+    std::sort(sorted.begin(), sorted.end());
+
+    for (int t = 0; t < tiles; t++) {
+        total += seconds[t];
+    }
+
+    printf("Tile cost prepass, 600 mirrors in one corner under 3 lights, %dx%d, %d tiles\n", camera.getWidth(),
+           camera.getHeight(), tiles);
+    printf("  tile time: median %.3f ms, max %.3f ms (%.0fx), total %.3f s on one thread\n", sorted[tiles / 2] * 1e3,
+           sorted[tiles - 1] * 1e3, sorted[tiles - 1] / std::max(sorted[tiles / 2], 1e-9f), total);
+    printf("  prepass: %.2f ms on one thread (%.2f%% of the render), %dx%d preview, estimate/time correlation %.3f\n",
+           renderer.getPrepassSeconds() * 1e3, 100.0 * renderer.getPrepassSeconds() / total,
+           renderer.getPreview().getWidth(), renderer.getPreview().getHeight(), correlation(costs, seconds));
+    printf("  image %s with cost ordering\n", (framebuffer.getHash() == hash) ? "identical" : "DIFFERENT");
+
+    /* Orders: the Morton tile order, longest first by the estimate, and by the measured times */
+    std::vector<int> orders[3];
+    const char* names[3] = { "FIFO", "estimate", "oracle" };
+
+    getTraversalOrder(TRAVERSAL_MORTON, camera.getTileCountX(), camera.getTileCountY(), orders[0]);
+    orders[1] = orders[2] = orders[0];
+    std::stable_sort(orders[1].begin(), orders[1].end(), [&costs](int a, int b) { return costs[a] > costs[b]; });
+    std::stable_sort(orders[2].begin(), orders[2].end(), [&seconds](int a, int b) { return seconds[a] > seconds[b]; });
+
+    printf("  Simulated from the tile times; the estimate's makespan includes its prepass split over the threads\n");
+    printf("  %7s %-9s %12s %10s %11s\n", "threads", "order", "makespan ms", "tail ms", "efficiency");
+
+    for (int w = 0; w < 3; w++) {
+        for (int o = 0; o < 3; o++) {
+            double tail;
+            double makespan = simulateTileSchedule(orders[o], seconds, workerCounts[w], tail);
+
+            makespan += (o == 1) ? renderer.getPrepassSeconds() / workerCounts[w] : 0.0;
+
+            printf("  %7d %-9s %12.3f %10.3f %10.1f%%\n", workerCounts[w], names[o], makespan * 1e3, tail * 1e3,
+                   100.0 * total / (workerCounts[w] * makespan));
+        }
+    }
+
+    /* The real thing, which only shows the difference with several cores */
+    double wall[2] = { INFINITY, INFINITY };
+
+    renderer.setThreadCount(threadCount);
+
+    for (int o = 0; o < 2; o++) {
+        renderer.setCostOrdering(o == 1);
+
+        for (int r = 0; r < 3; r++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            renderer.render(framebuffer);
+            wall[o] = std::min(wall[o], secondsSince(start));
+        }
+    }
+
+    printf("  measured on %d threads, best of 3: FIFO %.3f s, longest first %.3f s\n", threadCount, wall[0], wall[1]);
+
+    std::vector<Surface*> surfaces = scene.getSurfaces();
+
+    for (int i = 0; i < surfaces.size(); i++) {
+        delete surfaces[i];
+    }
+}
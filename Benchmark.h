@@ -0,0 +1,104 @@
+/************************************************************************************************
+ File: Benchmark.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____Benchmark__
+#define __Ray_Tracer__C_____Benchmark__
+
+#include <stdio.h>
+
+#define FAST_MATH_MIN_PSNR 40.0    /* dB, over the 8-bit output */
+
+/* Micro-benchmarks run from the command line with --benchmark <name>. Each prints its own report */
+
+/* Times every specialized Phong kernel against the generic powf() kernel on the same inputs */
+void runShadingBenchmark();
+
+/* Compares building a large scene and its grid from scratch with loading both from a memory-mapped
+    scene cache, timing each path to the same first traced ray */
+void runSceneCacheBenchmark();
+
+/* Renders a sphere field streamed from disk under a small memory budget and checks it against the
+    same field rendered fully resident */
+void runOutOfCoreBenchmark();
+
+/* Renders a large image texture receding to the horizon through a small texture cache, with and
+    without mip selection, and reports how the cache behaves */
+void runTextureCacheBenchmark();
+
+/* Compares the accelerator backends on uniform, clustered and "teapot in a stadium" sphere sets */
+void runAcceleratorBenchmark();
+
+/* Measures the error and speed of the fast math kernels, then renders a sphere field with exact and
+    fast math. Returns false if the fast image falls below FAST_MATH_MIN_PSNR against the exact one */
+bool runFastMathBenchmark();
+
+/* Renders mirrors of every reflectivity exhaustively, with a contribution cutoff and with Russian
+    roulette, and reports the rays each one saves and its error against the exhaustive image */
+void runRouletteBenchmark();
+
+/* Renders snapshots of a scene on several threads while an editor thread keeps moving its spheres, then
+    renders every version that was seen again from a replay of the edits and compares the images.
+    Returns false on any mismatch. Meant to be run under ThreadSanitizer as well */
+bool runSceneUpdateStress();
+
+/* Renders sphere fields with scanline, Morton and Hilbert tile and pixel orders and reports the time
+    and the hardware cache counters of each, where the machine offers them */
+void runTraversalBenchmark();
+
+/* Renders a sphere field with tracing off, on, and on with hardware counters, and reports what the
+    zones cost in each case along with the traced summary */
+void runTracingBenchmark();
+
+/* Renders spheres on a floor under rectangle, disk and sphere lights with adaptive and fixed shadow
+    sampling, and reports shadow rays per pixel, time against hard shadows and error against a
+    256-sample reference */
+void runSoftShadowBenchmark();
+
+/* Renders soft shadows at rising samples per pixel, raw and denoised, against a high-sample reference
+    and reports how many fewer samples the denoised image needs for the same PSNR, and the filter time */
+void runDenoiseBenchmark();
+
+/* Renders a sphere field into every framebuffer format and a paged sphere field with full and quantized
+    material tables, and reports memory, rays per second and error against the full-precision images */
+void runCompactFormatBenchmark();
+
+/* Renders sparse and dense sphere fields with per-ray traversal and with per-tile frustum culling, and
+    reports the time of each and how much of the scene the tiles' camera and shadow rays kept */
+void runFrustumBenchmark();
+
+/* Builds the importance tables of sky maps of rising size on one and on all threads, then renders spheres
+    on a floor lit only by a sky with a small sun, sampling it uniformly and by importance, and reports
+    build time, table memory, and render time and PSNR against a high-sample reference per sample count */
+void runEnvironmentBenchmark();
+
+/* Tests rays against spheres at unit scale, at large coordinates, with tiny radii and from origins on
+    the surface, many of them grazing, with the textbook float quadratic and in float, mixed and double
+    precision, and reports wrong decisions against double, root error, fallback rate and throughput;
+    then renders a sphere field in each precision. Returns false if mixed precision decides any test
+    differently from double */
+bool runPrecisionBenchmark();
+
+/* Builds two scenes through the C interface and renders them at once into caller memory of different
+    formats and strides while polling their progress, then renders each again alone and compares the
+    bytes. Also checks cancelling and rejected input. Returns false on any failure */
+bool runLibraryCheck();
+
+/* Reports the machine's NUMA nodes, then renders a sphere field flat, on the machine's nodes if it has
+    several and on 2 and 4 simulated nodes, with a shared scene and with a copy per node, and reports
+    render time, replica build time and the tiles other nodes took. Returns false if any image differs
+    from the flat one */
+bool runNumaBenchmark();
+
+/* Renders a scene whose tiles differ a hundredfold in cost, measuring every tile, then with the cost
+    prepass, and reports the spread of tile times, the prepass's time and how well its estimates follow
+    the measured times. Then simulates 4, 16 and 64 threads taking tiles in Morton (FIFO) order, longest
+    first by the estimates and longest first by the measured times, and reports the makespan and the
+    idle tail of each, and the real render time in both orders */
+void runTileCostBenchmark();
+
+#endif /* defined(__Ray_Tracer__C_____Benchmark__) */
@@ -0,0 +1,201 @@
+/************************************************************************************************
+ File: Camera.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "Camera.h"
+
+/* Default camera reproduces the original fixed setup: eye at (0, 0, -5) looking down +z through
+    an image plane at z = 0 that spans [-1, 1] in both directions */
+Camera::Camera()
+{
+    position = Point(0.0, 0.0, -5.0);
+    lookAt = Point(0.0, 0.0, 0.0);
+    up = Point(0.0, 1.0, 0.0);
+    fieldOfView = 2.0 * atanf(1.0 / 5.0) * 180.0 / M_PI;
+    width = 800;
+    height = 800;
+    clearRegion();
+    updateBasis();
+}
+
+Camera::Camera(const Camera& camera)
+{
+    position = camera.getPosition();
+    lookAt = camera.getLookAt();
+    up = camera.getUp();
+    fieldOfView = camera.getFieldOfView();
+    width = camera.getWidth();
+    height = camera.getHeight();
+    setRegion(camera.getRegionX0(), camera.getRegionY0(), camera.getRegionX1(), camera.getRegionY1());
+    updateBasis();
+}
+
+Camera::Camera(Point _position, Point _lookAt, Point _up, float _fieldOfView, int _width, int _height)
+{
+    position = _position;
+    lookAt = _lookAt;
+    up = _up;
+    fieldOfView = _fieldOfView;
+    width = _width;
+    height = _height;
+    clearRegion();
+    updateBasis();
+}
+
+void Camera::setResolution(int _width, int _height)
+{
+    width = _width;
+    height = _height;
+    clearRegion();
+    updateBasis();
+}
+
+void Camera::setRegion(int x0, int y0, int x1, int y1)
+{
+    regionX0 = (x0 < 0) ? 0 : x0;
+    regionY0 = (y0 < 0) ? 0 : y0;
+    regionX1 = (x1 > width) ? width : x1;
+    regionY1 = (y1 > height) ? height : y1;
+
+    if (regionX1 < regionX0) {
+        regionX1 = regionX0;
+    }
+
+    if (regionY1 < regionY0) {
+        regionY1 = regionY0;
+    }
+}
+
+float Camera::getPixelSpread() const
+{
+    return (height > 1) ? (2.0 * tanf(fieldOfView * M_PI / 360.0)) / (height - 1.0) : 0.0;
+}
+
+/* Tiles sit on a fixed TILE_SIZE grid anchored at pixel (0, 0) so that a tile never straddles two
+    framebuffer tiles, whatever the region of interest is */
+int Camera::getTileCountX() const
+{
+    return (regionX1 > regionX0) ? ((regionX1 - 1) / TILE_SIZE) - (regionX0 / TILE_SIZE) + 1 : 0;
+}
+
+int Camera::getTileCountY() const
+{
+    return (regionY1 > regionY0) ? ((regionY1 - 1) / TILE_SIZE) - (regionY0 / TILE_SIZE) + 1 : 0;
+}
+
+void Camera::getTileBounds(int tile, int& x0, int& y0, int& x1, int& y1) const
+{
+    int tilesX = getTileCountX();
+
+    x0 = ((regionX0 / TILE_SIZE) + (tile % tilesX)) * TILE_SIZE;
+    y0 = ((regionY0 / TILE_SIZE) + (tile / tilesX)) * TILE_SIZE;
+    x1 = (x0 + TILE_SIZE > regionX1) ? regionX1 : x0 + TILE_SIZE;
+    y1 = (y0 + TILE_SIZE > regionY1) ? regionY1 : y0 + TILE_SIZE;
+    x0 = (x0 < regionX0) ? regionX0 : x0;
+    y0 = (y0 < regionY0) ? regionY0 : y0;
+}
+
+Ray Camera::getPrimaryRay(int x, int y, float jitterX, float jitterY) const
+{
+    float px = x + jitterX;
+    float py = y + jitterY;
+
+    std::vector<float> direction(3);
+    float lengthSquared = 0.0;
+
+    for (int i = 0; i < 3; i++) {
+        direction[i] = corner[i] + (px * stepX[i]) + (py * stepY[i]);
+        lengthSquared += direction[i] * direction[i];
+    }
+
+    float inverseLength = 1.0 / sqrtf(lengthSquared);
+
+    for (int i = 0; i < 3; i++) {
+        direction[i] *= inverseLength;
+    }
+
+    return Ray(position, direction);
+}
+
+void Camera::getTileDirections(int x0, int y0, int x1, int y1, float* dirX, float* dirY, float* dirZ) const
+{
+    int count = x1 - x0;
+
+    for (int y = y0; y < y1; y++) {
+        /* Direction through the first pixel of the row, everything else is a multiple of stepX away */
+        float rowX = corner[0] + (x0 * stepX[0]) + (y * stepY[0]);
+        float rowY = corner[1] + (x0 * stepX[1]) + (y * stepY[1]);
+        float rowZ = corner[2] + (x0 * stepX[2]) + (y * stepY[2]);
+
+        for (int i = 0; i < count; i++) {
+            float dx = rowX + (i * stepX[0]);
+            float dy = rowY + (i * stepX[1]);
+            float dz = rowZ + (i * stepX[2]);
+            float inverseLength = 1.0f / sqrtf( (dx * dx) + (dy * dy) + (dz * dz) );
+
+            dirX[i] = dx * inverseLength;
+            dirY[i] = dy * inverseLength;
+            dirZ[i] = dz * inverseLength;
+        }
+
+        dirX += count;
+        dirY += count;
+        dirZ += count;
+    }
+}
+
+void Camera::getTileCorners(int x0, int y0, int x1, int y1, float margin, float corners[4][3]) const
+{
+    float left = x0 - 0.5f - margin, right = x1 - 0.5f + margin;
+    float top = y0 - 0.5f - margin, bottom = y1 - 0.5f + margin;
+    float pixelX[4] = { left, right, right, left }, pixelY[4] = { top, top, bottom, bottom };
+
+    for (int c = 0; c < 4; c++) {
+        for (int i = 0; i < 3; i++) {
+            corners[c][i] = corner[i] + (pixelX[c] * stepX[i]) + (pixelY[c] * stepY[i]);
+        }
+    }
+}
+
+/* Builds an orthonormal basis from the view direction and scales it so that pixel (0, 0) maps to
+    the upper-left corner of the image plane at unit distance and pixel (w-1, h-1) to the lower-right */
+void Camera::updateBasis()
+{
+    float forward[3] = { lookAt.getX() - position.getX(),
+                         lookAt.getY() - position.getY(),
+                         lookAt.getZ() - position.getZ() };
+    float norm = sqrtf( (forward[0] * forward[0]) + (forward[1] * forward[1]) + (forward[2] * forward[2]) );
+
+    for (int i = 0; i < 3; i++) {
+        forward[i] /= norm;
+    }
+
+    /* right = up x forward, trueUp = forward x right (left-handed, +x right, +y up, +z into screen) */
+    float right[3] = { up.getY() * forward[2] - up.getZ() * forward[1],
+                       up.getZ() * forward[0] - up.getX() * forward[2],
+                       up.getX() * forward[1] - up.getY() * forward[0] };
+    norm = sqrtf( (right[0] * right[0]) + (right[1] * right[1]) + (right[2] * right[2]) );
+
+    for (int i = 0; i < 3; i++) {
+        right[i] /= norm;
+    }
+
+    float trueUp[3] = { forward[1] * right[2] - forward[2] * right[1],
+                        forward[2] * right[0] - forward[0] * right[2],
+                        forward[0] * right[1] - forward[1] * right[0] };
+
+    float halfHeight = tanf(fieldOfView * M_PI / 360.0);
+    float halfWidth = halfHeight * ((float) width / (float) height);
+    float pixelWidth = (width > 1) ? (2.0 * halfWidth) / (width - 1.0) : 0.0;
+    float pixelHeight = (height > 1) ? (2.0 * halfHeight) / (height - 1.0) : 0.0;
+
+    for (int i = 0; i < 3; i++) {
+        corner[i] = forward[i] - (halfWidth * right[i]) + (halfHeight * trueUp[i]);
+        stepX[i] = pixelWidth * right[i];
+        stepY[i] = -pixelHeight * trueUp[i];
+    }
+}
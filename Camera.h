@@ -0,0 +1,81 @@
+/************************************************************************************************
+ File: Camera.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____Camera__
+#define __Ray_Tracer__C_____Camera__
+
+#include <stdio.h>
+#include "Point.h"
+#include "Ray.h"
+
+#define TILE_SIZE 16
+
+class Camera {
+public:
+    Camera();
+    Camera(const Camera& camera);
+    Camera(Point _position, Point _lookAt, Point _up, float _fieldOfView, int _width, int _height);
+
+    void setPosition(Point newPosition) { position = newPosition; updateBasis(); }
+    void setLookAt(Point newLookAt) { lookAt = newLookAt; updateBasis(); }
+    void setUp(Point newUp) { up = newUp; updateBasis(); }
+    void setFieldOfView(float degrees) { fieldOfView = degrees; updateBasis(); }
+    void setResolution(int _width, int _height);
+
+    /* Restricts rendering to the pixels [x0, x1) x [y0, y1); the rest of the image is left untouched */
+    void setRegion(int x0, int y0, int x1, int y1);
+    void clearRegion() { setRegion(0, 0, width, height); }
+
+    Point getPosition() const { return position; }
+    Point getLookAt() const { return lookAt; }
+    Point getUp() const { return up; }
+    float getFieldOfView() const { return fieldOfView; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getRegionX0() const { return regionX0; }
+    int getRegionY0() const { return regionY0; }
+    int getRegionX1() const { return regionX1; }
+    int getRegionY1() const { return regionY1; }
+
+    /* Angle in radians between the rays of two neighbouring pixels, the spread of a primary ray cone */
+    float getPixelSpread() const;
+
+    /* Tiles are the cells of a TILE_SIZE x TILE_SIZE grid over the image, clipped against the region of interest */
+    int getTileCountX() const;
+    int getTileCountY() const;
+    void getTileBounds(int tile, int& x0, int& y0, int& x1, int& y1) const;
+
+    /* Returns the primary ray through pixel (x, y) where (0, 0) is the upper-left corner of the
+     image. 'jitterX' and 'jitterY' offset the sample within the pixel and lie in [-0.5, 0.5) */
+    Ray getPrimaryRay(int x, int y, float jitterX = 0.0, float jitterY = 0.0) const;
+
+    /* Fills 'dirX', 'dirY' and 'dirZ' with the unit directions of the primary rays for the pixels
+     in [x0, x1) x [y0, y1), row by row. The directions are stepped incrementally across each row
+     so the inner loop carries no dependencies and vectorizes */
+    void getTileDirections(int x0, int y0, int x1, int y1, float* dirX, float* dirY, float* dirZ) const;
+
+    /* Unnormalized directions through the four corners of pixels [x0, x1) x [y0, y1), widened by
+     'margin' pixels on every side, in order around the tile. Every primary ray of those pixels,
+     jittered or not, lies between them */
+    void getTileCorners(int x0, int y0, int x1, int y1, float margin, float corners[4][3]) const;
+
+private:
+    void updateBasis();
+
+    Point position, lookAt, up;
+    float fieldOfView;      /* Vertical field of view in degrees */
+    int width, height;
+    int regionX0, regionY0, regionX1, regionY1;
+
+    /* Unnormalized direction through pixel (0, 0) and the per-pixel steps along a row and a column */
+    float corner[3];
+    float stepX[3];
+    float stepY[3];
+};
+
+#endif /* defined(__Ray_Tracer__C_____Camera__) */
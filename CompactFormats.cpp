@@ -0,0 +1,290 @@
+/************************************************************************************************
+ File: CompactFormats.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "CompactFormats.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+static inline uint32_t floatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static inline float bitsFloat(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/* Rounds to nearest even with integer arithmetic on the bits. Half subnormals are produced by
+    adding 0.5, which makes the FPU align and round the mantissa for us */
+uint16_t floatToHalf(float value)
+{
+    uint32_t bits = floatBits(value);
+    uint32_t sign = bits & 0x80000000u;
+    uint32_t magnitude = bits ^ sign;
+    uint32_t half;
+
+    if (magnitude >= 0x47800000u) {             /* 65520 and up round to infinity; NaN stays NaN */
+        half = (magnitude > 0x7f800000u) ? 0x7e00 : 0x7c00;
+    } else if (magnitude < 0x38800000u) {       /* Below the smallest normal half */
+        half = floatBits(bitsFloat(magnitude) + 0.5f) - 0x3f000000u;
+    } else {
+        uint32_t odd = (magnitude >> 13) & 1;
+        half = (magnitude + ((uint32_t) (15 - 127) << 23) + 0xfff + odd) >> 13;
+    }
+
+    return (uint16_t) (half | (sign >> 16));
+}
+
+float halfToFloat(uint16_t value)
+{
+    uint32_t bits = (uint32_t) (value & 0x7fff) << 13;
+    uint32_t exponent = bits & 0x0f800000u;
+
+    bits += (uint32_t) (127 - 15) << 23;
+
+    if (exponent == 0x0f800000u) {              /* Infinity or NaN */
+        bits += (uint32_t) (128 - 16) << 23;
+    } else if (exponent == 0) {                 /* Subnormal, renormalized by the FPU */
+        bits = floatBits(bitsFloat(bits + (1u << 23)) - bitsFloat(113u << 23));
+    }
+
+    return bitsFloat(bits | ((uint32_t) (value & 0x8000) << 16));
+}
+
+#if defined(__SSE2__)
+/* Four floats to halves in the low 16 bits of each lane, exactly as floatToHalf() */
+static inline __m128i floatToHalf4(__m128 value)
+{
+#if defined(__F16C__)
+    return _mm_cvtepu16_epi32(_mm_cvtps_ph(value, _MM_FROUND_TO_NEAREST_INT));
+#else
+    const __m128i subnormalMagic = _mm_set1_epi32(0x3f000000);
+    __m128 sign = _mm_and_ps(value, _mm_castsi128_ps(_mm_set1_epi32(0x80000000)));
+    __m128 magnitude = _mm_xor_ps(value, sign);
+    __m128i bits = _mm_castps_si128(magnitude);
+
+    __m128 isNaN = _mm_cmpunord_ps(magnitude, magnitude);
+    __m128i isFinite = _mm_cmpgt_epi32(_mm_set1_epi32(0x47800000), bits);
+    __m128i isSubnormal = _mm_cmpgt_epi32(_mm_set1_epi32(0x38800000), bits);
+    __m128i special = _mm_or_si128(_mm_and_si128(_mm_castps_si128(isNaN), _mm_set1_epi32(0x200)), _mm_set1_epi32(0x7c00));
+
+    __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(magnitude, _mm_castsi128_ps(subnormalMagic))),
+                                      subnormalMagic);
+    __m128i odd = _mm_srai_epi32(_mm_slli_epi32(bits, 31 - 13), 31);
+    __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(bits, _mm_set1_epi32(0xfff - ((127 - 15) << 23))), odd), 13);
+
+    __m128i finite = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+    __m128i half = _mm_or_si128(_mm_and_si128(isFinite, finite), _mm_andnot_si128(isFinite, special));
+
+    return _mm_or_si128(half, _mm_srli_epi32(_mm_castps_si128(sign), 16));
+#endif
+}
+
+/* Four halves in the low 16 bits of each lane to floats, exactly as halfToFloat() */
+static inline __m128 halfToFloat4(__m128i value)
+{
+#if defined(__F16C__)
+    return _mm_cvtph_ps(_mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(value, 16), 16), _mm_setzero_si128()));
+#else
+    __m128i magnitude = _mm_and_si128(value, _mm_set1_epi32(0x7fff));
+    __m128i sign = _mm_slli_epi32(_mm_xor_si128(value, magnitude), 16);
+
+    /* Scaling by 2^112 rebiases the exponent and turns subnormals into normals in one step */
+    __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(magnitude, 13)), _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+    __m128i infinite = _mm_and_si128(_mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x7bff)), _mm_set1_epi32(255 << 23));
+
+    return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infinite)));
+#endif
+}
+#endif
+
+void floatsToHalves(const float* input, uint16_t* output, int count)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    for (; i + 8 <= count; i += 8) {
+        __m128i low = floatToHalf4(_mm_loadu_ps(input + i));
+        __m128i high = floatToHalf4(_mm_loadu_ps(input + i + 4));
+
+        /* Sign-extend so the signed pack keeps all 16 bits */
+        low = _mm_srai_epi32(_mm_slli_epi32(low, 16), 16);
+        high = _mm_srai_epi32(_mm_slli_epi32(high, 16), 16);
+        _mm_storeu_si128((__m128i*) (output + i), _mm_packs_epi32(low, high));
+    }
+#endif
+
+    for (; i < count; i++) {
+        output[i] = floatToHalf(input[i]);
+    }
+}
+
+void halvesToFloats(const uint16_t* input, float* output, int count)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    for (; i + 8 <= count; i += 8) {
+        __m128i halves = _mm_loadu_si128((const __m128i*) (input + i));
+        _mm_storeu_ps(output + i, halfToFloat4(_mm_unpacklo_epi16(halves, _mm_setzero_si128())));
+        _mm_storeu_ps(output + i + 4, halfToFloat4(_mm_unpackhi_epi16(halves, _mm_setzero_si128())));
+    }
+#endif
+
+    for (; i < count; i++) {
+        output[i] = halfToFloat(input[i]);
+    }
+}
+
+/* The reference encoding of EXT_texture_shared_exponent */
+uint32_t encodeRGB9E5(float r, float g, float b)
+{
+    float rgb[3] = { r, g, b };
+
+    for (int c = 0; c < 3; c++) {
+        rgb[c] = (rgb[c] > 0.0f) ? std::min(rgb[c], RGB9E5_MAX_VALUE) : 0.0f;   /* NaN fails the test too */
+    }
+
+    float brightest = std::max(rgb[0], std::max(rgb[1], rgb[2]));
+    int exponent = std::max(-RGB9E5_EXPONENT_BIAS - 1, (int) ((floatBits(brightest) >> 23) & 0xff) - 127) +
+                   1 + RGB9E5_EXPONENT_BIAS;
+    float step = ldexpf(1.0f, exponent - RGB9E5_EXPONENT_BIAS - RGB9E5_MANTISSA_BITS);
+
+    if ((int) floorf(brightest / step + 0.5f) == (1 << RGB9E5_MANTISSA_BITS)) {
+        step *= 2.0f;
+        exponent++;
+    }
+
+    uint32_t packed = (uint32_t) exponent << (3 * RGB9E5_MANTISSA_BITS);
+
+    for (int c = 0; c < 3; c++) {
+        packed |= (uint32_t) floorf(rgb[c] / step + 0.5f) << (c * RGB9E5_MANTISSA_BITS);
+    }
+
+    return packed;
+}
+
+void decodeRGB9E5(uint32_t packed, float rgb[3])
+{
+    float step = bitsFloat((((packed >> 27) + 127 - RGB9E5_EXPONENT_BIAS - RGB9E5_MANTISSA_BITS) << 23));
+
+    for (int c = 0; c < 3; c++) {
+        rgb[c] = ((packed >> (c * RGB9E5_MANTISSA_BITS)) & 0x1ff) * step;
+    }
+}
+
+void decodeRGB9E5Row(const uint32_t* input, float* output, int count)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    /* Four colors at a time, transposed to RGB and written with overlapping stores; the last color of
+        each group is written on its own so nothing past it is touched */
+    __m128i mantissaMask = _mm_set1_epi32(0x1ff);
+    __m128i bias = _mm_set1_epi32(127 - RGB9E5_EXPONENT_BIAS - RGB9E5_MANTISSA_BITS);
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i packed = _mm_loadu_si128((const __m128i*) (input + i));
+        __m128 step = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_srli_epi32(packed, 27), bias), 23));
+        __m128 r = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(packed, mantissaMask)), step);
+        __m128 g = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed, 9), mantissaMask)), step);
+        __m128 b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed, 18), mantissaMask)), step);
+        __m128 a = _mm_setzero_ps();
+
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+
+        float* destination = output + 3 * i;
+        _mm_storeu_ps(destination, r);
+        _mm_storeu_ps(destination + 3, g);
+        _mm_storeu_ps(destination + 6, b);
+
+        float last[4];
+        _mm_storeu_ps(last, a);
+        destination[9] = last[0];
+        destination[10] = last[1];
+        destination[11] = last[2];
+    }
+#endif
+
+    for (; i < count; i++) {
+        decodeRGB9E5(input[i], output + 3 * i);
+    }
+}
+
+void halfRGBAToRGBRow(const uint16_t* input, float* output, int count)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    /* Two pixels at a time; the second pixel's alpha lane lands where the next pair starts and is
+        overwritten by it, the last pair's is written lane by lane */
+    for (; i + 2 <= count; i += 2) {
+        __m128i halves = _mm_loadu_si128((const __m128i*) (input + 4 * i));
+        __m128 first = halfToFloat4(_mm_unpacklo_epi16(halves, _mm_setzero_si128()));
+        __m128 second = halfToFloat4(_mm_unpackhi_epi16(halves, _mm_setzero_si128()));
+        float* destination = output + 3 * i;
+
+        _mm_storeu_ps(destination, first);
+
+        if (i + 2 < count) {
+            _mm_storeu_ps(destination + 3, second);
+        } else {
+            float last[4];
+            _mm_storeu_ps(last, second);
+            destination[3] = last[0];
+            destination[4] = last[1];
+            destination[5] = last[2];
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        for (int c = 0; c < 3; c++) {
+            output[3 * i + c] = halfToFloat(input[4 * i + c]);
+        }
+    }
+}
+
+CompactMaterial compactMaterial(const PackedMaterial& material)
+{
+    CompactMaterial compact;
+    compact.ambient = encodeRGB9E5(material.ambient[0], material.ambient[1], material.ambient[2]);
+    compact.diffuse = encodeRGB9E5(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+    compact.specular = encodeRGB9E5(material.specular[0], material.specular[1], material.specular[2]);
+    compact.reflectivity = floatToHalf(material.reflectivity);
+    compact.specularExponent = (uint16_t) std::min(65535, std::max(0, (int) material.specularExponent));
+
+    return compact;
+}
+
+PackedMaterial expandMaterial(const CompactMaterial& compact)
+{
+    PackedMaterial material;
+    memset(&material, 0, sizeof(material));
+
+    decodeRGB9E5(compact.ambient, material.ambient);
+    decodeRGB9E5(compact.diffuse, material.diffuse);
+    decodeRGB9E5(compact.specular, material.specular);
+    material.reflectivity = halfToFloat(compact.reflectivity);
+    material.specularExponent = compact.specularExponent;
+
+    return material;
+}
@@ -0,0 +1,61 @@
+/************************************************************************************************
+ File: CompactFormats.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____CompactFormats__
+#define __Ray_Tracer__C_____CompactFormats__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "SceneCache.h"
+
+#define RGB9E5_MANTISSA_BITS 9
+#define RGB9E5_EXPONENT_BIAS 15
+#define RGB9E5_MAX_VALUE 65408.0f     /* 511/512 * 2^16, the largest encodable channel */
+
+/************************************************************************************************
+ Reduced-precision encodings for stored colors and materials. Everything the renderer computes
+ stays in floats; these are only for what it keeps in memory, converted once on the way in and
+ once on the way out, never inside the tracing loop.
+
+    binary16    IEEE half float: 11 significant bits, range 6e-5 .. 65504, round to nearest even
+    RGB9E5      three 9-bit mantissas sharing a 5-bit exponent in 32 bits, for non-negative colors
+                (negative and NaN channels become 0). The brightest channel keeps 9 bits; dimmer
+                channels of the same pixel lose the bits they sit below it
+
+ The row conversions use SSE2 (F16C for halves where the compiler targets it) and handle any count
+************************************************************************************************/
+
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t value);
+
+void floatsToHalves(const float* input, uint16_t* output, int count);
+void halvesToFloats(const uint16_t* input, float* output, int count);
+
+uint32_t encodeRGB9E5(float r, float g, float b);
+void decodeRGB9E5(uint32_t packed, float rgb[3]);
+
+/* 'count' packed colors to 3 * 'count' floats */
+void decodeRGB9E5Row(const uint32_t* input, float* output, int count);
+
+/* 'count' RGBA half pixels to 3 * 'count' floats, dropping alpha */
+void halfRGBAToRGBRow(const uint16_t* input, float* output, int count);
+
+/* A material in 16 bytes instead of the 48 of PackedMaterial: RGB9E5 coefficients, a half
+    reflectivity and the Phong exponent clamped to 16 bits */
+struct CompactMaterial {
+    uint32_t ambient;
+    uint32_t diffuse;
+    uint32_t specular;
+    uint16_t reflectivity;
+    uint16_t specularExponent;
+};
+
+CompactMaterial compactMaterial(const PackedMaterial& material);
+PackedMaterial expandMaterial(const CompactMaterial& material);
+
+#endif /* defined(__Ray_Tracer__C_____CompactFormats__) */
@@ -0,0 +1,359 @@
+/************************************************************************************************
+ File: Denoiser.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "Denoiser.h"
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include "FastMath.h"
+#include "Trace.h"
+
+#define DENOISE_MAX_EXPONENT 125.0f     /* Weights below 2^-125 are as good as 0, and fastExp2 stays finite */
+#define DENOISE_MIN_DEPTH 1e-3f
+#define DENOISE_MIN_DEVIATION 1e-3f     /* Keeps the luminance scale finite where the variance is 0 */
+
+static const float kernelWeights[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+static inline float luminance(float r, float g, float b)
+{
+    return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+}
+
+Denoiser::Denoiser()
+{
+    iterations = DENOISE_ITERATIONS;
+    threadCount = 1;
+    luminanceSigma = DENOISE_LUMINANCE_SIGMA;
+    normalSigma = DENOISE_NORMAL_SIGMA;
+    depthSigma = DENOISE_DEPTH_SIGMA;
+    albedoSigma = DENOISE_ALBEDO_SIGMA;
+}
+
+Denoiser::Denoiser(const Denoiser& denoiser)
+{
+    iterations = denoiser.getIterations();
+    threadCount = denoiser.getThreadCount();
+    luminanceSigma = denoiser.getLuminanceSigma();
+    normalSigma = denoiser.getNormalSigma();
+    depthSigma = denoiser.getDepthSigma();
+    albedoSigma = denoiser.getAlbedoSigma();
+}
+
+/* Runs body(begin, end) over bands of TILE_SIZE rows on 'threadCount' threads, the caller included */
+static void forEachRowBand(int height, int threadCount, const std::function<void(int, int)>& body)
+{
+    std::atomic<int> next(0);
+    std::function<void()> work = [&body, &next, height]() {
+        for (int band = next.fetch_add(1); band * TILE_SIZE < height; band = next.fetch_add(1)) {
+            body(band * TILE_SIZE, std::min(height, (band + 1) * TILE_SIZE));
+        }
+    };
+
+    std::vector<std::thread> workers;
+
+    for (int i = 1; i < threadCount; i++) {
+        workers.push_back( std::thread(work) );
+    }
+
+    work();
+
+    for (int i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+void Denoiser::denoise(const FrameBuffer& input, const FeatureBuffer& features, FrameBuffer& output)
+{
+    TRACE_ZONE(TRACE_DENOISE);
+    int width = input.getWidth(), height = input.getHeight(), stride = features.getStride();
+
+    if (features.getWidth() != width || features.getHeight() != height) {
+        output = input;
+        return;
+    }
+
+    /* Planar scanline copies of the color and its variance, ping-ponged between the passes */
+    size_t planeSize = (size_t) stride * height;
+    std::vector<float> scanlines, ping(4 * planeSize), pong(4 * planeSize), scale(planeSize);
+    float* source[4] = { &ping[0], &ping[planeSize], &ping[2 * planeSize], &ping[3 * planeSize] };
+    float* destination[4] = { &pong[0], &pong[planeSize], &pong[2 * planeSize], &pong[3 * planeSize] };
+    const float* variance = features.getChannel(FEATURE_VARIANCE);
+    bool estimate = false;
+
+    input.toScanlines(scanlines, false);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            size_t index = (size_t) y * stride + x;
+
+            for (int c = 0; c < 3; c++) {
+                source[c][index] = scanlines[((size_t) y * width + x) * 3 + c];
+            }
+
+            source[3][index] = variance[index];
+            estimate = estimate || variance[index] < 0.0f;
+        }
+    }
+
+    if (estimate) {
+        forEachRowBand(height, threadCount, [this, &features, &source](int begin, int end) {
+            estimateVariance(features, source, source[3], begin, end);
+        });
+    }
+
+    for (int pass = 0; pass < iterations; pass++) {
+        float* luminanceScale = &scale[0];
+
+        forEachRowBand(height, threadCount, [this, &features, &source, luminanceScale](int begin, int end) {
+            computeLuminanceScale(features, source[3], luminanceScale, begin, end);
+        });
+
+        forEachRowBand(height, threadCount, [this, &features, &source, &destination, luminanceScale, pass](int begin, int end) {
+            filterRows(features, source, luminanceScale, destination, 1 << pass, begin, end);
+        });
+
+        std::swap(source, destination);
+    }
+
+    if (&output != &input) {
+        output.resize(width, height, input.getFormat());
+    }
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            size_t index = (size_t) y * stride + x;
+            output.setPixel(x, y, Color(source[0][index], source[1][index], source[2][index]));
+        }
+    }
+}
+
+/* Weighted spread of the luminance over the 5 x 5 neighbors, the same weights as the first pass
+    without the luminance term. At one sample per pixel that spread is the pixel's own variance */
+void Denoiser::estimateVariance(const FeatureBuffer& features, const float* const color[3], float* variance,
+                                int rowBegin, int rowEnd) const
+{
+    const float* albedo[3] = { features.getChannel(FEATURE_ALBEDO_R), features.getChannel(FEATURE_ALBEDO_G),
+                               features.getChannel(FEATURE_ALBEDO_B) };
+    const float* normal[3] = { features.getChannel(FEATURE_NORMAL_X), features.getChannel(FEATURE_NORMAL_Y),
+                               features.getChannel(FEATURE_NORMAL_Z) };
+    const float* depth = features.getChannel(FEATURE_DEPTH);
+    const float* rendered = features.getChannel(FEATURE_VARIANCE);
+    int width = features.getWidth(), height = features.getHeight(), stride = features.getStride();
+
+    float inverseNormal = 1.0f / (normalSigma * normalSigma);
+    float inverseAlbedo = 1.0f / (albedoSigma * albedoSigma);
+    float inverseDepth = 1.0f / depthSigma;
+
+    for (int y = rowBegin; y < rowEnd; y++) {
+        for (int x = 0; x < width; x++) {
+            size_t p = (size_t) y * stride + x;
+
+            if (rendered[p] >= 0.0f) {
+                continue;
+            }
+
+            float inverseZ = inverseDepth / std::max(depth[p], DENOISE_MIN_DEPTH);
+            float sum = 0.0, squares = 0.0, weightSum = 0.0;
+
+            for (int ky = 0; ky < 5; ky++) {
+                size_t row = (size_t) std::min(height - 1, std::max(0, y + ky - 2)) * stride;
+
+                for (int kx = 0; kx < 5; kx++) {
+                    size_t q = row + std::min(width - 1, std::max(0, x + kx - 2));
+                    float normalDistance = 0.0, albedoDistance = 0.0;
+
+                    for (int c = 0; c < 3; c++) {
+                        float dn = normal[c][q] - normal[c][p];
+                        float da = albedo[c][q] - albedo[c][p];
+                        normalDistance += dn * dn;
+                        albedoDistance += da * da;
+                    }
+
+                    float exponent = normalDistance * inverseNormal + albedoDistance * inverseAlbedo +
+                                     fabsf(depth[q] - depth[p]) * inverseZ;
+                    float weight = kernelWeights[ky] * kernelWeights[kx] *
+                                   fastExp2(-std::min(exponent, DENOISE_MAX_EXPONENT));
+                    float l = luminance(color[0][q], color[1][q], color[2][q]);
+
+                    sum += weight * l;
+                    squares += weight * l * l;
+                    weightSum += weight;
+                }
+            }
+
+            float mean = sum / weightSum;
+            variance[p] = std::max(0.0f, squares / weightSum - mean * mean);
+        }
+    }
+}
+
+void Denoiser::computeLuminanceScale(const FeatureBuffer& features, const float* variance, float* scale,
+                                     int rowBegin, int rowEnd) const
+{
+    static const float blurWeights[3] = { 0.25f, 0.5f, 0.25f };
+    int width = features.getWidth(), height = features.getHeight(), stride = features.getStride();
+
+    for (int y = rowBegin; y < rowEnd; y++) {
+        for (int x = 0; x < width; x++) {
+            float blurred = 0.0;
+
+            for (int ky = 0; ky < 3; ky++) {
+                size_t row = (size_t) std::min(height - 1, std::max(0, y + ky - 1)) * stride;
+
+                for (int kx = 0; kx < 3; kx++) {
+                    blurred += blurWeights[ky] * blurWeights[kx] * variance[row + std::min(width - 1, std::max(0, x + kx - 1))];
+                }
+            }
+
+            scale[(size_t) y * stride + x] = 1.0f / (luminanceSigma * sqrtf(blurred) + DENOISE_MIN_DEVIATION);
+        }
+    }
+}
+
+void Denoiser::filterRows(const FeatureBuffer& features, const float* const source[4], const float* scale,
+                          float* const destination[4], int step, int rowBegin, int rowEnd) const
+{
+    const float* albedo[3] = { features.getChannel(FEATURE_ALBEDO_R), features.getChannel(FEATURE_ALBEDO_G),
+                               features.getChannel(FEATURE_ALBEDO_B) };
+    const float* normal[3] = { features.getChannel(FEATURE_NORMAL_X), features.getChannel(FEATURE_NORMAL_Y),
+                               features.getChannel(FEATURE_NORMAL_Z) };
+    const float* depth = features.getChannel(FEATURE_DEPTH);
+    int width = features.getWidth(), height = features.getHeight(), stride = features.getStride();
+
+    float inverseNormal = 1.0f / (normalSigma * normalSigma);
+    float inverseAlbedo = 1.0f / (albedoSigma * albedoSigma);
+    float inverseDepth = 1.0f / (depthSigma * step);
+
+    for (int y = rowBegin; y < rowEnd; y++) {
+        size_t rows[5];
+
+        for (int k = 0; k < 5; k++) {
+            rows[k] = (size_t) std::min(height - 1, std::max(0, y + (k - 2) * step)) * stride;
+        }
+
+        size_t center = (size_t) y * stride;
+
+        /* One pixel, taps clamped to the image */
+        auto filterPixel = [&](int x) {
+            size_t p = center + x;
+            float inverseZ = inverseDepth / std::max(depth[p], DENOISE_MIN_DEPTH);
+            float centerLuminance = luminance(source[0][p], source[1][p], source[2][p]);
+            float sum[3] = { 0.0, 0.0, 0.0 }, varianceSum = 0.0, weightSum = 0.0;
+
+            for (int ky = 0; ky < 5; ky++) {
+                for (int kx = 0; kx < 5; kx++) {
+                    size_t q = rows[ky] + std::min(width - 1, std::max(0, x + (kx - 2) * step));
+                    float normalDistance = 0.0, albedoDistance = 0.0;
+
+                    for (int c = 0; c < 3; c++) {
+                        float dn = normal[c][q] - normal[c][p];
+                        float da = albedo[c][q] - albedo[c][p];
+                        normalDistance += dn * dn;
+                        albedoDistance += da * da;
+                    }
+
+                    float luminanceDistance = fabsf(luminance(source[0][q], source[1][q], source[2][q]) - centerLuminance);
+                    float exponent = luminanceDistance * scale[p] + normalDistance * inverseNormal +
+                                     albedoDistance * inverseAlbedo + fabsf(depth[q] - depth[p]) * inverseZ;
+                    float weight = kernelWeights[ky] * kernelWeights[kx] *
+                                   fastExp2(-std::min(exponent, DENOISE_MAX_EXPONENT));
+
+                    for (int c = 0; c < 3; c++) {
+                        sum[c] += weight * source[c][q];
+                    }
+
+                    varianceSum += weight * weight * source[3][q];
+                    weightSum += weight;
+                }
+            }
+
+            for (int c = 0; c < 3; c++) {
+                destination[c][p] = sum[c] / weightSum;
+            }
+
+            destination[3][p] = varianceSum / (weightSum * weightSum);
+        };
+
+        int x = 0;
+
+        for (; x < std::min(width, 2 * step); x++) {
+            filterPixel(x);
+        }
+
+#if defined(__SSE2__)
+        /* Four pixels whose taps are all inside the row */
+        __m128 inverseNormal4 = _mm_set1_ps(inverseNormal), inverseAlbedo4 = _mm_set1_ps(inverseAlbedo);
+        __m128 maxExponent = _mm_set1_ps(DENOISE_MAX_EXPONENT);
+        __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        __m128 lumaR = _mm_set1_ps(0.2126f), lumaG = _mm_set1_ps(0.7152f), lumaB = _mm_set1_ps(0.0722f);
+
+        for (; x + 3 + 2 * step < width; x += 4) {
+            size_t p = center + x;
+            __m128 centerNormal[3], centerAlbedo[3], sum[3];
+            __m128 centerDepth = _mm_loadu_ps(depth + p), centerScale = _mm_loadu_ps(scale + p);
+            __m128 inverseZ = _mm_div_ps(_mm_set1_ps(inverseDepth), _mm_max_ps(centerDepth, _mm_set1_ps(DENOISE_MIN_DEPTH)));
+            __m128 centerLuminance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lumaR, _mm_loadu_ps(source[0] + p)),
+                                                           _mm_mul_ps(lumaG, _mm_loadu_ps(source[1] + p))),
+                                                _mm_mul_ps(lumaB, _mm_loadu_ps(source[2] + p)));
+            __m128 varianceSum = _mm_setzero_ps(), weightSum = _mm_setzero_ps();
+
+            for (int c = 0; c < 3; c++) {
+                centerNormal[c] = _mm_loadu_ps(normal[c] + p);
+                centerAlbedo[c] = _mm_loadu_ps(albedo[c] + p);
+                sum[c] = _mm_setzero_ps();
+            }
+
+            for (int ky = 0; ky < 5; ky++) {
+                for (int kx = 0; kx < 5; kx++) {
+                    size_t q = rows[ky] + x + (kx - 2) * step;
+                    __m128 normalDistance = _mm_setzero_ps(), albedoDistance = _mm_setzero_ps(), tapColor[3];
+
+                    for (int c = 0; c < 3; c++) {
+                        tapColor[c] = _mm_loadu_ps(source[c] + q);
+                        __m128 dn = _mm_sub_ps(_mm_loadu_ps(normal[c] + q), centerNormal[c]);
+                        __m128 da = _mm_sub_ps(_mm_loadu_ps(albedo[c] + q), centerAlbedo[c]);
+                        normalDistance = _mm_add_ps(normalDistance, _mm_mul_ps(dn, dn));
+                        albedoDistance = _mm_add_ps(albedoDistance, _mm_mul_ps(da, da));
+                    }
+
+                    __m128 tapLuminance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lumaR, tapColor[0]), _mm_mul_ps(lumaG, tapColor[1])),
+                                                     _mm_mul_ps(lumaB, tapColor[2]));
+                    __m128 luminanceDistance = _mm_and_ps(_mm_sub_ps(tapLuminance, centerLuminance), signMask);
+                    __m128 depthDistance = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(depth + q), centerDepth), signMask);
+                    __m128 exponent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(luminanceDistance, centerScale),
+                                                            _mm_mul_ps(normalDistance, inverseNormal4)),
+                                                 _mm_add_ps(_mm_mul_ps(albedoDistance, inverseAlbedo4),
+                                                            _mm_mul_ps(depthDistance, inverseZ)));
+                    exponent = _mm_min_ps(exponent, maxExponent);
+
+                    __m128 weight = _mm_mul_ps(_mm_set1_ps(kernelWeights[ky] * kernelWeights[kx]),
+                                               fastExp2x4(_mm_sub_ps(_mm_setzero_ps(), exponent)));
+
+                    for (int c = 0; c < 3; c++) {
+                        sum[c] = _mm_add_ps(sum[c], _mm_mul_ps(weight, tapColor[c]));
+                    }
+
+                    varianceSum = _mm_add_ps(varianceSum, _mm_mul_ps(_mm_mul_ps(weight, weight), _mm_loadu_ps(source[3] + q)));
+                    weightSum = _mm_add_ps(weightSum, weight);
+                }
+            }
+
+            for (int c = 0; c < 3; c++) {
+                _mm_storeu_ps(destination[c] + p, _mm_div_ps(sum[c], weightSum));
+            }
+
+            _mm_storeu_ps(destination[3] + p, _mm_div_ps(varianceSum, _mm_mul_ps(weightSum, weightSum)));
+        }
+#endif
+
+        for (; x < width; x++) {
+            filterPixel(x);
+        }
+    }
+}
@@ -0,0 +1,86 @@
+/************************************************************************************************
+ File: Denoiser.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____Denoiser__
+#define __Ray_Tracer__C_____Denoiser__
+
+#include <stdio.h>
+#include <vector>
+#include "FrameBuffer.h"
+#include "FeatureBuffer.h"
+
+#define DENOISE_ITERATIONS 5        /* Filter passes; the footprint doubles with each */
+#define DENOISE_LUMINANCE_SIGMA 2.0 /* Default edge-stopping scales, see Denoiser */
+#define DENOISE_NORMAL_SIGMA 0.3
+#define DENOISE_DEPTH_SIGMA 0.05
+#define DENOISE_ALBEDO_SIGMA 0.1
+
+/************************************************************************************************
+ Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010), guided by variance as in SVGF
+ (Schied et al. 2017), run over a rendered image with the feature buffer the renderer filled in.
+ Each pass blurs with a 5 x 5 B3-spline kernel whose taps are spread 2^pass pixels apart, so a few
+ passes cover a wide footprint at 25 taps a pixel. Every tap is weighted down by how much it
+ differs from the center pixel:
+
+    w = kernel * 2^-( |luminance difference| / (luminanceSigma * standard deviation)
+                     + |normal difference|^2 / normalSigma^2 + |albedo difference|^2 / albedoSigma^2
+                     + relative depth difference / depthSigma )
+
+ so noise within a surface is smoothed while silhouettes, creases and texture edges are kept. The
+ luminance term compares against the pixel's own noise level: where the samples agreed, as in
+ converged or fully lit regions, even small differences are edges; where they scattered, as in
+ sampled penumbrae, the filter smooths across them. The noise level starts from the renderer's
+ per-pixel variance, or from the variance among similar neighbors at one sample per pixel, and
+ shrinks with every pass as the filter averages it away. The depth difference is relative to the
+ center's depth and to the tap distance, so slanted surfaces are not cut into bands.
+
+ Rows are split between threads and each row is filtered four pixels at a time with SSE, the border
+ columns one at a time
+************************************************************************************************/
+class Denoiser {
+public:
+    Denoiser();
+    Denoiser(const Denoiser& denoiser);
+
+    void setIterations(int count) { iterations = (count < 0) ? 0 : count; }
+    void setThreadCount(int count) { threadCount = (count < 1) ? 1 : count; }
+    void setLuminanceSigma(float sigma) { luminanceSigma = sigma; }
+    void setNormalSigma(float sigma) { normalSigma = sigma; }
+    void setDepthSigma(float sigma) { depthSigma = sigma; }
+    void setAlbedoSigma(float sigma) { albedoSigma = sigma; }
+    int getIterations() const { return iterations; }
+    int getThreadCount() const { return threadCount; }
+    float getLuminanceSigma() const { return luminanceSigma; }
+    float getNormalSigma() const { return normalSigma; }
+    float getDepthSigma() const { return depthSigma; }
+    float getAlbedoSigma() const { return albedoSigma; }
+
+    /* Filters 'input' into 'output', which may be the same framebuffer. 'features' must have been
+     rendered with 'input' */
+    void denoise(const FrameBuffer& input, const FeatureBuffer& features, FrameBuffer& output);
+
+private:
+    /* Variance of the luminance among the feature-similar neighbors of each pixel in rows [rowBegin, rowEnd) */
+    void estimateVariance(const FeatureBuffer& features, const float* const color[3], float* variance,
+                          int rowBegin, int rowEnd) const;
+
+    /* 1 / (luminanceSigma * standard deviation) per pixel, from the variance blurred over 3 x 3 */
+    void computeLuminanceScale(const FeatureBuffer& features, const float* variance, float* scale,
+                               int rowBegin, int rowEnd) const;
+
+    /* One pass over rows [rowBegin, rowEnd): color and variance planes of getStride() floats a row, from
+     'source' to 'destination' */
+    void filterRows(const FeatureBuffer& features, const float* const source[4], const float* scale,
+                    float* const destination[4], int step, int rowBegin, int rowEnd) const;
+
+    int iterations;
+    int threadCount;
+    float luminanceSigma, normalSigma, depthSigma, albedoSigma;
+};
+
+#endif /* defined(__Ray_Tracer__C_____Denoiser__) */
@@ -0,0 +1,206 @@
+/************************************************************************************************
+ File: EmbeddedRenderer.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "EmbeddedRenderer.h"
+
+static Point recordPoint(const float* values)
+{
+    return Point(values[0], values[1], values[2]);
+}
+
+static Color recordColor(const float* values)
+{
+    return Color(values[0], values[1], values[2]);
+}
+
+static bool materialsInRange(const uint32_t* indices, size_t stride, uint32_t count, uint32_t materialCount)
+{
+    const unsigned char* record = (const unsigned char*) indices;
+
+    for (uint32_t i = 0; i < count; i++, record += stride) {
+        if (*(const uint32_t*) record >= materialCount) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/* Embedded Scene */
+EmbeddedScene::EmbeddedScene(Color ambientIntensity)
+    : scene(ambientIntensity)
+{
+}
+
+/* The block is reserved to its final size before any surface goes in, so the pointers handed to the
+    scene stay valid for the life of the block */
+bool EmbeddedScene::addSpheres(const rt_sphere* spheres, uint32_t count, const rt_material* materials,
+                               uint32_t materialCount)
+{
+    if (count == 0) {
+        return true;
+    }
+
+    if (!materialsInRange(&spheres[0].material, sizeof(rt_sphere), count, materialCount)) {
+        return false;
+    }
+
+    sphereBlocks.push_back(std::vector<Sphere>());
+    std::vector<Sphere>& block = sphereBlocks.back();
+    block.reserve(count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        const rt_material& material = materials[spheres[i].material];
+
+        block.push_back(Sphere(recordPoint(spheres[i].center), spheres[i].radius, recordColor(material.ambient),
+                               recordColor(material.diffuse), recordColor(material.specular), material.reflectivity));
+        block.back().setSpecularExponent(material.specular_exponent);
+        scene.addSphere(&block.back());
+    }
+
+    return true;
+}
+
+bool EmbeddedScene::addPlanes(const rt_plane* planes, uint32_t count, const rt_material* materials,
+                              uint32_t materialCount)
+{
+    if (count == 0) {
+        return true;
+    }
+
+    if (!materialsInRange(&planes[0].material, sizeof(rt_plane), count, materialCount)) {
+        return false;
+    }
+
+    planeBlocks.push_back(std::vector<InfinitePlane>());
+    std::vector<InfinitePlane>& block = planeBlocks.back();
+    block.reserve(count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        const rt_material& material = materials[planes[i].material];
+        Point point = recordPoint(planes[i].point);
+        Point tip(point.getX() + planes[i].normal[0], point.getY() + planes[i].normal[1],
+                  point.getZ() + planes[i].normal[2]);
+
+        block.push_back(InfinitePlane(point, Ray(point, tip), recordColor(material.ambient),
+                                      recordColor(material.diffuse), recordColor(material.specular),
+                                      material.reflectivity));
+        block.back().setSpecularExponent(material.specular_exponent);
+        scene.addInfinitePlane(&block.back());
+    }
+
+    return true;
+}
+
+bool EmbeddedScene::addLights(const rt_light* lights, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        if (lights[i].shape > RT_LIGHT_SPHERE) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        Point position = recordPoint(lights[i].position);
+        Color intensity = recordColor(lights[i].intensity);
+
+        switch (lights[i].shape) {
+            case RT_LIGHT_RECTANGLE:
+                scene.addLight(Light::rectangle(position, recordPoint(lights[i].u_axis),
+                                                recordPoint(lights[i].v_axis), intensity));
+                break;
+            case RT_LIGHT_DISK:
+                scene.addLight(Light::disk(position, recordPoint(lights[i].u_axis), lights[i].radius, intensity));
+                break;
+            case RT_LIGHT_SPHERE:
+                scene.addLight(Light::sphere(position, lights[i].radius, intensity));
+                break;
+            default:
+                scene.addLight(Light(position, intensity));
+                break;
+        }
+    }
+
+    return true;
+}
+
+/* Two renders starting on the same scene at once both get here; only the first builds */
+const Scene* EmbeddedScene::prepare(int threadCount)
+{
+    std::lock_guard<std::mutex> lock(prepareMutex);
+
+    if (!scene.getAccelerator()) {
+        scene.buildAccelerator(ACCELERATOR_AUTO, threadCount);
+    }
+
+    return &scene;
+}
+
+
+/* Render Session */
+RenderSession::RenderSession(const Scene* scene, const Camera& camera)
+    : renderer(scene, camera)
+{
+    framebuffer = NULL;
+    finishedTiles = 0;
+    done = completed = false;
+    tileCount = 0;
+}
+
+RenderSession::~RenderSession()
+{
+    cancel();
+    wait();
+}
+
+bool RenderSession::start(FrameBuffer* target)
+{
+    if (worker.joinable()) {
+        return false;
+    }
+
+    if (target->getWidth() != renderer.getCamera().getWidth() ||
+        target->getHeight() != renderer.getCamera().getHeight()) {
+        return false;
+    }
+
+    framebuffer = target;
+    tileCount = target->getTileCountX() * target->getTileCountY();
+    finishedTiles = 0;
+    done = completed = false;
+
+    /* Called from the render threads as tiles complete; the count is all the caller polls */
+    renderer.setTileCallback([this](int) { finishedTiles++; });
+
+    worker = std::thread([this]() {
+        renderer.render(*framebuffer);
+        completed = !renderer.isCancelled();
+        done = true;
+    });
+
+    return true;
+}
+
+float RenderSession::getProgress() const
+{
+    if (tileCount == 0) {
+        return 0.0;
+    }
+
+    return (float) finishedTiles / tileCount;
+}
+
+bool RenderSession::wait()
+{
+    if (worker.joinable()) {
+        worker.join();
+    }
+
+    return completed;
+}
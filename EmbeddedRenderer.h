@@ -0,0 +1,89 @@
+/************************************************************************************************
+ File: EmbeddedRenderer.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____EmbeddedRenderer__
+#define __Ray_Tracer__C_____EmbeddedRenderer__
+
+#include <stdio.h>
+#include <list>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include "RayTracerAPI.h"
+#include "Scene.h"
+#include "Renderer.h"
+#include "FrameBuffer.h"
+
+/* A scene that owns its surfaces, for applications embedding the renderer. Surfaces are added in
+    bulk from the caller's record arrays (the C records of RayTracerAPI.h, which C++ callers use too)
+    and built straight into one block per call, so a million spheres are one allocation rather than a
+    million. Nothing in it is global, so any number of scenes can coexist */
+class EmbeddedScene {
+public:
+    EmbeddedScene(Color ambientIntensity);
+
+    /* Both fail, adding nothing, if a record names a material past 'materialCount' */
+    bool addSpheres(const rt_sphere* spheres, uint32_t count, const rt_material* materials, uint32_t materialCount);
+    bool addPlanes(const rt_plane* planes, uint32_t count, const rt_material* materials, uint32_t materialCount);
+
+    /* Fails, adding nothing, on an unknown shape */
+    bool addLights(const rt_light* lights, uint32_t count);
+
+    /* Builds the accelerator if surfaces were added since it was last built, and returns the scene ready
+     to render. Must not run while a render of this scene is running */
+    const Scene* prepare(int threadCount);
+
+    const Scene& getScene() const { return scene; }
+
+private:
+    EmbeddedScene(const EmbeddedScene& scene);     /* Not copyable, the scene points into its blocks */
+
+    Scene scene;
+    std::list<std::vector<Sphere> > sphereBlocks;
+    std::list<std::vector<InfinitePlane> > planeBlocks;
+    std::mutex prepareMutex;
+};
+
+/* One render running on background threads into a framebuffer, typically one wrapping the caller's
+    memory, that can be polled for progress and cancelled. The renderer is configured through
+    getRenderer() before start(); every session has its own, so sessions never share state beyond the
+    scene they read */
+class RenderSession {
+public:
+    RenderSession(const Scene* scene, const Camera& camera);
+    ~RenderSession();   /* Cancels and waits */
+
+    Renderer& getRenderer() { return renderer; }
+
+    /* Starts rendering into 'target', which must stay alive until wait() returns. Returns false if a
+     render is already running or the target does not match the camera's size */
+    bool start(FrameBuffer* target);
+
+    /* Fraction of the tiles finished */
+    float getProgress() const;
+    bool isDone() const { return done; }
+
+    void cancel() { renderer.cancel(); }
+
+    /* Blocks until the render has stopped; true if it completed */
+    bool wait();
+
+private:
+    RenderSession(const RenderSession& session);
+
+    Renderer renderer;
+    FrameBuffer* framebuffer;
+    std::thread worker;
+    std::atomic<int> finishedTiles;
+    std::atomic<bool> done;
+    std::atomic<bool> completed;    /* Finished without being cancelled */
+    int tileCount;
+};
+
+#endif /* defined(__Ray_Tracer__C_____EmbeddedRenderer__) */
@@ -0,0 +1,294 @@
+/************************************************************************************************
+ File: EnvironmentMap.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "EnvironmentMap.h"
+#include <string.h>
+#include <cmath>
+#include <thread>
+#include <algorithm>
+#include <functional>
+
+EnvironmentMap::EnvironmentMap()
+{
+    width = height = 0;
+    intensity = 1.0;
+    importanceSampling = true;
+    totalWeight = 0.0;
+}
+
+bool EnvironmentMap::loadPFM(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    char magic[3] = { 0, 0, 0 };
+    int fileWidth, fileHeight;
+    float scale;
+
+    if (file == NULL) {
+        return false;
+    }
+
+    bool ok = fscanf(file, "%2s %d %d %f", magic, &fileWidth, &fileHeight, &scale) == 4 && strcmp(magic, "PF") == 0 &&
+              fileWidth > 0 && fileHeight > 0 && scale != 0.0f;
+    std::vector<float> raster;
+
+    if (ok) {
+        fgetc(file);    /* The single whitespace character before the raster */
+        raster.resize((size_t) fileWidth * fileHeight * 3);
+        ok = fread(&raster[0], sizeof(float), raster.size(), file) == raster.size();
+    }
+
+    fclose(file);
+
+    if (!ok) {
+        return false;
+    }
+
+    /* A negative scale marks little-endian data */
+    uint16_t probe = 1;
+    bool littleEndianHost = *(unsigned char*) &probe == 1;
+
+    if ((scale < 0.0f) != littleEndianHost) {
+        for (size_t i = 0; i < raster.size(); i++) {
+            unsigned char* bytes = (unsigned char*) &raster[i];
+            std::swap(bytes[0], bytes[3]);
+            std::swap(bytes[1], bytes[2]);
+        }
+    }
+
+    width = fileWidth;
+    height = fileHeight;
+    texels.resize(raster.size());
+
+    for (int y = 0; y < height; y++) {
+        memcpy(&texels[(size_t) y * width * 3], &raster[(size_t) (height - 1 - y) * width * 3], width * 3 * sizeof(float));
+    }
+
+    for (size_t i = 0; i < texels.size(); i++) {
+        texels[i] = std::isfinite(texels[i]) ? std::max(texels[i], 0.0f) : 0.0f;
+    }
+
+    return true;
+}
+
+/* Sky from a blue zenith to a pale horizon, ground a dull brown, and a sun disk on top */
+void EnvironmentMap::makeSky(int _width, const float sunDirection[3], float sunRadius, Color sunRadiance)
+{
+    float length = sqrtf( (sunDirection[0] * sunDirection[0]) + (sunDirection[1] * sunDirection[1]) +
+                          (sunDirection[2] * sunDirection[2]) );
+    float sun[3] = { sunDirection[0] / length, sunDirection[1] / length, sunDirection[2] / length };
+    float cosSun = cosf(sunRadius);
+    const float zenith[3] = { 0.15f, 0.3f, 0.8f }, horizon[3] = { 0.7f, 0.8f, 0.95f }, ground[3] = { 0.12f, 0.1f, 0.08f };
+
+    width = std::max(_width, 2);
+    height = width / 2;
+    texels.resize((size_t) width * height * 3);
+
+    for (int y = 0; y < height; y++) {
+        float theta = (float) M_PI * (y + 0.5f) / height;
+
+        for (int x = 0; x < width; x++) {
+            float phi = 2.0f * (float) M_PI * ((x + 0.5f) / width - 0.5f);
+            float direction[3] = { sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi) };
+            float* texel = &texels[((size_t) y * width + x) * 3];
+            float elevation = direction[1];
+            float blend = powf(fmaxf(elevation, 0.0f), 0.5f);
+
+            for (int c = 0; c < 3; c++) {
+                texel[c] = (elevation < 0.0f) ? ground[c] : horizon[c] + (zenith[c] - horizon[c]) * blend;
+            }
+
+            if ((direction[0] * sun[0]) + (direction[1] * sun[1]) + (direction[2] * sun[2]) >= cosSun) {
+                texel[0] = sunRadiance.getR();
+                texel[1] = sunRadiance.getG();
+                texel[2] = sunRadiance.getB();
+            }
+        }
+    }
+}
+
+/* Luminance times the solid angle of the texel's row */
+float EnvironmentMap::getWeight(int x, int y) const
+{
+    const float* texel = getTexel(x, y);
+    float luminance = (0.2126f * texel[0]) + (0.7152f * texel[1]) + (0.0722f * texel[2]);
+
+    return luminance * sinf((float) M_PI * (y + 0.5f) / height);
+}
+
+/* Vose's method: entries below the mean weight are topped up by one above it, which becomes their
+    alias, until every entry holds exactly the mean */
+bool EnvironmentMap::buildAliasTable(const float* weights, int count, AliasEntry* table)
+{
+    double total = 0.0;
+
+    for (int i = 0; i < count; i++) {
+        total += weights[i];
+    }
+
+    if (total <= 0.0) {
+        for (int i = 0; i < count; i++) {
+            table[i].probability = 1.0f;
+            table[i].alias = i;
+        }
+        return false;
+    }
+
+    std::vector<double> scaled(count);
+    std::vector<int> small, large;
+
+    for (int i = 0; i < count; i++) {
+        scaled[i] = weights[i] * count / total;
+        (scaled[i] < 1.0) ? small.push_back(i) : large.push_back(i);
+    }
+
+    while (!small.empty() && !large.empty()) {
+        int low = small.back(), high = large.back();
+        small.pop_back();
+
+        table[low].probability = (float) scaled[low];
+        table[low].alias = high;
+        scaled[high] -= 1.0 - scaled[low];
+
+        if (scaled[high] < 1.0) {
+            large.pop_back();
+            small.push_back(high);
+        }
+    }
+
+    /* What is left holds the mean up to rounding */
+    for (int i = 0; i < small.size(); i++) {
+        table[small[i]].probability = 1.0f;
+        table[small[i]].alias = small[i];
+    }
+
+    for (int i = 0; i < large.size(); i++) {
+        table[large[i]].probability = 1.0f;
+        table[large[i]].alias = large[i];
+    }
+
+    return true;
+}
+
+int EnvironmentMap::sampleAliasTable(const AliasEntry* table, int count, float& u)
+{
+    float scaled = u * count;
+    int entry = std::min((int) scaled, count - 1);
+    float rest = scaled - entry;
+    const AliasEntry& candidate = table[entry];
+
+    if (rest < candidate.probability) {
+        u = rest / candidate.probability;
+        return entry;
+    }
+
+    u = (rest - candidate.probability) / (1.0f - candidate.probability);
+    return candidate.alias;
+}
+
+void EnvironmentMap::build(int threadCount)
+{
+    rowWeights.assign(height, 0.0f);
+    rowTable.resize(height);
+    texelTables.resize((size_t) width * height);
+
+    /* Every row's table on its own; contiguous chunks of rows per thread */
+    std::function<void(int, int)> buildRows = [this](int begin, int end) {
+        std::vector<float> weights(width);
+
+        for (int y = begin; y < end; y++) {
+            double total = 0.0;
+
+            for (int x = 0; x < width; x++) {
+                weights[x] = getWeight(x, y);
+                total += weights[x];
+            }
+
+            rowWeights[y] = (float) total;
+            buildAliasTable(&weights[0], width, &texelTables[(size_t) y * width]);
+        }
+    };
+
+    int chunks = std::max(1, std::min(threadCount, height));
+    std::vector<std::thread> workers;
+
+    for (int i = 1; i < chunks; i++) {
+        workers.push_back( std::thread(buildRows, (int) ((int64_t) height * i / chunks),
+                                       (int) ((int64_t) height * (i + 1) / chunks)) );
+    }
+
+    buildRows(0, height / chunks);
+
+    for (int i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+
+    totalWeight = 0.0;
+
+    for (int y = 0; y < height; y++) {
+        totalWeight += rowWeights[y];
+    }
+
+    buildAliasTable(&rowWeights[0], height, &rowTable[0]);
+}
+
+Color EnvironmentMap::lookup(const float direction[3]) const
+{
+    if (width == 0) {
+        return Color(0.0, 0.0, 0.0);
+    }
+
+    float u = 0.5f + atan2f(direction[2], direction[0]) / (2.0f * (float) M_PI);
+    float v = acosf(fminf(fmaxf(direction[1], -1.0f), 1.0f)) / (float) M_PI;
+    int x = std::min((int) (u * width), width - 1);
+    int y = std::min((int) (v * height), height - 1);
+    const float* texel = getTexel(std::max(x, 0), std::max(y, 0));
+
+    return Color(texel[0] * intensity, texel[1] * intensity, texel[2] * intensity);
+}
+
+/* A texel is drawn with probability weight / total and a point uniformly within it in (u, v), a
+    density of weight / total * width * height per unit of u and v; one unit of u and v covers
+    2 pi^2 sin(theta) steradians, hence the pdf */
+Color EnvironmentMap::sample(float s, float t, float direction[3], float& pdf) const
+{
+    if (!importanceSampling || totalWeight <= 0.0) {
+        float y = 1.0f - (2.0f * s), ring = sqrtf(fmaxf(0.0f, 1.0f - y * y)), phi = 2.0f * (float) M_PI * t;
+
+        direction[0] = ring * cosf(phi);
+        direction[1] = y;
+        direction[2] = ring * sinf(phi);
+        pdf = 1.0f / (4.0f * (float) M_PI);
+
+        return lookup(direction);
+    }
+
+    int y = sampleAliasTable(&rowTable[0], height, s);
+    int x = sampleAliasTable(&texelTables[(size_t) y * width], width, t);
+    float theta = (float) M_PI * (y + s) / height;
+    float phi = 2.0f * (float) M_PI * ((x + t) / width - 0.5f);
+    float sine = sinf(theta);
+
+    direction[0] = sine * cosf(phi);
+    direction[1] = cosf(theta);
+    direction[2] = sine * sinf(phi);
+
+    if (sine <= 0.0f) {
+        pdf = 0.0f;
+        return Color(0.0, 0.0, 0.0);
+    }
+
+    pdf = (float) (getWeight(x, y) / totalWeight * width * height / (2.0 * M_PI * M_PI * sine));
+
+    const float* texel = getTexel(x, y);
+    return Color(texel[0] * intensity, texel[1] * intensity, texel[2] * intensity);
+}
+
+size_t EnvironmentMap::getTableBytes() const
+{
+    return (rowTable.size() + texelTables.size()) * sizeof(AliasEntry) + rowWeights.size() * sizeof(float);
+}
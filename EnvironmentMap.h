@@ -0,0 +1,96 @@
+/************************************************************************************************
+ File: EnvironmentMap.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____EnvironmentMap__
+#define __Ray_Tracer__C_____EnvironmentMap__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "Color.h"
+
+#define ENVIRONMENT_SAMPLES 16      /* Default environment samples per camera ray hit; deeper hits take one */
+
+/************************************************************************************************
+ HDR radiance arriving from infinitely far away in every direction, stored as a latitude-longitude
+ image: u = 0.5 + atan2(z, x) / 2 pi across, v = acos(y) / pi down, like Sphere's texture coordinates.
+ Rays that miss the scene see it, and shading gathers its light with shadow rays in place of the
+ flat ambient term.
+
+ A few bright texels, a sun or a window, carry most of the light of a typical map, so directions
+ are drawn in proportion to the light instead of uniformly. build() turns the luminance of every
+ texel, times the sine of its latitude for the area it covers on the sphere, into a two-level alias
+ table: one table over the rows and one within every row, each giving a texel in O(1) from one
+ random number. The row tables are independent, so they are built on several threads. Sampling
+ costs the same for any map, and the table takes 8 bytes a texel
+************************************************************************************************/
+
+class EnvironmentMap {
+public:
+    EnvironmentMap();
+
+    /* Reads a little- or big-endian color PFM (portable float map), rows stored bottom to top.
+     Returns false if the file cannot be read */
+    bool loadPFM(const char* path);
+
+    /* A clear sky over a dark ground with a sun of 'sunRadius' radians towards 'sunDirection', for
+     scenes without a map file. 'width' x 'width / 2' texels */
+    void makeSky(int width, const float sunDirection[3], float sunRadius, Color sunRadiance);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    /* Scales the radiance of the map */
+    void setIntensity(float newIntensity) { intensity = newIntensity; }
+    float getIntensity() const { return intensity; }
+
+    /* Draw directions in proportion to the map's light (the default), or uniformly over the sphere */
+    void setImportanceSampling(bool enabled) { importanceSampling = enabled; }
+    bool isImportanceSampling() const { return importanceSampling; }
+
+    /* Builds the alias tables on 'threadCount' threads. Must run after the image changes and before
+     sample() is used with importance sampling */
+    void build(int threadCount);
+
+    /* Radiance arriving from the unit vector 'direction' */
+    Color lookup(const float direction[3]) const;
+
+    /* Draws a unit 'direction' from (s, t) in [0, 1)^2 and returns the radiance from it, with 'pdf'
+     set to the probability density of the direction per steradian */
+    Color sample(float s, float t, float direction[3], float& pdf) const;
+
+    /* Bytes of the sampling tables */
+    size_t getTableBytes() const;
+
+private:
+    struct AliasEntry {
+        float probability;      /* Of keeping this entry rather than taking its alias */
+        uint32_t alias;
+    };
+
+    /* Fills 'table' for 'weights' with Vose's method; false if they are all zero */
+    static bool buildAliasTable(const float* weights, int count, AliasEntry* table);
+
+    /* Entry of 'table' for the uniform 'u', whose leftover precision is returned in 'u' */
+    static int sampleAliasTable(const AliasEntry* table, int count, float& u);
+
+    const float* getTexel(int x, int y) const { return &texels[((size_t) y * width + x) * 3]; }
+    float getWeight(int x, int y) const;
+
+    int width, height;
+    std::vector<float> texels;          /* RGB, row by row from the top (v = 0) */
+    float intensity;
+    bool importanceSampling;
+
+    std::vector<AliasEntry> rowTable;   /* Over the rows, by their total weight */
+    std::vector<AliasEntry> texelTables;    /* Within each row, 'width' entries per row */
+    std::vector<float> rowWeights;      /* Total weight of every row */
+    double totalWeight;                 /* 0 for a black map, which is sampled uniformly */
+};
+
+#endif /* defined(__Ray_Tracer__C_____EnvironmentMap__) */
@@ -0,0 +1,11 @@
+/************************************************************************************************
+ File: FastMath.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "FastMath.h"
+
+bool useFastMath = false;
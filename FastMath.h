@@ -0,0 +1,135 @@
+/************************************************************************************************
+ File: FastMath.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____FastMath__
+#define __Ray_Tracer__C_____FastMath__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <cmath>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/************************************************************************************************
+ Approximate math for the intersection and shading hot path. Every function is branch-free
+ straight-line code on floats so the compiler can keep it in registers and vectorize loops over it.
+ The exact library calls stay the default; --fast-math switches the hot path over at run time.
+
+ Error bounds, measured by --benchmark fast-math:
+   fastReciprocalSqrt   relative error below 2e-7 with SSE (rsqrtss and one Newton step), below
+                        5e-6 elsewhere (bit estimate and two Newton steps)
+   fastPow(x, y)        for 0 < x <= 1 and 1 <= y <= 128: relative error below 2.5e-6 * y,
+                        from the log2 polynomial (absolute error 2.5e-6) scaled by y
+************************************************************************************************/
+
+/* Whether the hot path uses the approximations. Set once before rendering */
+extern bool useFastMath;
+
+inline void setFastMath(bool enabled) { useFastMath = enabled; }
+inline bool isFastMath() { return useFastMath; }
+
+/* a * b + c, fused into one rounding where the target has an FMA instruction */
+inline float multiplyAdd(float a, float b, float c) {
+#if defined(__FP_FAST_FMAF)
+    return fmaf(a, b, c);
+#else
+    return (a * b) + c;
+#endif
+}
+
+inline float fastReciprocalSqrt(float x) {
+#if defined(__SSE__)
+    float estimate = _mm_cvtss_f32( _mm_rsqrt_ss( _mm_set_ss(x) ) );
+    return estimate * (1.5f - 0.5f * x * estimate * estimate);
+#else
+    uint32_t bits;
+    float estimate;
+
+    memcpy(&bits, &x, sizeof(bits));
+    bits = 0x5f375a86 - (bits >> 1);
+    memcpy(&estimate, &bits, sizeof(estimate));
+
+    estimate *= 1.5f - 0.5f * x * estimate * estimate;
+    return estimate * (1.5f - 0.5f * x * estimate * estimate);
+#endif
+}
+
+/* 1 / sqrt(x), exact unless fast math is on */
+inline float reciprocalSqrt(float x) {
+    return useFastMath ? fastReciprocalSqrt(x) : 1.0f / sqrtf(x);
+}
+
+/* log2(x) for normal, positive x: exponent plus a degree 6 fit of log2(1 + t) on the mantissa */
+inline float fastLog2(float x) {
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+
+    float exponent = (float) ((int) (bits >> 23) - 127);
+    bits = (bits & 0x007fffff) | 0x3f800000;
+
+    float t;
+    memcpy(&t, &bits, sizeof(t));
+    t -= 1.0f;
+
+    /* Estrin's scheme: three short chains instead of one long Horner chain */
+    float t2 = t * t;
+    float high = multiplyAdd(multiplyAdd(-0.025792329f, t, 0.12147290f), t2, multiplyAdd(-0.27734159f, t, 0.45715809f));
+    float low = multiplyAdd(-0.71803358f, t, 1.44253478f);
+
+    return multiplyAdd(multiplyAdd(high, t2, low), t, exponent);
+}
+
+/* 2^x for x < 128, flushed to zero below -126: integer part into the exponent, degree 5 fit of 2^f on the fraction */
+inline float fastExp2(float x) {
+    int whole = (int) x;
+    whole -= (x < (float) whole);   /* floor without the library call */
+    float f = x - (float) whole;
+
+    float f2 = f * f;
+    float p = multiplyAdd(multiplyAdd(multiplyAdd(0.0018854038f, f, 0.0089728993f), f2,
+                                      multiplyAdd(0.055836598f, f, 0.24015244f)), f2,
+                          multiplyAdd(0.69315254f, f, 1.0f));
+
+    /* Below 2^-126 the mask zeroes the result, without a data-dependent branch */
+    uint32_t bits = ((uint32_t) (whole + 127) << 23) & -(uint32_t) (whole > -127);
+    float scale;
+    memcpy(&scale, &bits, sizeof(scale));
+
+    return p * scale;
+}
+
+#if defined(__SSE2__)
+/* fastExp2 on four floats at once, bit-identical to it lane by lane when fastExp2 does not fuse */
+inline __m128 fastExp2x4(__m128 x) {
+    __m128i whole = _mm_cvttps_epi32(x);
+    whole = _mm_add_epi32(whole, _mm_castps_si128( _mm_cmplt_ps(x, _mm_cvtepi32_ps(whole)) ));    /* -1 if truncation rounded up */
+    __m128 f = _mm_sub_ps(x, _mm_cvtepi32_ps(whole));
+
+    __m128 f2 = _mm_mul_ps(f, f);
+    __m128 high = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.0018854038f), f), _mm_set1_ps(0.0089728993f)), f2),
+                             _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.055836598f), f), _mm_set1_ps(0.24015244f)));
+    __m128 p = _mm_add_ps(_mm_mul_ps(high, f2), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.69315254f), f), _mm_set1_ps(1.0f)));
+
+    __m128i bits = _mm_and_si128( _mm_slli_epi32(_mm_add_epi32(whole, _mm_set1_epi32(127)), 23),
+                                  _mm_cmpgt_epi32(whole, _mm_set1_epi32(-127)) );
+
+    return _mm_mul_ps(p, _mm_castsi128_ps(bits));
+}
+#endif
+
+/* x^y for x > 0. Results below 2^-126 flush to zero */
+inline float fastPow(float x, float y) {
+    return fastExp2(y * fastLog2(x));
+}
+
+#endif /* defined(__Ray_Tracer__C_____FastMath__) */
@@ -0,0 +1,56 @@
+/************************************************************************************************
+ File: FeatureBuffer.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "FeatureBuffer.h"
+#include <stdint.h>
+#include <string.h>
+
+FeatureBuffer::FeatureBuffer()
+{
+    resize(0, 0);
+}
+
+FeatureBuffer::FeatureBuffer(int _width, int _height)
+{
+    resize(_width, _height);
+}
+
+void FeatureBuffer::resize(int _width, int _height)
+{
+    size_t floatsPerLine = CACHE_LINE_SIZE / sizeof(float);
+
+    width = _width;
+    height = _height;
+    stride = ((width + TILE_SIZE - 1) / TILE_SIZE) * TILE_SIZE;
+    planeSize = (size_t) stride * height;
+    planeSize = ((planeSize + floatsPerLine - 1) / floatsPerLine) * floatsPerLine;
+
+    storage.assign(planeSize * FEATURE_CHANNEL_COUNT + floatsPerLine, 0.0f);
+
+    uintptr_t address = (uintptr_t) &storage[0];
+    planes = &storage[0] + ((CACHE_LINE_SIZE - address % CACHE_LINE_SIZE) % CACHE_LINE_SIZE) / sizeof(float);
+}
+
+void FeatureBuffer::clear()
+{
+    memset(planes, 0, planeSize * FEATURE_CHANNEL_COUNT * sizeof(float));
+}
+
+void FeatureBuffer::setPixel(int x, int y, const Color& albedo, const float normal[3], float depth, float variance)
+{
+    float* pixel = planes + (size_t) y * stride + x;
+
+    pixel[FEATURE_ALBEDO_R * planeSize] = albedo.getR();
+    pixel[FEATURE_ALBEDO_G * planeSize] = albedo.getG();
+    pixel[FEATURE_ALBEDO_B * planeSize] = albedo.getB();
+    pixel[FEATURE_NORMAL_X * planeSize] = normal[0];
+    pixel[FEATURE_NORMAL_Y * planeSize] = normal[1];
+    pixel[FEATURE_NORMAL_Z * planeSize] = normal[2];
+    pixel[FEATURE_DEPTH * planeSize] = depth;
+    pixel[FEATURE_VARIANCE * planeSize] = variance;
+}
@@ -0,0 +1,56 @@
+/************************************************************************************************
+ File: FeatureBuffer.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____FeatureBuffer__
+#define __Ray_Tracer__C_____FeatureBuffer__
+
+#include <stdio.h>
+#include <vector>
+#include "Color.h"
+#include "FrameBuffer.h"
+
+enum FeatureChannel { FEATURE_ALBEDO_R, FEATURE_ALBEDO_G, FEATURE_ALBEDO_B, FEATURE_NORMAL_X, FEATURE_NORMAL_Y,
+                      FEATURE_NORMAL_Z, FEATURE_DEPTH, FEATURE_VARIANCE, FEATURE_CHANNEL_COUNT };
+
+/* What the camera rays of each pixel first hit, next to the color: the diffuse albedo (texture
+    included), the unit surface normal and the distance along the ray, averaged over the pixel's
+    samples. Pixels whose rays miss everything keep zeros, and since hits are at a distance of 1 or
+    more a depth of 0 tells them apart. The variance is that of the pixel's luminance, the mean of its
+    samples, estimated from their spread; it is -1 where a pixel has a single sample.
+    Each channel is a separate scanline plane so filters can stream over it with SIMD loads. Rows are
+    padded to whole tiles and start on cache lines, so a row of a tile is exactly one cache line and
+    threads writing different tiles never share one */
+class FeatureBuffer {
+public:
+    FeatureBuffer();
+    FeatureBuffer(int _width, int _height);
+
+    /* Discards the current contents */
+    void resize(int _width, int _height);
+    void clear();
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getStride() const { return stride; }   /* Floats from one row of a channel to the next */
+
+    float* getChannel(FeatureChannel channel) { return planes + channel * planeSize; }
+    const float* getChannel(FeatureChannel channel) const { return planes + channel * planeSize; }
+
+    void setPixel(int x, int y, const Color& albedo, const float normal[3], float depth, float variance);
+
+private:
+    FeatureBuffer(const FeatureBuffer& buffer);
+    FeatureBuffer& operator=(const FeatureBuffer& buffer);
+
+    int width, height, stride;
+    size_t planeSize;           /* Floats per channel, a multiple of a cache line */
+    std::vector<float> storage;
+    float* planes;              /* Cache-line-aligned view into 'storage' */
+};
+
+#endif /* defined(__Ray_Tracer__C_____FeatureBuffer__) */
@@ -0,0 +1,318 @@
+/************************************************************************************************
+ File: FrameBuffer.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "FrameBuffer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "CompactFormats.h"
+
+bool parsePixelFormat(const char* name, PixelFormat& format)
+{
+    for (int f = 0; f < PIXEL_FORMAT_COUNT; f++) {
+        if (strcmp(name, getPixelFormatName((PixelFormat) f)) == 0) {
+            format = (PixelFormat) f;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char* getPixelFormatName(PixelFormat format)
+{
+    const char* names[] = { "float", "float4", "half", "rgb9e5", "rgba8" };
+
+    return names[format];
+}
+
+FrameBuffer::FrameBuffer()
+{
+    pixels = NULL;
+    allocation = NULL;
+    resize(0, 0);
+}
+
+FrameBuffer::FrameBuffer(const FrameBuffer& framebuffer)
+{
+    pixels = NULL;
+    allocation = NULL;
+    *this = framebuffer;
+}
+
+FrameBuffer::FrameBuffer(int _width, int _height, PixelFormat _format)
+{
+    pixels = NULL;
+    allocation = NULL;
+    resize(_width, _height, _format);
+}
+
+FrameBuffer::FrameBuffer(void* memory, int _width, int _height, size_t _rowBytes, PixelFormat _format)
+{
+    pixels = NULL;
+    allocation = NULL;
+    resize(0, 0, _format);
+
+    width = _width;
+    height = _height;
+    tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    rowBytes = _rowBytes;
+    pixels = (unsigned char*) memory;
+}
+
+FrameBuffer::~FrameBuffer()
+{
+    release();
+}
+
+FrameBuffer& FrameBuffer::operator=(const FrameBuffer& framebuffer)
+{
+    if (this == &framebuffer) {
+        return *this;
+    }
+
+    resize(framebuffer.getWidth(), framebuffer.getHeight(), framebuffer.getFormat());
+
+    if (!framebuffer.isWrapping()) {
+        memcpy(pixels, framebuffer.pixels, tilesX * tilesY * tileStride);
+        return *this;
+    }
+
+    /* Row by row out of the caller's memory; pixels are contiguous along a row within a tile either way */
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x += TILE_SIZE) {
+            int count = (x + TILE_SIZE > width) ? width - x : TILE_SIZE;
+            memcpy(pixelAddress(x, y), framebuffer.pixelAddress(x, y), count * pixelBytes);
+        }
+    }
+
+    return *this;
+}
+
+void FrameBuffer::resize(int _width, int _height, PixelFormat _format)
+{
+    const int formatBytes[] = { 3 * sizeof(float), 4 * sizeof(float), 4 * sizeof(uint16_t), sizeof(uint32_t), 4 };
+
+    release();
+
+    width = _width;
+    height = _height;
+    format = _format;
+    pixelBytes = formatBytes[format];
+    rowBytes = 0;
+    tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+    /* Round each tile block up to whole cache lines so no two tiles share one */
+    tileStride = TILE_SIZE * TILE_SIZE * pixelBytes;
+    tileStride = ((tileStride + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE) * CACHE_LINE_SIZE;
+
+    allocate();
+    clear();
+}
+
+void FrameBuffer::clear()
+{
+    if (rowBytes == 0) {
+        memset(pixels, 0, tilesX * tilesY * tileStride);
+        return;
+    }
+
+    for (int y = 0; y < height; y++) {
+        memset(pixels + y * rowBytes, 0, (size_t) width * pixelBytes);
+    }
+}
+
+void FrameBuffer::setPixel(int x, int y, const Color& color)
+{
+    unsigned char* pixel = pixelAddress(x, y);
+    float rgb[3] = { color.getR(), color.getG(), color.getB() };
+
+    for (int i = 0; i < 3; i++) {
+        if (rgb[i] <= 1.0) {
+            rgb[i] = (rgb[i] >= 0.0) ? rgb[i] : 0.0;
+        } else {
+            rgb[i] = 1.0;
+        }
+    }
+
+    switch (format) {
+        case PIXEL_RGB_FLOAT:
+            memcpy(pixel, rgb, sizeof(rgb));
+            break;
+        case PIXEL_RGBA_FLOAT: {
+            float rgba[4] = { rgb[0], rgb[1], rgb[2], 1.0f };
+            memcpy(pixel, rgba, sizeof(rgba));
+            break;
+        }
+        case PIXEL_RGBA_HALF: {
+            uint16_t halves[4] = { floatToHalf(rgb[0]), floatToHalf(rgb[1]), floatToHalf(rgb[2]), 0x3C00 };    /* 1.0 */
+            memcpy(pixel, halves, sizeof(halves));
+            break;
+        }
+        case PIXEL_RGB9E5: {
+            uint32_t packed = encodeRGB9E5(rgb[0], rgb[1], rgb[2]);
+            memcpy(pixel, &packed, sizeof(packed));
+            break;
+        }
+        case PIXEL_RGBA8:
+            for (int i = 0; i < 3; i++) {
+                pixel[i] = (unsigned char) (rgb[i] * 255.0 + 0.5);
+            }
+
+            pixel[3] = 255;
+            break;
+        default:
+            break;
+    }
+}
+
+Color FrameBuffer::getPixel(int x, int y) const
+{
+    const unsigned char* pixel = pixelAddress(x, y);
+    float rgb[3];
+
+    switch (format) {
+        case PIXEL_RGB_FLOAT:
+        case PIXEL_RGBA_FLOAT:
+            memcpy(rgb, pixel, sizeof(rgb));
+            break;
+        case PIXEL_RGBA_HALF:
+            halfRGBAToRGBRow((const uint16_t*) pixel, rgb, 1);
+            break;
+        case PIXEL_RGB9E5:
+            decodeRGB9E5Row((const uint32_t*) pixel, rgb, 1);
+            break;
+        default:
+            for (int i = 0; i < 3; i++) {
+                rgb[i] = pixel[i] / 255.0f;
+            }
+            break;
+    }
+
+    return Color(rgb[0], rgb[1], rgb[2]);
+}
+
+void FrameBuffer::toScanlines(std::vector<float>& output, bool bottomUp) const
+{
+    output.resize((size_t) width * height * 3);
+
+    for (int tileY = 0; tileY < tilesY; tileY++) {
+        for (int tileX = 0; tileX < tilesX; tileX++) {
+            int x0 = tileX * TILE_SIZE;
+            int y0 = tileY * TILE_SIZE;
+            int x1 = (x0 + TILE_SIZE > width) ? width : x0 + TILE_SIZE;
+            int y1 = (y0 + TILE_SIZE > height) ? height : y0 + TILE_SIZE;
+
+            for (int y = y0; y < y1; y++) {
+                const unsigned char* source = pixelAddress(x0, y);
+                int row = bottomUp ? (height - 1 - y) : y;
+                float* destination = &output[((size_t) row * width + x0) * 3];
+
+                if (format == PIXEL_RGBA_HALF) {
+                    halfRGBAToRGBRow((const uint16_t*) source, destination, x1 - x0);
+                } else if (format == PIXEL_RGB9E5) {
+                    decodeRGB9E5Row((const uint32_t*) source, destination, x1 - x0);
+                } else if (format == PIXEL_RGBA8) {
+                    for (int i = 0; i < 4 * (x1 - x0); i += 4) {
+                        for (int c = 0; c < 3; c++) {
+                            *destination++ = source[i + c] / 255.0f;
+                        }
+                    }
+                } else {
+                    int channels = pixelBytes / sizeof(float);
+
+                    for (int x = x0; x < x1; x++) {
+                        memcpy(destination, source, 3 * sizeof(float));
+                        destination += 3;
+                        source += channels * sizeof(float);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void FrameBuffer::encodePPM(std::vector<unsigned char>& output) const
+{
+    char header[64];
+    int headerLength = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+    std::vector<float> scanlines;
+
+    toScanlines(scanlines, false);
+    output.insert(output.end(), header, header + headerLength);
+
+    for (size_t i = 0; i < scanlines.size(); i++) {
+        output.push_back((unsigned char) (scanlines[i] * 255.0 + 0.5));
+    }
+}
+
+bool FrameBuffer::writePPM(const char* path) const
+{
+    std::vector<unsigned char> encoded;
+    FILE* file = fopen(path, "wb");
+
+    if (file == NULL) {
+        return false;
+    }
+
+    encodePPM(encoded);
+    bool ok = fwrite(&encoded[0], 1, encoded.size(), file) == encoded.size();
+
+    return (fclose(file) == 0) && ok;
+}
+
+uint64_t FrameBuffer::getHash() const
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            Color color = getPixel(x, y);
+            float rgb[3] = { color.getR(), color.getG(), color.getB() };
+            const unsigned char* bytes = (const unsigned char*) rgb;
+
+            for (int i = 0; i < sizeof(rgb); i++) {
+                hash ^= bytes[i];
+                hash *= 1099511628211ULL;
+            }
+        }
+    }
+
+    return hash;
+}
+
+unsigned char* FrameBuffer::pixelAddress(int x, int y) const
+{
+    if (rowBytes != 0) {
+        return pixels + y * rowBytes + x * pixelBytes;
+    }
+
+    unsigned char* tile = pixels + (((y / TILE_SIZE) * tilesX) + (x / TILE_SIZE)) * tileStride;
+
+    return tile + (((y % TILE_SIZE) * TILE_SIZE) + (x % TILE_SIZE)) * pixelBytes;
+}
+
+void FrameBuffer::allocate()
+{
+    size_t bytes = tilesX * tilesY * tileStride;
+
+    /* Over-allocate by a cache line and align by hand so this works without posix_memalign */
+    allocation = malloc(bytes + CACHE_LINE_SIZE);
+    uintptr_t address = (uintptr_t) allocation;
+    address = (address + CACHE_LINE_SIZE - 1) & ~((uintptr_t) CACHE_LINE_SIZE - 1);
+    pixels = (unsigned char*) address;
+}
+
+void FrameBuffer::release()
+{
+    free(allocation);   /* NULL when wrapping caller memory */
+    allocation = NULL;
+    pixels = NULL;
+}
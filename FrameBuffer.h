@@ -0,0 +1,99 @@
+/************************************************************************************************
+ File: FrameBuffer.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____FrameBuffer__
+#define __Ray_Tracer__C_____FrameBuffer__
+
+#include <stdio.h>
+#include <vector>
+#include <stdint.h>
+#include "Color.h"
+#include "Camera.h"
+
+#define CACHE_LINE_SIZE 64
+
+/* How pixels are stored: RGB or RGBA floats (12 or 16 bytes), RGBA halves (8 bytes), shared-exponent
+    RGB9E5 (4 bytes, see CompactFormats.h) or RGBA bytes rounded like the PPM output. Every RGBA format
+    stores an opaque alpha (1.0, or 255 in bytes). Colors are clamped to [0, 1] before they are stored,
+    where halves and RGB9E5 are within 2^-12 and 2^-10 of the float, below the step of the 8-bit output */
+enum PixelFormat { PIXEL_RGB_FLOAT, PIXEL_RGBA_FLOAT, PIXEL_RGBA_HALF, PIXEL_RGB9E5, PIXEL_RGBA8, PIXEL_FORMAT_COUNT };
+
+/* Parses "float", "float4", "half", "rgb9e5" or "rgba8"; returns false for anything else */
+bool parsePixelFormat(const char* name, PixelFormat& format);
+const char* getPixelFormatName(PixelFormat format);
+
+/* Pixels are stored tile-major: the image is cut into TILE_SIZE x TILE_SIZE tiles (the same grid the
+    camera hands out) and every tile is one contiguous, cache-line-aligned block. A thread that owns a
+    tile therefore never shares a cache line with another thread and can write it back without locks.
+    Scanline order only exists in the output produced by toScanlines(). Compact formats are encoded in
+    setPixel(), once per pixel after all its samples, and decoded a tile row at a time with SIMD by
+    toScanlines(); the renderer itself only ever sees floats.
+    A framebuffer can instead wrap scanline memory the caller owns, 'rowBytes' apart, so an embedding
+    application receives the render in its own buffer without a copy. Such a framebuffer has no tiles,
+    and threads writing neighboring tiles may share the cache lines where their rows meet. */
+class FrameBuffer {
+public:
+    FrameBuffer();
+    FrameBuffer(const FrameBuffer& framebuffer);
+    FrameBuffer(int _width, int _height, PixelFormat _format = PIXEL_RGB_FLOAT);
+    FrameBuffer(void* memory, int _width, int _height, size_t _rowBytes, PixelFormat _format);
+    ~FrameBuffer();
+
+    FrameBuffer& operator=(const FrameBuffer& framebuffer);
+
+    /* Discards the current contents. A framebuffer wrapping caller memory lets go of it and allocates
+     its own, as it does when assigned to */
+    void resize(int _width, int _height, PixelFormat _format = PIXEL_RGB_FLOAT);
+    void clear();
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    PixelFormat getFormat() const { return format; }
+    int getPixelBytes() const { return pixelBytes; }
+    size_t getMemoryBytes() const { return (rowBytes != 0) ? rowBytes * height : tilesX * tilesY * tileStride; }
+    bool isWrapping() const { return rowBytes != 0; }
+    int getTileCountX() const { return tilesX; }
+    int getTileCountY() const { return tilesY; }
+
+    /* Returns the block of tile (tileX, tileY): TILE_SIZE rows of TILE_SIZE pixels of getPixelBytes() bytes.
+     Only for framebuffers that own their memory */
+    unsigned char* getTile(int tileX, int tileY) { return pixels + ((tileY * tilesX) + tileX) * tileStride; }
+    const unsigned char* getTile(int tileX, int tileY) const { return pixels + ((tileY * tilesX) + tileX) * tileStride; }
+
+    /* (0, 0) is the upper-left pixel; colors are clamped to [0, 1] */
+    void setPixel(int x, int y, const Color& color);
+    Color getPixel(int x, int y) const;
+
+    /* Writes the image as packed RGB floats in scanline order. 'bottomUp' starts with the last row, which
+     is what glDrawPixels expects */
+    void toScanlines(std::vector<float>& output, bool bottomUp) const;
+
+    /* Appends the image as a binary (P6) PPM */
+    void encodePPM(std::vector<unsigned char>& output) const;
+    bool writePPM(const char* path) const;
+
+    /* 64-bit FNV-1a hash of the RGB values in scanline order, independent of tile layout and padding */
+    uint64_t getHash() const;
+
+private:
+    unsigned char* pixelAddress(int x, int y) const;
+    void allocate();
+    void release();
+
+    int width, height;
+    PixelFormat format;
+    int pixelBytes;
+    int tilesX, tilesY;
+    size_t tileStride;      /* Bytes per tile block, always a multiple of a cache line */
+    size_t rowBytes;        /* From one row to the next in wrapped memory; 0 when the pixels are tiled */
+
+    unsigned char* pixels;  /* Cache-line-aligned view into 'allocation' */
+    void* allocation;
+};
+
+#endif /* defined(__Ray_Tracer__C_____FrameBuffer__) */
@@ -0,0 +1,423 @@
+/************************************************************************************************
+ File: Frustum.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "Frustum.h"
+#include <math.h>
+#include <algorithm>
+#include "PagedGeometry.h"
+#include "Traversal.h"
+
+/* Half the diagonal of a box, the radius of the sphere around it */
+static float boxRadius(const float* boxMin, const float* boxMax)
+{
+    float x = boxMax[0] - boxMin[0], y = boxMax[1] - boxMin[1], z = boxMax[2] - boxMin[2];
+    return 0.5f * sqrtf( (x * x) + (y * y) + (z * z) );
+}
+
+/* The four side planes of the pyramid from the eye through the tile's corners, as inward unit normals */
+struct TilePyramid {
+    TilePyramid(const float eye[3], const float corners[4][3]) {
+        float middle[3] = { 0.0, 0.0, 0.0 };
+
+        for (int c = 0; c < 4; c++) {
+            for (int i = 0; i < 3; i++) {
+                origin[i] = eye[i];
+                middle[i] += corners[c][i];
+            }
+        }
+
+        for (int c = 0; c < 4; c++) {
+            const float* a = corners[c];
+            const float* b = corners[(c + 1) % 4];
+            float* n = normals[c];
+
+            n[0] = (a[1] * b[2]) - (a[2] * b[1]);
+            n[1] = (a[2] * b[0]) - (a[0] * b[2]);
+            n[2] = (a[0] * b[1]) - (a[1] * b[0]);
+
+            float length = sqrtf( (n[0] * n[0]) + (n[1] * n[1]) + (n[2] * n[2]) );
+            float side = ( (n[0] * middle[0]) + (n[1] * middle[1]) + (n[2] * middle[2]) ) < 0.0f ? -1.0f : 1.0f;
+
+            for (int i = 0; i < 3; i++) {
+                n[i] *= side / length;
+            }
+        }
+    }
+
+    /* False only if the box lies wholly outside a side plane, by more than rounding could account for */
+    bool overlaps(const float* boxMin, const float* boxMax) const {
+        float scale = 1.0f;
+
+        for (int i = 0; i < 3; i++) {
+            scale = std::max(scale, std::max(fabsf(boxMin[i] - origin[i]), fabsf(boxMax[i] - origin[i])));
+        }
+
+        for (int c = 0; c < 4; c++) {
+            const float* n = normals[c];
+            float reach = 0.0;
+
+            for (int i = 0; i < 3; i++) {
+                reach += n[i] * (((n[i] > 0.0f) ? boxMax[i] : boxMin[i]) - origin[i]);
+            }
+
+            if (reach < -1e-4f * scale) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    float origin[3];
+    float normals[4][3];
+};
+
+/* Every shadow segment from a point of the light's sphere to a point of the sphere around the hits
+    lies within the spheres swept along the axis between them, their radius growing linearly from
+    one end to the other. That round cone is the light-to-tile frustum */
+struct ShadowVolume {
+    ShadowVolume(const float* lightCenter, float lightRadius, const float* hitCenter, float hitRadius) {
+        float axis[3];
+
+        for (int i = 0; i < 3; i++) {
+            start[i] = lightCenter[i];
+            axis[i] = hitCenter[i] - lightCenter[i];
+        }
+
+        length = sqrtf( (axis[0] * axis[0]) + (axis[1] * axis[1]) + (axis[2] * axis[2]) );
+        startRadius = lightRadius;
+        endRadius = hitRadius;
+
+        /* One sphere inside the other: the hull is the larger sphere */
+        degenerate = length <= fabsf(hitRadius - lightRadius);
+
+        if (degenerate) {
+            if (hitRadius > lightRadius) {
+                for (int i = 0; i < 3; i++) {
+                    start[i] = hitCenter[i];
+                }
+            }
+            startRadius = std::max(lightRadius, hitRadius);
+            return;
+        }
+
+        for (int i = 0; i < 3; i++) {
+            direction[i] = axis[i] / length;
+        }
+
+        slope = (hitRadius - lightRadius) / length;
+        tangentShift = slope / sqrtf(1.0f - slope * slope);
+    }
+
+    /* Whether the sphere ('center', 'radius') can meet the volume: the distance to the volume is convex
+     along the axis, so its minimum is at the stationary point clamped to the segment */
+    bool touches(const float* center, float radius) const {
+        float offset[3] = { center[0] - start[0], center[1] - start[1], center[2] - start[2] };
+        float distanceSquared = (offset[0] * offset[0]) + (offset[1] * offset[1]) + (offset[2] * offset[2]);
+        float margin = 1e-4f * (1.0f + length + sqrtf(distanceSquared));
+
+        if (degenerate) {
+            return sqrtf(distanceSquared) - startRadius <= radius + margin;
+        }
+
+        float along = (offset[0] * direction[0]) + (offset[1] * direction[1]) + (offset[2] * direction[2]);
+        float across = sqrtf(std::max(0.0f, distanceSquared - along * along));
+        float t = std::min(length, std::max(0.0f, along + tangentShift * across));
+        float gap = sqrtf( (across * across) + (along - t) * (along - t) ) - (startRadius + slope * t);
+
+        return gap <= radius + margin;
+    }
+
+    float start[3], direction[3];
+    float length, startRadius, endRadius, slope, tangentShift;
+    bool degenerate;
+};
+
+
+/* Frustum Culler */
+FrustumCuller::FrustumCuller()
+{
+    testsEverySurface = true;
+    streamed = false;
+}
+
+/* Clusters follow the Morton order of the surfaces' centers, so each holds surfaces close together */
+void FrustumCuller::build(const Scene& scene)
+{
+    std::shared_ptr<const Accelerator> accelerator = scene.getAccelerator();
+    std::vector<Light> lights = scene.getLights();
+    std::vector<uint32_t> bounded;
+    float low[3] = { INFINITY, INFINITY, INFINITY }, high[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+    surfaces = scene.getSurfaces();
+    bounds.assign(surfaces.size() * 6, 0.0);
+    unbounded.clear();
+    members.clear();
+    clusters.clear();
+    testsEverySurface = !accelerator || accelerator->getType() == ACCELERATOR_BRUTE_FORCE;
+    streamed = scene.getPagedGeometry() != NULL;
+
+    for (uint32_t s = 0; s < surfaces.size(); s++) {
+        float* box = &bounds[s * 6];
+
+        if (!surfaces[s]->getBounds(box, box + 3)) {
+            unbounded.push_back(s);
+            continue;
+        }
+
+        bounded.push_back(s);
+
+        for (int i = 0; i < 3; i++) {
+            float center = 0.5f * (box[i] + box[i + 3]);
+            low[i] = std::min(low[i], center);
+            high[i] = std::max(high[i], center);
+        }
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t> > order;     /* Morton code, surface */
+
+    for (int n = 0; n < bounded.size(); n++) {
+        const float* box = &bounds[bounded[n] * 6];
+        float center[3];
+
+        for (int i = 0; i < 3; i++) {
+            center[i] = 0.5f * (box[i] + box[i + 3]);
+        }
+
+        order.push_back( std::make_pair(mortonKey(center, low, high), bounded[n]) );
+    }
+
+    std::sort(order.begin(), order.end());
+
+    for (int n = 0; n < order.size(); n++) {
+        members.push_back(order[n].second);
+    }
+
+    for (uint32_t first = 0; first < members.size(); first += FRUSTUM_CLUSTER_SIZE) {
+        Cluster cluster;
+        cluster.first = first;
+        cluster.count = std::min((uint32_t) FRUSTUM_CLUSTER_SIZE, (uint32_t) members.size() - first);
+
+        for (int i = 0; i < 3; i++) {
+            cluster.boundsMin[i] = INFINITY;
+            cluster.boundsMax[i] = -INFINITY;
+        }
+
+        for (uint32_t m = first; m < first + cluster.count; m++) {
+            const float* box = &bounds[members[m] * 6];
+
+            for (int i = 0; i < 3; i++) {
+                cluster.boundsMin[i] = std::min(cluster.boundsMin[i], box[i]);
+                cluster.boundsMax[i] = std::max(cluster.boundsMax[i], box[i + 3]);
+            }
+        }
+
+        clusters.push_back(cluster);
+    }
+
+    /* Area light samples stay within these spheres; see Light::samplePosition() */
+    lightBounds.clear();
+
+    for (int l = 0; l < lights.size(); l++) {
+        Point position = lights[l].getPosition(), u = lights[l].getUAxis(), v = lights[l].getVAxis();
+        float radius = 0.0;
+
+        switch (lights[l].getShape()) {
+            case Light::RECTANGLE:
+                radius = 0.5f * (sqrtf( (u.getX() * u.getX()) + (u.getY() * u.getY()) + (u.getZ() * u.getZ()) ) +
+                                 sqrtf( (v.getX() * v.getX()) + (v.getY() * v.getY()) + (v.getZ() * v.getZ()) ));
+                break;
+            case Light::DISK:
+            case Light::SPHERE:
+                radius = lights[l].getRadius();
+                break;
+            default:
+                break;
+        }
+
+        lightBounds.push_back(position.getX());
+        lightBounds.push_back(position.getY());
+        lightBounds.push_back(position.getZ());
+        lightBounds.push_back(radius * 1.001f);
+    }
+}
+
+/* Bounded surfaces can only be hit inside their bounds. The part of a plane in the pyramid is the
+    quadrilateral between the corner rays' hits, provided all four hit it in front of the eye */
+bool FrustumCuller::getHitBounds(const float eye[3], const float corners[4][3], const std::vector<uint32_t>& kept,
+                                 float hitMin[3], float hitMax[3]) const
+{
+    for (int i = 0; i < 3; i++) {
+        hitMin[i] = INFINITY;
+        hitMax[i] = -INFINITY;
+    }
+
+    for (int n = 0; n < kept.size(); n++) {
+        const float* box = &bounds[kept[n] * 6];
+        Surface* surface = surfaces[kept[n]];
+
+        if (!std::binary_search(unbounded.begin(), unbounded.end(), kept[n])) {
+            for (int i = 0; i < 3; i++) {
+                hitMin[i] = std::min(hitMin[i], box[i]);
+                hitMax[i] = std::max(hitMax[i], box[i + 3]);
+            }
+            continue;
+        }
+
+        if (surface->getSurfaceType() != Surface::INFINITE_PLANE) {
+            return false;
+        }
+
+        InfinitePlane* plane = (InfinitePlane*) surface;
+        std::vector<float> normal = plane->getNormal().normalize();
+        Point point = plane->getPoint();
+        float offset = (normal[0] * (point.getX() - eye[0])) + (normal[1] * (point.getY() - eye[1])) +
+                       (normal[2] * (point.getZ() - eye[2]));
+
+        for (int c = 0; c < 4; c++) {
+            float facing = (normal[0] * corners[c][0]) + (normal[1] * corners[c][1]) + (normal[2] * corners[c][2]);
+            float t = (facing != 0.0f) ? offset / facing : -1.0f;
+
+            if (t <= 0.0f || !(t < INFINITY)) {
+                return false;
+            }
+
+            for (int i = 0; i < 3; i++) {
+                hitMin[i] = std::min(hitMin[i], eye[i] + t * corners[c][i]);
+                hitMax[i] = std::max(hitMax[i], eye[i] + t * corners[c][i]);
+            }
+        }
+    }
+
+    return true;
+}
+
+void FrustumCuller::cull(const Point& eye, const float corners[4][3], TileCandidates& candidates,
+                         FrustumStats& stats) const
+{
+    float origin[3] = { eye.getX(), eye.getY(), eye.getZ() };
+    TilePyramid pyramid(origin, corners);
+    std::vector<uint32_t>& kept = candidates.indices;
+    int lightCount = (int) lightBounds.size() / 4;
+
+    /* A list that grows past the limit is given up at once, and the tile's shadow rays with it */
+    size_t limit = testsEverySurface ? surfaces.size() : FRUSTUM_MAX_CANDIDATES;
+
+    candidates.primaryCulled = false;
+    candidates.shadowCulled.assign(lightCount, 0);
+    candidates.shadow.resize(lightCount);
+    stats.tiles++;
+    stats.surfaces += surfaces.size();
+    stats.shadowLists += lightCount;
+
+    kept.assign(unbounded.begin(), unbounded.end());
+
+    for (int c = 0; c < clusters.size() && kept.size() <= limit; c++) {
+        const Cluster& cluster = clusters[c];
+
+        if (!pyramid.overlaps(cluster.boundsMin, cluster.boundsMax)) {
+            continue;
+        }
+
+        for (uint32_t m = cluster.first; m < cluster.first + cluster.count; m++) {
+            const float* box = &bounds[members[m] * 6];
+
+            if (pyramid.overlaps(box, box + 3)) {
+                kept.push_back(members[m]);
+            }
+        }
+    }
+
+    if (kept.size() > limit) {
+        return;
+    }
+
+    std::sort(kept.begin(), kept.end());
+
+    candidates.primary.clear();
+
+    for (int n = 0; n < kept.size(); n++) {
+        candidates.primary.push_back(surfaces[kept[n]]);
+    }
+
+    candidates.primaryCulled = true;
+    stats.primaryTiles++;
+    stats.primaryKept += kept.size();
+
+    /* Shadow rays, from the lights to the hits */
+    float hitMin[3], hitMax[3];
+
+    if (streamed || !getHitBounds(origin, corners, kept, hitMin, hitMax)) {
+        return;
+    }
+
+    if (kept.empty()) {     /* Nothing to hit, so nothing to shade */
+        candidates.shadowCulled.assign(lightCount, 1);
+
+        for (int l = 0; l < lightCount; l++) {
+            candidates.shadow[l].clear();
+        }
+
+        stats.shadowCulledLists += lightCount;
+        stats.shadowTested += (uint64_t) lightCount * surfaces.size();
+        return;
+    }
+
+    float hitCenter[3];
+    float hitRadius = boxRadius(hitMin, hitMax);
+
+    for (int i = 0; i < 3; i++) {
+        hitCenter[i] = 0.5f * (hitMin[i] + hitMax[i]);
+    }
+
+    hitRadius += 1e-3f * (1.0f + hitRadius);    /* Hit points are offset off their surfaces by rounding */
+
+    for (int l = 0; l < lightCount; l++) {
+        ShadowVolume volume(&lightBounds[l * 4], lightBounds[l * 4 + 3], hitCenter, hitRadius);
+
+        kept.assign(unbounded.begin(), unbounded.end());
+
+        for (int c = 0; c < clusters.size() && kept.size() <= limit; c++) {
+            const Cluster& cluster = clusters[c];
+            float center[3] = { 0.5f * (cluster.boundsMin[0] + cluster.boundsMax[0]),
+                                0.5f * (cluster.boundsMin[1] + cluster.boundsMax[1]),
+                                0.5f * (cluster.boundsMin[2] + cluster.boundsMax[2]) };
+
+            if (!volume.touches(center, boxRadius(cluster.boundsMin, cluster.boundsMax))) {
+                continue;
+            }
+
+            for (uint32_t m = cluster.first; m < cluster.first + cluster.count; m++) {
+                const float* box = &bounds[members[m] * 6];
+                float surfaceCenter[3] = { 0.5f * (box[0] + box[3]), 0.5f * (box[1] + box[4]),
+                                           0.5f * (box[2] + box[5]) };
+
+                if (volume.touches(surfaceCenter, boxRadius(box, box + 3))) {
+                    kept.push_back(members[m]);
+                }
+            }
+        }
+
+        if (kept.size() > limit) {
+            continue;
+        }
+
+        std::sort(kept.begin(), kept.end());
+
+        candidates.shadow[l].clear();
+
+        for (int n = 0; n < kept.size(); n++) {
+            candidates.shadow[l].push_back(surfaces[kept[n]]);
+        }
+
+        candidates.shadowCulled[l] = 1;
+        stats.shadowCulledLists++;
+        stats.shadowTested += surfaces.size();
+        stats.shadowKept += kept.size();
+    }
+}
@@ -0,0 +1,109 @@
+/************************************************************************************************
+ File: Frustum.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____Frustum__
+#define __Ray_Tracer__C_____Frustum__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "Scene.h"
+
+#define FRUSTUM_CLUSTER_SIZE 16     /* Bounded surfaces per cluster, the level culled before the surfaces */
+#define FRUSTUM_MAX_CANDIDATES 24   /* Longer candidate lists lose to the grid; their rays use the scene instead */
+#define FRUSTUM_PIXEL_MARGIN 0.5f   /* Pixels the tile frustum is widened by beyond the jittered samples */
+
+/************************************************************************************************
+ Per-tile culling of the surface list. All camera rays of a tile leave the eye inside the pyramid
+ through the tile's corners, so a surface whose bounds lie outside one of its four side planes can
+ not be hit by any of them. The shadow rays cast from their first hits run from a light to a point
+ in the bounds of the surfaces left in that pyramid, so a surface outside the hull of the light and
+ those bounds cannot block any of them either.
+
+ The survivors stay in scene order, and intersecting them one by one gives exactly what intersecting
+ the whole scene would, ties included, so culling never changes the image. Surfaces without bounds
+ (planes) are never culled. The tile's first hits are only bounded when each plane left in the
+ pyramid is hit by all four corner rays; otherwise, or with streamed geometry, shadow rays are not
+ culled. A list that grows longer than the limit is dropped in favour of the scene's accelerator,
+ unless the scene tests every surface anyway.
+
+ The surfaces are grouped into clusters of nearby surfaces once per render and each tile tests the
+ clusters first, so a tile costs a fraction of a pass over the scene
+************************************************************************************************/
+
+/* Surfaces the rays of one tile can reach, in scene order */
+class TileCandidates {
+public:
+    /* The surfaces to intersect camera rays with, or NULL to use the scene */
+    const std::vector<Surface*>* getPrimary() const { return primaryCulled ? &primary : NULL; }
+
+    /* The surfaces that can block shadow rays from first hits towards 'light', or NULL to use the scene */
+    const std::vector<Surface*>* getShadow(int light) const {
+        return (shadowCulled[light] != 0) ? &shadow[light] : NULL;
+    }
+
+private:
+    friend class FrustumCuller;
+
+    bool primaryCulled;
+    std::vector<Surface*> primary;
+    std::vector<char> shadowCulled;
+    std::vector<std::vector<Surface*> > shadow;
+    std::vector<uint32_t> indices;      /* Scratch */
+};
+
+/* Totals over the tiles culled, for the culling ratios */
+struct FrustumStats {
+    FrustumStats() : tiles(0), primaryTiles(0), surfaces(0), primaryKept(0), shadowLists(0), shadowCulledLists(0),
+                     shadowTested(0), shadowKept(0) {}
+
+    uint64_t tiles;
+    uint64_t primaryTiles;          /* Tiles whose camera rays used their candidates */
+    uint64_t surfaces;              /* Scene surfaces, summed over tiles */
+    uint64_t primaryKept;           /* Candidates, summed over the tiles that used them */
+    uint64_t shadowLists;           /* Tile and light pairs */
+    uint64_t shadowCulledLists;     /* Pairs whose shadow rays used their candidates */
+    uint64_t shadowTested;          /* Scene surfaces, summed over those pairs */
+    uint64_t shadowKept;            /* Candidates, summed over those pairs */
+};
+
+class FrustumCuller {
+public:
+    FrustumCuller();
+
+    /* Clusters the surfaces of 'scene', which must not change until the culler is rebuilt */
+    void build(const Scene& scene);
+
+    /* Fills 'candidates' for the camera rays from 'eye' between the directions 'corners' (see
+     Camera::getTileCorners) and for their shadow rays, and adds the tile to 'stats' */
+    void cull(const Point& eye, const float corners[4][3], TileCandidates& candidates, FrustumStats& stats) const;
+
+private:
+    FrustumCuller(const FrustumCuller& culler);
+
+    struct Cluster {
+        float boundsMin[3], boundsMax[3];
+        uint32_t first, count;      /* Range of 'members' */
+    };
+
+    /* Bounds of the first hits of rays in the pyramid, which can only be on the surfaces 'kept'. False
+     if they are unbounded */
+    bool getHitBounds(const float eye[3], const float corners[4][3], const std::vector<uint32_t>& kept,
+                      float hitMin[3], float hitMax[3]) const;
+
+    std::vector<Surface*> surfaces;
+    std::vector<uint32_t> unbounded;    /* Indices into 'surfaces', ascending */
+    std::vector<uint32_t> members;      /* Bounded surfaces, cluster by cluster */
+    std::vector<float> bounds;          /* Six floats (min xyz, max xyz) per surface */
+    std::vector<Cluster> clusters;
+    std::vector<float> lightBounds;     /* Center and radius of every light's extent */
+    bool testsEverySurface;             /* The scene has no grid, so any candidate list is cheaper */
+    bool streamed;                      /* The scene has paged geometry, whose hits are not bounded here */
+};
+
+#endif /* defined(__Ray_Tracer__C_____Frustum__) */
@@ -7,22 +7,178 @@
 ************************************************************************************************/
 
 #include "Light.h"
+#include <cmath>
+#include <string.h>
 
 Light::Light()
 {
     position = Point();
     rgbIntensity = Color();
+    shape = POINT;
+    radius = 0.0;
 }
 
 Light::Light(const Light& light)
 {
     position = light.getPosition();
     rgbIntensity = light.getRGBIntensity();
+    shape = light.getShape();
+    uAxis = light.getUAxis();
+    vAxis = light.getVAxis();
+    radius = light.getRadius();
 }
 
 Light::Light(Point _position, Color _rgbIntensity)
 {
     position = _position;
     rgbIntensity = _rgbIntensity;
+    shape = POINT;
+    radius = 0.0;
 }
 
+/* Two unit vectors that complete the unit vector 'w' to an orthonormal basis */
+static void getPerpendicularAxes(const float w[3], float u[3], float v[3])
+{
+    float a[3] = { 0.0, 0.0, 0.0 };
+    a[ (fabsf(w[0]) < 0.9f) ? 0 : 1 ] = 1.0;
+
+    u[0] = a[1] * w[2] - a[2] * w[1];
+    u[1] = a[2] * w[0] - a[0] * w[2];
+    u[2] = a[0] * w[1] - a[1] * w[0];
+
+    float inverseLength = 1.0f / sqrtf( (u[0] * u[0]) + (u[1] * u[1]) + (u[2] * u[2]) );
+
+    for (int i = 0; i < 3; i++) {
+        u[i] *= inverseLength;
+    }
+
+    v[0] = w[1] * u[2] - w[2] * u[1];
+    v[1] = w[2] * u[0] - w[0] * u[2];
+    v[2] = w[0] * u[1] - w[1] * u[0];
+}
+
+Light Light::rectangle(Point center, Point edge1, Point edge2, Color intensity)
+{
+    Light light(center, intensity);
+    light.shape = RECTANGLE;
+    light.uAxis = edge1;
+    light.vAxis = edge2;
+
+    return light;
+}
+
+Light Light::disk(Point center, Point normal, float radius, Color intensity)
+{
+    Point unitNormal = normal.normalize();
+    float w[3] = { unitNormal.getX(), unitNormal.getY(), unitNormal.getZ() };
+    float u[3], v[3];
+
+    getPerpendicularAxes(w, u, v);
+
+    Light light(center, intensity);
+    light.shape = DISK;
+    light.radius = radius;
+    light.uAxis = Point(u[0] * radius, u[1] * radius, u[2] * radius);
+    light.vAxis = Point(v[0] * radius, v[1] * radius, v[2] * radius);
+
+    return light;
+}
+
+Light Light::sphere(Point center, float radius, Color intensity)
+{
+    Light light(center, intensity);
+    light.shape = SPHERE;
+    light.radius = radius;
+
+    return light;
+}
+
+/* The frame costs two square roots and a cross product, so the renderer makes it once per receiver
+    rather than once per sample */
+Light::SampleFrame Light::getSampleFrame(const Point& receiver) const
+{
+    SampleFrame frame;
+    memset(&frame, 0, sizeof(frame));
+
+    if (shape != SPHERE) {
+        return frame;
+    }
+
+    float* w = frame.w;
+    w[0] = receiver.getX() - position.getX();
+    w[1] = receiver.getY() - position.getY();
+    w[2] = receiver.getZ() - position.getZ();
+
+    float length = sqrtf( (w[0] * w[0]) + (w[1] * w[1]) + (w[2] * w[2]) );
+
+    if (length == 0.0f) {
+        frame.degenerate = true;
+        return frame;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        w[i] /= length;
+    }
+
+    getPerpendicularAxes(w, frame.u, frame.v);
+
+    return frame;
+}
+
+/* Every mapping is area-preserving and continuous, so strata of the unit square stay strata on the
+    light: the disk uses Shirley and Chiu's concentric map, the sphere's facing half the uniform
+    hemisphere map with s as the height towards the receiver */
+Point Light::samplePosition(float s, float t, const SampleFrame& frame) const
+{
+    float a, b;
+
+    switch (shape) {
+        case RECTANGLE:
+            a = s - 0.5f;
+            b = t - 0.5f;
+            break;
+
+        case DISK: {
+            float x = 2.0f * s - 1.0f, y = 2.0f * t - 1.0f;
+            float r, angle;
+
+            if (x == 0.0f && y == 0.0f) {
+                return position;
+            }
+
+            if (fabsf(x) > fabsf(y)) {
+                r = x;
+                angle = (float) M_PI_4 * (y / x);
+            } else {
+                r = y;
+                angle = (float) M_PI_2 - (float) M_PI_4 * (x / y);
+            }
+
+            a = r * cosf(angle);
+            b = r * sinf(angle);
+            break;
+        }
+
+        case SPHERE: {
+            const float *u = frame.u, *v = frame.v, *w = frame.w;
+
+            if (frame.degenerate) {
+                return position;
+            }
+
+            float height = s, ring = sqrtf(fmaxf(0.0f, 1.0f - height * height)), angle = 2.0f * (float) M_PI * t;
+            float x = ring * cosf(angle), y = ring * sinf(angle);
+
+            return Point( position.getX() + radius * (x * u[0] + y * v[0] + height * w[0]),
+                          position.getY() + radius * (x * u[1] + y * v[1] + height * w[1]),
+                          position.getZ() + radius * (x * u[2] + y * v[2] + height * w[2]) );
+        }
+
+        default:
+            return position;
+    }
+
+    return Point( position.getX() + a * uAxis.getX() + b * vAxis.getX(),
+                  position.getY() + a * uAxis.getY() + b * vAxis.getY(),
+                  position.getZ() + a * uAxis.getZ() + b * vAxis.getZ() );
+}
@@ -13,21 +13,56 @@
 #include "Point.h"
 #include "Color.h"
 
+/* A point light, or an area light whose emitting surface is sampled for soft shadows. Area lights
+    are shaded as if all their light came from 'position', the center of the shape, and only their
+    visibility is integrated over the shape */
 class Light {
 public:
+    enum LightShape { POINT, RECTANGLE, DISK, SPHERE };
     
     Light();
     Light(const Light& light);
     Light(Point _position, Color _rgbIntensity);
     
+    /* Parallelogram centered on 'center' with the two edge vectors 'edge1' and 'edge2' */
+    static Light rectangle(Point center, Point edge1, Point edge2, Color intensity);
+    /* Disk of 'radius' centered on 'center', facing along 'normal' */
+    static Light disk(Point center, Point normal, float radius, Color intensity);
+    static Light sphere(Point center, float radius, Color intensity);
+    
     void setPosition(Point newPosition) { position = newPosition; };
     void setRGBIntensity(Color newRGBIntensity) { rgbIntensity = newRGBIntensity; };
+    void setShape(LightShape newShape) { shape = newShape; }
+    void setAxes(Point newUAxis, Point newVAxis) { uAxis = newUAxis; vAxis = newVAxis; }
+    void setRadius(float newRadius) { radius = newRadius; }
     Point getPosition() const { return position; };
     Color getRGBIntensity() const { return rgbIntensity; };
+    LightShape getShape() const { return shape; }
+    Point getUAxis() const { return uAxis; }
+    Point getVAxis() const { return vAxis; }
+    float getRadius() const { return radius; }
+    bool isAreaLight() const { return shape != POINT; }
+    
+    /* What the samples taken from one receiver share: for sphere lights, the frame of the half facing
+     it, whose 'w' points at the receiver. Unused by the other shapes */
+    struct SampleFrame {
+        float u[3], v[3], w[3];
+        bool degenerate;    /* The receiver is at the center; every sample is the center */
+    };
+
+    SampleFrame getSampleFrame(const Point& receiver) const;
+
+    /* Point on the light for the stratified sample (s, t) in [0, 1)^2. Sphere lights sample the half
+     facing the receiver 'frame' was made for, the rest cannot be seen from it */
+    Point samplePosition(float s, float t, const SampleFrame& frame) const;
+    Point samplePosition(float s, float t, const Point& receiver) const { return samplePosition(s, t, getSampleFrame(receiver)); }
     
 private:
     Point position;
     Color rgbIntensity;
+    LightShape shape;
+    Point uAxis, vAxis;     /* Rectangle edges, or the disk's in-plane axes scaled by its radius */
+    float radius;           /* Disks and spheres */
 };
 
 #endif /* defined(__Ray_Tracer__C_____Light__) */
@@ -0,0 +1,307 @@
+/************************************************************************************************
+ File: Numa.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "Numa.h"
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#endif
+
+static thread_local int currentNode = 0;
+
+/* CPUs the process may run on, ascending */
+static std::vector<int> getAllowedCpus()
+{
+    std::vector<int> cpus;
+
+#if defined(__linux__)
+    cpu_set_t set;
+
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+
+    if (cpus.empty()) {
+        int count = std::max(1, (int) std::thread::hardware_concurrency());
+
+        for (int cpu = 0; cpu < count; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+bool parseCpuList(const char* list, std::vector<int>& cpus)
+{
+    const char* position = list;
+
+    cpus.clear();
+
+    while (*position != '\0' && *position != '\n') {
+        char* end;
+        long first = strtol(position, &end, 10), last;
+
+        if (end == position || first < 0) {
+            return false;
+        }
+
+        last = first;
+        position = end;
+
+        if (*position == '-') {
+            last = strtol(position + 1, &end, 10);
+
+            if (end == position + 1 || last < first) {
+                return false;
+            }
+            position = end;
+        }
+
+        for (long cpu = first; cpu <= last; cpu++) {
+            cpus.push_back((int) cpu);
+        }
+
+        if (*position == ',') {
+            position++;
+        }
+    }
+
+    return true;
+}
+
+
+/* NUMA Topology */
+NumaTopology::NumaTopology()
+{
+    nodeCpus.push_back(getAllowedCpus());
+    nodeIds.push_back(0);
+    simulated = false;
+}
+
+bool NumaTopology::detect()
+{
+#if defined(__linux__)
+    DIR* directory = opendir("/sys/devices/system/node");
+    std::vector<int> ids;
+
+    if (directory == NULL) {
+        return false;
+    }
+
+    for (struct dirent* entry = readdir(directory); entry != NULL; entry = readdir(directory)) {
+        char* end;
+
+        if (strncmp(entry->d_name, "node", 4) == 0) {
+            long id = strtol(entry->d_name + 4, &end, 10);
+
+            if (end != entry->d_name + 4 && *end == '\0') {
+                ids.push_back((int) id);
+            }
+        }
+    }
+
+    closedir(directory);
+    std::sort(ids.begin(), ids.end());
+
+    std::vector<int> allowed = getAllowedCpus();
+    std::vector<std::vector<int> > detectedCpus;
+    std::vector<int> detectedIds;
+
+    for (int i = 0; i < ids.size(); i++) {
+        char path[64], list[4096];
+        std::vector<int> cpus, usable;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", ids[i]);
+        FILE* file = fopen(path, "r");
+
+        if (file == NULL) {
+            continue;
+        }
+
+        bool ok = fgets(list, sizeof(list), file) != NULL && parseCpuList(list, cpus);
+        fclose(file);
+
+        for (int c = 0; ok && c < cpus.size(); c++) {
+            if (std::binary_search(allowed.begin(), allowed.end(), cpus[c])) {
+                usable.push_back(cpus[c]);
+            }
+        }
+
+        /* Memory-only nodes, and nodes the process may not run on, cannot host workers */
+        if (!usable.empty()) {
+            detectedCpus.push_back(usable);
+            detectedIds.push_back(ids[i]);
+        }
+    }
+
+    if (detectedCpus.empty()) {
+        return false;
+    }
+
+    nodeCpus.swap(detectedCpus);
+    nodeIds.swap(detectedIds);
+    simulated = false;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void NumaTopology::simulate(int nodeCount)
+{
+    std::vector<int> cpus;
+
+    for (int n = 0; n < nodeCpus.size(); n++) {
+        cpus.insert(cpus.end(), nodeCpus[n].begin(), nodeCpus[n].end());
+    }
+
+    nodeCount = std::max(1, nodeCount);
+    nodeCpus.assign(nodeCount, std::vector<int>());
+    nodeIds.assign(nodeCount, -1);
+    simulated = true;
+
+    for (int n = 0; n < nodeCount; n++) {
+        if (cpus.size() < nodeCount) {
+            nodeCpus[n].push_back(cpus[n % cpus.size()]);
+            continue;
+        }
+
+        for (size_t c = cpus.size() * n / nodeCount; c < cpus.size() * (n + 1) / nodeCount; c++) {
+            nodeCpus[n].push_back(cpus[c]);
+        }
+    }
+}
+
+int NumaTopology::getCpuCount() const
+{
+    int count = 0;
+
+    for (int n = 0; n < nodeCpus.size(); n++) {
+        count += (int) nodeCpus[n].size();
+    }
+
+    return count;
+}
+
+int NumaTopology::getWorkerNode(int worker, int threadCount) const
+{
+    int position = (int) ((int64_t) worker * getCpuCount() / std::max(1, threadCount));
+
+    for (int n = 0; n < nodeCpus.size(); n++) {
+        if (position < nodeCpus[n].size()) {
+            return n;
+        }
+        position -= (int) nodeCpus[n].size();
+    }
+
+    return (int) nodeCpus.size() - 1;
+}
+
+bool bindThreadToNode(const NumaTopology& topology, int node)
+{
+    currentNode = node;
+
+#if defined(__linux__)
+    const std::vector<int>& cpus = topology.getCpus(node);
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+
+    for (int c = 0; c < cpus.size(); c++) {
+        CPU_SET(cpus[c], &set);
+    }
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+int getCurrentNumaNode()
+{
+    return currentNode;
+}
+
+
+/* Scene Replicas */
+
+/* The clones, lights and accelerator are all allocated and first written by the node's own thread.
+    The accelerator is built on the node's CPUs: threads started here inherit the affinity */
+SceneReplicas::SceneReplicas(const Scene& scene, const NumaTopology& topology)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int nodeCount = topology.getNodeCount();
+    std::shared_ptr<const Accelerator> accelerator = scene.getAccelerator();
+    AcceleratorType type = accelerator ? accelerator->getType() : ACCELERATOR_BRUTE_FORCE;
+    std::vector<std::thread> builders;
+
+    scenes.assign(nodeCount, NULL);
+    cullers.assign(nodeCount, NULL);
+    surfaces.resize(nodeCount);
+
+    for (int n = 0; n < nodeCount; n++) {
+        builders.push_back( std::thread([this, &scene, &topology, type, n]() {
+            bindThreadToNode(topology, n);
+
+            std::vector<Surface*> original = scene.getSurfaces();
+            std::vector<Light> lights = scene.getLights();
+            Scene* replica = new Scene(scene.getAmbientIntensity());
+
+            for (int i = 0; i < lights.size(); i++) {
+                replica->addLight(lights[i]);
+            }
+
+            for (int i = 0; i < original.size(); i++) {
+                surfaces[n].push_back(original[i]->Clone());
+                replica->addSurface(surfaces[n].back());
+            }
+
+            replica->setPagedGeometry(scene.getPagedGeometry());
+            replica->setEnvironment(scene.getEnvironment());
+            replica->buildAccelerator(type, (int) topology.getCpus(n).size());
+
+            FrustumCuller* culler = new FrustumCuller();
+            culler->build(*replica);
+
+            scenes[n] = replica;
+            cullers[n] = culler;
+        }) );
+    }
+
+    for (int n = 0; n < builders.size(); n++) {
+        builders[n].join();
+    }
+
+    buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+SceneReplicas::~SceneReplicas()
+{
+    for (int n = 0; n < scenes.size(); n++) {
+        delete cullers[n];
+        delete scenes[n];
+
+        for (int i = 0; i < surfaces[n].size(); i++) {
+            delete surfaces[n][i];
+        }
+    }
+}
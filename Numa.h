@@ -0,0 +1,103 @@
+/************************************************************************************************
+ File: Numa.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____Numa__
+#define __Ray_Tracer__C_____Numa__
+
+#include <stdio.h>
+#include <vector>
+#include "Scene.h"
+#include "Frustum.h"
+
+/************************************************************************************************
+ Placement of render threads and scene data on NUMA machines, where each socket (node) has its own
+ memory and reaching another node's costs more latency and shares its links with everyone else.
+
+ NumaTopology reads the nodes and their CPUs from /sys/devices/system/node, limited to the CPUs the
+ process may run on. With more than one node, Renderer::parallelFor pins each worker to the CPUs of a
+ node, in proportion to the node's CPUs, and splits the tile sequence into one contiguous range per
+ node: a node's workers take tiles from the front of their own range, which in Morton order is one
+ compact region of the image, and only once it is empty take tiles from the back of other nodes'
+ ranges, away from where their owners are working. On one node none of this happens.
+
+ SceneReplicas copies the surfaces, accelerator and frustum culler of a scene once per node, each
+ copy built by a thread pinned to that node so that the kernel's first-touch policy places its pages
+ in the node's memory. Workers then traverse their own node's copy. The copies are identical to the
+ scene, so the image is too. Paged geometry, textures and the environment map are shared, not copied.
+
+ A topology can also be simulated, splitting the CPUs into any number of nodes, so the scheduling and
+ replication paths run, and can be checked, on single-node machines
+************************************************************************************************/
+
+class NumaTopology {
+public:
+    /* One node with every CPU the process may use */
+    NumaTopology();
+
+    /* Reads the nodes from sysfs; false where there is no NUMA information (not Linux, or a kernel
+     without NUMA support), which leaves the single node. Nodes without usable CPUs are left out */
+    bool detect();
+
+    /* Splits the CPUs of the current topology into 'nodeCount' nodes of consecutive CPUs. With fewer
+     CPUs than nodes, nodes share CPUs */
+    void simulate(int nodeCount);
+
+    int getNodeCount() const { return (int) nodeCpus.size(); }
+    const std::vector<int>& getCpus(int node) const { return nodeCpus[node]; }
+    int getNodeId(int node) const { return nodeIds[node]; }     /* The kernel's number; -1 when simulated */
+    bool isSimulated() const { return simulated; }
+    int getCpuCount() const;
+
+    /* Node of worker 'worker' of 'threadCount': consecutive workers fill the nodes in order, each
+     getting a share of the workers proportional to its CPUs */
+    int getWorkerNode(int worker, int threadCount) const;
+
+private:
+    std::vector<std::vector<int> > nodeCpus;
+    std::vector<int> nodeIds;
+    bool simulated;
+};
+
+/* Parses a sysfs CPU list such as "0-3,8,10-11" into 'cpus'; false if it is malformed */
+bool parseCpuList(const char* list, std::vector<int>& cpus);
+
+/* Restricts the calling thread to the CPUs of 'node' and records the node for getCurrentNumaNode().
+    Returns false where the affinity cannot be set, in which case the node is still recorded */
+bool bindThreadToNode(const NumaTopology& topology, int node);
+
+/* The node the calling thread was last bound to; 0 for threads never bound */
+int getCurrentNumaNode();
+
+
+/* Per-node copies of a scene for rendering; see above. The scene must not change while they are in
+    use, and its paged geometry and environment map must outlive them */
+class SceneReplicas {
+public:
+    /* Builds one copy per node of 'topology' at once, each on a thread of its node */
+    SceneReplicas(const Scene& scene, const NumaTopology& topology);
+    ~SceneReplicas();
+
+    int getNodeCount() const { return (int) scenes.size(); }
+
+    /* The copy of 'node', which wraps around the copies for nodes beyond them */
+    const Scene* getScene(int node) const { return scenes[node % scenes.size()]; }
+    const FrustumCuller* getCuller(int node) const { return cullers[node % cullers.size()]; }
+
+    /* Seconds taken by the constructor */
+    double getBuildSeconds() const { return buildSeconds; }
+
+private:
+    SceneReplicas(const SceneReplicas& replicas);
+
+    std::vector<Scene*> scenes;
+    std::vector<FrustumCuller*> cullers;
+    std::vector<std::vector<Surface*> > surfaces;   /* Owned clones, per node */
+    double buildSeconds;
+};
+
+#endif /* defined(__Ray_Tracer__C_____Numa__) */
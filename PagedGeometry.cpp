@@ -0,0 +1,494 @@
+/************************************************************************************************
+ File: PagedGeometry.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "PagedGeometry.h"
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "Traversal.h"
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/* True if 'size' bytes at 'offset' lie within a file of 'fileSize' bytes; cannot overflow */
+static bool fitsInFile(uint64_t offset, uint64_t size, uint64_t fileSize)
+{
+    return offset <= fileSize && size <= fileSize - offset;
+}
+
+/* Resident footprint of a page: what the budget is charged for */
+static size_t residentSize(const GeometryPage& page)
+{
+    return sizeof(GeometryPage) + page.spheres.size() * sizeof(Sphere) + page.accelerator->getMemoryBytes();
+}
+
+PagedGeometry::PagedGeometry()
+{
+    descriptor = -1;
+    memset(&header, 0, sizeof(header));
+    memoryBudget = 0;
+    residentBytes = 0;
+    ioBusy = false;
+    stopping = false;
+    pageHits = pageFaults = evictions = bytesRead = readNanoseconds = 0;
+}
+
+PagedGeometry::~PagedGeometry()
+{
+    close();
+}
+
+bool PagedGeometry::write(const char* path, const std::vector<PackedSphere>& spheres,
+                          const std::vector<PackedMaterial>& materials, int spheresPerPage)
+{
+    float sceneMin[3] = { INFINITY, INFINITY, INFINITY };
+    float sceneMax[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+    for (size_t i = 0; i < spheres.size(); i++) {
+        for (int k = 0; k < 3; k++) {
+            sceneMin[k] = std::min(sceneMin[k], spheres[i].center[k]);
+            sceneMax[k] = std::max(sceneMax[k], spheres[i].center[k]);
+        }
+    }
+
+    /* Order the spheres along a Morton curve through the scene bounds */
+    std::vector<std::pair<uint32_t, uint32_t> > order(spheres.size());
+
+    for (size_t i = 0; i < spheres.size(); i++) {
+        order[i] = std::make_pair(mortonKey(spheres[i].center, sceneMin, sceneMax), (uint32_t) i);
+    }
+
+    std::sort(order.begin(), order.end());
+
+    GeometryPageHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = GEOMETRY_PAGE_MAGIC;
+    header.version = GEOMETRY_PAGE_VERSION;
+    header.pageCount = (uint32_t) ((spheres.size() + spheresPerPage - 1) / spheresPerPage);
+    header.materialCount = (uint32_t) materials.size();
+    header.pageBytes = alignUp(spheresPerPage * sizeof(PackedSphere), GEOMETRY_PAGE_ALIGNMENT);
+    header.materialsOffset = sizeof(header);
+    header.pageTableOffset = header.materialsOffset + materials.size() * sizeof(PackedMaterial);
+
+    uint64_t firstPage = alignUp(header.pageTableOffset + header.pageCount * sizeof(GeometryPageEntry), GEOMETRY_PAGE_ALIGNMENT);
+    std::vector<GeometryPageEntry> pageTable(header.pageCount);
+    std::vector<PackedSphere> pageData;
+
+    int descriptor = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (descriptor < 0) {
+        return false;
+    }
+
+    bool ok = true;
+
+    for (uint32_t page = 0; page < header.pageCount && ok; page++) {
+        GeometryPageEntry& entry = pageTable[page];
+        size_t first = (size_t) page * spheresPerPage;
+        size_t last = std::min(first + spheresPerPage, spheres.size());
+
+        memset(&entry, 0, sizeof(entry));
+        entry.sphereCount = (uint32_t) (last - first);
+        entry.offset = firstPage + page * header.pageBytes;
+
+        for (int k = 0; k < 3; k++) {
+            entry.boundsMin[k] = INFINITY;
+            entry.boundsMax[k] = -INFINITY;
+        }
+
+        pageData.assign(header.pageBytes / sizeof(PackedSphere), PackedSphere());
+        memset(&pageData[0], 0, header.pageBytes);
+
+        for (size_t i = first; i < last; i++) {
+            const PackedSphere& sphere = spheres[order[i].second];
+            pageData[i - first] = sphere;
+
+            for (int k = 0; k < 3; k++) {
+                entry.boundsMin[k] = std::min(entry.boundsMin[k], sphere.center[k] - sphere.radius);
+                entry.boundsMax[k] = std::max(entry.boundsMax[k], sphere.center[k] + sphere.radius);
+            }
+        }
+
+        ok = pwrite(descriptor, &pageData[0], header.pageBytes, entry.offset) == (ssize_t) header.pageBytes;
+    }
+
+    ok = ok && pwrite(descriptor, &header, sizeof(header), 0) == (ssize_t) sizeof(header);
+    ok = ok && (materials.empty() || pwrite(descriptor, &materials[0], materials.size() * sizeof(PackedMaterial),
+                                            header.materialsOffset) == (ssize_t) (materials.size() * sizeof(PackedMaterial)));
+    ok = ok && (pageTable.empty() || pwrite(descriptor, &pageTable[0], pageTable.size() * sizeof(GeometryPageEntry),
+                                            header.pageTableOffset) == (ssize_t) (pageTable.size() * sizeof(GeometryPageEntry)));
+
+    return (::close(descriptor) == 0) && ok;
+}
+
+bool PagedGeometry::open(const char* path, size_t _memoryBudget, bool quantizeMaterials)
+{
+    close();
+
+    descriptor = ::open(path, O_RDONLY);
+
+    if (descriptor < 0) {
+        return false;
+    }
+
+    struct stat status;
+    bool ok = fstat(descriptor, &status) == 0 &&
+              pread(descriptor, &header, sizeof(header), 0) == (ssize_t) sizeof(header) &&
+              header.magic == GEOMETRY_PAGE_MAGIC && header.version == GEOMETRY_PAGE_VERSION;
+    uint64_t fileSize = ok ? (uint64_t) status.st_size : 0;
+    uint64_t materialBytes = (uint64_t) header.materialCount * sizeof(PackedMaterial);
+    uint64_t tableBytes = (uint64_t) header.pageCount * sizeof(GeometryPageEntry);
+
+    /* Checked before anything is allocated, so a damaged header cannot ask for more than the file holds */
+    ok = ok && fitsInFile(header.materialsOffset, materialBytes, fileSize) &&
+         fitsInFile(header.pageTableOffset, tableBytes, fileSize);
+
+    if (ok) {
+        materials.resize(header.materialCount);
+        pageTable.resize(header.pageCount);
+
+        ok = (materialBytes == 0 || pread(descriptor, &materials[0], materialBytes, header.materialsOffset) == (ssize_t) materialBytes) &&
+             (tableBytes == 0 || pread(descriptor, &pageTable[0], tableBytes, header.pageTableOffset) == (ssize_t) tableBytes);
+
+        for (uint32_t page = 0; ok && page < header.pageCount; page++) {
+            uint64_t bytes = (uint64_t) pageTable[page].sphereCount * sizeof(PackedSphere);
+            ok = bytes <= header.pageBytes && fitsInFile(pageTable[page].offset, bytes, fileSize);
+        }
+    }
+
+    if (ok && quantizeMaterials) {
+        compactMaterials.resize(materials.size());
+
+        for (size_t i = 0; i < materials.size(); i++) {
+            compactMaterials[i] = compactMaterial(materials[i]);
+        }
+
+        std::vector<PackedMaterial>().swap(materials);
+    }
+
+    if (!ok) {
+        ::close(descriptor);
+        descriptor = -1;
+        return false;
+    }
+
+    std::vector<float> boxes;
+    gridPages.clear();
+
+    for (uint32_t page = 0; page < header.pageCount; page++) {
+        if (pageTable[page].sphereCount > 0) {
+            boxes.insert(boxes.end(), pageTable[page].boundsMin, pageTable[page].boundsMin + 3);
+            boxes.insert(boxes.end(), pageTable[page].boundsMax, pageTable[page].boundsMax + 3);
+            gridPages.push_back(page);
+        }
+    }
+
+    pageGrid.buildFromBounds(boxes, 1);
+
+    memoryBudget = _memoryBudget;
+    residentBytes = 0;
+    resident.assign(header.pageCount, GeometryPagePin());
+    lruPosition.assign(header.pageCount, recentlyUsed.end());
+    stopping = false;
+    ioThread = std::thread(&PagedGeometry::ioLoop, this);
+
+    return true;
+}
+
+void PagedGeometry::close()
+{
+    if (descriptor < 0) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    ioWork.notify_all();
+    ioThread.join();
+
+    ::close(descriptor);
+    descriptor = -1;
+    resident.clear();
+    std::vector<PackedMaterial>().swap(materials);
+    std::vector<CompactMaterial>().swap(compactMaterials);
+    lruPosition.clear();
+    recentlyUsed.clear();
+    requested.clear();
+    residentBytes = 0;
+}
+
+/* Slab test of 'ray' (unit 'direction', so t is a distance as in Sphere::intersect()) against the
+    bounds of 'entry'. A cell can list pages that overlap it without being crossed by the ray in it */
+static bool crossesPage(const GeometryPageEntry& entry, const float origin[3], const float inverse[3], float tMax)
+{
+    float tNear = 0.0, tFar = tMax;
+
+    for (int k = 0; k < 3; k++) {
+        float t0 = (entry.boundsMin[k] - origin[k]) * inverse[k];
+        float t1 = (entry.boundsMax[k] - origin[k]) * inverse[k];
+        tNear = std::max(tNear, std::min(t0, t1));
+        tFar = std::min(tFar, std::max(t0, t1));
+    }
+
+    return tNear <= tFar;
+}
+
+/* Pages are tested as the walk over the page grid reaches them, so the walk stops at the first cell
+    that ends beyond the closest hit and the pages past it are neither tested nor loaded. Equal
+    distances go to the page reached first, then the first sphere in it */
+Surface* PagedGeometry::intersect(Ray ray, float& closest, Ray& normal, std::vector<GeometryPagePin>& pins,
+                                  bool& missing, bool blocking)
+{
+    std::vector<uint32_t> visited, page(1);
+    std::vector<GeometryPagePin> candidates;
+    Surface* closestSphere = NULL;
+    GeometryPagePin closestPage;
+    std::vector<float> direction = ray.normalize();
+    Point start = ray.getStartPoint();
+    float origin[3] = { start.getX(), start.getY(), start.getZ() };
+    float inverse[3] = { 1.0f / direction[0], 1.0f / direction[1], 1.0f / direction[2] };
+
+    pageGrid.walkCells(ray, closest, [&](const uint32_t* first, const uint32_t* last) -> float {
+        for (const uint32_t* box = first; box < last; box++) {
+            if (std::find(visited.begin(), visited.end(), gridPages[*box]) != visited.end()) {
+                continue;
+            }
+
+            visited.push_back(gridPages[*box]);
+            page[0] = gridPages[*box];
+            candidates.clear();
+
+            if (!crossesPage(pageTable[page[0]], origin, inverse, closest)) {
+                continue;
+            }
+
+            if (!pinPages(page, candidates, blocking)) {
+                missing = true;
+                continue;
+            }
+
+            Surface* sphere = candidates[0]->accelerator->intersect(ray, closest, normal);
+
+            if (sphere != NULL) {
+                closestSphere = sphere;
+                closestPage = candidates[0];
+            }
+        }
+        return closest;
+    });
+
+    if (closestSphere != NULL) {
+        pins.push_back(closestPage);
+    }
+
+    return closestSphere;
+}
+
+bool PagedGeometry::occluded(Ray ray, float maxDistance, bool& missing, bool blocking)
+{
+    std::vector<uint32_t> visited, page(1);
+    std::vector<GeometryPagePin> candidates;
+    bool hit = false;
+    std::vector<float> direction = ray.normalize();
+    Point start = ray.getStartPoint();
+    float origin[3] = { start.getX(), start.getY(), start.getZ() };
+    float inverse[3] = { 1.0f / direction[0], 1.0f / direction[1], 1.0f / direction[2] };
+
+    pageGrid.walkCells(ray, maxDistance, [&](const uint32_t* first, const uint32_t* last) -> float {
+        for (const uint32_t* box = first; box < last; box++) {
+            if (std::find(visited.begin(), visited.end(), gridPages[*box]) != visited.end()) {
+                continue;
+            }
+
+            visited.push_back(gridPages[*box]);
+            page[0] = gridPages[*box];
+            candidates.clear();
+
+            if (!crossesPage(pageTable[page[0]], origin, inverse, maxDistance)) {
+                continue;
+            }
+
+            if (!pinPages(page, candidates, blocking)) {
+                missing = true;
+                continue;
+            }
+
+            if (candidates[0]->accelerator->occluded(ray, maxDistance)) {
+                hit = true;
+                return -INFINITY;
+            }
+        }
+        return INFINITY;
+    });
+
+    return hit;
+}
+
+void PagedGeometry::waitForPendingLoads()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (!requested.empty() || ioBusy) {
+        ioIdle.wait(lock);
+    }
+}
+
+bool PagedGeometry::pinPages(const std::vector<uint32_t>& pages, std::vector<GeometryPagePin>& pins, bool blocking)
+{
+    std::vector<uint32_t> absent;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (size_t i = 0; i < pages.size(); i++) {
+            uint32_t page = pages[i];
+
+            if (resident[page]) {
+                pageHits++;
+                pins.push_back(resident[page]);
+                recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, lruPosition[page]);
+            } else {
+                pageFaults++;
+                absent.push_back(page);
+
+                if (!blocking && requested.insert(page).second) {
+                    ioWork.notify_one();
+                }
+            }
+        }
+    }
+
+    if (!blocking) {
+        return absent.empty();
+    }
+
+    for (size_t i = 0; i < absent.size(); i++) {
+        GeometryPagePin data = readPage(absent[i]);
+        pins.push_back(data);
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (!resident[absent[i]]) {
+            insertPage(absent[i], data);
+        }
+    }
+
+    return true;
+}
+
+GeometryPagePin PagedGeometry::readPage(uint32_t page)
+{
+    const GeometryPageEntry& entry = pageTable[page];
+    std::vector<PackedSphere> records(entry.sphereCount);
+    size_t bytes = records.size() * sizeof(PackedSphere);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    if (bytes > 0 && pread(descriptor, &records[0], bytes, entry.offset) != (ssize_t) bytes) {
+        records.clear();    /* Treat an unreadable page as empty rather than retrying forever */
+    }
+
+    /* Material indices are only seen as pages are read; a page naming a missing material is damaged and
+        is treated as unreadable too */
+    size_t materialCount = header.materialCount;
+
+    for (size_t i = 0; i < records.size(); i++) {
+        if (records[i].material >= materialCount) {
+            records.clear();
+        }
+    }
+
+    readNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    bytesRead += bytes;
+
+    GeometryPagePin data = std::make_shared<GeometryPage>();
+    data->spheres.reserve(records.size());
+
+    for (size_t i = 0; i < records.size(); i++) {
+        uint32_t index = records[i].material;
+        const PackedMaterial& material = compactMaterials.empty() ? materials[index] : expandMaterial(compactMaterials[index]);
+        Sphere sphere(Point(records[i].center[0], records[i].center[1], records[i].center[2]), records[i].radius,
+                      Color(material.ambient[0], material.ambient[1], material.ambient[2]),
+                      Color(material.diffuse[0], material.diffuse[1], material.diffuse[2]),
+                      Color(material.specular[0], material.specular[1], material.specular[2]), material.reflectivity);
+
+        sphere.setSpecularExponent(material.specularExponent);
+        data->spheres.push_back(sphere);
+    }
+
+    std::vector<Surface*> surfaces;
+
+    for (size_t i = 0; i < data->spheres.size(); i++) {
+        surfaces.push_back(&data->spheres[i]);
+    }
+
+    data->accelerator.reset( createAccelerator(ACCELERATOR_AUTO, surfaces, 1) );
+
+    return data;
+}
+
+/* Called with 'mutex' held. Pinned pages that get evicted stay alive until their last pin is dropped */
+void PagedGeometry::insertPage(uint32_t page, GeometryPagePin data)
+{
+    size_t size = residentSize(*data);
+
+    while (!recentlyUsed.empty() && residentBytes + size > memoryBudget) {
+        uint32_t victim = recentlyUsed.back();
+        recentlyUsed.pop_back();
+        residentBytes -= residentSize(*resident[victim]);
+        resident[victim].reset();
+        lruPosition[victim] = recentlyUsed.end();
+        evictions++;
+    }
+
+    resident[page] = data;
+    recentlyUsed.push_front(page);
+    lruPosition[page] = recentlyUsed.begin();
+    residentBytes += size;
+}
+
+void PagedGeometry::ioLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        while (requested.empty() && !stopping) {
+            ioWork.wait(lock);
+        }
+
+        if (stopping) {
+            return;
+        }
+
+        uint32_t page = *requested.begin();
+        ioBusy = true;
+        lock.unlock();
+
+        GeometryPagePin data = readPage(page);
+
+        lock.lock();
+
+        if (!resident[page]) {
+            insertPage(page, data);
+        }
+
+        requested.erase(page);
+        ioBusy = false;
+
+        if (requested.empty()) {
+            ioIdle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,143 @@
+/************************************************************************************************
+ File: PagedGeometry.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____PagedGeometry__
+#define __Ray_Tracer__C_____PagedGeometry__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <list>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include "Surface.h"
+#include "SceneCache.h"
+#include "CompactFormats.h"
+#include "Accelerator.h"
+
+#define GEOMETRY_PAGE_MAGIC 0x47505452     /* "RTPG" read as a little-endian word */
+#define GEOMETRY_PAGE_VERSION 1
+#define GEOMETRY_PAGE_ALIGNMENT 4096        /* Pages start and end on OS page boundaries */
+#define DEFAULT_SPHERES_PER_PAGE 2048
+
+/* Page table entry: the bounds of a page's spheres act as the top level of the acceleration structure,
+    so rays can be culled against pages that are not in memory. A grid over these bounds, built when the
+    file is opened, finds the pages along a ray nearest first */
+struct GeometryPageEntry {
+    float boundsMin[3];
+    float boundsMax[3];
+    uint32_t sphereCount;
+    uint32_t padding;
+    uint64_t offset;    /* Bytes from the start of the file */
+};
+
+struct GeometryPageHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pageCount;
+    uint32_t materialCount;
+    uint64_t pageBytes;         /* On-disk size of every page, a multiple of GEOMETRY_PAGE_ALIGNMENT */
+    uint64_t materialsOffset;
+    uint64_t pageTableOffset;
+};
+
+/* One resident page: the spheres of the page instantiated as renderable surfaces, and the accelerator
+    over them that rays reaching the page go through */
+struct GeometryPage {
+    std::vector<Sphere> spheres;
+    std::unique_ptr<Accelerator> accelerator;
+};
+
+typedef std::shared_ptr<GeometryPage> GeometryPagePin;
+
+/* Spheres streamed from an on-disk, page-aligned file under a memory budget. Only the page table and
+    the materials stay in memory; pages are read by a background I/O thread when a ray needs them and
+    evicted least recently used first. Lookups never wait for I/O: a ray that needs a missing page
+    reports it and the caller defers the ray until the page has arrived */
+class PagedGeometry {
+public:
+    PagedGeometry();
+    ~PagedGeometry();
+
+    /* Sorts 'spheres' along a Morton curve so each page covers a compact region, then writes them */
+    static bool write(const char* path, const std::vector<PackedSphere>& spheres,
+                      const std::vector<PackedMaterial>& materials, int spheresPerPage = DEFAULT_SPHERES_PER_PAGE);
+
+    /* With 'quantizeMaterials' the resident material table is quantized to CompactMaterial, a third of
+     the size, and expanded as pages are read. Scenes with a material per sphere keep as many materials
+     in memory as there are spheres, so this is most of what stays resident under a small budget, at the
+     cost of images that differ slightly from the full-precision ones. Fails if the file is missing,
+     from another version, or has a material table, page table or page that lies outside it */
+    bool open(const char* path, size_t _memoryBudget, bool quantizeMaterials = false);
+    void close();
+
+    /* Closest sphere hit by 'ray' with 1 <= t < 'closest'. Updates 'closest' and 'normal' and returns the
+     sphere, which stays valid while 'pins' holds its page. Sets 'missing' when a page the ray passes
+     through is not resident, in which case the answer may be incomplete. With 'blocking' the missing
+     pages are read on the calling thread instead, which guarantees progress when the budget is so
+     tight that a deferred ray keeps finding its pages evicted again */
+    Surface* intersect(Ray ray, float& closest, Ray& normal, std::vector<GeometryPagePin>& pins, bool& missing,
+                       bool blocking = false);
+
+    /* True if any sphere blocks 'ray' with 1 < t < 'maxDistance'. Sets 'missing' like intersect() */
+    bool occluded(Ray ray, float maxDistance, bool& missing, bool blocking = false);
+
+    /* Blocks until every requested page has been loaded */
+    void waitForPendingLoads();
+
+    size_t getMemoryBudget() const { return memoryBudget; }
+    size_t getResidentBytes() const { return residentBytes; }
+    size_t getMaterialBytes() const { return materials.capacity() * sizeof(PackedMaterial) +
+                                             compactMaterials.capacity() * sizeof(CompactMaterial); }
+    uint32_t getPageCount() const { return header.pageCount; }
+    uint64_t getPageHits() const { return pageHits; }
+    uint64_t getPageFaults() const { return pageFaults; }
+    uint64_t getEvictions() const { return evictions; }
+    uint64_t getBytesRead() const { return bytesRead; }
+    double getReadSeconds() const { return readNanoseconds * 1e-9; }
+
+private:
+    PagedGeometry(const PagedGeometry& geometry);
+
+    /* Pins the resident pages among 'pages' and queues loads for the rest (or reads them right away when
+     'blocking'). Returns false if any page is missing */
+    bool pinPages(const std::vector<uint32_t>& pages, std::vector<GeometryPagePin>& pins, bool blocking);
+
+    GeometryPagePin readPage(uint32_t page);
+    void insertPage(uint32_t page, GeometryPagePin data);
+    void ioLoop();
+
+    int descriptor;
+    GeometryPageHeader header;
+    std::vector<GeometryPageEntry> pageTable;
+    GridAccelerator pageGrid;                           /* Over the bounds of the non-empty pages */
+    std::vector<uint32_t> gridPages;                    /* Page of each box in 'pageGrid' */
+    std::vector<PackedMaterial> materials;
+    std::vector<CompactMaterial> compactMaterials;     /* Replaces 'materials' when open() was asked to */
+    size_t memoryBudget;
+
+    std::mutex mutex;
+    std::vector<GeometryPagePin> resident;              /* Null while the page is on disk */
+    std::vector<std::list<uint32_t>::iterator> lruPosition;
+    std::list<uint32_t> recentlyUsed;                   /* Front is the most recently used page */
+    std::set<uint32_t> requested;
+    size_t residentBytes;
+
+    std::thread ioThread;
+    std::condition_variable ioWork, ioIdle;
+    bool ioBusy;
+    bool stopping;
+
+    std::atomic<uint64_t> pageHits, pageFaults, evictions, bytesRead, readNanoseconds;
+};
+
+#endif /* defined(__Ray_Tracer__C_____PagedGeometry__) */
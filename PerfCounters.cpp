@@ -0,0 +1,136 @@
+/************************************************************************************************
+ File: PerfCounters.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "PerfCounters.h"
+#include <string.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+PerfCounters::PerfCounters()
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        descriptors[i] = -1;
+        counts[i] = 0;
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    close();
+}
+
+const char* PerfCounters::getName(PerfEvent event)
+{
+    const char* names[] = { "cycles", "instructions", "cache-references", "cache-misses", "L1d-read-misses",
+                            "LLC-read-misses", "branch-misses" };
+
+    return names[event];
+}
+
+#if defined(__linux__)
+
+/* Each event is a counter of its own: inherited counters cannot be read as a group */
+int PerfCounters::open(bool wholeProcess)
+{
+    const uint32_t types[] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                               PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE };
+    const uint64_t configs[] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_REFERENCES,
+                                 PERF_COUNT_HW_CACHE_MISSES,
+                                 PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+                                 PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+                                 PERF_COUNT_HW_BRANCH_MISSES };
+    int opened = 0;
+
+    close();
+
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        struct perf_event_attr attributes;
+        memset(&attributes, 0, sizeof(attributes));
+
+        attributes.size = sizeof(attributes);
+        attributes.type = types[i];
+        attributes.config = configs[i];
+        attributes.disabled = 1;
+        attributes.inherit = wholeProcess ? 1 : 0;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        descriptors[i] = (int) syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+        opened += (descriptors[i] >= 0) ? 1 : 0;
+    }
+
+    return opened;
+}
+
+void PerfCounters::close()
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (descriptors[i] >= 0) {
+            ::close(descriptors[i]);
+            descriptors[i] = -1;
+        }
+    }
+}
+
+void PerfCounters::start()
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (descriptors[i] >= 0) {
+            ioctl(descriptors[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(descriptors[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void PerfCounters::stop()
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (descriptors[i] >= 0) {
+            ioctl(descriptors[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+
+        counts[i] = readScaled(i);
+    }
+}
+
+void PerfCounters::read(uint64_t values[PERF_EVENT_COUNT]) const
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        values[i] = readScaled(i);
+    }
+}
+
+uint64_t PerfCounters::readScaled(int event) const
+{
+    uint64_t values[3];     /* Count, time enabled, time running */
+
+    if (descriptors[event] < 0 || ::read(descriptors[event], values, sizeof(values)) != sizeof(values) || values[2] == 0) {
+        return 0;
+    }
+
+    return (uint64_t) ((double) values[0] * values[1] / values[2]);
+}
+
+#else
+
+int PerfCounters::open(bool wholeProcess) { return 0; }
+void PerfCounters::close() {}
+void PerfCounters::start() {}
+void PerfCounters::stop() {}
+void PerfCounters::read(uint64_t values[PERF_EVENT_COUNT]) const { memset(values, 0, PERF_EVENT_COUNT * sizeof(uint64_t)); }
+uint64_t PerfCounters::readScaled(int event) const { return 0; }
+
+#endif
@@ -0,0 +1,55 @@
+/************************************************************************************************
+ File: PerfCounters.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____PerfCounters__
+#define __Ray_Tracer__C_____PerfCounters__
+
+#include <stdio.h>
+#include <stdint.h>
+
+enum PerfEvent { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_CACHE_REFERENCES, PERF_CACHE_MISSES, PERF_L1D_READ_MISSES,
+                 PERF_LLC_READ_MISSES, PERF_BRANCH_MISSES, PERF_EVENT_COUNT };
+
+/* Hardware event counters from perf_event_open (Linux only), of the whole process or of the calling
+    thread. Process counting includes the threads created while the counters are open, so they must
+    be opened before a render starts its workers, and the workers must have exited when the counters
+    are read. Events the machine or the kernel does not offer, such as in most virtual machines, are
+    reported as unavailable */
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    /* Opens every event that is available and returns how many are. With 'wholeProcess' false only
+     the calling thread is counted, and only it may read the counters */
+    int open(bool wholeProcess = true);
+    void close();
+
+    void start();
+    void stop();
+
+    bool isAvailable(PerfEvent event) const { return descriptors[event] >= 0; }
+
+    /* Count between start() and stop(), scaled up when the kernel had to multiplex the counters */
+    uint64_t getCount(PerfEvent event) const { return counts[event]; }
+
+    /* Counts since start() without stopping, one read() per available event; 0 for the others */
+    void read(uint64_t values[PERF_EVENT_COUNT]) const;
+
+    static const char* getName(PerfEvent event);
+
+private:
+    PerfCounters(const PerfCounters& counters);
+
+    uint64_t readScaled(int event) const;
+
+    int descriptors[PERF_EVENT_COUNT];
+    uint64_t counts[PERF_EVENT_COUNT];
+};
+
+#endif /* defined(__Ray_Tracer__C_____PerfCounters__) */
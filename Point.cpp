@@ -7,6 +7,7 @@
 ************************************************************************************************/
 
 #include "Point.h"
+#include "FastMath.h"
 
 Point::Point()
 {
@@ -56,6 +57,12 @@ Point Point::adjust(float adjustment, std::vector<float> normal)
 
 Point Point::normalize()
 {
+    if (useFastMath) {
+        float inverseNorm = fastReciprocalSqrt( (x * x) + (y * y) + (z * z) );
+        
+        return Point( x * inverseNorm, y * inverseNorm, z * inverseNorm );
+    }
+    
     float norm = sqrtf( (x * x) + (y * y) + (z * z) );
     
     return Point( x/norm, y/norm, z/norm );
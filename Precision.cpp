@@ -0,0 +1,36 @@
+/************************************************************************************************
+ File: Precision.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "Precision.h"
+#include <string.h>
+
+IntersectionPrecision intersectionPrecision = PRECISION_MIXED;
+thread_local PrecisionCounts precisionCounts = { 0, 0 };
+thread_local bool precisionCounting = false;
+
+bool parseIntersectionPrecision(const char* name, IntersectionPrecision& precision)
+{
+    if (strcmp(name, "float") == 0) {
+        precision = PRECISION_FLOAT;
+    } else if (strcmp(name, "mixed") == 0) {
+        precision = PRECISION_MIXED;
+    } else if (strcmp(name, "double") == 0) {
+        precision = PRECISION_DOUBLE;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+const char* getIntersectionPrecisionName(IntersectionPrecision precision)
+{
+    const char* names[] = { "float", "mixed", "double" };
+
+    return names[precision];
+}
@@ -0,0 +1,175 @@
+/************************************************************************************************
+ File: Precision.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____Precision__
+#define __Ray_Tracer__C_____Precision__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <float.h>
+#include <cmath>
+#include "FastMath.h"
+
+/************************************************************************************************
+ Mixed-precision ray/sphere intersection. The quadratic is solved in a form that avoids both
+ cancellations of the textbook one:
+   the discriminant b^2 - ac is computed as a (r^2 - |f|^2), where f is the offset from the center
+   to the point of the ray nearest to it, instead of as a difference of two large, nearly equal
+   squares, so grazing rays and spheres far from the origin keep their accuracy
+   the near root is c / q and the far one q / a, with q = -(b + sign(b) sqrt(b^2 - ac)), so neither
+   subtracts two nearly equal numbers
+ Two cases are still ill-conditioned in float: a ray so close to tangent that the discriminant is
+ within its rounding error of zero, where hit or miss is undecided, and an origin so close to the
+ surface that c = |o|^2 - r^2 is within its rounding error of zero, where the near root is noise.
+ The float kernel bounds both errors (PRECISION_ERROR_BOUND times the magnitudes that went into each
+ term, a conservative form of the usual gamma(n) bounds) and reports whether its answer is reliable.
+ Mixed precision recomputes only the unreliable cases in double, where the products of the float
+ inputs are exact, so every hit and miss is decided as the exact math on the inputs would decide
+ it. --benchmark precision measures how rare the fallback is and checks every decision against
+ double precision
+************************************************************************************************/
+
+#define PRECISION_ERROR_BOUND (16.0f * FLT_EPSILON)    /* Relative error bound of the float terms */
+
+enum IntersectionPrecision { PRECISION_FLOAT, PRECISION_MIXED, PRECISION_DOUBLE };
+
+/* The precision of every sphere intersection. Set once before rendering; mixed by default */
+extern IntersectionPrecision intersectionPrecision;
+
+inline void setIntersectionPrecision(IntersectionPrecision precision) { intersectionPrecision = precision; }
+inline IntersectionPrecision getIntersectionPrecision() { return intersectionPrecision; }
+
+/* Parses "float", "mixed" or "double"; returns false for anything else */
+bool parseIntersectionPrecision(const char* name, IntersectionPrecision& precision);
+const char* getIntersectionPrecisionName(IntersectionPrecision precision);
+
+/* Sphere tests and double-precision fallbacks made by the calling thread while it has counting on.
+    Counting is off by default so renders do not pay for it; benchmarks switch it on around the work
+    they measure */
+struct PrecisionCounts {
+    uint64_t tests;
+    uint64_t fallbacks;
+};
+
+extern thread_local PrecisionCounts precisionCounts;
+extern thread_local bool precisionCounting;
+
+inline PrecisionCounts getPrecisionCounts() { return precisionCounts; }
+inline void resetPrecisionCounts() { precisionCounts.tests = precisionCounts.fallbacks = 0; }
+inline void setPrecisionCounting(bool counting) { precisionCounting = counting; }
+inline bool getPrecisionCounting() { return precisionCounting; }
+
+inline float dotProduct3(const float a[3], const float b[3]) {
+    return useFastMath ? multiplyAdd(a[0], b[0], multiplyAdd(a[1], b[1], a[2] * b[2]))
+                       : (a[0] * b[0]) + (a[1] * b[1]) + (a[2] * b[2]);
+}
+
+/* Distances along 'direction' (in its units) to where the ray from 'origin' enters and leaves the
+    sphere, nearest first. Returns false on a miss. 'reliable' is false where the rounding error
+    bound does not rule out the opposite decision or a wrong near root */
+inline bool solveSphereFloat(const float origin[3], const float direction[3], const float center[3], float radius,
+                             float& nearRoot, float& farRoot, bool& reliable)
+{
+    float offset[3] = { origin[0] - center[0], origin[1] - center[1], origin[2] - center[2] };
+    float a = dotProduct3(direction, direction);
+    float b = dotProduct3(direction, offset);       /* Half of the textbook b */
+    float offsetLength2 = dotProduct3(offset, offset);
+    float radius2 = radius * radius;
+
+    float inverseA = 1.0f / a;
+    float along = b * inverseA;
+    float foot[3] = { offset[0] - along * direction[0], offset[1] - along * direction[1], offset[2] - along * direction[2] };
+    float footLength2 = dotProduct3(foot, foot);
+    float discriminant = a * (radius2 - footLength2);
+
+    /* The error of |f|^2 grows with |f| |o|. Bounding that by (|f|^2 + |o|^2) / 2 settles most rays
+        without a square root; only the rest pay for the tight bound */
+    float discriminantError = PRECISION_ERROR_BOUND * a * (radius2 + footLength2 + offsetLength2);
+
+    if (fabsf(discriminant) <= discriminantError) {
+        discriminantError = PRECISION_ERROR_BOUND * a * (radius2 + footLength2 + sqrtf(footLength2 * offsetLength2));
+    }
+
+    if (discriminant < -discriminantError) {
+        reliable = true;
+        return false;
+    }
+
+    float c = offsetLength2 - radius2;
+
+    reliable = (discriminant > discriminantError) && (fabsf(c) > PRECISION_ERROR_BOUND * (offsetLength2 + radius2));
+
+    if (discriminant < 0) {
+        return false;
+    }
+
+    float q = -(b + copysignf(sqrtf(discriminant), b));
+    float first = (q != 0) ? c / q : 0.0f;     /* q = 0 only for a tangent ray starting on the sphere */
+    float second = q * inverseA;
+
+    nearRoot = (first < second) ? first : second;
+    farRoot = (first < second) ? second : first;
+
+    return true;
+}
+
+/* solveSphereFloat() in double precision, which is always reliable for float inputs */
+inline bool solveSphereDouble(const float origin[3], const float direction[3], const float center[3], float radius,
+                              float& nearRoot, float& farRoot)
+{
+    double offset[3] = { (double) origin[0] - center[0], (double) origin[1] - center[1], (double) origin[2] - center[2] };
+    double d[3] = { direction[0], direction[1], direction[2] };
+    double a = (d[0] * d[0]) + (d[1] * d[1]) + (d[2] * d[2]);
+    double b = (d[0] * offset[0]) + (d[1] * offset[1]) + (d[2] * offset[2]);
+    double radius2 = (double) radius * radius;
+
+    double along = b / a;
+    double foot[3] = { offset[0] - along * d[0], offset[1] - along * d[1], offset[2] - along * d[2] };
+    double discriminant = a * (radius2 - ((foot[0] * foot[0]) + (foot[1] * foot[1]) + (foot[2] * foot[2])));
+
+    if (discriminant < 0) {
+        return false;
+    }
+
+    double c = (offset[0] * offset[0]) + (offset[1] * offset[1]) + (offset[2] * offset[2]) - radius2;
+    double q = -(b + copysign(sqrt(discriminant), b));
+    double first = (q != 0) ? c / q : 0.0;
+    double second = q / a;
+
+    nearRoot = (float) ((first < second) ? first : second);
+    farRoot = (float) ((first < second) ? second : first);
+
+    return true;
+}
+
+/* The sphere kernel at the current precision */
+inline bool solveSphere(const float origin[3], const float direction[3], const float center[3], float radius,
+                        float& nearRoot, float& farRoot)
+{
+    if (precisionCounting) {
+        precisionCounts.tests++;
+    }
+
+    if (intersectionPrecision == PRECISION_DOUBLE) {
+        return solveSphereDouble(origin, direction, center, radius, nearRoot, farRoot);
+    }
+
+    bool reliable;
+    bool hit = solveSphereFloat(origin, direction, center, radius, nearRoot, farRoot, reliable);
+
+    if (reliable || intersectionPrecision == PRECISION_FLOAT) {
+        return hit;
+    }
+
+    if (precisionCounting) {
+        precisionCounts.fallbacks++;
+    }
+    return solveSphereDouble(origin, direction, center, radius, nearRoot, farRoot);
+}
+
+#endif /* defined(__Ray_Tracer__C_____Precision__) */
@@ -0,0 +1,99 @@
+/************************************************************************************************
+ File: Random.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____Random__
+#define __Ray_Tracer__C_____Random__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <random>
+
+/* Mixes four 32-bit counters into one well-distributed 32-bit value (chained murmur3-style finalizers) */
+inline uint32_t hashCounters(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    uint32_t h = a ^ 0x9e3779b9;
+    uint32_t keys[3] = { b, c, d };
+
+    for (int i = 0; i < 3; i++) {
+        h ^= keys[i] + 0x7f4a7c15 + (h << 6) + (h >> 2);
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+    }
+
+    return h;
+}
+
+/* Point 'index' of the two-dimensional Sobol sequence, a (0, 2)-sequence: every aligned block of 4^k
+    points puts one point in each cell of a 2^k x 2^k grid, so a prefix of 4 points is stratified and
+    extending it to 16 or 64 keeps it stratified at the finer grid. 'shiftS' and 'shiftT' rotate the
+    set over the unit square to decorrelate it between pixels */
+inline void getSobolSample(uint32_t index, float shiftS, float shiftT, float& s, float& t) {
+    uint32_t first = 0, second = 0;
+
+    for (uint32_t bit = 1u << 31, direction = 1u << 31; index != 0; index >>= 1, bit >>= 1, direction ^= direction >> 1) {
+        if (index & 1) {
+            first ^= bit;
+            second ^= direction;
+        }
+    }
+
+    s = (first >> 8) * (1.0f / 16777216.0f) + shiftS;
+    t = (second >> 8) * (1.0f / 16777216.0f) + shiftT;
+    s = (s >= 1.0f) ? s - 1.0f : s;
+    t = (t >= 1.0f) ? t - 1.0f : t;
+}
+
+/* Random numbers for one sample of one pixel. In counter-based mode every value is a pure function
+    of (seed, pixel, sample, bounce, dimension), so it does not matter which thread traces the pixel
+    or in what order: the same pixel always sees the same numbers. The free-running mode draws from a
+    per-thread generator instead and only exists to measure what determinism costs */
+class RandomStream {
+public:
+    RandomStream() { seed = pixel = sample = 0; counterBased = true; }
+    RandomStream(const RandomStream& stream) {
+        seed = stream.getSeed();
+        pixel = stream.getPixel();
+        sample = stream.getSample();
+        counterBased = stream.isCounterBased();
+    }
+    RandomStream(uint32_t _seed, uint32_t _pixel, uint32_t _sample, bool _counterBased = true) {
+        seed = _seed;
+        pixel = _pixel;
+        sample = _sample;
+        counterBased = _counterBased;
+    }
+
+    uint32_t getSeed() const { return seed; }
+    uint32_t getPixel() const { return pixel; }
+    uint32_t getSample() const { return sample; }
+    bool isCounterBased() const { return counterBased; }
+
+    /* Returns a number in [0, 1). 'bounce' is the path depth and 'dimension' tells apart the numbers
+     drawn at the same bounce (lens jitter, light sample, termination test, ...) */
+    float get(int bounce, int dimension) const {
+        uint32_t bits;
+
+        if (counterBased) {
+            bits = hashCounters(seed, pixel, sample, ((uint32_t) bounce << 16) | (uint32_t) dimension);
+        } else {
+            static thread_local std::minstd_rand engine(std::random_device{}());
+            bits = (uint32_t) engine() << 1;
+        }
+
+        /* Top 24 bits so the result is exactly representable and strictly below 1 */
+        return (bits >> 8) * (1.0f / 16777216.0f);
+    }
+
+private:
+    uint32_t seed, pixel, sample;
+    bool counterBased;
+};
+
+#endif /* defined(__Ray_Tracer__C_____Random__) */
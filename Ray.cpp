@@ -7,6 +7,7 @@
 ************************************************************************************************/
 
 #include "Ray.h"
+#include "FastMath.h"
 
 Ray::Ray ()
 {
@@ -29,17 +30,7 @@ Ray::Ray (const Ray& ray)
     directionPoint = ray.getDirectionPoint();
     unitDirectionVector = directionPoint - startPoint;
     
-    float temp = 0.0;
-    
-    for (int i = 0; i < unitDirectionVector.size(); i++) {
-        temp += pow(unitDirectionVector[i], 2);
-    }
-    
-    temp = sqrtf(temp);
-    
-    for (int i = 0; i < unitDirectionVector.size(); i++) {
-        unitDirectionVector[i] /= temp;
-    }
+    normalizeDirection();
 }
 
 Ray::Ray(Point _startPoint, Point _directionPoint)
@@ -48,10 +39,35 @@ Ray::Ray(Point _startPoint, Point _directionPoint)
     directionPoint = _directionPoint;
     unitDirectionVector = directionPoint - startPoint;
     
+    normalizeDirection();
+}
+
+Ray::Ray(Point _startPoint, std::vector<float> _unitDirectionVector)
+{
+    startPoint = _startPoint;
+    unitDirectionVector = _unitDirectionVector;
+    directionPoint = getRayPoint(1.0);
+}
+
+/* The squares are summed in double precision, as pow() did, which keeps the exact path bit-identical */
+void Ray::normalizeDirection()
+{
+    if (useFastMath) {
+        float inverseLength = fastReciprocalSqrt( (unitDirectionVector[0] * unitDirectionVector[0]) +
+                                                  (unitDirectionVector[1] * unitDirectionVector[1]) +
+                                                  (unitDirectionVector[2] * unitDirectionVector[2]) );
+        
+        for (int i = 0; i < unitDirectionVector.size(); i++) {
+            unitDirectionVector[i] *= inverseLength;
+        }
+        
+        return;
+    }
+    
     float temp = 0.0;
     
     for (int i = 0; i < unitDirectionVector.size(); i++) {
-        temp += pow(unitDirectionVector[i], 2);
+        temp += (double) unitDirectionVector[i] * unitDirectionVector[i];
     }
     
     temp = sqrtf(temp);
@@ -61,13 +77,6 @@ Ray::Ray(Point _startPoint, Point _directionPoint)
     }
 }
 
-Ray::Ray(Point _startPoint, std::vector<float> _unitDirectionVector)
-{
-    startPoint = _startPoint;
-    unitDirectionVector = _unitDirectionVector;
-    directionPoint = getRayPoint(1.0);
-}
-
 std::vector<float> Ray::normalize()
 {
     return unitDirectionVector;
@@ -28,6 +28,8 @@ public:
     Ray getReflectedRay(Ray normal);
     
 private:
+    void normalizeDirection();
+    
     Point startPoint, directionPoint;
     std::vector<float> unitDirectionVector;
 };
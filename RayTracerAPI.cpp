@@ -0,0 +1,118 @@
+/************************************************************************************************
+ File: RayTracerAPI.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include <algorithm>
+#include "RayTracerAPI.h"
+#include "EmbeddedRenderer.h"
+
+struct rt_scene {
+    rt_scene(Color ambient) : embedded(ambient) {}
+
+    EmbeddedScene embedded;
+};
+
+/* The framebuffer wraps the caller's pixels and must outlive the session rendering into it */
+struct rt_render {
+    rt_render(const Scene* scene, const Camera& camera, void* pixels, size_t rowBytes, PixelFormat format)
+        : framebuffer(pixels, camera.getWidth(), camera.getHeight(), rowBytes, format), session(scene, camera) {}
+
+    FrameBuffer framebuffer;
+    RenderSession session;
+};
+
+rt_scene* rt_scene_create(const float ambient[3])
+{
+    return new rt_scene(Color(ambient[0], ambient[1], ambient[2]));
+}
+
+void rt_scene_destroy(rt_scene* scene)
+{
+    delete scene;
+}
+
+int rt_scene_add_spheres(rt_scene* scene, const rt_sphere* spheres, uint32_t count,
+                         const rt_material* materials, uint32_t material_count)
+{
+    return scene->embedded.addSpheres(spheres, count, materials, material_count);
+}
+
+int rt_scene_add_planes(rt_scene* scene, const rt_plane* planes, uint32_t count,
+                        const rt_material* materials, uint32_t material_count)
+{
+    return scene->embedded.addPlanes(planes, count, materials, material_count);
+}
+
+int rt_scene_add_lights(rt_scene* scene, const rt_light* lights, uint32_t count)
+{
+    return scene->embedded.addLights(lights, count);
+}
+
+rt_render* rt_render_start(rt_scene* scene, const rt_camera* camera, const rt_render_settings* settings,
+                           void* pixels, size_t row_bytes, int format)
+{
+    if (format < 0 || format >= PIXEL_FORMAT_COUNT || camera->width < 1 || camera->height < 1 || pixels == NULL) {
+        return NULL;
+    }
+
+    int threads = (settings != NULL && settings->threads > 0) ? settings->threads : 0;
+
+    if (threads == 0) {
+        threads = std::max(1, (int) std::thread::hardware_concurrency());
+    }
+
+    Camera view(Point(camera->eye[0], camera->eye[1], camera->eye[2]),
+                Point(camera->look_at[0], camera->look_at[1], camera->look_at[2]),
+                Point(camera->up[0], camera->up[1], camera->up[2]),
+                camera->field_of_view, camera->width, camera->height);
+    rt_render* render = new rt_render(scene->embedded.prepare(threads), view, pixels, row_bytes, (PixelFormat) format);
+
+    if (row_bytes < (size_t) camera->width * render->framebuffer.getPixelBytes()) {
+        delete render;
+        return NULL;
+    }
+
+    Renderer& renderer = render->session.getRenderer();
+    renderer.setThreadCount(threads);
+
+    if (settings != NULL && settings->samples > 0) {
+        renderer.setSamplesPerPixel(settings->samples);
+    }
+
+    if (settings != NULL) {
+        renderer.setSeed(settings->seed);
+    }
+
+    render->session.start(&render->framebuffer);
+
+    return render;
+}
+
+float rt_render_progress(const rt_render* render)
+{
+    return render->session.getProgress();
+}
+
+int rt_render_is_done(const rt_render* render)
+{
+    return render->session.isDone();
+}
+
+void rt_render_cancel(rt_render* render)
+{
+    render->session.cancel();
+}
+
+int rt_render_wait(rt_render* render)
+{
+    return render->session.wait();
+}
+
+void rt_render_destroy(rt_render* render)
+{
+    delete render;
+}
@@ -0,0 +1,126 @@
+/************************************************************************************************
+ File: RayTracerAPI.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____RayTracerAPI__
+#define __Ray_Tracer__C_____RayTracerAPI__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/************************************************************************************************
+ C interface for embedding the ray tracer, for callers in C and for foreign function interfaces.
+ It keeps no global state: any number of scenes and renders can exist at once, on any threads.
+
+    rt_scene_create, rt_scene_add_*     build a scene from arrays the caller keeps; the records are
+                                        read once, straight into the scene's own surfaces
+    rt_render_start                     renders a scene on background threads into pixel memory the
+                                        caller owns, in one of the RT_PIXEL_* formats, rows
+                                        'row_bytes' apart, top row first
+    rt_render_progress, _is_done        poll a render
+    rt_render_cancel, _wait, _destroy   stop, join and free it
+
+ A scene must outlive its renders and must not be added to while one of them is running. Several
+ renders may share a scene. Functions that can fail return 0 or NULL on failure and 1 or the new
+ object on success. The pixel memory must stay valid until rt_render_wait() or rt_render_destroy()
+ returns. The C++ classes underneath are in EmbeddedRenderer.h
+************************************************************************************************/
+
+typedef struct rt_scene rt_scene;
+typedef struct rt_render rt_render;
+
+/* The same values as PixelFormat in FrameBuffer.h */
+enum { RT_PIXEL_RGB_FLOAT, RT_PIXEL_RGBA_FLOAT, RT_PIXEL_RGBA_HALF, RT_PIXEL_RGB9E5, RT_PIXEL_RGBA8 };
+
+/* The same values as Light::LightShape */
+enum { RT_LIGHT_POINT, RT_LIGHT_RECTANGLE, RT_LIGHT_DISK, RT_LIGHT_SPHERE };
+
+typedef struct rt_material {
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+    float reflectivity;
+    int32_t specular_exponent;
+} rt_material;
+
+typedef struct rt_sphere {
+    float center[3];
+    float radius;
+    uint32_t material;      /* Index into the materials passed along with the spheres */
+} rt_sphere;
+
+typedef struct rt_plane {
+    float point[3];
+    float normal[3];
+    uint32_t material;
+} rt_plane;
+
+/* Point lights only use 'position' and 'intensity'. Rectangles span 'u_axis' and 'v_axis' around
+    'position'; disks face along 'u_axis' with 'radius'; spheres have 'radius'. See Light.h */
+typedef struct rt_light {
+    float position[3];
+    float intensity[3];
+    uint32_t shape;
+    float u_axis[3];
+    float v_axis[3];
+    float radius;
+} rt_light;
+
+typedef struct rt_camera {
+    float eye[3];
+    float look_at[3];
+    float up[3];
+    float field_of_view;    /* Degrees */
+    int width;
+    int height;
+} rt_camera;
+
+/* Zero in any field picks the default: hardware threads, 1 sample per pixel, seed 0 */
+typedef struct rt_render_settings {
+    int threads;
+    int samples;
+    uint32_t seed;
+} rt_render_settings;
+
+rt_scene* rt_scene_create(const float ambient[3]);
+void rt_scene_destroy(rt_scene* scene);
+
+/* Fails, adding nothing, if a record names a material past 'material_count' */
+int rt_scene_add_spheres(rt_scene* scene, const rt_sphere* spheres, uint32_t count,
+                         const rt_material* materials, uint32_t material_count);
+int rt_scene_add_planes(rt_scene* scene, const rt_plane* planes, uint32_t count,
+                        const rt_material* materials, uint32_t material_count);
+
+/* Fails, adding nothing, on an unknown shape */
+int rt_scene_add_lights(rt_scene* scene, const rt_light* lights, uint32_t count);
+
+/* 'settings' may be NULL. Fails on an unknown format, a size below 1 or rows shorter than a pixel row */
+rt_render* rt_render_start(rt_scene* scene, const rt_camera* camera, const rt_render_settings* settings,
+                           void* pixels, size_t row_bytes, int format);
+
+/* Fraction of the image's tiles finished, from 0 to 1 */
+float rt_render_progress(const rt_render* render);
+int rt_render_is_done(const rt_render* render);
+
+/* Asks the render to stop at the next tile; returns immediately */
+void rt_render_cancel(rt_render* render);
+
+/* Blocks until the render has stopped. Returns 1 if it finished the image and 0 if it was cancelled */
+int rt_render_wait(rt_render* render);
+
+/* Cancels the render if it is still running, waits for it and frees it */
+void rt_render_destroy(rt_render* render);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* defined(__Ray_Tracer__C_____RayTracerAPI__) */
@@ -0,0 +1,427 @@
+/************************************************************************************************
+ File: RenderServer.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "RenderServer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+static bool sendAll(int connection, const void* data, size_t size)
+{
+    const char* bytes = (const char*) data;
+
+    while (size > 0) {
+        ssize_t sent = send(connection, bytes, size, 0);
+
+        if (sent <= 0) {
+            return false;
+        }
+
+        bytes += sent;
+        size -= sent;
+    }
+
+    return true;
+}
+
+static bool receiveAll(int connection, void* data, size_t size)
+{
+    char* bytes = (char*) data;
+
+    while (size > 0) {
+        ssize_t received = recv(connection, bytes, size, 0);
+
+        if (received <= 0) {
+            return false;
+        }
+
+        bytes += received;
+        size -= received;
+    }
+
+    return true;
+}
+
+/* Reads up to and excluding the next '\n'. Byte-at-a-time keeps any image that follows in the socket */
+static bool receiveLine(int connection, std::string& line)
+{
+    char c;
+    line.clear();
+
+    while (recv(connection, &c, 1, 0) == 1) {
+        if (c == '\n') {
+            return true;
+        } else if (c != '\r') {
+            line += c;
+        }
+    }
+
+    return false;
+}
+
+static bool parsePoint(const std::string& value, Point& point)
+{
+    float x, y, z;
+
+    if (sscanf(value.c_str(), "%f,%f,%f", &x, &y, &z) != 3) {
+        return false;
+    }
+
+    point = Point(x, y, z);
+    return true;
+}
+
+static double percentile(const std::vector<double>& sorted, double fraction)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+
+    size_t index = (size_t) (fraction * (sorted.size() - 1) + 0.5);
+
+    return sorted[index];
+}
+
+RenderServer::RenderServer(SceneLibrary* _library, ThreadPool* _pool)
+{
+    library = _library;
+    pool = _pool;
+    nextJobId = 1;
+    finishedJobs = 0;
+    listenSocket = -1;
+    stopping = false;
+    openConnections = 0;
+}
+
+bool RenderServer::run(int port)
+{
+    listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (listenSocket < 0) {
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listenSocket, (sockaddr*) &address, sizeof(address)) != 0 || listen(listenSocket, 16) != 0) {
+        close(listenSocket);
+        return false;
+    }
+
+    while (!stopping) {
+        int connection = accept(listenSocket, NULL, NULL);
+
+        if (connection < 0) {
+            continue;   /* Interrupted, or the listening socket was shut down by QUIT */
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            openConnections++;
+        }
+
+        std::thread(&RenderServer::serveConnection, this, connection).detach();
+    }
+
+    close(listenSocket);
+
+    std::unique_lock<std::mutex> lock(connectionsMutex);
+
+    while (openConnections > 0) {
+        connectionsClosed.wait(lock);
+    }
+
+    return true;
+}
+
+void RenderServer::serveConnection(int connection)
+{
+    std::string line;
+
+    while (receiveLine(connection, line)) {
+        std::vector<unsigned char> image;
+        std::string reply = handleRequest(line, image);
+
+        if (!sendAll(connection, reply.data(), reply.size()) ||
+            (!image.empty() && !sendAll(connection, &image[0], image.size()))) {
+            break;
+        }
+
+        if (line == "QUIT") {
+            break;
+        }
+    }
+
+    close(connection);
+
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+
+    if (--openConnections == 0) {
+        connectionsClosed.notify_all();
+    }
+}
+
+std::string RenderServer::handleRequest(const std::string& line, std::vector<unsigned char>& image)
+{
+    std::istringstream words(line);
+    std::string command;
+    words >> command;
+
+    if (command == "RENDER") {
+        RenderJob job;
+        std::string error;
+
+        if (!parseJob(line, job, error)) {
+            return "ERROR " + error + "\n";
+        }
+
+        return renderJob(job, image);
+    } else if (command == "CANCEL") {
+        std::string id;
+        words >> id;
+        return cancelJob(id);
+    } else if (command == "STATS") {
+        return statsReport();
+    } else if (command == "QUIT") {
+        stopping = true;
+        shutdown(listenSocket, SHUT_RDWR);
+        return "OK\n";
+    }
+
+    return "ERROR unknown command\n";
+}
+
+bool RenderServer::parseJob(const std::string& line, RenderJob& job, std::string& error)
+{
+    std::istringstream words(line);
+    std::string word;
+    int width = 0, height = 0;
+    int region[4] = { 0, 0, -1, -1 };
+    Camera camera;
+
+    job.sceneId = 0;
+    job.samples = 1;
+    job.priority = 0;
+    words >> word;  /* RENDER */
+
+    while (words >> word) {
+        size_t equals = word.find('=');
+
+        if (equals == std::string::npos) {
+            error = "expected key=value, got " + word;
+            return false;
+        }
+
+        std::string key = word.substr(0, equals);
+        std::string value = word.substr(equals + 1);
+        Point point;
+
+        if (key == "scene") {
+            job.sceneId = atoi(value.c_str());
+        } else if (key == "width") {
+            width = atoi(value.c_str());
+        } else if (key == "height") {
+            height = atoi(value.c_str());
+        } else if (key == "samples") {
+            job.samples = atoi(value.c_str());
+        } else if (key == "priority") {
+            job.priority = atoi(value.c_str());
+        } else if (key == "id") {
+            job.id = value;
+        } else if (key == "region") {
+            if (sscanf(value.c_str(), "%d,%d,%d,%d", &region[0], &region[1], &region[2], &region[3]) != 4) {
+                error = "bad region";
+                return false;
+            }
+        } else if (key == "eye" && parsePoint(value, point)) {
+            camera.setPosition(point);
+        } else if (key == "lookat" && parsePoint(value, point)) {
+            camera.setLookAt(point);
+        } else if (key == "up" && parsePoint(value, point)) {
+            camera.setUp(point);
+        } else if (key == "fov") {
+            camera.setFieldOfView(atof(value.c_str()));
+        } else {
+            error = "bad parameter " + key;
+            return false;
+        }
+    }
+
+    if (width <= 0 || height <= 0) {
+        error = "width and height are required";
+        return false;
+    }
+
+    camera.setResolution(width, height);
+
+    if (region[2] >= 0) {
+        camera.setRegion(region[0], region[1], region[2], region[3]);
+    }
+
+    job.camera = camera;
+
+    if (job.id.empty()) {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        job.id = "job" + std::to_string(nextJobId++);
+    }
+
+    return true;
+}
+
+std::string RenderServer::renderJob(RenderJob& job, std::vector<unsigned char>& image)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::shared_ptr<const Scene> scene = library->get(job.sceneId);
+
+    if (!scene) {
+        return "ERROR unknown scene\n";
+    }
+
+    Renderer renderer(scene.get(), job.camera);
+    renderer.setThreadPool(pool);
+    renderer.setPriority(job.priority);
+    renderer.setSamplesPerPixel(job.samples);
+
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        std::deque<std::string>::iterator cancelled = std::find(cancelledIds.begin(), cancelledIds.end(), job.id);
+
+        if (activeJobs.count(job.id) > 0) {
+            return "ERROR duplicate id\n";
+        }
+
+        if (cancelled != cancelledIds.end()) {
+            cancelledIds.erase(cancelled);
+            return "CANCELLED " + job.id + "\n";
+        }
+
+        activeJobs[job.id] = &renderer;
+    }
+
+    FrameBuffer framebuffer(job.camera.getWidth(), job.camera.getHeight());
+    renderer.render(framebuffer);
+
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        activeJobs.erase(job.id);
+
+        if (renderer.isCancelled()) {
+            return "CANCELLED " + job.id + "\n";
+        }
+
+        latencies.push_back(milliseconds);
+        finishedJobs++;
+
+        if (latencies.size() > SERVER_LATENCY_WINDOW) {
+            latencies.pop_front();
+        }
+    }
+
+    framebuffer.encodePPM(image);
+
+    char reply[256];
+    snprintf(reply, sizeof(reply), "OK %s %d %d %.3f %lu\n", job.id.c_str(), job.camera.getWidth(),
+             job.camera.getHeight(), milliseconds, (unsigned long) image.size());
+
+    return reply;
+}
+
+std::string RenderServer::cancelJob(const std::string& id)
+{
+    if (id.empty()) {
+        return "ERROR missing id\n";
+    }
+
+    std::lock_guard<std::mutex> lock(jobsMutex);
+    std::map<std::string, Renderer*>::iterator job = activeJobs.find(id);
+
+    if (job != activeJobs.end()) {
+        job->second->cancel();
+    } else if (std::find(cancelledIds.begin(), cancelledIds.end(), id) == cancelledIds.end()) {
+        cancelledIds.push_back(id);     /* The request may still be on its way */
+
+        if (cancelledIds.size() > SERVER_MAX_PENDING_CANCELS) {
+            cancelledIds.pop_front();
+        }
+    }
+
+    return "OK\n";
+}
+
+std::string RenderServer::statsReport()
+{
+    std::vector<double> sorted;
+    unsigned long jobs;
+
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        sorted.assign(latencies.begin(), latencies.end());
+        jobs = finishedJobs;
+    }
+
+    std::sort(sorted.begin(), sorted.end());
+
+    char reply[256];
+    snprintf(reply, sizeof(reply), "STATS jobs=%lu p50=%.3f p90=%.3f p99=%.3f max=%.3f scene_hits=%d scene_misses=%d\n",
+             jobs, percentile(sorted, 0.50), percentile(sorted, 0.90),
+             percentile(sorted, 0.99), sorted.empty() ? 0.0 : sorted.back(), library->getHits(), library->getMisses());
+
+    return reply;
+}
+
+bool RenderServer::sendRequest(int port, const std::string& request, std::string& reply, std::vector<unsigned char>& image)
+{
+    int connection = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (connection < 0) {
+        return false;
+    }
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    std::string line = request + "\n";
+    bool ok = connect(connection, (sockaddr*) &address, sizeof(address)) == 0 &&
+              sendAll(connection, line.data(), line.size()) && receiveLine(connection, reply);
+
+    /* OK <id> <width> <height> <latency> <bytes> announces an image */
+    char id[128];
+    int width, height;
+    double latency;
+    unsigned long bytes = 0;
+
+    image.clear();
+
+    if (ok && sscanf(reply.c_str(), "OK %127s %d %d %lf %lu", id, &width, &height, &latency, &bytes) == 5 && bytes > 0) {
+        image.resize(bytes);
+        ok = receiveAll(connection, &image[0], bytes);
+    }
+
+    close(connection);
+
+    return ok;
+}
@@ -0,0 +1,95 @@
+/************************************************************************************************
+ File: RenderServer.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____RenderServer__
+#define __Ray_Tracer__C_____RenderServer__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "SceneLibrary.h"
+#include "ThreadPool.h"
+#include "Renderer.h"
+
+#define SERVER_MAX_PENDING_CANCELS 256  /* Cancels remembered for jobs that have not started */
+#define SERVER_LATENCY_WINDOW 4096      /* Finished jobs the STATS percentiles are taken over */
+
+/************************************************************************************************
+ Long-running render service on a local TCP port. Requests are single text lines, answered in order
+ on the same connection:
+
+   RENDER scene=1 width=200 height=200 [region=x0,y0,x1,y1] [samples=1] [priority=0] [id=name]
+          [eye=x,y,z] [lookat=x,y,z] [up=x,y,z] [fov=degrees]
+       -> OK <id> <width> <height> <latency ms> <bytes>\n followed by <bytes> of binary PPM
+       -> CANCELLED <id>\n
+       -> ERROR duplicate id\n when a job with that id is still rendering
+   CANCEL <id>      -> OK\n, or ERROR missing id\n
+   STATS            -> STATS jobs=.. p50=.. p90=.. p99=.. max=.. scene_hits=.. scene_misses=..\n
+                       jobs counts every finished job; the latencies are those of the last
+                       SERVER_LATENCY_WINDOW of them
+   QUIT             -> OK\n, then the server stops accepting and returns once idle
+
+ A CANCEL for an id that is not rendering is remembered, since its RENDER may still be on its way over
+ another connection; that RENDER is then answered CANCELLED. Only the last SERVER_MAX_PENDING_CANCELS
+ such ids are kept, so ids that are never rendered do not pile up.
+
+ Anything else is answered with ERROR <message>\n. Every job's tiles go to the shared thread pool at
+ the job's priority, and scenes come from a shared LRU scene library, so repeated requests for the
+ same scene skip loading entirely.
+************************************************************************************************/
+class RenderServer {
+public:
+    RenderServer(SceneLibrary* _library, ThreadPool* _pool);
+
+    /* Serves on 127.0.0.1:'port' until a client sends QUIT. Returns false if the port could not be bound */
+    bool run(int port);
+
+    /* Client side: sends one request line and reads the reply line and, for renders, the image */
+    static bool sendRequest(int port, const std::string& request, std::string& reply, std::vector<unsigned char>& image);
+
+private:
+    RenderServer(const RenderServer& server);
+
+    struct RenderJob {
+        std::string id;
+        int sceneId;
+        int samples;
+        int priority;
+        Camera camera;
+    };
+
+    void serveConnection(int connection);
+    std::string handleRequest(const std::string& line, std::vector<unsigned char>& image);
+    bool parseJob(const std::string& line, RenderJob& job, std::string& error);
+    std::string renderJob(RenderJob& job, std::vector<unsigned char>& image);
+    std::string cancelJob(const std::string& id);
+    std::string statsReport();
+
+    SceneLibrary* library;
+    ThreadPool* pool;
+
+    std::mutex jobsMutex;
+    std::map<std::string, Renderer*> activeJobs;
+    std::deque<std::string> cancelledIds;   /* Cancelled before their RENDER request arrived, oldest first */
+    std::deque<double> latencies;           /* Milliseconds of the last finished jobs, oldest first */
+    unsigned long finishedJobs;
+    int nextJobId;
+
+    int listenSocket;
+    std::atomic<bool> stopping;
+    int openConnections;
+    std::mutex connectionsMutex;
+    std::condition_variable connectionsClosed;
+};
+
+#endif /* defined(__Ray_Tracer__C_____RenderServer__) */
@@ -0,0 +1,825 @@
+/************************************************************************************************
+ File: Renderer.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Dr. Scott Schaefer & Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "Renderer.h"
+#include "Trace.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+Renderer::Renderer()
+{
+    scene = NULL;
+    threadCount = 1;
+    samplesPerPixel = 1;
+    seed = 0;
+    deterministic = true;
+    threadPool = NULL;
+    priority = 0;
+    contributionCutoff = 0.0;
+    rouletteThreshold = 0.0;
+    tileOrder = pixelOrder = TRAVERSAL_SCANLINE;
+    shadowProbes = SHADOW_PROBES;
+    maxShadowSamples = SHADOW_MAX_SAMPLES;
+    shadowRayBudget = SHADOW_RAY_BUDGET;
+    featureBuffer = NULL;
+    frustumCulling = true;
+    environmentSamples = ENVIRONMENT_SAMPLES;
+    numaTopology = NULL;
+    sceneReplicas = NULL;
+    costOrdering = false;
+    prepassSeconds = 0.0;
+    cancelled = false;
+    rayCount = shadowRayCount = stolenTiles = 0;
+}
+
+Renderer::Renderer(const Renderer& renderer)
+{
+    scene = renderer.getScene();
+    camera = renderer.getCamera();
+    threadCount = renderer.getThreadCount();
+    samplesPerPixel = renderer.getSamplesPerPixel();
+    seed = renderer.getSeed();
+    deterministic = renderer.isDeterministic();
+    threadPool = renderer.getThreadPool();
+    priority = renderer.getPriority();
+    tileCallback = renderer.getTileCallback();
+    contributionCutoff = renderer.getContributionCutoff();
+    rouletteThreshold = renderer.getRouletteThreshold();
+    tileOrder = renderer.getTileOrder();
+    pixelOrder = renderer.getPixelOrder();
+    shadowProbes = renderer.getShadowProbes();
+    maxShadowSamples = renderer.getMaxShadowSamples();
+    shadowRayBudget = renderer.getShadowRayBudget();
+    featureBuffer = renderer.getFeatureBuffer();
+    frustumCulling = renderer.isFrustumCulling();
+    environmentSamples = renderer.getEnvironmentSamples();
+    numaTopology = renderer.getNumaTopology();
+    sceneReplicas = renderer.getSceneReplicas();
+    costOrdering = renderer.isCostOrdering();
+    previewCallback = renderer.getPreviewCallback();
+    prepassSeconds = 0.0;
+    cancelled = renderer.isCancelled();
+    rayCount = shadowRayCount = stolenTiles = 0;
+}
+
+Renderer::Renderer(const Scene* _scene, const Camera& _camera)
+{
+    scene = _scene;
+    camera = _camera;
+    threadCount = 1;
+    samplesPerPixel = 1;
+    seed = 0;
+    deterministic = true;
+    threadPool = NULL;
+    priority = 0;
+    contributionCutoff = 0.0;
+    rouletteThreshold = 0.0;
+    tileOrder = pixelOrder = TRAVERSAL_SCANLINE;
+    shadowProbes = SHADOW_PROBES;
+    maxShadowSamples = SHADOW_MAX_SAMPLES;
+    shadowRayBudget = SHADOW_RAY_BUDGET;
+    featureBuffer = NULL;
+    frustumCulling = true;
+    environmentSamples = ENVIRONMENT_SAMPLES;
+    numaTopology = NULL;
+    sceneReplicas = NULL;
+    costOrdering = false;
+    prepassSeconds = 0.0;
+    cancelled = false;
+    rayCount = shadowRayCount = stolenTiles = 0;
+}
+
+void Renderer::render(FrameBuffer& framebuffer)
+{
+    TRACE_ZONE(TRACE_RENDER);
+
+    beginRender();
+
+    parallelFor((int) tileSequence.size(), [this, &framebuffer](int n) {
+        renderTile(framebuffer, tileSequence[n], NULL, false);
+    });
+
+    renderDeferredPixels(framebuffer);
+}
+
+void Renderer::beginRender()
+{
+    deferredPixels.clear();
+    rayCount = shadowRayCount = stolenTiles = 0;
+
+    getTraversalOrder(tileOrder, camera.getTileCountX(), camera.getTileCountY(), tileSequence);
+    getTraversalOrder(pixelOrder, TILE_SIZE, TILE_SIZE, pixelSequence);
+    tileSeconds.assign(camera.getTileCountX() * camera.getTileCountY(), 0.0f);
+
+    if (frustumCulling) {
+        frustumStats = FrustumStats();
+        culler.reset();
+
+        /* Replicas bring a culler per node */
+        if (sceneReplicas == NULL) {
+            TRACE_ZONE(TRACE_FRUSTUM_CULL);
+            FrustumCuller* built = new FrustumCuller();
+            built->build(*scene);
+            culler.reset(built);
+        }
+    }
+
+    /* Longest first; equal costs keep the tile order */
+    if (costOrdering) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        estimateTileCosts();
+        std::stable_sort(tileSequence.begin(), tileSequence.end(), [this](int a, int b) {
+            return tileCosts[a] > tileCosts[b];
+        });
+
+        prepassSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (previewCallback) {
+            previewCallback(preview);
+        }
+    }
+}
+
+void Renderer::estimateTileCosts()
+{
+    TRACE_ZONE(TRACE_COST_PREPASS);
+    const EnvironmentMap* environment = scene->getEnvironment();
+    std::vector<Light> lights = scene->getLights();
+    float shadowRays = 0.0;
+
+    for (int j = 0; j < lights.size(); j++) {
+        shadowRays += lights[j].isAreaLight() ? shadowProbes : 1;
+    }
+
+    /* Rays of a camera ray's hit, and of a reflection's, which takes one environment sample */
+    float hitRays = 1.0f + shadowRays + ((environment != NULL) ? environmentSamples : 0);
+    float bounceRays = 1.0f + shadowRays + ((environment != NULL) ? 1 : 0);
+
+    tileCosts.assign(camera.getTileCountX() * camera.getTileCountY(), 0.0f);
+    preview.resize((camera.getWidth() + PREPASS_STRIDE - 1) / PREPASS_STRIDE,
+                   (camera.getHeight() + PREPASS_STRIDE - 1) / PREPASS_STRIDE);
+
+    parallelFor((int) tileSequence.size(), [&](int n) {
+        const Scene* tracedScene = (sceneReplicas != NULL) ? sceneReplicas->getScene(getCurrentNumaNode()) : scene;
+        int tile = tileSequence[n];
+        int x0, y0, x1, y1;
+        float cost = 0.0;
+        bool counting = getTraversalCounting();
+
+        camera.getTileBounds(tile, x0, y0, x1, y1);
+        setTraversalCounting(true);     /* A sampled ray's surface tests and cell visits are its traversal cost */
+
+        /* Sample pixels on the image-wide grid, so that the preview pixels line up across tiles */
+        for (int y = (y0 + PREPASS_STRIDE - 1) / PREPASS_STRIDE * PREPASS_STRIDE; y < y1; y += PREPASS_STRIDE) {
+            for (int x = (x0 + PREPASS_STRIDE - 1) / PREPASS_STRIDE * PREPASS_STRIDE; x < x1; x += PREPASS_STRIDE) {
+                Ray ray = camera.getPrimaryRay(x, y), normal;
+                float closest = INFINITY;
+                TraversalCounts before = getTraversalCounts();
+                Surface* surface = tracedScene->intersect(ray, closest, normal);
+                TraversalCounts after = getTraversalCounts();
+                float traversal = 1.0f + (float) (after.surfaceTests - before.surfaceTests) +
+                                  (float) (after.cellVisits - before.cellVisits);
+                std::vector<float> direction = ray.normalize();
+                Color color = BG_COLOR;
+
+                if (surface == NULL) {
+                    cost += traversal;
+
+                    if (environment != NULL) {
+                        color = environment->lookup(&direction[0]);
+                    }
+                } else {
+                    std::vector<float> normalVector = normal.normalize();
+                    float facing = fabsf( (direction[0] * normalVector[0]) + (direction[1] * normalVector[1]) +
+                                          (direction[2] * normalVector[2]) );
+                    float throughput = 1.0, rays = hitRays;
+
+                    for (int depth = 0; depth <= DEPTH_LIMIT && surface->isReflective(); depth++) {
+                        throughput *= surface->getReflectivity();
+
+                        if (throughput < contributionCutoff) {
+                            break;
+                        }
+                        rays += bounceRays;
+                    }
+
+                    cost += traversal * rays;
+                    color = surface->getDiffuseCoefficients() * (0.2f + 0.8f * facing);
+                }
+
+                preview.setPixel(x / PREPASS_STRIDE, y / PREPASS_STRIDE, color);
+            }
+        }
+
+        setTraversalCounting(counting);
+        tileCosts[tile] = cost;
+    });
+}
+
+/* Without a pool, worker threads claim indices from a shared counter and the calling thread works too
+    instead of idling until the others are done. With a pool there is one task per index so that a
+    higher-priority render submitted later overtakes this one at the next tile boundary. Cancelled
+    work still runs its task, but returns immediately */
+void Renderer::parallelFor(int count, const std::function<void(int)>& body)
+{
+    if (threadPool != NULL) {
+        TaskGroup group;
+
+        group.add(count);
+
+        for (int i = 0; i < count; i++) {
+            threadPool->submit([this, &body, &group, i]() {
+                if (!cancelled) {
+                    body(i);
+                }
+                group.done();
+            }, priority);
+        }
+
+        group.wait();
+        return;
+    }
+
+    if (numaTopology != NULL && numaTopology->getNodeCount() > 1) {
+        parallelForNodes(count, body);
+        return;
+    }
+
+    std::atomic<int> next(0);
+    std::function<void()> work = [this, &body, &next, count]() {
+        for (int i = next.fetch_add(1); i < count && !cancelled; i = next.fetch_add(1)) {
+            body(i);
+        }
+    };
+
+    std::vector<std::thread> workers;
+
+    for (int i = 1; i < threadCount; i++) {
+        workers.push_back( std::thread(work) );
+    }
+
+    work();
+
+    for (int i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+/* Each node's range of indices is a head and a tail packed into one word, so that its own workers
+    taking from the front and other nodes' workers taking from the back never claim the same index.
+    Every worker is a new thread pinned to its node; the calling thread only waits, since its affinity
+    is the caller's */
+void Renderer::parallelForNodes(int count, const std::function<void(int)>& body)
+{
+    struct NodeRange {
+        std::atomic<uint64_t> bounds;   /* Tail << 32 | head */
+        char padding[56];               /* Keeps the nodes' words on different cache lines */
+    };
+
+    int nodeCount = numaTopology->getNodeCount();
+    std::vector<int> workerNodes(threadCount), nodeWorkers(nodeCount, 0);
+    std::unique_ptr<NodeRange[]> ranges(new NodeRange[nodeCount]);
+
+    for (int w = 0; w < threadCount; w++) {
+        workerNodes[w] = numaTopology->getWorkerNode(w, threadCount);
+        nodeWorkers[workerNodes[w]]++;
+    }
+
+    /* Shares of the indices proportional to the nodes' workers */
+    for (int n = 0, before = 0; n < nodeCount; n++) {
+        uint64_t head = (uint64_t) ((int64_t) count * before / threadCount);
+        uint64_t tail = (uint64_t) ((int64_t) count * (before + nodeWorkers[n]) / threadCount);
+
+        ranges[n].bounds = (tail << 32) | head;
+        before += nodeWorkers[n];
+    }
+
+    /* Claims the front or the back index of 'range'; -1 once it is empty */
+    auto claim = [](NodeRange& range, bool front) {
+        uint64_t bounds = range.bounds.load();
+
+        while (true) {
+            uint32_t head = (uint32_t) bounds, tail = (uint32_t) (bounds >> 32);
+
+            if (head >= tail) {
+                return -1;
+            }
+
+            uint64_t claimed = front ? bounds + 1 : bounds - ((uint64_t) 1 << 32);
+
+            if (range.bounds.compare_exchange_weak(bounds, claimed)) {
+                return (int) (front ? head : tail - 1);
+            }
+        }
+    };
+
+    std::function<void(int)> work = [this, &body, &ranges, &claim, nodeCount](int node) {
+        bindThreadToNode(*numaTopology, node);
+
+        for (int i = claim(ranges[node], true); i >= 0 && !cancelled; i = claim(ranges[node], true)) {
+            body(i);
+        }
+
+        /* Nearest node numbers first, which is where the kernel usually puts nearby nodes */
+        for (int step = 1; step < nodeCount && !cancelled; step++) {
+            NodeRange& victim = ranges[(node + step) % nodeCount];
+
+            for (int i = claim(victim, false); i >= 0 && !cancelled; i = claim(victim, false)) {
+                stolenTiles++;
+                body(i);
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+
+    for (int w = 0; w < threadCount; w++) {
+        workers.push_back( std::thread(work, workerNodes[w]) );
+    }
+
+    for (int w = 0; w < workers.size(); w++) {
+        workers[w].join();
+    }
+}
+
+/* Deferred pixels are retried once the pages they asked for have been loaded. Under a tight memory
+    budget those pages may be evicted again before the retry gets to them, so after a few rounds the
+    remaining pixels read their pages themselves */
+void Renderer::renderDeferredPixels(FrameBuffer& framebuffer)
+{
+    for (int round = 0; !deferredPixels.empty() && !cancelled; round++) {
+        TRACE_ZONE(TRACE_DEFERRED_PIXELS);
+        std::vector<std::pair<int, std::vector<int> > > pending(deferredPixels.begin(), deferredPixels.end());
+        bool blockingLoads = round >= DEFERRED_ROUNDS;
+
+        deferredPixels.clear();
+        scene->getPagedGeometry()->waitForPendingLoads();
+
+        parallelFor((int) pending.size(), [this, &framebuffer, &pending, blockingLoads](int i) {
+            renderTile(framebuffer, pending[i].first, &pending[i].second, blockingLoads);
+        });
+    }
+}
+
+/* Luminance of a color as the framebuffer will store it, clamped to [0, 1] */
+static float displayLuminance(const Color& color)
+{
+    float r = std::min(1.0f, std::max(0.0f, color.getR()));
+    float g = std::min(1.0f, std::max(0.0f, color.getG()));
+    float b = std::min(1.0f, std::max(0.0f, color.getB()));
+
+    return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+}
+
+/* Each tile's primary ray directions are generated in one pass by the camera rather than per pixel.
+    With several samples per pixel the samples are jittered and added up in sample order, so the sum
+    never depends on which thread rendered the tile */
+void Renderer::renderTile(FrameBuffer& framebuffer, int tile, const std::vector<int>* pixels, bool blockingLoads)
+{
+    TRACE_ZONE(TRACE_TILE);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    float dirX[TILE_SIZE * TILE_SIZE], dirY[TILE_SIZE * TILE_SIZE], dirZ[TILE_SIZE * TILE_SIZE];
+    int x0, y0, x1, y1;
+    int rays = 0, shadowRays = 0;
+    int sampleBudget = std::max(1, shadowRayBudget / samplesPerPixel);
+    std::vector<int> missed;
+
+    camera.getTileBounds(tile, x0, y0, x1, y1);
+
+    /* The copy of the scene on this worker's node, if there are copies */
+    const Scene* tileScene = (sceneReplicas != NULL) ? sceneReplicas->getScene(getCurrentNumaNode()) : scene;
+    const FrustumCuller* tileCuller = (sceneReplicas != NULL) ? sceneReplicas->getCuller(getCurrentNumaNode()) :
+                                                                culler.get();
+
+    /* The tile-level stage: cull the scene once for all of the tile's camera and shadow rays */
+    TileCandidates candidates;
+
+    if (frustumCulling) {
+        TRACE_ZONE(TRACE_FRUSTUM_CULL);
+        float corners[4][3];
+        FrustumStats tileStats;
+
+        camera.getTileCorners(x0, y0, x1, y1, FRUSTUM_PIXEL_MARGIN, corners);
+        tileCuller->cull(camera.getPosition(), corners, candidates, tileStats);
+
+        std::lock_guard<std::mutex> lock(statsMutex);
+        frustumStats.tiles += tileStats.tiles;
+        frustumStats.primaryTiles += tileStats.primaryTiles;
+        frustumStats.surfaces += tileStats.surfaces;
+        frustumStats.primaryKept += tileStats.primaryKept;
+        frustumStats.shadowLists += tileStats.shadowLists;
+        frustumStats.shadowCulledLists += tileStats.shadowCulledLists;
+        frustumStats.shadowTested += tileStats.shadowTested;
+        frustumStats.shadowKept += tileStats.shadowKept;
+    }
+
+    if (samplesPerPixel == 1) {
+        TRACE_ZONE(TRACE_CAMERA_RAYS);
+        camera.getTileDirections(x0, y0, x1, y1, dirX, dirY, dirZ);
+    }
+
+    /* The pixel order of a whole tile, less the pixels that a clipped tile does not have */
+    int order[TILE_SIZE * TILE_SIZE];
+    int pixelCount = 0;
+
+    if (pixels == NULL) {
+        for (int n = 0; n < pixelSequence.size(); n++) {
+            int localX = pixelSequence[n] % TILE_SIZE, localY = pixelSequence[n] / TILE_SIZE;
+
+            if (localX < x1 - x0 && localY < y1 - y0) {
+                order[pixelCount++] = localY * (x1 - x0) + localX;
+            }
+        }
+    } else {
+        pixelCount = (int) pixels->size();
+    }
+
+    for (int p = 0; p < pixelCount; p++) {
+
+        int k = (pixels != NULL) ? (*pixels)[p] : order[p];
+        int i = y0 + k / (x1 - x0);
+        int j = x0 + k % (x1 - x0);
+        uint32_t pixelIndex = (uint32_t) i * camera.getWidth() + j;
+        Color pixelColor, albedo;
+        float normal[3] = { 0.0, 0.0, 0.0 }, depth = 0.0, variance = -1.0;
+        float luminanceSum = 0.0, luminanceSquares = 0.0;
+        bool missing = false;
+
+        if (samplesPerPixel == 1) {
+            std::vector<float> direction(3);
+            direction[0] = dirX[k];
+            direction[1] = dirY[k];
+            direction[2] = dirZ[k];
+
+            TraceState state(RandomStream(seed, pixelIndex, 0, deterministic));
+            state.blockingLoads = blockingLoads;
+            state.shadowBudget = sampleBudget;
+            state.recordFeatures = featureBuffer != NULL;
+            state.candidates = frustumCulling ? &candidates : NULL;
+            state.scene = tileScene;
+            pixelColor = rayTrace( Ray(camera.getPosition(), direction), 0, state );
+            missing = state.missing;
+            rays += state.rays;
+            shadowRays += state.shadowRays;
+            albedo = state.albedo;
+            depth = state.depth;
+
+            for (int c = 0; c < 3; c++) {
+                normal[c] = state.normal[c];
+            }
+        } else {
+            for (int sample = 0; sample < samplesPerPixel; sample++) {
+                TraceState state(RandomStream(seed, pixelIndex, sample, deterministic));
+                state.blockingLoads = blockingLoads;
+                state.shadowBudget = sampleBudget;
+                state.recordFeatures = featureBuffer != NULL;
+                state.candidates = frustumCulling ? &candidates : NULL;
+                state.scene = tileScene;
+                Ray primaryRay;
+
+                {
+                    TRACE_ZONE(TRACE_CAMERA_RAYS);
+                    primaryRay = camera.getPrimaryRay(j, i, state.random.get(0, 0) - 0.5f, state.random.get(0, 1) - 0.5f);
+                }
+
+                Color sampleColor = rayTrace(primaryRay, 0, state);
+                pixelColor += sampleColor;
+                missing = missing || state.missing;
+                rays += state.rays;
+                shadowRays += state.shadowRays;
+                albedo += state.albedo;
+                depth += state.depth;
+
+                if (featureBuffer != NULL) {
+                    float luminance = displayLuminance(sampleColor);
+                    luminanceSum += luminance;
+                    luminanceSquares += luminance * luminance;
+                }
+
+                for (int c = 0; c < 3; c++) {
+                    normal[c] += state.normal[c];
+                }
+            }
+
+            pixelColor /= samplesPerPixel;
+            albedo /= samplesPerPixel;
+            depth /= samplesPerPixel;
+
+            for (int c = 0; c < 3; c++) {
+                normal[c] /= samplesPerPixel;
+            }
+
+            /* Unbiased sample variance, divided by the count for the variance of the mean */
+            float mean = luminanceSum / samplesPerPixel;
+            variance = std::max(0.0f, (luminanceSquares - samplesPerPixel * mean * mean) /
+                                      ((samplesPerPixel - 1) * samplesPerPixel));
+        }
+
+        framebuffer.setPixel(j, i, pixelColor);
+
+        if (featureBuffer != NULL) {
+            featureBuffer->setPixel(j, i, albedo, normal, depth, variance);
+        }
+
+        if (missing) {
+            missed.push_back(k);
+        }
+
+    }
+
+    rayCount += rays;
+    shadowRayCount += shadowRays;
+    tileSeconds[tile] += std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+    if (!missed.empty()) {
+        std::lock_guard<std::mutex> lock(deferredMutex);
+        deferredPixels[tile] = missed;
+    } else if (tileCallback) {
+        tileCallback(tile);     /* Tiles with deferred pixels report once their last retry is done */
+    }
+}
+
+
+/************************************************************************************************
+ RayTracing functions
+************************************************************************************************/
+Color Renderer::calcAmbience(Surface* surface, const Color& albedo) {
+    Color surfaceAmbience = surface->getAmbientCoefficients() * albedo;
+    Color sceneAmbience = scene->getAmbientIntensity();
+
+    return Color(surfaceAmbience.getR() * sceneAmbience.getR(),
+                 surfaceAmbience.getG() * sceneAmbience.getG(),
+                 surfaceAmbience.getB() * sceneAmbience.getB());
+}
+
+/* Illum = kaA + C( kd(L.N) + ks(R.E)^n ), the light-dependent part comes from the surface's kernel */
+Color Renderer::calcIllumination(Surface* surface, const ShadingPoint& point, const Light& lightSource, bool calcAmb,
+                                 float visibility) {
+    TRACE_ZONE(TRACE_SHADING);
+    Color final;
+
+    if (calcAmb) {
+        final += calcAmbience(surface, point.albedo);
+    }
+
+    final += surface->shade(point, lightSource) * visibility;
+
+    return final;
+}
+
+/* Traced from the light to the point, as the ray tracer always has, so the blocking surfaces are those
+    between the surface's own intersection and the light */
+bool Renderer::isShadowed(Surface* surface, const Point& point, const Point& lightPoint,
+                          const std::vector<Surface*>* occluders, TraceState& state) {
+    const Scene* tracedScene = getTracedScene(state);
+    PagedGeometry* pagedGeometry = tracedScene->getPagedGeometry();
+    Ray lightRay(lightPoint, point);
+    Ray tempNormal;
+
+    state.rays++;
+    state.shadowRays++;
+
+    float distance = surface->intersect(lightRay, tempNormal);
+    bool inShadow = (occluders != NULL) ? BruteForceAccelerator::occludedByAny(*occluders, lightRay, distance) :
+                                          tracedScene->occluded(lightRay, distance);
+
+    if (!inShadow && pagedGeometry != NULL) {
+        inShadow = pagedGeometry->occluded(lightRay, distance, state.missing, state.blockingLoads);
+    }
+
+    return inShadow;
+}
+
+/* Area samples are a prefix of the Sobol sequence, randomly rotated per pixel and light, so the probes
+    are stratified in 2 x 2 and the samples that follow refine them in 4 x 4 */
+float Renderer::lightVisibility(Surface* surface, const Point& point, const Light& light, int lightIndex, int depth,
+                                TraceState& state) {
+    /* Shadow rays from the camera ray's hit only need the tile's candidates */
+    const std::vector<Surface*>* occluders = (depth == 0 && state.candidates != NULL) ?
+                                             state.candidates->getShadow(lightIndex) : NULL;
+
+    if (!light.isAreaLight()) {
+        return isShadowed(surface, point, light.getPosition(), occluders, state) ? 0.0f : 1.0f;
+    }
+
+    float shiftS = state.random.get(depth, SHADOW_DIMENSION + 2 * lightIndex);
+    float shiftT = state.random.get(depth, SHADOW_DIMENSION + 2 * lightIndex + 1);
+    int probes = std::max(1, std::min(shadowProbes, state.shadowBudget - state.shadowRays));
+    int limit = probes;
+    int visible = 0, taken = 0;
+    Light::SampleFrame frame = light.getSampleFrame(point);
+
+    for (; taken < limit; taken++) {
+        float s, t;
+        getSobolSample(taken, shiftS, shiftT, s, t);
+        visible += isShadowed(surface, point, light.samplePosition(s, t, frame), occluders, state) ? 0 : 1;
+
+        /* Penumbra: refine within what the budget has left */
+        if (taken + 1 == probes && visible != 0 && visible != probes) {
+            limit = std::min(maxShadowSamples, probes + std::max(0, state.shadowBudget - state.shadowRays));
+        }
+    }
+
+    return (float) visible / taken;
+}
+
+Color Renderer::environmentLighting(Surface* surface, const ShadingPoint& point, int lightCount, int depth,
+                                    TraceState& state) {
+    const Scene* tracedScene = getTracedScene(state);
+    const EnvironmentMap* environment = tracedScene->getEnvironment();
+    PagedGeometry* pagedGeometry = tracedScene->getPagedGeometry();
+    Point start(point.position[0], point.position[1], point.position[2]);
+    int samples = (depth == 0) ? environmentSamples : 1;
+    int dimension = SHADOW_DIMENSION + 2 * lightCount;
+    Color gathered;
+
+    for (int n = 0; n < samples; n++) {
+        float s = state.random.get(depth, dimension + 2 * n), t = state.random.get(depth, dimension + 2 * n + 1);
+        float direction[3], pdf;
+
+        Color radiance = environment->sample(s, t, direction, pdf);
+        float cosine = (point.normal[0] * direction[0]) + (point.normal[1] * direction[1]) +
+                       (point.normal[2] * direction[2]);
+
+        if (pdf <= 0.0f || cosine <= 0.0f) {
+            continue;
+        }
+
+        /* Surfaces only block beyond t = 1, so the ray starts one unit behind the point */
+        Ray shadowRay(Point(start.getX() - direction[0], start.getY() - direction[1], start.getZ() - direction[2]), start);
+        bool blocked = tracedScene->occluded(shadowRay, INFINITY);
+
+        if (!blocked && pagedGeometry != NULL) {
+            blocked = pagedGeometry->occluded(shadowRay, INFINITY, state.missing, state.blockingLoads);
+        }
+
+        state.rays++;
+        state.shadowRays++;
+
+        if (!blocked) {
+            gathered += radiance * (cosine / (pdf * samples));
+        }
+    }
+
+    return surface->getDiffuseCoefficients() * point.albedo * gathered * (float) (1.0 / M_PI);
+}
+
+Color Renderer::rayTrace(Ray ray, int depth, TraceState& state) {
+
+    const Scene* tracedScene = getTracedScene(state);
+    PagedGeometry* pagedGeometry = tracedScene->getPagedGeometry();
+    Ray closestSurfaceNormal;
+    float closestIntersection = INFINITY;
+
+    state.rays++;
+
+    /* Find the surface that has the closest intersection with 'ray' */
+    Surface* closestSurface;
+
+    {
+        TRACE_ZONE(TRACE_INTERSECTION);
+        const std::vector<Surface*>* candidates = (depth == 0 && state.candidates != NULL) ?
+                                                  state.candidates->getPrimary() : NULL;
+
+        if (candidates != NULL) {
+            closestSurface = BruteForceAccelerator::intersectAll(*candidates, ray, closestIntersection,
+                                                                 closestSurfaceNormal);
+        } else {
+            closestSurface = tracedScene->intersect(ray, closestIntersection, closestSurfaceNormal);
+        }
+
+        if (pagedGeometry != NULL) {
+            Surface* streamedSurface = pagedGeometry->intersect(ray, closestIntersection, closestSurfaceNormal,
+                                                                state.pins, state.missing, state.blockingLoads);
+
+            if (streamedSurface != NULL) {
+                closestSurface = streamedSurface;
+            }
+        }
+    }
+
+    Color finalColor;
+
+    if (closestSurface == NULL) {   /* If there are no intersections return background color */
+
+        if (tracedScene->getEnvironment() != NULL) {
+            std::vector<float> direction = ray.normalize();
+            return tracedScene->getEnvironment()->lookup(&direction[0]);
+        }
+
+        return BG_COLOR;
+
+    } else {
+
+        Point adjustedIntersectionPoint = closestSurfaceNormal.getStartPoint();
+
+        std::vector<Light> sceneLights = tracedScene->getLights();
+
+        /* Geometry needed by the shading kernels, computed once for all lights */
+        ShadingPoint shadingPoint;
+        std::vector<float> normalVector = closestSurfaceNormal.normalize();
+        Point eye = camera.getPosition();
+
+        shadingPoint.position[0] = adjustedIntersectionPoint.getX();
+        shadingPoint.position[1] = adjustedIntersectionPoint.getY();
+        shadingPoint.position[2] = adjustedIntersectionPoint.getZ();
+        shadingPoint.toEye[0] = eye.getX() - shadingPoint.position[0];
+        shadingPoint.toEye[1] = eye.getY() - shadingPoint.position[1];
+        shadingPoint.toEye[2] = eye.getZ() - shadingPoint.position[2];
+
+        float inverseLength = reciprocalSqrt( (shadingPoint.toEye[0] * shadingPoint.toEye[0]) +
+                                              (shadingPoint.toEye[1] * shadingPoint.toEye[1]) +
+                                              (shadingPoint.toEye[2] * shadingPoint.toEye[2]) );
+
+        for (int i = 0; i < 3; i++) {
+            shadingPoint.normal[i] = normalVector[i];
+            shadingPoint.toEye[i] *= inverseLength;
+        }
+
+        /* Ray cone: the footprint grows by one pixel's spread per unit travelled and stretches on
+            surfaces seen at a grazing angle */
+        float footprintWidth = state.coneWidth + camera.getPixelSpread() * closestIntersection;
+        shadingPoint.albedo = Color(1.0, 1.0, 1.0);
+
+        if (closestSurface->getTexture() != NULL) {
+            std::vector<float> rayDirection = ray.normalize();
+            float cosine = fabsf( (rayDirection[0] * normalVector[0]) + (rayDirection[1] * normalVector[1]) +
+                                  (rayDirection[2] * normalVector[2]) );
+            float u, v, scale;
+
+            closestSurface->getTextureCoordinates(adjustedIntersectionPoint, u, v, scale);
+            shadingPoint.albedo = closestSurface->getTexture()->sample(u, v, footprintWidth / fmaxf(cosine, 0.1f) * scale);
+        }
+
+        if (depth == 0 && state.recordFeatures) {
+            state.albedo = closestSurface->getDiffuseCoefficients() * shadingPoint.albedo;
+            state.depth = closestIntersection;
+
+            for (int i = 0; i < 3; i++) {
+                state.normal[i] = shadingPoint.normal[i];
+            }
+        }
+
+        /* Cast shadow rays from each light source to the surface to determine how much of it is in shadow.
+            An environment map replaces the ambient term */
+        bool calcAmb = (tracedScene->getEnvironment() == NULL);
+        for (int j = 0; j < sceneLights.size(); j++) {
+            float visibility;
+
+            {
+                TRACE_ZONE(TRACE_SHADOWING);
+                visibility = lightVisibility(closestSurface, adjustedIntersectionPoint, sceneLights[j], j, depth, state);
+            }
+
+            if (visibility == 0.0f) {
+                if (calcAmb) {
+                    finalColor += calcAmbience(closestSurface, shadingPoint.albedo);
+                    calcAmb = false;
+                }
+            } else {
+                /* Calculate illumination at intersection point */
+                finalColor += calcIllumination(closestSurface, shadingPoint, sceneLights[j], calcAmb, visibility);
+                calcAmb = false;
+            }
+        }
+
+        if (tracedScene->getEnvironment() != NULL) {
+            TRACE_ZONE(TRACE_SHADOWING);
+            finalColor += environmentLighting(closestSurface, shadingPoint, (int) sceneLights.size(), depth, state);
+        }
+
+        /* Cast reflection ray if object is reflective and the reflection still contributes enough */
+        if (depth <= DEPTH_LIMIT && closestSurface->isReflective()) {
+            float reflectivity = closestSurface->getReflectivity();
+            float throughput = state.throughput * reflectivity;
+            float weight = 1.0;
+            bool reflect = throughput >= contributionCutoff;
+
+            if (reflect && throughput < rouletteThreshold) {
+                float survival = throughput / rouletteThreshold;
+
+                reflect = state.random.get(depth + 1, ROULETTE_DIMENSION) < survival;
+                weight = 1.0f / survival;
+            }
+
+            if (reflect) {
+                TRACE_ZONE(TRACE_REFLECTION);
+                Ray reflectedRay = ray.getReflectedRay(closestSurfaceNormal);
+                state.coneWidth = footprintWidth;   /* Treats the mirror as flat, so the cone keeps its spread */
+                state.throughput = throughput * weight;
+                finalColor += (rayTrace(reflectedRay, depth + 1, state) * (reflectivity * weight));
+            }
+        }
+
+    }
+
+    return finalColor;
+}
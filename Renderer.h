@@ -0,0 +1,272 @@
+/************************************************************************************************
+ File: Renderer.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____Renderer__
+#define __Ray_Tracer__C_____Renderer__
+
+#include <stdio.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <functional>
+#include <memory>
+#include "Scene.h"
+#include "Camera.h"
+#include "FrameBuffer.h"
+#include "Random.h"
+#include "Shading.h"
+#include "ThreadPool.h"
+#include "PagedGeometry.h"
+#include "Texture.h"
+#include "Traversal.h"
+#include "FeatureBuffer.h"
+#include "Frustum.h"
+#include "EnvironmentMap.h"
+#include "Numa.h"
+
+#define BG_COLOR Color (0.1, 0.1, 0.1)
+#define DEPTH_LIMIT 2
+#define DEFERRED_ROUNDS 4   /* Retry rounds that wait for streamed pages before deferred pixels load them directly */
+#define ROULETTE_DIMENSION 2    /* Random dimension of the termination test; 0 and 1 jitter the primary ray */
+#define SHADOW_DIMENSION 3      /* First of the two random dimensions per light that rotate its area samples */
+#define SHADOW_PROBES 4         /* Default shadow rays tried first on an area light */
+#define SHADOW_MAX_SAMPLES 16   /* Default shadow rays per area light where the probes disagree */
+#define SHADOW_RAY_BUDGET 64    /* Default shadow rays per pixel over every light and bounce */
+#define PREPASS_STRIDE 4        /* The cost prepass traces one pixel in PREPASS_STRIDE x PREPASS_STRIDE */
+
+/* Per-pixel state carried through the recursion of rayTrace() */
+struct TraceState {
+    TraceState(const RandomStream& _random) : random(_random), coneWidth(0.0), throughput(1.0), rays(0),
+                                              shadowRays(0), shadowBudget(SHADOW_RAY_BUDGET), blockingLoads(false),
+                                              missing(false), candidates(NULL), scene(NULL), recordFeatures(false),
+                                              depth(0.0) {
+        normal[0] = normal[1] = normal[2] = 0.0;
+    }
+
+    RandomStream random;
+    float coneWidth;                        /* Width of the ray's footprint where it starts, for texture filtering */
+    float throughput;                       /* Weight of the current ray's radiance in the pixel */
+    int rays;                               /* Camera, reflection and shadow rays traced so far */
+    int shadowRays;                         /* Shadow rays among them */
+    int shadowBudget;                       /* Shadow rays area lights may use before falling back to one each */
+    bool blockingLoads;                     /* Read missing geometry pages instead of deferring */
+    bool missing;                           /* Set when the trace needed a page that was not resident */
+    std::vector<GeometryPagePin> pins;      /* Keeps streamed surfaces alive until the pixel is done */
+    const TileCandidates* candidates;       /* What the camera ray and its shadow rays can hit, or NULL for the scene */
+    const Scene* scene;                     /* The copy of the scene to trace, or NULL for the renderer's own */
+
+    /* First hit of the camera ray, filled in when 'recordFeatures' is set; see FeatureBuffer */
+    bool recordFeatures;
+    Color albedo;
+    float normal[3];
+    float depth;
+};
+
+class Renderer {
+public:
+    /* Called from a worker thread with the index of a tile whose pixels are final */
+    typedef std::function<void(int tile)> TileCallback;
+
+    /* Called on the rendering thread with the cost prepass's image, before any tile is rendered */
+    typedef std::function<void(const FrameBuffer& preview)> PreviewCallback;
+
+    Renderer();
+    Renderer(const Renderer& renderer);
+    Renderer(const Scene* _scene, const Camera& _camera);
+
+    void setScene(const Scene* newScene) { scene = newScene; }
+    void setCamera(const Camera& newCamera) { camera = newCamera; }
+    void setThreadCount(int count) { threadCount = (count < 1) ? 1 : count; }
+    void setSamplesPerPixel(int samples) { samplesPerPixel = (samples < 1) ? 1 : samples; }
+    void setSeed(uint32_t newSeed) { seed = newSeed; }
+    void setDeterministic(bool enabled) { deterministic = enabled; }
+    void setThreadPool(ThreadPool* pool) { threadPool = pool; }
+    void setPriority(int newPriority) { priority = newPriority; }
+    void setTileCallback(const TileCallback& callback) { tileCallback = callback; }
+    void setContributionCutoff(float cutoff) { contributionCutoff = cutoff; }
+    void setRouletteThreshold(float threshold) { rouletteThreshold = threshold; }
+    void setTileOrder(TraversalOrder order) { tileOrder = order; }
+    void setShadowProbes(int probes) { shadowProbes = (probes < 1) ? 1 : probes; }
+    void setMaxShadowSamples(int samples) { maxShadowSamples = (samples < 1) ? 1 : samples; }
+    void setShadowRayBudget(int budget) { shadowRayBudget = (budget < 1) ? 1 : budget; }
+    void setFeatureBuffer(FeatureBuffer* buffer) { featureBuffer = buffer; }
+    void setPixelOrder(TraversalOrder order) { pixelOrder = order; }
+    void setFrustumCulling(bool enabled) { frustumCulling = enabled; }
+    void setEnvironmentSamples(int samples) { environmentSamples = (samples < 1) ? 1 : samples; }
+    void setNumaTopology(const NumaTopology* topology) { numaTopology = topology; }
+    void setSceneReplicas(const SceneReplicas* replicas) { sceneReplicas = replicas; }
+    void setCostOrdering(bool enabled) { costOrdering = enabled; }
+    void setPreviewCallback(const PreviewCallback& callback) { previewCallback = callback; }
+    const Scene* getScene() const { return scene; }
+    Camera getCamera() const { return camera; }
+    int getThreadCount() const { return threadCount; }
+    int getSamplesPerPixel() const { return samplesPerPixel; }
+    uint32_t getSeed() const { return seed; }
+    bool isDeterministic() const { return deterministic; }
+    ThreadPool* getThreadPool() const { return threadPool; }
+    int getPriority() const { return priority; }
+    TileCallback getTileCallback() const { return tileCallback; }
+    float getContributionCutoff() const { return contributionCutoff; }
+    float getRouletteThreshold() const { return rouletteThreshold; }
+    TraversalOrder getTileOrder() const { return tileOrder; }
+    TraversalOrder getPixelOrder() const { return pixelOrder; }
+    int getShadowProbes() const { return shadowProbes; }
+    int getMaxShadowSamples() const { return maxShadowSamples; }
+    int getShadowRayBudget() const { return shadowRayBudget; }
+    FeatureBuffer* getFeatureBuffer() const { return featureBuffer; }
+    bool isFrustumCulling() const { return frustumCulling; }
+    int getEnvironmentSamples() const { return environmentSamples; }
+    const NumaTopology* getNumaTopology() const { return numaTopology; }
+    const SceneReplicas* getSceneReplicas() const { return sceneReplicas; }
+    bool isCostOrdering() const { return costOrdering; }
+    PreviewCallback getPreviewCallback() const { return previewCallback; }
+
+    /* Rays traced by the last render() */
+    uint64_t getRayCount() const { return rayCount; }
+    uint64_t getShadowRayCount() const { return shadowRayCount; }
+
+    /* Culling totals of the last render() with frustum culling */
+    FrustumStats getFrustumStats() const { return frustumStats; }
+
+    /* Tiles of the last render() run on a NUMA node other than the one whose range they were in */
+    uint64_t getStolenTileCount() const { return stolenTiles; }
+
+    /* Seconds every tile took in the last render(), by tile index, deferred retries included */
+    const std::vector<float>& getTileSeconds() const { return tileSeconds; }
+
+    /* With cost ordering, the prepass of the last render(): its estimate of every tile's cost (in rays
+     weighted by the traversal work of their camera ray), its image, PREPASS_STRIDE times smaller
+     than the camera's, and the seconds it took */
+    const std::vector<float>& getTileCosts() const { return tileCosts; }
+    const FrameBuffer& getPreview() const { return preview; }
+    double getPrepassSeconds() const { return prepassSeconds; }
+
+    /* Makes an in-flight render() skip its remaining tiles and return early. Safe from any thread */
+    void cancel() { cancelled = true; }
+    bool isCancelled() const { return cancelled; }
+
+    /* Renders the camera's region of interest into 'framebuffer', which must match the camera's
+     resolution. Worker threads claim whole tiles from a shared counter and write them straight
+     into their own tile blocks, so no locking is needed. In deterministic mode (the default) the
+     image is bit-identical for any thread count: random numbers come from per-pixel counter-based
+     streams and each pixel's samples are summed by one thread in a fixed order. With a thread pool
+     every tile becomes a task at this renderer's priority and the thread count is ignored.
+     Pixels that need streamed geometry which is not in memory yet are rendered again once the
+     pages have arrived, so out-of-core scenes give the same image as resident ones.
+     Tiles are handed out, and each tile's pixels traced, in the tile and pixel orders (scanline by
+     default). Every pixel is computed independently, so the orders never change the image.
+     With a feature buffer, which must match the framebuffer's size, the albedo, normal and depth of
+     every pixel's first hits and the variance of its luminance are written to it alongside the color,
+     for the denoiser.
+     With frustum culling every tile first culls the scene to the surfaces its camera rays and their
+     shadow rays can reach, and traces those against the short lists; see Frustum.h. The image is the
+     same either way, and culling is on by default.
+     With a NUMA topology of several nodes, and no thread pool, every worker is pinned to a node and
+     works through that node's share of the tiles first, and with scene replicas for the topology it
+     traces its node's copy of the scene; see Numa.h. The image is the same either way.
+     With cost ordering, a prepass first estimates every tile's cost (see estimateTileCosts()) and the
+     tiles are handed out most expensive first instead of in the tile order, so the last tiles to
+     finish are cheap ones and no thread is left alone with an expensive tile at the end. Its image is
+     passed to the preview callback as a coarse preview. Off by default; the image is the same */
+    void render(FrameBuffer& framebuffer);
+
+    /* Reflection paths carry their throughput, the product of the reflectivities so far. A reflection
+     whose throughput would fall below the contribution cutoff is not traced at all. Below the roulette
+     threshold it is traced with probability throughput / threshold and its radiance divided by that
+     probability, which keeps the expected image unchanged. Both are 0 (off) by default */
+    Color rayTrace(Ray ray, int depth, TraceState& state);
+
+    /* Fraction of 'light' that 'point' on 'surface' sees. A point light is one shadow ray. An area light
+     first gets the probe rays, stratified over its shape; only if they disagree, in a penumbra, does
+     it get more, up to the maximum samples, and never beyond what is left of the pixel's shadow-ray
+     budget (split evenly between its samples). Fully lit and fully shadowed points, most of an image,
+     so cost the probes alone */
+    float lightVisibility(Surface* surface, const Point& point, const Light& light, int lightIndex, int depth,
+                          TraceState& state);
+
+    /* Diffuse light from the scene's environment map at 'point': kd / pi times the integral of the
+     radiance times N.w over the directions w no surface blocks, estimated from the environment samples
+     (one at reflection hits), each drawn from the map and checked with a shadow ray. The alias
+     tables reorder the unit square, which would undo the stratification of Sobol points and leave them
+     worse than independent ones, so every sample takes its own two random dimensions after the lights' */
+    Color environmentLighting(Surface* surface, const ShadingPoint& point, int lightCount, int depth,
+                              TraceState& state);
+
+private:
+    /* Resets the counters and sets up the tile and pixel orders and, with frustum culling, the culler.
+     render() is this, every tile, then the deferred pixels */
+    void beginRender();
+
+    /* The prepass of cost ordering: the camera ray of one pixel in PREPASS_STRIDE x PREPASS_STRIDE,
+     intersected with the resident surfaces but not shaded, predicts the rays its pixel will trace: one
+     if it misses, else one per shadow probe and environment sample, again for every reflection the
+     hit's reflectivity lets through the cutoff, assuming mirrors face mirrors. The surface tests and
+     grid cell visits of the camera ray (see TraversalCounts), plus one, weight them, standing in for
+     how crowded the scene is there. A tile's cost is the sum over its samples. Also paints 'preview'
+     with the hits' diffuse color under a headlight */
+    void estimateTileCosts();
+
+    /* Runs body(0) .. body(count - 1) on the thread pool or on 'threadCount' threads, placed on the
+     NUMA nodes if there are several */
+    void parallelFor(int count, const std::function<void(int)>& body);
+    void parallelForNodes(int count, const std::function<void(int)>& body);
+
+    /* Renders the pixels of 'tile' listed in 'pixels' (tile-local indices), or all of them if NULL */
+    void renderTile(FrameBuffer& framebuffer, int tile, const std::vector<int>* pixels, bool blockingLoads);
+    void renderDeferredPixels(FrameBuffer& framebuffer);
+
+    /* The scene 'state' traces: its replica, or the renderer's scene */
+    const Scene* getTracedScene(const TraceState& state) const { return (state.scene != NULL) ? state.scene : scene; }
+
+    Color calcAmbience(Surface* surface, const Color& albedo);
+    Color calcIllumination(Surface* surface, const ShadingPoint& point, const Light& lightSource, bool calcAmb,
+                           float visibility);
+
+    /* True if the shadow ray from 'lightPoint' to 'point' on 'surface' is blocked, by a surface of the
+     scene or, if given, of 'occluders' */
+    bool isShadowed(Surface* surface, const Point& point, const Point& lightPoint,
+                    const std::vector<Surface*>* occluders, TraceState& state);
+
+    const Scene* scene;
+    Camera camera;
+    int threadCount;
+    int samplesPerPixel;
+    uint32_t seed;
+    bool deterministic;
+    ThreadPool* threadPool;
+    int priority;
+    TileCallback tileCallback;
+    float contributionCutoff;
+    float rouletteThreshold;
+    TraversalOrder tileOrder, pixelOrder;
+    int shadowProbes, maxShadowSamples, shadowRayBudget;
+    FeatureBuffer* featureBuffer;
+    bool frustumCulling;
+    int environmentSamples;
+    const NumaTopology* numaTopology;
+    const SceneReplicas* sceneReplicas;
+    bool costOrdering;
+    PreviewCallback previewCallback;
+    std::unique_ptr<const FrustumCuller> culler;    /* Set up at the start of every render */
+    std::mutex statsMutex;
+    FrustumStats frustumStats;
+    std::atomic<bool> cancelled;
+    std::atomic<uint64_t> rayCount, shadowRayCount;
+    std::atomic<uint64_t> stolenTiles;
+
+    std::vector<int> tileSequence;      /* Tile indices in tile order, for the current render */
+    std::vector<int> pixelSequence;     /* Pixels of a whole tile, as y * TILE_SIZE + x, in pixel order */
+    std::vector<float> tileSeconds, tileCosts;      /* By tile index */
+    FrameBuffer preview;
+    double prepassSeconds;
+
+    std::mutex deferredMutex;
+    std::map<int, std::vector<int> > deferredPixels;   /* Tile -> pixels waiting for geometry pages */
+};
+
+#endif /* defined(__Ray_Tracer__C_____Renderer__) */
@@ -7,10 +7,14 @@
 ************************************************************************************************/
 
 #include "Scene.h"
+#include "Trace.h"
+#include <algorithm>
 
 Scene::Scene()
 {
     ambientIntensity.setRGB(0.5, 0.5, 0.5);
+    pagedGeometry = NULL;
+    environment = NULL;
 }
 
 Scene::Scene(const Scene& scene)
@@ -18,11 +22,18 @@ Scene::Scene(const Scene& scene)
     ambientIntensity = scene.getAmbientIntensity();
     surfaces = scene.getSurfaces();
     lights = scene.getLights();
+    pagedGeometry = scene.getPagedGeometry();
+    environment = scene.getEnvironment();
+    accelerator = scene.getAccelerator();
+    staleAccelerator = scene.staleAccelerator;
+    replaced = scene.replaced;
 }
 
 Scene::Scene(Color ambientLightIntensity)
 {
     ambientIntensity = ambientLightIntensity;
+    pagedGeometry = NULL;
+    environment = NULL;
 }
 
 void Scene::addLight(Light light)
@@ -38,19 +49,104 @@ void Scene::addLight(Point lightPosition, Color lightIntensity)
 void Scene::addSphere(Sphere* sphere)
 {
     surfaces.push_back(sphere);
+    accelerator.reset();
+    staleAccelerator.reset();
 }
 
 void Scene::addEllipsoid(Ellipsoid* ellipsoid)
 {
     surfaces.push_back(ellipsoid);
+    accelerator.reset();
+    staleAccelerator.reset();
 }
 
 void Scene::addInfinitePlane(InfinitePlane* plane)
 {
     surfaces.push_back(plane);
+    accelerator.reset();
+    staleAccelerator.reset();
 }
 
 void Scene::addInfiniteCylinder(InfiniteCylinder* cylinder)
 {
     surfaces.push_back(cylinder);
-}
\ No newline at end of file
+    accelerator.reset();
+    staleAccelerator.reset();
+}
+
+void Scene::addSurface(Surface* surface)
+{
+    surfaces.push_back(surface);
+    accelerator.reset();
+    staleAccelerator.reset();
+}
+
+void Scene::replaceSurface(int index, Surface* surface)
+{
+    surfaces[index] = surface;
+    
+    if (accelerator) {
+        staleAccelerator = accelerator;
+        replaced.clear();
+        accelerator.reset();
+    }
+    
+    if (staleAccelerator) {
+        std::vector<uint32_t>::iterator position = std::lower_bound(replaced.begin(), replaced.end(), (uint32_t) index);
+        
+        if (position == replaced.end() || *position != index) {
+            replaced.insert(position, index);
+        }
+    }
+}
+
+bool Scene::isTextured() const
+{
+    for (int i = 0; i < surfaces.size(); i++) {
+        if (surfaces[i]->getTexture() != NULL) {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+
+void Scene::buildAccelerator(AcceleratorType type, int threadCount)
+{
+    TRACE_ZONE(TRACE_ACCELERATOR_BUILD);
+    Accelerator* updated = NULL;
+    
+    if (staleAccelerator && (type == ACCELERATOR_AUTO || type == staleAccelerator->getType())) {
+        updated = staleAccelerator->update(surfaces, replaced);
+    }
+    
+    accelerator.reset( (updated != NULL) ? updated : createAccelerator(type, surfaces, threadCount) );
+    staleAccelerator.reset();
+    replaced.clear();
+}
+
+void Scene::setAccelerator(const std::shared_ptr<const Accelerator>& built)
+{
+    accelerator = built;
+    staleAccelerator.reset();
+    replaced.clear();
+}
+
+Surface* Scene::intersect(Ray& ray, float& closest, Ray& normal) const
+{
+    if (accelerator) {
+        return accelerator->intersect(ray, closest, normal);
+    }
+    
+    return BruteForceAccelerator::intersectAll(surfaces, ray, closest, normal);
+}
+
+bool Scene::occluded(Ray& ray, float maxDistance) const
+{
+    if (accelerator) {
+        return accelerator->occluded(ray, maxDistance);
+    }
+    
+    return BruteForceAccelerator::occludedByAny(surfaces, ray, maxDistance);
+}
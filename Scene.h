@@ -10,9 +10,14 @@
 #define __Ray_Tracer__C_____Scene__
 
 #include <stdio.h>
+#include <memory>
 #include "Surface.h"
 #include "Color.h"
 #include "Light.h"
+#include "Accelerator.h"
+
+class PagedGeometry;
+class EnvironmentMap;
 
 class Scene {
 public:
@@ -26,14 +31,52 @@ public:
     void addEllipsoid(Ellipsoid* ellipsoid);
     void addInfinitePlane(InfinitePlane* plane);
     void addInfiniteCylinder(InfiniteCylinder* cylinder);
+    void addSurface(Surface* surface);
+
+    /* Puts 'surface' at 'index' in place of the surface there, which the caller still owns. The
+     accelerator is dropped like on every other change, but the next buildAccelerator() updates it
+     for the replaced surfaces instead of building it again when the backend allows */
+    void replaceSurface(int index, Surface* surface);
+
+    /* Spheres streamed from disk in addition to 'surfaces'. The scene does not own the geometry */
+    void setPagedGeometry(PagedGeometry* geometry) { pagedGeometry = geometry; }
     
     Color getAmbientIntensity() const { return ambientIntensity; }
     std::vector<Light> getLights() const { return lights; }
     std::vector<Surface*> getSurfaces() const { return surfaces; }
+    PagedGeometry* getPagedGeometry() const { return pagedGeometry; }
+    
+    /* Light from infinitely far away that rays leaving the scene see, in place of the background
+     color and the flat ambient term; see EnvironmentMap. The scene does not own the map */
+    void setEnvironment(const EnvironmentMap* map) { environment = map; }
+    const EnvironmentMap* getEnvironment() const { return environment; }
+    
+    /* True if any surface has a texture, which the binary scene formats cannot store */
+    bool isTextured() const;
+    
+    /* Builds the accelerator answering intersect() and occluded(). Adding surfaces drops it again, in
+     which case queries fall back to testing every surface */
+    void buildAccelerator(AcceleratorType type, int threadCount);
+    std::shared_ptr<const Accelerator> getAccelerator() const { return accelerator; }
+    
+    /* Uses 'built', an accelerator over exactly the current surfaces made elsewhere (such as from a
+     scene cache), in place of building one */
+    void setAccelerator(const std::shared_ptr<const Accelerator>& built);
+    
+    /* Closest surface hit by 'ray' with 1 <= t < 'closest'; see Accelerator */
+    Surface* intersect(Ray& ray, float& closest, Ray& normal) const;
+    
+    /* True if a surface is hit by 'ray' with 1 < t < 'maxDistance' */
+    bool occluded(Ray& ray, float maxDistance) const;
     
 private:
     Color ambientIntensity;
     std::vector<Surface*> surfaces;
+    PagedGeometry* pagedGeometry;
+    const EnvironmentMap* environment;
+    std::shared_ptr<const Accelerator> accelerator;     /* Shared by copies of the scene */
+    std::shared_ptr<const Accelerator> staleAccelerator;    /* Built before the replacements in 'replaced' */
+    std::vector<uint32_t> replaced;                         /* Ascending */
     
     /* Holds all light information for scene except ambient light which is light-independent */
     std::vector<Light> lights;
@@ -0,0 +1,518 @@
+/************************************************************************************************
+ File: SceneCache.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "SceneCache.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Precision.h"
+
+static void packColor(const Color& color, float* destination)
+{
+    destination[0] = color.getR();
+    destination[1] = color.getG();
+    destination[2] = color.getB();
+}
+
+static void packPoint(const Point& point, float* destination)
+{
+    destination[0] = point.getX();
+    destination[1] = point.getY();
+    destination[2] = point.getZ();
+}
+
+static Color unpackColor(const float* source)
+{
+    return Color(source[0], source[1], source[2]);
+}
+
+static Point unpackPoint(const float* source)
+{
+    return Point(source[0], source[1], source[2]);
+}
+
+/* Sphere::intersect() on a record: the distance along the ray's unit direction, or -1 on a miss */
+static inline float intersectRecord(const PackedSphere& sphere, const float origin[3], const float direction[3])
+{
+    float nearRoot, farRoot;
+
+    if (!solveSphere(origin, direction, sphere.center, sphere.radius, nearRoot, farRoot)) {
+        return -1;
+    }
+
+    return (nearRoot > 0) ? nearRoot : farRoot;
+}
+
+/* Keeps 'index' if it is the closer hit, or as close and listed first, as Accelerator requires */
+static inline void keepClosest(float intersection, int index, float& closest, int& closestIndex)
+{
+    if (intersection >= 1 && (intersection < closest || (intersection == closest && closestIndex >= 0 && index < closestIndex))) {
+        closest = intersection;
+        closestIndex = index;
+    }
+}
+
+/* Bytes per record of each section type, in SceneCacheSectionType order */
+static const uint64_t sectionRecordSizes[SCENE_CACHE_SECTION_TYPES] = {
+    sizeof(PackedMaterial), sizeof(PackedSphere), sizeof(PackedPlane), sizeof(PackedLight),
+    sizeof(PackedGrid), sizeof(uint32_t), sizeof(uint32_t)
+};
+
+static void hashBytes(uint64_t& hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*) data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+/* Shared by PackedScene and SceneCache so that records in memory and in a mapping build the same scene */
+static Scene buildSceneFromRecords(const float* ambient, const PackedMaterial* materials,
+                                   const PackedSphere* spheres, uint32_t sphereCount,
+                                   const PackedPlane* planes, uint32_t planeCount,
+                                   const PackedLight* lights, uint32_t lightCount)
+{
+    Scene scene(unpackColor(ambient));
+
+    for (uint32_t i = 0; i < lightCount; i++) {
+        Light light(unpackPoint(lights[i].position), unpackColor(lights[i].intensity));
+
+        light.setShape((Light::LightShape) lights[i].shape);
+        light.setAxes(unpackPoint(lights[i].uAxis), unpackPoint(lights[i].vAxis));
+        light.setRadius(lights[i].radius);
+        scene.addLight(light);
+    }
+
+    for (uint32_t i = 0; i < sphereCount; i++) {
+        const PackedMaterial& material = materials[spheres[i].material];
+        Sphere* sphere = new Sphere(unpackPoint(spheres[i].center), spheres[i].radius, unpackColor(material.ambient),
+                                    unpackColor(material.diffuse), unpackColor(material.specular), material.reflectivity);
+
+        sphere->setSpecularExponent(material.specularExponent);
+        scene.addSphere(sphere);
+    }
+
+    for (uint32_t i = 0; i < planeCount; i++) {
+        const PackedMaterial& material = materials[planes[i].material];
+        Ray normal(unpackPoint(planes[i].normalStart), unpackPoint(planes[i].normalEnd));
+        InfinitePlane* plane = new InfinitePlane(unpackPoint(planes[i].point), normal, unpackColor(material.ambient),
+                                                 unpackColor(material.diffuse), unpackColor(material.specular),
+                                                 material.reflectivity);
+
+        plane->setSpecularExponent(material.specularExponent);
+        scene.addInfinitePlane(plane);
+    }
+
+    return scene;
+}
+
+
+/* Packed Scene */
+PackedScene::PackedScene()
+{
+    ambient[0] = ambient[1] = ambient[2] = 0.0;
+}
+
+/* Surfaces without an intersection routine (ellipsoids, cylinders) cannot be rendered and are skipped */
+PackedScene::PackedScene(const Scene& scene)
+{
+    std::vector<Surface*> surfaces = scene.getSurfaces();
+    std::vector<Light> sceneLights = scene.getLights();
+
+    packColor(scene.getAmbientIntensity(), ambient);
+
+    for (int i = 0; i < sceneLights.size(); i++) {
+        PackedLight light;
+        packPoint(sceneLights[i].getPosition(), light.position);
+        packColor(sceneLights[i].getRGBIntensity(), light.intensity);
+        packPoint(sceneLights[i].getUAxis(), light.uAxis);
+        packPoint(sceneLights[i].getVAxis(), light.vAxis);
+        light.radius = sceneLights[i].getRadius();
+        light.shape = (uint32_t) sceneLights[i].getShape();
+        lights.push_back(light);
+    }
+
+    for (int i = 0; i < surfaces.size(); i++) {
+        Surface::SurfaceType type = surfaces[i]->getSurfaceType();
+
+        if (type != Surface::SPHERE && type != Surface::INFINITE_PLANE) {
+            continue;
+        }
+
+        PackedMaterial material;
+        memset(&material, 0, sizeof(material));
+        packColor(surfaces[i]->getAmbientCoefficients(), material.ambient);
+        packColor(surfaces[i]->getDiffuseCoefficients(), material.diffuse);
+        packColor(surfaces[i]->getSpecularCoefficients(), material.specular);
+        material.reflectivity = surfaces[i]->getReflectivity();
+        material.specularExponent = surfaces[i]->getSpecularExponent();
+        materials.push_back(material);
+
+        if (type == Surface::SPHERE) {
+            Sphere* sphere = (Sphere*) surfaces[i];
+            PackedSphere packed;
+            memset(&packed, 0, sizeof(packed));
+            packPoint(sphere->getCenter(), packed.center);
+            packed.radius = sphere->getRadius();
+            packed.material = (uint32_t) materials.size() - 1;
+            spheres.push_back(packed);
+        } else {
+            InfinitePlane* plane = (InfinitePlane*) surfaces[i];
+            Ray normal = plane->getNormal();
+            PackedPlane packed;
+            memset(&packed, 0, sizeof(packed));
+            packPoint(plane->getPoint(), packed.point);
+            packPoint(normal.getStartPoint(), packed.normalStart);
+            packPoint(normal.getDirectionPoint(), packed.normalEnd);
+            packed.material = (uint32_t) materials.size() - 1;
+            planes.push_back(packed);
+        }
+    }
+}
+
+uint64_t PackedScene::getContentHash() const
+{
+    uint64_t hash = 14695981039346656037ULL;
+    uint32_t version = SCENE_CACHE_VERSION;
+
+    hashBytes(hash, &version, sizeof(version));
+    hashBytes(hash, ambient, sizeof(ambient));
+    hashBytes(hash, materials.data(), materials.size() * sizeof(PackedMaterial));
+    hashBytes(hash, spheres.data(), spheres.size() * sizeof(PackedSphere));
+    hashBytes(hash, planes.data(), planes.size() * sizeof(PackedPlane));
+    hashBytes(hash, lights.data(), lights.size() * sizeof(PackedLight));
+
+    return hash;
+}
+
+Scene PackedScene::buildScene() const
+{
+    return buildSceneFromRecords(ambient, materials.data(), spheres.data(), (uint32_t) spheres.size(),
+                                 planes.data(), (uint32_t) planes.size(), lights.data(), (uint32_t) lights.size());
+}
+
+/* Built over the spheres alone, so the cell lists hold sphere indices, which are also the indices of
+    the spheres among the surfaces of buildScene() */
+void PackedScene::buildGrid(int threadCount)
+{
+    grid.clear();
+    cellStarts.clear();
+    cellSurfaces.clear();
+
+    if (spheres.size() < GRID_MIN_SURFACES) {
+        return;
+    }
+
+    std::vector<Surface*> surfaces;
+    GridAccelerator built;
+
+    for (int i = 0; i < spheres.size(); i++) {
+        surfaces.push_back(new Sphere(unpackPoint(spheres[i].center), spheres[i].radius, Color(), Color(), Color(), 0.0));
+    }
+
+    built.build(surfaces, threadCount);
+
+    PackedGrid packed;
+    memset(&packed, 0, sizeof(packed));
+
+    for (int i = 0; i < 3; i++) {
+        packed.gridMin[i] = built.getGridMin()[i];
+        packed.gridMax[i] = built.getGridMax()[i];
+        packed.resolution[i] = built.getResolution(i);
+    }
+
+    grid.push_back(packed);
+    cellStarts.assign(built.getCellStarts(), built.getCellStarts() + built.getCellCount() + 1);
+    cellSurfaces.assign(built.getCellSurfaces(), built.getCellSurfaces() + cellStarts.back());
+
+    for (int i = 0; i < surfaces.size(); i++) {
+        delete surfaces[i];
+    }
+}
+
+
+/* Scene Cache */
+SceneCache::SceneCache()
+{
+    header = NULL;
+    mapping = NULL;
+    mappingSize = 0;
+}
+
+SceneCache::~SceneCache()
+{
+    close();
+}
+
+bool SceneCache::write(const char* path, const PackedScene& scene)
+{
+    SceneCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SCENE_CACHE_MAGIC;
+    header.version = SCENE_CACHE_VERSION;
+    header.contentHash = scene.getContentHash();
+    memcpy(header.ambient, scene.ambient, sizeof(header.ambient));
+
+    const void* data[SCENE_CACHE_SECTION_TYPES] = { scene.materials.data(), scene.spheres.data(), scene.planes.data(),
+                                                     scene.lights.data(), scene.grid.data(), scene.cellStarts.data(),
+                                                     scene.cellSurfaces.data() };
+    size_t counts[SCENE_CACHE_SECTION_TYPES] = { scene.materials.size(), scene.spheres.size(), scene.planes.size(),
+                                                 scene.lights.size(), scene.grid.size(), scene.cellStarts.size(),
+                                                 scene.cellSurfaces.size() };
+    uint64_t offset = sizeof(SceneCacheHeader);
+
+    header.sectionCount = SCENE_CACHE_SECTION_TYPES;
+
+    for (int i = 0; i < SCENE_CACHE_SECTION_TYPES; i++) {
+        offset = (offset + SCENE_CACHE_ALIGNMENT - 1) & ~((uint64_t) SCENE_CACHE_ALIGNMENT - 1);
+        header.sections[i].type = i;
+        header.sections[i].count = (uint32_t) counts[i];
+        header.sections[i].offset = offset;
+        header.sections[i].size = counts[i] * sectionRecordSizes[i];
+        offset += header.sections[i].size;
+    }
+
+    FILE* file = fopen(path, "wb");
+
+    if (file == NULL) {
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    uint64_t written = sizeof(header);
+    char zeros[SCENE_CACHE_ALIGNMENT] = { 0 };
+
+    for (int i = 0; i < SCENE_CACHE_SECTION_TYPES && ok; i++) {
+        ok = fwrite(zeros, 1, header.sections[i].offset - written, file) == header.sections[i].offset - written;
+
+        if (ok && header.sections[i].size > 0) {
+            ok = fwrite(data[i], header.sections[i].size, 1, file) == 1;
+        }
+
+        written = header.sections[i].offset + header.sections[i].size;
+    }
+
+    return (fclose(file) == 0) && ok;
+}
+
+bool SceneCache::open(const char* path, uint64_t expectedHash)
+{
+    close();
+
+    int descriptor = ::open(path, O_RDONLY);
+
+    if (descriptor < 0) {
+        return false;
+    }
+
+    struct stat status;
+
+    if (fstat(descriptor, &status) != 0 || status.st_size < (off_t) sizeof(SceneCacheHeader)) {
+        ::close(descriptor);
+        return false;
+    }
+
+    void* address = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    ::close(descriptor);
+
+    if (address == MAP_FAILED) {
+        return false;
+    }
+
+    mapping = address;
+    mappingSize = status.st_size;
+    header = (const SceneCacheHeader*) mapping;
+
+    bool valid = header->magic == SCENE_CACHE_MAGIC && header->version == SCENE_CACHE_VERSION &&
+                 header->contentHash == expectedHash && header->sectionCount <= SCENE_CACHE_MAX_SECTIONS;
+
+    /* Written as two comparisons so that a huge offset or size cannot wrap around the sum */
+    for (uint32_t i = 0; valid && i < header->sectionCount; i++) {
+        const SceneCacheSection& entry = header->sections[i];
+
+        valid = entry.type < SCENE_CACHE_SECTION_TYPES && entry.offset <= mappingSize &&
+                entry.size <= mappingSize - entry.offset && entry.offset % SCENE_CACHE_ALIGNMENT == 0 &&
+                entry.size == entry.count * sectionRecordSizes[entry.type];
+    }
+
+    if (valid) {
+        valid = validateMaterials();
+    }
+
+    if (valid && hasGrid()) {
+        valid = validateGrid();
+    }
+
+    if (!valid) {
+        close();
+        return false;
+    }
+
+    if (hasGrid()) {
+        const PackedGrid* packed = (const PackedGrid*) section(SECTION_GRID);
+
+        grid.adopt(std::vector<Surface*>(), packed->gridMin, packed->gridMax, packed->resolution,
+                   (const uint32_t*) section(SECTION_CELL_STARTS), (const uint32_t*) section(SECTION_CELL_SURFACES), false);
+    }
+
+    return true;
+}
+
+bool SceneCache::validateMaterials() const
+{
+    const PackedSphere* spheres = getSpheres();
+    const PackedPlane* planes = getPlanes();
+    uint32_t materialCount = getMaterialCount();
+
+    for (uint32_t i = 0; i < getSphereCount(); i++) {
+        if (spheres[i].material >= materialCount) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < getPlaneCount(); i++) {
+        if (planes[i].material >= materialCount) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* With the section sizes already checked, a cache that passes these checks cannot send intersect()
+    outside the mapping */
+bool SceneCache::validateGrid() const
+{
+    const PackedGrid* packed = (const PackedGrid*) section(SECTION_GRID);
+    uint64_t cellCount = 1;
+
+    for (int i = 0; i < 3; i++) {
+        if (packed->resolution[i] < 1 || packed->resolution[i] > GRID_MAX_RESOLUTION ||
+            !(packed->gridMin[i] < packed->gridMax[i])) {
+            return false;
+        }
+        cellCount *= packed->resolution[i];
+    }
+
+    const uint32_t* starts = (const uint32_t*) section(SECTION_CELL_STARTS);
+    const uint32_t* members = (const uint32_t*) section(SECTION_CELL_SURFACES);
+    uint32_t memberCount = count(SECTION_CELL_SURFACES), sphereCount = getSphereCount();
+
+    if (count(SECTION_CELL_STARTS) != cellCount + 1 || starts[0] != 0 || starts[cellCount] != memberCount) {
+        return false;
+    }
+
+    for (uint64_t c = 0; c < cellCount; c++) {
+        if (starts[c] > starts[c + 1]) {
+            return false;
+        }
+    }
+
+    for (uint32_t m = 0; m < memberCount; m++) {
+        if (members[m] >= sphereCount) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void SceneCache::close()
+{
+    if (mapping != NULL) {
+        munmap(mapping, mappingSize);
+    }
+
+    header = NULL;
+    mapping = NULL;
+    mappingSize = 0;
+    grid = GridAccelerator();   /* Its cells pointed into the mapping */
+}
+
+/* Planes have no bounds, so like GridAccelerator this tests them on every ray, then walks the cells */
+int SceneCache::intersect(Ray& ray, float& closest) const
+{
+    const PackedSphere* spheres = getSpheres();
+    const PackedPlane* planes = getPlanes();
+    const PackedMaterial* materials = getMaterials();
+    uint32_t sphereCount = getSphereCount(), planeCount = getPlaneCount();
+    int closestIndex = -1;
+
+    for (uint32_t i = 0; i < planeCount; i++) {
+        const PackedMaterial& material = materials[planes[i].material];
+        Ray normal(unpackPoint(planes[i].normalStart), unpackPoint(planes[i].normalEnd)), surfaceNormal;
+        InfinitePlane plane(unpackPoint(planes[i].point), normal, unpackColor(material.ambient),
+                            unpackColor(material.diffuse), unpackColor(material.specular), material.reflectivity);
+
+        keepClosest(plane.intersect(ray, surfaceNormal), sphereCount + i, closest, closestIndex);
+    }
+
+    std::vector<float> direction = ray.normalize();
+    Point start = ray.getStartPoint();
+    float origin[3] = { start.getX(), start.getY(), start.getZ() };
+
+    if (!hasGrid()) {
+        for (uint32_t i = 0; i < sphereCount; i++) {
+            keepClosest(intersectRecord(spheres[i], origin, &direction[0]), i, closest, closestIndex);
+        }
+        return closestIndex;
+    }
+
+    grid.walkCells(ray, closest, [&](const uint32_t* first, const uint32_t* last) -> float {
+        for (const uint32_t* k = first; k < last; k++) {
+            keepClosest(intersectRecord(spheres[*k], origin, &direction[0]), *k, closest, closestIndex);
+        }
+        return closest;
+    });
+
+    return closestIndex;
+}
+
+/* The spheres come first among the surfaces, so the grid's sphere indices are surface indices */
+Scene SceneCache::buildScene(AcceleratorType type) const
+{
+    Scene scene = buildSceneFromRecords(getAmbient(), getMaterials(), getSpheres(), getSphereCount(),
+                                        getPlanes(), getPlaneCount(), getLights(), getLightCount());
+
+    if (hasGrid() && (type == ACCELERATOR_AUTO || type == ACCELERATOR_GRID)) {
+        const PackedGrid* packed = (const PackedGrid*) section(SECTION_GRID);
+        std::shared_ptr<GridAccelerator> stored = std::make_shared<GridAccelerator>();
+
+        stored->adopt(scene.getSurfaces(), packed->gridMin, packed->gridMax, packed->resolution,
+                      (const uint32_t*) section(SECTION_CELL_STARTS), (const uint32_t*) section(SECTION_CELL_SURFACES), true);
+        scene.setAccelerator(stored);
+    }
+
+    return scene;
+}
+
+const void* SceneCache::section(SceneCacheSectionType type) const
+{
+    for (uint32_t i = 0; i < header->sectionCount; i++) {
+        if (header->sections[i].type == type) {
+            return (const char*) mapping + header->sections[i].offset;
+        }
+    }
+
+    return NULL;
+}
+
+uint32_t SceneCache::count(SceneCacheSectionType type) const
+{
+    for (uint32_t i = 0; i < header->sectionCount; i++) {
+        if (header->sections[i].type == type) {
+            return header->sections[i].count;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,169 @@
+/************************************************************************************************
+ File: SceneCache.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____SceneCache__
+#define __Ray_Tracer__C_____SceneCache__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "Scene.h"
+#include "Accelerator.h"
+
+#define SCENE_CACHE_MAGIC 0x43535452    /* "RTSC" read as a little-endian word */
+#define SCENE_CACHE_VERSION 3
+#define SCENE_CACHE_ALIGNMENT 64        /* Every section starts on a cache line */
+#define SCENE_CACHE_MAX_SECTIONS 8
+
+/* Flattened, pointer-free scene records. Cross references are array indices, never addresses, so a
+    mapped file can be used in place at whatever address it lands */
+struct PackedMaterial {
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+    float reflectivity;
+    int32_t specularExponent;
+    uint32_t padding;
+};
+
+struct PackedSphere {
+    float center[3];
+    float radius;
+    uint32_t material;
+    uint32_t padding[3];
+};
+
+struct PackedPlane {
+    float point[3];
+    float normalStart[3];
+    float normalEnd[3];
+    uint32_t material;
+    uint32_t padding[2];
+};
+
+struct PackedLight {
+    float position[3];
+    float intensity[3];
+    float uAxis[3];
+    float vAxis[3];
+    float radius;
+    uint32_t shape;     /* Light::LightShape */
+};
+
+/* A GridAccelerator over the spheres, whose cell lists hold sphere indices. Stored once there are
+    GRID_MIN_SURFACES spheres, where ACCELERATOR_AUTO would build one */
+struct PackedGrid {
+    float gridMin[3];
+    float gridMax[3];
+    int32_t resolution[3];
+    uint32_t padding[3];
+};
+
+enum SceneCacheSectionType { SECTION_MATERIALS, SECTION_SPHERES, SECTION_PLANES, SECTION_LIGHTS,
+                             SECTION_GRID, SECTION_CELL_STARTS, SECTION_CELL_SURFACES };
+#define SCENE_CACHE_SECTION_TYPES 7
+
+struct SceneCacheSection {
+    uint32_t type;
+    uint32_t count;     /* Number of records */
+    uint64_t offset;    /* Bytes from the start of the file */
+    uint64_t size;      /* Bytes */
+};
+
+struct SceneCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t contentHash;   /* Hash of the source scene the cache was built from */
+    float ambient[3];
+    uint32_t sectionCount;
+    SceneCacheSection sections[SCENE_CACHE_MAX_SECTIONS];
+};
+
+/* The flattened form of a Scene, held in ordinary vectors while it is being built or written */
+struct PackedScene {
+    PackedScene();
+    PackedScene(const Scene& scene);
+
+    /* FNV-1a over the packed records; identical scenes hash the same on every run */
+    uint64_t getContentHash() const;
+
+    /* Instantiates the renderable surfaces described by the records */
+    Scene buildScene() const;
+
+    /* Builds the grid stored with the records, if there are enough spheres for one. The grid is derived
+     data and not part of the content hash */
+    void buildGrid(int threadCount);
+
+    float ambient[3];
+    std::vector<PackedMaterial> materials;
+    std::vector<PackedSphere> spheres;
+    std::vector<PackedPlane> planes;
+    std::vector<PackedLight> lights;
+    std::vector<PackedGrid> grid;           /* Empty or one record */
+    std::vector<uint32_t> cellStarts;
+    std::vector<uint32_t> cellSurfaces;
+};
+
+/* A read-only, memory-mapped scene cache file. The arrays returned by the getters point straight into
+    the mapping; nothing is parsed or copied when the cache is opened, and intersect() traces rays
+    through the stored grid and records where they lie */
+class SceneCache {
+public:
+    SceneCache();
+    ~SceneCache();
+
+    /* Writes 'scene' in cache format. Returns false if the file could not be written */
+    static bool write(const char* path, const PackedScene& scene);
+
+    /* Maps 'path'. Fails, leaving the cache closed, if the file is missing, truncated, from another
+     version, was built from a scene whose hash is not 'expectedHash', has a section whose size does
+     not match its record count, refers to a material it does not hold, or holds a malformed grid */
+    bool open(const char* path, uint64_t expectedHash);
+    void close();
+    bool isOpen() const { return mapping != NULL; }
+
+    uint64_t getContentHash() const { return header->contentHash; }
+    const float* getAmbient() const { return header->ambient; }
+    const PackedMaterial* getMaterials() const { return (const PackedMaterial*) section(SECTION_MATERIALS); }
+    const PackedSphere* getSpheres() const { return (const PackedSphere*) section(SECTION_SPHERES); }
+    const PackedPlane* getPlanes() const { return (const PackedPlane*) section(SECTION_PLANES); }
+    const PackedLight* getLights() const { return (const PackedLight*) section(SECTION_LIGHTS); }
+    uint32_t getMaterialCount() const { return count(SECTION_MATERIALS); }
+    uint32_t getSphereCount() const { return count(SECTION_SPHERES); }
+    uint32_t getPlaneCount() const { return count(SECTION_PLANES); }
+    uint32_t getLightCount() const { return count(SECTION_LIGHTS); }
+    bool hasGrid() const { return count(SECTION_GRID) == 1; }
+
+    /* Index of the closest surface hit by 'ray' with 1 <= t < 'closest', numbered as in buildScene()
+     (spheres, then planes), or -1 if there is none. Updates 'closest'. Tests the mapped records
+     through the mapped grid, without instantiating anything */
+    int intersect(Ray& ray, float& closest) const;
+
+    /* Instantiates the renderable surfaces described by the mapped records. When 'type' would build a
+     grid and the cache holds one, the scene gets the stored grid as its accelerator instead */
+    Scene buildScene(AcceleratorType type) const;
+
+private:
+    SceneCache(const SceneCache& cache);    /* Not copyable, owns the mapping */
+
+    const void* section(SceneCacheSectionType type) const;
+    uint32_t count(SceneCacheSectionType type) const;
+
+    /* Checks that every sphere and plane refers to a stored material */
+    bool validateMaterials() const;
+
+    /* Checks the grid sections against each other and the sphere count */
+    bool validateGrid() const;
+
+    const SceneCacheHeader* header;
+    void* mapping;
+    size_t mappingSize;
+    GridAccelerator grid;       /* Over no surfaces, reading the mapped cells in place; for intersect() */
+};
+
+#endif /* defined(__Ray_Tracer__C_____SceneCache__) */
@@ -0,0 +1,63 @@
+/************************************************************************************************
+ File: SceneLibrary.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "SceneLibrary.h"
+
+/* Scene copies share surface pointers, so only the library's own copy deletes them */
+static void deleteOwnedScene(const Scene* scene)
+{
+    std::vector<Surface*> surfaces = scene->getSurfaces();
+
+    for (int i = 0; i < surfaces.size(); i++) {
+        delete surfaces[i];
+    }
+
+    delete scene;
+}
+
+SceneLibrary::SceneLibrary(SceneLoader _loader, int _capacity)
+{
+    loader = _loader;
+    capacity = (_capacity < 1) ? 1 : _capacity;
+    hits = misses = 0;
+}
+
+/* Loading happens under the lock; loads are rare next to renders and this keeps two requests for the
+    same scene from building it twice */
+std::shared_ptr<const Scene> SceneLibrary::get(int id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::map<int, std::pair<std::shared_ptr<const Scene>, std::list<int>::iterator> >::iterator entry = resident.find(id);
+
+    if (entry != resident.end()) {
+        hits++;
+        recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, entry->second.second);
+        return entry->second.first;
+    }
+
+    misses++;
+
+    Scene* scene = new Scene();
+
+    if (!loader(id, *scene)) {
+        deleteOwnedScene(scene);
+        return std::shared_ptr<const Scene>();
+    }
+
+    if (resident.size() >= capacity) {
+        resident.erase(recentlyUsed.back());
+        recentlyUsed.pop_back();
+    }
+
+    std::shared_ptr<const Scene> loaded(scene, deleteOwnedScene);
+    recentlyUsed.push_front(id);
+    resident[id] = std::make_pair(loaded, recentlyUsed.begin());
+
+    return loaded;
+}
@@ -0,0 +1,52 @@
+/************************************************************************************************
+ File: SceneLibrary.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____SceneLibrary__
+#define __Ray_Tracer__C_____SceneLibrary__
+
+#include <stdio.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "Scene.h"
+
+/* Keeps up to 'capacity' loaded scenes resident, evicting the least recently used one. Scenes are
+    handed out as shared pointers, so a scene evicted while a render still uses it stays alive until
+    that render lets go of it */
+class SceneLibrary {
+public:
+    /* Builds scene 'id' with freshly allocated surfaces, which the library then owns; returns false
+     for unknown ids or when loading fails, in which case the library deletes whatever surfaces it
+     had already added */
+    typedef std::function<bool(int id, Scene& scene)> SceneLoader;
+
+    SceneLibrary(SceneLoader _loader, int _capacity);
+
+    /* Returns the resident scene 'id', loading it on a miss. Returns NULL for unknown ids */
+    std::shared_ptr<const Scene> get(int id);
+
+    int getCapacity() const { return capacity; }
+    int getHits() const { return hits; }
+    int getMisses() const { return misses; }
+
+private:
+    SceneLibrary(const SceneLibrary& library);
+
+    SceneLoader loader;
+    int capacity;
+    std::atomic<int> hits, misses;     /* Read by the server's STATS without the lock */
+
+    std::list<int> recentlyUsed;    /* Front is the most recently used id */
+    std::map<int, std::pair<std::shared_ptr<const Scene>, std::list<int>::iterator> > resident;
+    std::mutex mutex;
+};
+
+#endif /* defined(__Ray_Tracer__C_____SceneLibrary__) */
@@ -0,0 +1,184 @@
+/************************************************************************************************
+ File: SceneStore.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "SceneStore.h"
+#include <stdlib.h>
+#include <new>
+#include <thread>
+
+/* Over-allocates and aligns by hand like FrameBuffer, keeping what malloc returned just before the store */
+void* SceneStore::operator new(size_t size)
+{
+    void* allocation = malloc(size + CACHE_LINE_SIZE + sizeof(void*));
+
+    if (allocation == NULL) {
+        throw std::bad_alloc();
+    }
+
+    uintptr_t address = ((uintptr_t) allocation + sizeof(void*) + CACHE_LINE_SIZE - 1) & ~((uintptr_t) CACHE_LINE_SIZE - 1);
+    ((void**) address)[-1] = allocation;
+
+    return (void*) address;
+}
+
+void SceneStore::operator delete(void* pointer)
+{
+    if (pointer != NULL) {
+        free(((void**) pointer)[-1]);
+    }
+}
+
+SceneStore::SceneStore(const Scene& initial, AcceleratorType _acceleratorType, int _threadCount)
+{
+    for (int i = 0; i < SCENE_STORE_SLOTS; i++) {
+        slots[i].claimed = false;
+        slots[i].epoch = 0;
+    }
+
+    Version* first = new Version();
+    first->scene = initial;
+    first->number = 0;
+
+    current = first;
+    epoch = 1;
+    version = 0;
+    acceleratorType = _acceleratorType;
+    threadCount = _threadCount;
+    retiredCount = reclaimedCount = 0;
+}
+
+/* No snapshot may outlive the store */
+SceneStore::~SceneStore()
+{
+    std::lock_guard<std::mutex> lock(editMutex);
+
+    for (int i = 0; i < retired.size(); i++) {
+        for (int j = 0; j < retired[i].surfaces.size(); j++) {
+            delete retired[i].surfaces[j];
+        }
+
+        delete retired[i].version;
+    }
+
+    delete current.load();
+}
+
+uint64_t SceneStore::edit(const SceneEdit& change)
+{
+    std::lock_guard<std::mutex> lock(editMutex);
+
+    /* Only editors replace 'current', so it cannot be retired while this edit reads it */
+    const Version* previous = current.load();
+    Version* next = new Version();
+    RetiredVersion retiring;
+
+    next->scene = previous->scene;
+    next->number = previous->number + 1;
+
+    change(next->scene, retiring.surfaces);
+    next->scene.buildAccelerator(acceleratorType, threadCount);
+
+    current.store(next);
+
+    /* Snapshots that could have read 'previous' were taken in this epoch or earlier */
+    retiring.version = previous;
+    retiring.epoch = epoch.fetch_add(1);
+    retired.push_back(retiring);
+    retiredCount++;
+    version = next->number;
+
+    reclaimWhileLocked();
+
+    return next->number;
+}
+
+void SceneStore::reclaim()
+{
+    std::lock_guard<std::mutex> lock(editMutex);
+    reclaimWhileLocked();
+}
+
+void SceneStore::reclaimWhileLocked()
+{
+    uint64_t oldest = UINT64_MAX;
+
+    for (int i = 0; i < SCENE_STORE_SLOTS; i++) {
+        uint64_t pinned = slots[i].epoch.load();
+
+        if (pinned != 0 && pinned < oldest) {
+            oldest = pinned;
+        }
+    }
+
+    while (!retired.empty() && retired.front().epoch < oldest) {
+        for (int j = 0; j < retired.front().surfaces.size(); j++) {
+            delete retired.front().surfaces[j];
+        }
+
+        delete retired.front().version;
+        retired.pop_front();
+        reclaimedCount++;
+    }
+}
+
+int SceneStore::getPendingCount()
+{
+    std::lock_guard<std::mutex> lock(editMutex);
+    return (int) retired.size();
+}
+
+/* The slot's epoch is published before 'current' is read and checked against the global epoch
+    afterwards. If an edit advanced the epoch in between, the slot may have been missed by that edit's
+    reclaim scan, so the pin starts over with the new epoch */
+int SceneStore::pin(const Version*& pinned)
+{
+    int start = (int) (std::hash<std::thread::id>()(std::this_thread::get_id()) % SCENE_STORE_SLOTS);
+    int slot = -1;
+
+    while (slot < 0) {
+        for (int i = 0; i < SCENE_STORE_SLOTS; i++) {
+            int candidate = (start + i) % SCENE_STORE_SLOTS;
+
+            if (!slots[candidate].claimed.load(std::memory_order_relaxed) && !slots[candidate].claimed.exchange(true)) {
+                slot = candidate;
+                break;
+            }
+        }
+
+        if (slot < 0) {
+            std::this_thread::yield();
+        }
+    }
+
+    uint64_t observed;
+
+    do {
+        observed = epoch.load();
+        slots[slot].epoch.store(observed);
+    } while (epoch.load() != observed);
+
+    pinned = current.load();
+
+    return slot;
+}
+
+void SceneStore::unpin(int slot)
+{
+    slots[slot].epoch.store(0);
+    slots[slot].claimed.store(false);
+}
+
+SceneSnapshot::SceneSnapshot(SceneStore& _store) : store(_store)
+{
+    slot = store.pin(version);
+}
+
+SceneSnapshot::~SceneSnapshot()
+{
+    store.unpin(slot);
+}
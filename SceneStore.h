@@ -0,0 +1,120 @@
+/************************************************************************************************
+ File: SceneStore.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____SceneStore__
+#define __Ray_Tracer__C_____SceneStore__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "Scene.h"
+#include "FrameBuffer.h"
+
+#define SCENE_STORE_SLOTS 64    /* Snapshots that can be held at once; more wait for a free slot */
+
+/************************************************************************************************
+ The versions of one scene, shared between renders and editors in read-copy-update style. A render
+ pins the current version with a SceneSnapshot and reads it for as long as it likes; the version is
+ immutable, and pinning takes no lock, only a few atomic operations on the snapshot's slot. An edit
+ copies the current version, changes the copy off to the side, updates its accelerator and then
+ publishes it with one atomic store, so a render sees either the old or the new version, never a
+ half-built one.
+
+ Replaced versions are reclaimed by epoch: publishing advances a global epoch and retires the old
+ version under the epoch it was current in. A snapshot records the epoch it was taken in, so a
+ retired version can be deleted once every pinned snapshot is from a later epoch.
+************************************************************************************************/
+class SceneStore {
+public:
+    /* Called with a copy of the current version to change. The copy shares its surfaces with the
+     current version, so surfaces are changed by replacing them with changed clones, never in place.
+     Surfaces taken out go into 'retired' if the store should delete them once no snapshot can see
+     them any more */
+    typedef std::function<void(Scene& next, std::vector<Surface*>& retired)> SceneEdit;
+
+    /* Starts from a copy of 'initial'. The store does not own the initial surfaces */
+    SceneStore(const Scene& initial, AcceleratorType _acceleratorType = ACCELERATOR_AUTO, int _threadCount = 1);
+    ~SceneStore();
+
+    /* Cache-line-aligned on the heap too, which plain new only guarantees from C++17 on */
+    static void* operator new(size_t size);
+    static void operator delete(void* pointer);
+
+    /* Builds and publishes the next version. Edits are serialized among themselves but never wait for
+     renders. Returns the new version number */
+    uint64_t edit(const SceneEdit& change);
+
+    /* Deletes the retired versions that no snapshot can see any more. Called by every edit */
+    void reclaim();
+
+    uint64_t getVersion() const { return version; }
+    uint64_t getRetiredCount() const { return retiredCount; }
+    uint64_t getReclaimedCount() const { return reclaimedCount; }
+    int getPendingCount();
+
+private:
+    friend class SceneSnapshot;
+
+    SceneStore(const SceneStore& store);
+
+    /* One pinned snapshot. Slots sit on their own cache lines so readers never contend */
+    struct alignas(CACHE_LINE_SIZE) ReaderSlot {
+        std::atomic<bool> claimed;
+        std::atomic<uint64_t> epoch;    /* 0 while no snapshot is pinned in this slot */
+    };
+
+    struct Version {
+        Scene scene;
+        uint64_t number;
+    };
+
+    struct RetiredVersion {
+        const Version* version;
+        std::vector<Surface*> surfaces;     /* Deleted along with the version */
+        uint64_t epoch;
+    };
+
+    int pin(const Version*& pinned);
+    void unpin(int slot);
+    void reclaimWhileLocked();
+
+    ReaderSlot slots[SCENE_STORE_SLOTS];
+    std::atomic<const Version*> current;
+    std::atomic<uint64_t> epoch;
+    std::atomic<uint64_t> version;
+
+    AcceleratorType acceleratorType;
+    int threadCount;
+
+    std::mutex editMutex;                   /* Taken by editors only */
+    std::deque<RetiredVersion> retired;     /* Oldest first */
+    std::atomic<uint64_t> retiredCount, reclaimedCount;
+};
+
+/* Pins the current version of a store for the snapshot's lifetime */
+class SceneSnapshot {
+public:
+    SceneSnapshot(SceneStore& _store);
+    ~SceneSnapshot();
+
+    const Scene* get() const { return &version->scene; }
+    uint64_t getVersion() const { return version->number; }
+
+private:
+    SceneSnapshot(const SceneSnapshot& snapshot);
+
+    SceneStore& store;
+    const SceneStore::Version* version;
+    int slot;
+};
+
+#endif /* defined(__Ray_Tracer__C_____SceneStore__) */
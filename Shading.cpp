@@ -0,0 +1,41 @@
+/************************************************************************************************
+ File: Shading.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "Shading.h"
+
+ShadingKernel selectShadingKernel(const Surface& surface)
+{
+    Color specular = surface.getSpecularCoefficients();
+
+    if (specular.getR() == 0.0 && specular.getG() == 0.0 && specular.getB() == 0.0) {
+        return phongKernel<false, 0>;
+    }
+
+    switch (surface.getSpecularExponent()) {
+        case 1:   return phongKernel<true, 1>;
+        case 2:   return phongKernel<true, 2>;
+        case 3:   return phongKernel<true, 3>;
+        case 4:   return phongKernel<true, 4>;
+        case 5:   return phongKernel<true, 5>;
+        case 8:   return phongKernel<true, 8>;
+        case 10:  return phongKernel<true, 10>;
+        case 16:  return phongKernel<true, 16>;
+        case 20:  return phongKernel<true, 20>;
+        case 32:  return phongKernel<true, 32>;
+        case 50:  return phongKernel<true, 50>;
+        case 64:  return phongKernel<true, 64>;
+        case 100: return phongKernel<true, 100>;
+        case 128: return phongKernel<true, 128>;
+        default:  return phongKernel<true, RUNTIME_EXPONENT>;
+    }
+}
+
+ShadingKernel genericShadingKernel()
+{
+    return phongKernel<true, RUNTIME_EXPONENT>;
+}
@@ -0,0 +1,103 @@
+/************************************************************************************************
+ File: Shading.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____Shading__
+#define __Ray_Tracer__C_____Shading__
+
+#include <stdio.h>
+#include <cmath>
+#include "Surface.h"
+#include "Light.h"
+#include "FastMath.h"
+
+/* Phong shading kernels: Illum = C( kd(L.N) + ks(R.E)^n ). Each material gets a kernel instantiated
+    for its features when the scene is built, so diffuse-only materials skip the specular term and
+    common integer exponents compile down to a handful of multiplications instead of a powf() call */
+
+#define RUNTIME_EXPONENT -1
+
+/* Geometry shared by every light evaluated at one hit point */
+struct ShadingPoint {
+    float position[3];
+    float normal[3];    /* Unit normal of the surface at 'position' */
+    float toEye[3];     /* Unit vector from 'position' to the eye */
+    Color albedo;       /* Texture color scaling kd at 'position', white for untextured surfaces */
+};
+
+/* x^N for a compile-time N, expanded into multiplications by repeated squaring */
+template <int N>
+struct Power {
+    static inline float of(float x) {
+        float half = Power<N / 2>::of(x);
+        return (N % 2 == 1) ? half * half * x : half * half;
+    }
+};
+
+template <>
+struct Power<1> {
+    static inline float of(float x) { return x; }
+};
+
+template <>
+struct Power<0> {
+    static inline float of(float x) { return 1.0f; }
+};
+
+template <int Exponent>
+inline float specularFactor(float RE, const Surface& surface) {
+    return Power<Exponent>::of(RE);
+}
+
+/* Generic fallback for exponents that have no specialization */
+template <>
+inline float specularFactor<RUNTIME_EXPONENT>(float RE, const Surface& surface) {
+    return useFastMath ? fastPow(RE, (float) surface.getSpecularExponent()) : powf(RE, (float) surface.getSpecularExponent());
+}
+
+template <bool Specular, int Exponent>
+Color phongKernel(const Surface& surface, const ShadingPoint& point, const Light& light) {
+    Point lightPosition = light.getPosition();
+    float L[3] = { lightPosition.getX() - point.position[0],
+                   lightPosition.getY() - point.position[1],
+                   lightPosition.getZ() - point.position[2] };
+    float inverseLength = reciprocalSqrt( (L[0] * L[0]) + (L[1] * L[1]) + (L[2] * L[2]) );
+
+    L[0] *= inverseLength;
+    L[1] *= inverseLength;
+    L[2] *= inverseLength;
+
+    float LN = (L[0] * point.normal[0]) + (L[1] * point.normal[1]) + (L[2] * point.normal[2]);
+
+    if (LN <= 0.0) {    /* Light is hitting non-visible side of the surface */
+        return Color();
+    }
+
+    Color result = (surface.getDiffuseCoefficients() * point.albedo) * LN;
+
+    if (Specular) {
+        /* R = 2(L.N)N - L, so R.E = 2(L.N)(N.E) - L.E without building R */
+        float NE = (point.normal[0] * point.toEye[0]) + (point.normal[1] * point.toEye[1]) + (point.normal[2] * point.toEye[2]);
+        float LE = (L[0] * point.toEye[0]) + (L[1] * point.toEye[1]) + (L[2] * point.toEye[2]);
+        float RE = (2.0f * LN * NE) - LE;
+
+        if (RE > 0.0) {
+            result += surface.getSpecularCoefficients() * specularFactor<Exponent>(RE, surface);
+        }
+    }
+
+    return light.getRGBIntensity() * result;
+}
+
+/* Picks the kernel specialized for 'surface': diffuse-only when it has no specular coefficients,
+    otherwise the instantiation for its exponent, or the generic powf() kernel for uncommon exponents */
+ShadingKernel selectShadingKernel(const Surface& surface);
+
+/* The generic kernel that every material could use; kept for benchmarking the specializations */
+ShadingKernel genericShadingKernel();
+
+#endif /* defined(__Ray_Tracer__C_____Shading__) */
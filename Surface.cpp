@@ -7,6 +7,14 @@
 ************************************************************************************************/
 
 #include "Surface.h"
+#include "Shading.h"
+#include "FastMath.h"
+#include "Precision.h"
+
+void Surface::updateShadingKernel()
+{
+    shadingKernel = selectShadingKernel(*this);
+}
 
 /* Sphere */
 Sphere::Sphere()
@@ -25,35 +33,21 @@ Sphere::Sphere(Point sphereCenter, float sphereRadius, Color amb, Color diff, Co
 
 float Sphere::intersect(Ray ray, Ray& normal)
 {
-    /* x(1,2) = [(-b (+,-) sqrt(determinant)) / 2a] */
-    float a, b, c, determinant, intersection, x1, x2;
+    float intersection, nearRoot, farRoot;
     
     std::vector<float> rayUnitDirectionVector = ray.normalize();
     Point rayStartPoint = ray.getStartPoint();
     
-    a = powf(rayUnitDirectionVector[0], 2.00) + powf(rayUnitDirectionVector[1], 2.00) + powf(rayUnitDirectionVector[2], 2.00);
-    
-    b = 2.00 * ((rayUnitDirectionVector[0] * (rayStartPoint.getX() - this->center.getX())) +
-                (rayUnitDirectionVector[1] * (rayStartPoint.getY() - this->center.getY())) +
-                (rayUnitDirectionVector[2] * (rayStartPoint.getZ() - this->center.getZ())));
+    /* Stable quadratic, refined in double where float cannot decide it (see Precision.h) */
+    float origin[3] = { rayStartPoint.getX(), rayStartPoint.getY(), rayStartPoint.getZ() };
+    float centerCoordinates[3] = { center.getX(), center.getY(), center.getZ() };
     
-    c = powf(this->center.getX(), 2.00) + powf(this->center.getY(), 2.00) + powf(this->center.getZ(), 2.00) +
-        powf(rayStartPoint.getX(), 2.00) + powf(rayStartPoint.getY(), 2.00) + powf(rayStartPoint.getZ(), 2.00) -
-        (2 * (this->center.getX() * rayStartPoint.getX() + this->center.getY() * rayStartPoint.getY() + this->center.getZ() * rayStartPoint.getZ())) -
-        powf(this->radius, 2.00);
-    
-    determinant = powf(b, 2.00) - (4 * a * c);
-    float absDeterminant = fabs(determinant);
-    
-    if (determinant < 0 && absDeterminant > 0.0001) {    /* No intersection */
+    if (!solveSphere(origin, &rayUnitDirectionVector[0], centerCoordinates, radius, nearRoot, farRoot)) {
         return -1;
-    } else {    /* Ray passes through sphere */
-        x1 = ( -b + sqrtf(absDeterminant) ) / (2 * a);
-        x2 = ( -b - sqrtf(absDeterminant) ) / (2 * a);
     }
     
     /* Set intersection to closest intersection point along ray */
-    intersection = (x2 > 0) ? x2 : x1;
+    intersection = (nearRoot > 0) ? nearRoot : farRoot;
     
     /* Prepare a ray representing the normal of the surface at the intersection point */
     Point newStartPoint(rayStartPoint.getX() + rayUnitDirectionVector[0] * intersection,
@@ -75,6 +69,33 @@ float Sphere::intersect(Ray ray, Ray& normal)
     return intersection;
 }
 
+/* intersect() only reports rays that pass within the radius of the center, up to rounding in float
+    precision; the margin covers that and the rounding of the bounds */
+bool Sphere::getBounds(float boundsMin[3], float boundsMax[3]) const
+{
+    float reach = radius * (1.0f + 1e-5f) + 1e-6f;
+    float coordinates[3] = { center.getX(), center.getY(), center.getZ() };
+
+    for (int i = 0; i < 3; i++) {
+        boundsMin[i] = coordinates[i] - reach;
+        boundsMax[i] = coordinates[i] + reach;
+    }
+
+    return true;
+}
+
+/* Longitude around the y axis and latitude from the north pole, each spanning [0, 1] */
+void Sphere::getTextureCoordinates(const Point& hitPoint, float& u, float& v, float& scale) const
+{
+    float direction[3] = { (hitPoint.getX() - center.getX()) / radius,
+                           (hitPoint.getY() - center.getY()) / radius,
+                           (hitPoint.getZ() - center.getZ()) / radius };
+
+    u = 0.5f + atan2f(direction[2], direction[0]) / (2.0f * M_PI);
+    v = acosf(fminf(fmaxf(direction[1], -1.0f), 1.0f)) / M_PI;
+    scale = 1.0f / (M_PI * radius);
+}
+
 
 
 /* Infinite Plane */
@@ -103,21 +124,30 @@ float InfinitePlane::intersect(Ray ray, Ray& retNormal) {
         return -1;
     }
     
+    /* Plane: N.X + d = 0, so t = -(N.S + d) / N.D */
     d = -(normalVector[0] * point.getX() + normalVector[1] * point.getY() + normalVector[2] * point.getZ());
-    numerator = d - dotProduct(ray.getStartPoint(), this->normal.normalize());
+    numerator = -d - dotProduct(ray.getStartPoint(), this->normal.normalize());
     
     if ( (t = numerator/denominator) < 1 || t == 0 ) {
         return -1;
     } else {
-        if (denominator > 0) {  /* Normal of plane pointing away from viewer, so reverse  the directon vector */
-            
-            retNormal = Ray(normal.getDirectionPoint(), normal.getStartPoint());
-            
-        } else {    /* Normal of plane pointing towards viewer */
-            
-            retNormal = this->normal;
-            
+        /* The returned normal starts at the intersection point and faces the viewer, reversing the
+         plane's normal if it points away */
+        float side = (denominator > 0) ? -1.0 : 1.0;
+        std::vector<float> rayUnitDirectionVector = ray.normalize();
+        std::vector<float> facingNormal(3);
+        Point rayStartPoint = ray.getStartPoint();
+        
+        for (int i = 0; i < 3; i++) {
+            facingNormal[i] = side * normalVector[i];
         }
+        
+        Point intersectionPoint(rayStartPoint.getX() + rayUnitDirectionVector[0] * t,
+                                rayStartPoint.getY() + rayUnitDirectionVector[1] * t,
+                                rayStartPoint.getZ() + rayUnitDirectionVector[2] * t);
+        
+        retNormal = Ray(intersectionPoint.adjust(0.0001, facingNormal), facingNormal);
+        
         return t;
     }
 }
@@ -125,3 +155,32 @@ float InfinitePlane::intersect(Ray ray, Ray& retNormal) {
 
 
 
+
+
+/* Planar coordinates in world units along two axes lying in the plane, so textures repeat every unit */
+void InfinitePlane::getTextureCoordinates(const Point& hitPoint, float& u, float& v, float& scale) const
+{
+    std::vector<float> n = Ray(normal).normalize();
+    float seed[3] = { 0.0, 0.0, 0.0 };
+
+    seed[(fabsf(n[0]) < 0.9f) ? 0 : 1] = 1.0;
+
+    /* tangent = seed x n, bitangent = n x tangent */
+    float tangent[3] = { seed[1] * n[2] - seed[2] * n[1],
+                         seed[2] * n[0] - seed[0] * n[2],
+                         seed[0] * n[1] - seed[1] * n[0] };
+    float inverseLength = 1.0f / sqrtf( (tangent[0] * tangent[0]) + (tangent[1] * tangent[1]) + (tangent[2] * tangent[2]) );
+
+    for (int i = 0; i < 3; i++) {
+        tangent[i] *= inverseLength;
+    }
+
+    float bitangent[3] = { n[1] * tangent[2] - n[2] * tangent[1],
+                           n[2] * tangent[0] - n[0] * tangent[2],
+                           n[0] * tangent[1] - n[1] * tangent[0] };
+    float offset[3] = { hitPoint.getX() - point.getX(), hitPoint.getY() - point.getY(), hitPoint.getZ() - point.getZ() };
+
+    u = (offset[0] * tangent[0]) + (offset[1] * tangent[1]) + (offset[2] * tangent[2]);
+    v = (offset[0] * bitangent[0]) + (offset[1] * bitangent[1]) + (offset[2] * bitangent[2]);
+    scale = 1.0;
+}
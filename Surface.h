@@ -13,6 +13,16 @@
 #include "Assets.h"
 #include "Ray.h"
 #include "Color.h"
+#include "Light.h"
+
+#define DEFAULT_SPECULAR_EXPONENT 5
+
+class Surface;
+class Texture;
+struct ShadingPoint;
+
+/* Evaluates the diffuse and specular light reflected by 'surface' at 'point' from 'light' */
+typedef Color (*ShadingKernel)(const Surface& surface, const ShadingPoint& point, const Light& light);
 
 class Surface {
 public:
@@ -22,44 +32,80 @@ public:
         surfaceType = SurfaceType::NONE;
         
         reflectivity = 0.0;
+        specularExponent = DEFAULT_SPECULAR_EXPONENT;
         
         ambienceCoefficients = Color(0.0, 0.0, 0.0);
         diffuseCoefficients = Color(0.0, 0.0, 0.0);
         specularCoefficients = Color(0.0, 0.0, 0.0);
+        texture = NULL;
+        
+        updateShadingKernel();
     }
     
     Surface(SurfaceType surface, Color amb, Color diff, Color spec, float reflection) {
         surfaceType = surface;
         
         reflectivity = reflection;
+        specularExponent = DEFAULT_SPECULAR_EXPONENT;
         
         ambienceCoefficients = amb;
         diffuseCoefficients = diff;
         specularCoefficients = spec;
+        texture = NULL;
+        
+        updateShadingKernel();
     }
     
+    virtual ~Surface() {}
+    
     virtual Surface* Clone() = 0;   /* Virtual copy constructor */
     
     /* Returns -1 if no intersection or intersection behind eye, otherwise, returns 
      the magnitude along given ray where intersection occurs and updates 'normal' 
      parameter with the value of the normal ray that extends from the surface's face */
     virtual float intersect(Ray ray, Ray& normal) = 0;
-    virtual void setReflectivity(float reflect) { reflectivity = reflect; }
-    virtual void setAmbientCoefficients(Color amb) { ambienceCoefficients = amb; }
-    virtual void setDiffuseCoefficients(Color diff) { diffuseCoefficients = diff; }
-    virtual void setSpecularCoefficients(Color spec) { specularCoefficients = spec; }
-    virtual float getReflectivity() { return reflectivity; }
-    virtual Color getAmbientCoefficients() { return ambienceCoefficients; }
-    virtual Color getDiffuseCoefficients() { return diffuseCoefficients; }
-    virtual Color getSpecularCoefficients() { return specularCoefficients; }
+    
+    /* Texture coordinates of 'hitPoint' on the surface, and 'scale', the change in (u, v) per unit of
+     distance on the surface, which converts a ray footprint into texture space */
+    virtual void getTextureCoordinates(const Point& hitPoint, float& u, float& v, float& scale) const {
+        u = v = scale = 0.0;
+    }
+    
+    /* Axis-aligned box containing every point intersect() can report; false for unbounded surfaces */
+    virtual bool getBounds(float boundsMin[3], float boundsMax[3]) const { return false; }
+    
+    /* Material setters re-select the shading kernel, so material changes are picked up at scene-build time */
+    void setReflectivity(float reflect) { reflectivity = reflect; updateShadingKernel(); }
+    void setAmbientCoefficients(Color amb) { ambienceCoefficients = amb; }
+    void setDiffuseCoefficients(Color diff) { diffuseCoefficients = diff; }
+    void setSpecularCoefficients(Color spec) { specularCoefficients = spec; updateShadingKernel(); }
+    void setSpecularExponent(int exponent) { specularExponent = exponent; updateShadingKernel(); }
+    void setTexture(Texture* newTexture) { texture = newTexture; }
+    float getReflectivity() const { return reflectivity; }
+    int getSpecularExponent() const { return specularExponent; }
+    Texture* getTexture() const { return texture; }
+    Color getAmbientCoefficients() const { return ambienceCoefficients; }
+    Color getDiffuseCoefficients() const { return diffuseCoefficients; }
+    Color getSpecularCoefficients() const { return specularCoefficients; }
+    bool isReflective() const { return reflectivity > 0.0; }
+    SurfaceType getSurfaceType() const { return surfaceType; }
+    
+    /* Diffuse + specular contribution of one light, using the kernel specialized for this material */
+    Color shade(const ShadingPoint& point, const Light& light) const { return shadingKernel(*this, point, light); }
+    ShadingKernel getShadingKernel() const { return shadingKernel; }
     
 protected:
+    void updateShadingKernel();
+    
     /* For light calculations */
     Color ambienceCoefficients;
     Color diffuseCoefficients;
     Color specularCoefficients;
     float reflectivity;
+    int specularExponent;   /* Phong exponent 'n' in ks(R.E)^n */
+    Texture* texture;       /* Scales ka and kd over the surface when set; not owned by the surface */
     SurfaceType surfaceType;
+    ShadingKernel shadingKernel;
 };
 
 
@@ -71,6 +117,12 @@ public:
     virtual Surface* Clone() { return new Sphere(*this); }  /* Virtual copy constructor */
     
     float intersect(Ray ray, Ray& normal);
+    void getTextureCoordinates(const Point& hitPoint, float& u, float& v, float& scale) const;
+    bool getBounds(float boundsMin[3], float boundsMax[3]) const;
+    void setCenter(Point newCenter) { center = newCenter; }
+    void setRadius(float newRadius) { radius = newRadius; }
+    Point getCenter() const { return center; }
+    float getRadius() const { return radius; }
     
 private:
     Point center;
@@ -122,6 +174,9 @@ public:
     /* Returns -1 if no intersection or ray is parallel to plane, otherwise, returns value of
      intersection point and normalized normal at point on surface */
     float intersect(Ray ray, Ray& normal);
+    void getTextureCoordinates(const Point& hitPoint, float& u, float& v, float& scale) const;
+    Point getPoint() const { return point; }
+    Ray getNormal() const { return normal; }
     
 private:
     Point point;
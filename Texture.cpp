@@ -0,0 +1,120 @@
+/************************************************************************************************
+ File: Texture.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "Texture.h"
+#include <cmath>
+#include "Random.h"
+
+/* Blend of 'a' into 'b' by 't' */
+static Color mix(Color a, Color b, float t)
+{
+    return (a * (1.0f - t)) + (b * t);
+}
+
+/* Integral over [0, x] of a square wave that is 1 on odd unit intervals and 0 on even ones */
+static float oddIntegral(float x)
+{
+    float pairs = floorf(x * 0.5f);
+
+    return pairs + fmaxf(x - (2.0f * pairs) - 1.0f, 0.0f);
+}
+
+/* Fraction of [x - width / 2, x + width / 2] that lies on odd unit intervals */
+static float oddFraction(float x, float width)
+{
+    if (width < 1e-4f) {
+        return (float) (((long) floorf(x)) & 1);
+    }
+
+    return (oddIntegral(x + (0.5f * width)) - oddIntegral(x - (0.5f * width))) / width;
+}
+
+CheckerTexture::CheckerTexture(Color _even, Color _odd, float _frequency)
+{
+    even = _even;
+    odd = _odd;
+    frequency = _frequency;
+}
+
+/* A square is odd when exactly one of its u and v intervals is, so the filtered XOR of the two
+    independent box-filtered square waves gives the covered fraction of odd squares */
+Color CheckerTexture::sample(float u, float v, float footprint) const
+{
+    float width = footprint * frequency;
+    float oddU = oddFraction(u * frequency, width);
+    float oddV = oddFraction(v * frequency, width);
+
+    return mix(even, odd, (oddU * (1.0f - oddV)) + ((1.0f - oddU) * oddV));
+}
+
+
+
+NoiseTexture::NoiseTexture(Color _low, Color _high, float _frequency, int _octaves, uint32_t _seed)
+{
+    low = _low;
+    high = _high;
+    frequency = _frequency;
+    octaves = _octaves;
+    seed = _seed;
+}
+
+/* Smoothly interpolated random values on the integer lattice, in [0, 1) */
+float NoiseTexture::valueNoise(float x, float y) const
+{
+    float cellX = floorf(x), cellY = floorf(y);
+    float fx = x - cellX, fy = y - cellY;
+    uint32_t ix = (uint32_t) (int32_t) cellX, iy = (uint32_t) (int32_t) cellY;
+    float corners[4];
+
+    for (int i = 0; i < 4; i++) {
+        corners[i] = (hashCounters(seed, ix + (i & 1), iy + (i >> 1), 0) >> 8) * (1.0f / 16777216.0f);
+    }
+
+    fx = fx * fx * (3.0f - 2.0f * fx);
+    fy = fy * fy * (3.0f - 2.0f * fy);
+
+    float top = corners[0] + (corners[1] - corners[0]) * fx;
+    float bottom = corners[2] + (corners[3] - corners[2]) * fx;
+
+    return top + (bottom - top) * fy;
+}
+
+/* Each octave fades to its mean as its cells shrink from half the footprint to the footprint */
+Color NoiseTexture::sample(float u, float v, float footprint) const
+{
+    float value = 0.0, amplitude = 0.5, total = 0.0, octaveFrequency = frequency;
+
+    for (int i = 0; i < octaves; i++) {
+        float detail = fminf(fmaxf(2.0f - (2.0f * octaveFrequency * footprint), 0.0f), 1.0f);
+
+        if (detail > 0.0) {
+            value += amplitude * (0.5f + detail * (valueNoise(u * octaveFrequency, v * octaveFrequency) - 0.5f));
+        } else {
+            value += amplitude * 0.5f;
+        }
+
+        total += amplitude;
+        amplitude *= 0.5f;
+        octaveFrequency *= 2.0f;
+    }
+
+    return mix(low, high, value / total);
+}
+
+
+
+ImageTexture::ImageTexture(TextureCache* _cache, int _texture)
+{
+    cache = _cache;
+    texture = _texture;
+}
+
+Color ImageTexture::sample(float u, float v, float footprint) const
+{
+    return cache->sample(texture, u, v, footprint);
+}
@@ -0,0 +1,73 @@
+/************************************************************************************************
+ File: Texture.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____Texture__
+#define __Ray_Tracer__C_____Texture__
+
+#include <stdio.h>
+#include "Color.h"
+#include "TextureCache.h"
+
+/* A color that varies over a surface. Textures are looked up with the surface's (u, v) coordinates
+    and the width of the ray footprint in the same units, so each one can filter out detail that is
+    smaller than a pixel instead of aliasing */
+class Texture {
+public:
+    virtual ~Texture() {}
+
+    virtual Color sample(float u, float v, float footprint) const = 0;
+};
+
+
+
+/* Alternating squares, 'frequency' of each color per unit of u and v. The squares are box filtered
+    over the footprint, so they fade to the average color in the distance */
+class CheckerTexture : public Texture {
+public:
+    CheckerTexture(Color _even, Color _odd, float _frequency);
+
+    Color sample(float u, float v, float footprint) const;
+
+private:
+    Color even, odd;
+    float frequency;
+};
+
+
+
+/* Fractal value noise blending 'low' into 'high'. Octaves finer than the footprint are left out */
+class NoiseTexture : public Texture {
+public:
+    NoiseTexture(Color _low, Color _high, float _frequency, int _octaves, uint32_t _seed);
+
+    Color sample(float u, float v, float footprint) const;
+
+private:
+    float valueNoise(float x, float y) const;
+
+    Color low, high;
+    float frequency;
+    int octaves;
+    uint32_t seed;
+};
+
+
+
+/* An image from a texture cache, repeated every unit of u and v */
+class ImageTexture : public Texture {
+public:
+    ImageTexture(TextureCache* _cache, int _texture);
+
+    Color sample(float u, float v, float footprint) const;
+
+private:
+    TextureCache* cache;
+    int texture;
+};
+
+#endif /* defined(__Ray_Tracer__C_____Texture__) */
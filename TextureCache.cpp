@@ -0,0 +1,349 @@
+/************************************************************************************************
+ File: TextureCache.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "TextureCache.h"
+#include <string.h>
+#include <ctype.h>
+#include <cmath>
+#include <string>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define TILE_BYTES (TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE * 3)
+
+/* Reads the next header field of a PPM file, skipping whitespace and '#' comments */
+static bool readPPMField(FILE* file, int& value)
+{
+    int c = fgetc(file);
+
+    while (c == '#' || isspace(c)) {
+        if (c == '#') {
+            while (c != '\n' && c != EOF) {
+                c = fgetc(file);
+            }
+        }
+        c = fgetc(file);
+    }
+
+    ungetc(c, file);
+
+    return fscanf(file, "%d", &value) == 1;
+}
+
+static bool readPPM(const char* path, int& width, int& height, std::vector<unsigned char>& pixels)
+{
+    FILE* file = fopen(path, "rb");
+    int maxValue;
+
+    if (file == NULL) {
+        return false;
+    }
+
+    bool ok = fgetc(file) == 'P' && fgetc(file) == '6' && readPPMField(file, width) && readPPMField(file, height) &&
+              readPPMField(file, maxValue) && width > 0 && height > 0 && width <= TEXTURE_MAX_SIZE &&
+              height <= TEXTURE_MAX_SIZE && maxValue > 0 && maxValue < 256;
+
+    if (ok) {
+        fgetc(file);    /* The single whitespace character before the raster */
+        pixels.resize((size_t) width * height * 3);
+        ok = fread(&pixels[0], 1, pixels.size(), file) == pixels.size();
+    }
+
+    fclose(file);
+
+    return ok;
+}
+
+/* True if 'entry' describes a level that texel() and fetchTile() can read without dividing by zero
+    or reading outside a file of 'fileSize' bytes */
+static bool isValidLevel(const TextureLevelEntry& entry, uint64_t fileSize)
+{
+    if (entry.width < 1 || entry.height < 1 || entry.width > TEXTURE_MAX_SIZE || entry.height > TEXTURE_MAX_SIZE ||
+        entry.tilesX != (entry.width + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE ||
+        entry.tilesY != (entry.height + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE) {
+        return false;
+    }
+
+    uint64_t bytes = (uint64_t) entry.tilesX * entry.tilesY * TILE_BYTES;
+
+    return entry.offset <= fileSize && bytes <= fileSize - entry.offset;
+}
+
+TextureCache::TextureCache(size_t _memoryBudget)
+{
+    memoryBudget = _memoryBudget;
+    mipMapping = true;
+    residentBytes = 0;
+    hits = misses = evictions = 0;
+}
+
+TextureCache::~TextureCache()
+{
+    for (int i = 0; i < textures.size(); i++) {
+        close(textures[i].descriptor);
+    }
+}
+
+/* Each mip level is a 2x2 box filter of the one above, down to a single texel */
+bool TextureCache::convert(const char* imagePath, const char* tiledPath)
+{
+    int width, height;
+    std::vector<std::vector<unsigned char> > levels(1);
+    std::vector<TextureLevelEntry> entries;
+
+    if (!readPPM(imagePath, width, height, levels[0])) {
+        return false;
+    }
+
+    while (true) {
+        TextureLevelEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.width = width;
+        entry.height = height;
+        entry.tilesX = (width + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+        entry.tilesY = (height + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+        entries.push_back(entry);
+
+        if (width == 1 && height == 1) {
+            break;
+        }
+
+        int nextWidth = std::max(width / 2, 1), nextHeight = std::max(height / 2, 1);
+        const std::vector<unsigned char>& above = levels.back();
+        std::vector<unsigned char> below((size_t) nextWidth * nextHeight * 3);
+
+        for (int y = 0; y < nextHeight; y++) {
+            int y0 = 2 * y, y1 = std::min(2 * y + 1, height - 1);
+
+            for (int x = 0; x < nextWidth; x++) {
+                int x0 = 2 * x, x1 = std::min(2 * x + 1, width - 1);
+
+                for (int c = 0; c < 3; c++) {
+                    int sum = above[((size_t) y0 * width + x0) * 3 + c] + above[((size_t) y0 * width + x1) * 3 + c] +
+                              above[((size_t) y1 * width + x0) * 3 + c] + above[((size_t) y1 * width + x1) * 3 + c];
+                    below[((size_t) y * nextWidth + x) * 3 + c] = (unsigned char) ((sum + 2) / 4);
+                }
+            }
+        }
+
+        levels.push_back(below);
+        width = nextWidth;
+        height = nextHeight;
+    }
+
+    TextureFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = TEXTURE_FILE_MAGIC;
+    header.version = TEXTURE_FILE_VERSION;
+    header.levelCount = (uint32_t) entries.size();
+
+    uint64_t offset = sizeof(header) + entries.size() * sizeof(TextureLevelEntry);
+
+    for (int i = 0; i < entries.size(); i++) {
+        entries[i].offset = offset;
+        offset += (uint64_t) entries[i].tilesX * entries[i].tilesY * TILE_BYTES;
+    }
+
+    FILE* file = fopen(tiledPath, "wb");
+
+    if (file == NULL) {
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(&entries[0], sizeof(TextureLevelEntry), entries.size(), file) == entries.size();
+
+    unsigned char tile[TILE_BYTES];
+
+    for (int i = 0; ok && i < entries.size(); i++) {
+        const TextureLevelEntry& entry = entries[i];
+
+        for (uint32_t tileY = 0; ok && tileY < entry.tilesY; tileY++) {
+            for (uint32_t tileX = 0; ok && tileX < entry.tilesX; tileX++) {
+                memset(tile, 0, sizeof(tile));
+
+                for (int y = 0; y < TEXTURE_TILE_SIZE && tileY * TEXTURE_TILE_SIZE + y < entry.height; y++) {
+                    int columns = std::min((int) TEXTURE_TILE_SIZE, (int) (entry.width - tileX * TEXTURE_TILE_SIZE));
+                    size_t source = (((size_t) tileY * TEXTURE_TILE_SIZE + y) * entry.width + tileX * TEXTURE_TILE_SIZE) * 3;
+                    memcpy(&tile[y * TEXTURE_TILE_SIZE * 3], &levels[i][source], columns * 3);
+                }
+
+                ok = fwrite(tile, 1, sizeof(tile), file) == sizeof(tile);
+            }
+        }
+    }
+
+    return (fclose(file) == 0) && ok;
+}
+
+/* Textures are registered while the scene is built, before any thread samples them */
+int TextureCache::open(const char* tiledPath)
+{
+    TextureFile texture;
+    TextureFileHeader header;
+    struct stat status;
+
+    texture.descriptor = ::open(tiledPath, O_RDONLY);
+
+    if (texture.descriptor < 0) {
+        return -1;
+    }
+
+    bool ok = fstat(texture.descriptor, &status) == 0 &&
+              pread(texture.descriptor, &header, sizeof(header), 0) == (ssize_t) sizeof(header) &&
+              header.magic == TEXTURE_FILE_MAGIC && header.version == TEXTURE_FILE_VERSION &&
+              header.levelCount > 0 && header.levelCount <= TEXTURE_MAX_LEVELS;
+
+    if (ok) {
+        size_t tableBytes = header.levelCount * sizeof(TextureLevelEntry);
+        texture.levels.resize(header.levelCount);
+        ok = pread(texture.descriptor, &texture.levels[0], tableBytes, sizeof(header)) == (ssize_t) tableBytes;
+    }
+
+    for (uint32_t i = 0; ok && i < header.levelCount; i++) {
+        ok = isValidLevel(texture.levels[i], (uint64_t) status.st_size);
+    }
+
+    if (!ok) {
+        close(texture.descriptor);
+        return -1;
+    }
+
+    textures.push_back(texture);
+
+    return (int) textures.size() - 1;
+}
+
+int TextureCache::load(const char* imagePath)
+{
+    std::string tiledPath = std::string(imagePath) + TEXTURE_FILE_EXTENSION;
+    struct stat image, tiled;
+
+    if (stat(imagePath, &image) != 0) {
+        return -1;
+    }
+
+    if (stat(tiledPath.c_str(), &tiled) != 0 || tiled.st_mtime < image.st_mtime) {
+        if (!convert(imagePath, tiledPath.c_str())) {
+            return -1;
+        }
+    }
+
+    return open(tiledPath.c_str());
+}
+
+/* The mip level is picked so that one texel roughly matches the footprint, which keeps distant and
+    grazing surfaces on small levels instead of scattering lookups over the full-resolution tiles */
+Color TextureCache::sample(int texture, float u, float v, float footprint)
+{
+    const std::vector<TextureLevelEntry>& levels = textures[texture].levels;
+    float texels = footprint * std::max(levels[0].width, levels[0].height);
+    float lod = (mipMapping && texels > 1.0f) ? log2f(texels) : 0.0f;
+    int maxLevel = (int) levels.size() - 1;
+    TileCursor cursor;
+
+    cursor.key = UINT64_MAX;
+
+    if (lod >= maxLevel) {
+        return bilinear(texture, maxLevel, u, v, cursor);
+    }
+
+    int level = (int) lod;
+    float blend = lod - level;
+    Color color = bilinear(texture, level, u, v, cursor);
+
+    if (blend > 0.0) {
+        color = (color * (1.0f - blend)) + (bilinear(texture, level + 1, u, v, cursor) * blend);
+    }
+
+    return color;
+}
+
+Color TextureCache::bilinear(int texture, int level, float u, float v, TileCursor& cursor)
+{
+    const TextureLevelEntry& entry = textures[texture].levels[level];
+    float x = (u - floorf(u)) * entry.width - 0.5f;
+    float y = (v - floorf(v)) * entry.height - 0.5f;
+    float cellX = floorf(x), cellY = floorf(y);
+    float fx = x - cellX, fy = y - cellY;
+    int x0 = (int) cellX, y0 = (int) cellY;
+
+    Color top = (texel(texture, level, x0, y0, cursor) * (1.0f - fx)) + (texel(texture, level, x0 + 1, y0, cursor) * fx);
+    Color bottom = (texel(texture, level, x0, y0 + 1, cursor) * (1.0f - fx)) + (texel(texture, level, x0 + 1, y0 + 1, cursor) * fx);
+
+    return (top * (1.0f - fy)) + (bottom * fy);
+}
+
+Color TextureCache::texel(int texture, int level, int x, int y, TileCursor& cursor)
+{
+    const TextureLevelEntry& entry = textures[texture].levels[level];
+
+    int width = entry.width, height = entry.height;
+
+    x = ((x % width) + width) % width;
+    y = ((y % height) + height) % height;
+
+    int tileX = x / TEXTURE_TILE_SIZE, tileY = y / TEXTURE_TILE_SIZE;
+    uint64_t key = ((uint64_t) texture << 48) | ((uint64_t) level << 40) | ((uint64_t) tileY << 20) | (uint64_t) tileX;
+
+    if (key != cursor.key) {
+        cursor.data = fetchTile(texture, level, tileX, tileY, key);
+        cursor.key = key;
+    }
+
+    const unsigned char* rgb = &(*cursor.data)[((y % TEXTURE_TILE_SIZE) * TEXTURE_TILE_SIZE + (x % TEXTURE_TILE_SIZE)) * 3];
+
+    return Color(rgb[0] * (1.0f / 255.0f), rgb[1] * (1.0f / 255.0f), rgb[2] * (1.0f / 255.0f));
+}
+
+/* Tiles are read outside the lock, so a miss only stalls the thread that needs the tile */
+TextureCache::TileData TextureCache::fetchTile(int texture, int level, int tileX, int tileY, uint64_t key)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_map<uint64_t, std::pair<TileData, std::list<uint64_t>::iterator> >::iterator tile = tiles.find(key);
+
+        if (tile != tiles.end()) {
+            hits++;
+            recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, tile->second.second);
+            return tile->second.first;
+        }
+    }
+
+    misses++;
+
+    const TextureLevelEntry& entry = textures[texture].levels[level];
+    std::shared_ptr<std::vector<unsigned char> > data = std::make_shared<std::vector<unsigned char> >(TILE_BYTES);
+    off_t offset = entry.offset + ((uint64_t) tileY * entry.tilesX + tileX) * TILE_BYTES;
+
+    if (pread(textures[texture].descriptor, &(*data)[0], TILE_BYTES, offset) != TILE_BYTES) {
+        std::fill(data->begin(), data->end(), 0);   /* A truncated file reads as black */
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unordered_map<uint64_t, std::pair<TileData, std::list<uint64_t>::iterator> >::iterator tile = tiles.find(key);
+
+    if (tile != tiles.end()) {  /* Another thread loaded it meanwhile */
+        return tile->second.first;
+    }
+
+    while (!recentlyUsed.empty() && residentBytes + TILE_BYTES > memoryBudget) {
+        tiles.erase(recentlyUsed.back());
+        recentlyUsed.pop_back();
+        residentBytes -= TILE_BYTES;
+        evictions++;
+    }
+
+    recentlyUsed.push_front(key);
+    tiles[key] = std::make_pair(TileData(data), recentlyUsed.begin());
+    residentBytes += TILE_BYTES;
+
+    return data;
+}
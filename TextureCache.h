@@ -0,0 +1,116 @@
+/************************************************************************************************
+ File: TextureCache.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____TextureCache__
+#define __Ray_Tracer__C_____TextureCache__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include "Color.h"
+
+#define TEXTURE_FILE_MAGIC 0x58545452      /* "RTTX" read as a little-endian word */
+#define TEXTURE_FILE_VERSION 1
+#define TEXTURE_TILE_SIZE 32                /* Texels per tile side; a tile is 32 * 32 RGB bytes */
+#define TEXTURE_FILE_EXTENSION ".rttx"
+#define TEXTURE_MAX_SIZE (1 << 24)          /* Texels per side; keeps tile coordinates within a cache key */
+#define TEXTURE_MAX_LEVELS 32
+
+struct TextureFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t levelCount;
+    uint32_t padding;
+};
+
+/* One mip level of a tiled texture file. Tiles are stored row by row, each one TEXTURE_TILE_SIZE^2
+    texels even at the right and bottom edges, so any tile can be read with a single pread() */
+struct TextureLevelEntry {
+    uint32_t width;
+    uint32_t height;
+    uint32_t tilesX;
+    uint32_t tilesY;
+    uint64_t offset;    /* Bytes from the start of the file to the level's first tile */
+};
+
+/* Image textures shared by every surface and render thread. Images are converted once into a tiled,
+    mipmapped file next to the source image; afterwards only the tiles that rays actually touch are
+    read from disk, at the mip level matching the ray footprint, and kept under a fixed memory budget
+    with least-recently-used eviction */
+class TextureCache {
+public:
+    TextureCache(size_t _memoryBudget);
+    ~TextureCache();
+
+    /* Converts a binary (P6) PPM image into a tiled, mipmapped texture file */
+    static bool convert(const char* imagePath, const char* tiledPath);
+
+    /* Registers the tiled texture at 'tiledPath' and returns its id, or -1 if it cannot be read or is
+     malformed: no levels or more than TEXTURE_MAX_LEVELS, a level with no texels or more than
+     TEXTURE_MAX_SIZE per side, a tile count that does not match its size, or tiles outside the file */
+    int open(const char* tiledPath);
+
+    /* Registers a PPM image, (re)converting it to imagePath + TEXTURE_FILE_EXTENSION when that file is
+     missing or older than the image. Returns the texture id, or -1 */
+    int load(const char* imagePath);
+
+    /* Trilinearly filtered color of 'texture' at ('u', 'v'), wrapping in both directions. 'footprint'
+     is the width of the ray at the hit point in texture space, where the texture spans [0, 1] */
+    Color sample(int texture, float u, float v, float footprint);
+
+    /* Always sample the full-resolution level; only used to measure what mip selection saves */
+    void setMipMapping(bool enabled) { mipMapping = enabled; }
+    bool isMipMapping() const { return mipMapping; }
+
+    int getTextureCount() const { return (int) textures.size(); }
+    size_t getMemoryBudget() const { return memoryBudget; }
+    size_t getResidentBytes() const { return residentBytes; }
+    uint64_t getHits() const { return hits; }
+    uint64_t getMisses() const { return misses; }
+    uint64_t getEvictions() const { return evictions; }
+    double getHitRate() const { return (hits + misses > 0) ? (double) hits / (double) (hits + misses) : 0.0; }
+    void resetStatistics() { hits = misses = evictions = 0; }
+
+private:
+    TextureCache(const TextureCache& cache);
+
+    typedef std::shared_ptr<const std::vector<unsigned char> > TileData;
+
+    struct TextureFile {
+        int descriptor;
+        std::vector<TextureLevelEntry> levels;
+    };
+
+    /* A tile pinned by the current lookup, so neighbouring texels of the same tile skip the cache */
+    struct TileCursor {
+        uint64_t key;
+        TileData data;
+    };
+
+    Color bilinear(int texture, int level, float u, float v, TileCursor& cursor);
+    Color texel(int texture, int level, int x, int y, TileCursor& cursor);
+    TileData fetchTile(int texture, int level, int tileX, int tileY, uint64_t key);
+
+    std::vector<TextureFile> textures;
+    size_t memoryBudget;
+    bool mipMapping;
+
+    std::mutex mutex;
+    std::list<uint64_t> recentlyUsed;   /* Front is the most recently used tile */
+    std::unordered_map<uint64_t, std::pair<TileData, std::list<uint64_t>::iterator> > tiles;
+    size_t residentBytes;
+
+    std::atomic<uint64_t> hits, misses, evictions;
+};
+
+#endif /* defined(__Ray_Tracer__C_____TextureCache__) */
@@ -0,0 +1,99 @@
+/************************************************************************************************
+ File: ThreadPool.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "ThreadPool.h"
+
+/* Thread Pool */
+ThreadPool::ThreadPool(int threadCount)
+{
+    nextSequence = 0;
+    stopping = false;
+
+    for (int i = 0; i < ((threadCount < 1) ? 1 : threadCount); i++) {
+        workers.push_back( std::thread(&ThreadPool::workerLoop, this) );
+    }
+}
+
+/* Lets the workers drain the queue before joining them */
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    available.notify_all();
+
+    for (int i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task, int priority)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Task entry;
+        entry.priority = priority;
+        entry.sequence = nextSequence++;
+        entry.function = task;
+        tasks.push(entry);
+    }
+
+    available.notify_one();
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true) {
+        std::function<void()> function;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            while (tasks.empty() && !stopping) {
+                available.wait(lock);
+            }
+
+            if (tasks.empty()) {
+                return;
+            }
+
+            function = tasks.top().function;
+            tasks.pop();
+        }
+
+        function();
+    }
+}
+
+
+/* Task Group */
+void TaskGroup::add(int count)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    pending += count;
+}
+
+void TaskGroup::done()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (--pending == 0) {
+        finished.notify_all();
+    }
+}
+
+void TaskGroup::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (pending > 0) {
+        finished.wait(lock);
+    }
+}
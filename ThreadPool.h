@@ -0,0 +1,74 @@
+/************************************************************************************************
+ File: ThreadPool.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____ThreadPool__
+#define __Ray_Tracer__C_____ThreadPool__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/* Fixed set of worker threads shared by every render in the process. Tasks with a higher priority
+    run first; tasks of equal priority run in the order they were submitted */
+class ThreadPool {
+public:
+    ThreadPool(int threadCount);
+    ~ThreadPool();
+
+    int getThreadCount() const { return (int) workers.size(); }
+
+    void submit(std::function<void()> task, int priority = 0);
+
+private:
+    ThreadPool(const ThreadPool& pool);     /* Not copyable, owns threads */
+
+    struct Task {
+        int priority;
+        uint64_t sequence;
+        std::function<void()> function;
+    };
+
+    struct TaskOrder {
+        bool operator()(const Task& a, const Task& b) const {
+            return (a.priority != b.priority) ? (a.priority < b.priority) : (a.sequence > b.sequence);
+        }
+    };
+
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::priority_queue<Task, std::vector<Task>, TaskOrder> tasks;
+    std::mutex mutex;
+    std::condition_variable available;
+    uint64_t nextSequence;
+    bool stopping;
+};
+
+/* Counts outstanding tasks so that the submitter can wait for all of them */
+class TaskGroup {
+public:
+    TaskGroup() { pending = 0; }
+
+    void add(int count);
+    void done();
+    void wait();
+
+private:
+    TaskGroup(const TaskGroup& group);
+
+    int pending;
+    std::mutex mutex;
+    std::condition_variable finished;
+};
+
+#endif /* defined(__Ray_Tracer__C_____ThreadPool__) */
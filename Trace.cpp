@@ -0,0 +1,317 @@
+/************************************************************************************************
+ File: Trace.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "Trace.h"
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <string.h>
+
+bool tracingEnabled = false;
+
+namespace {
+
+struct TraceEvent {
+    uint64_t start;         /* Nanoseconds since tracing started */
+    uint64_t duration;
+    uint32_t zone;
+};
+
+/* Everything one thread traced. Only that thread writes it; it is read once tracing has stopped */
+struct ThreadTrace {
+    int track;
+    std::vector<TraceEvent> events;
+    std::vector<uint64_t> eventCounters;    /* PERF_EVENT_COUNT per event, when counters are read */
+    uint64_t dropped;
+    PerfCounters* counters;
+
+    /* Open zones */
+    int depth, skipped;
+    uint64_t openStart[TRACE_MAX_DEPTH], childTime[TRACE_MAX_DEPTH];
+    uint64_t openCounters[TRACE_MAX_DEPTH][PERF_EVENT_COUNT], childCounters[TRACE_MAX_DEPTH][PERF_EVENT_COUNT];
+
+    /* Summary per zone */
+    uint64_t calls[TRACE_ZONE_COUNT], total[TRACE_ZONE_COUNT], self[TRACE_ZONE_COUNT];
+    uint64_t selfCounters[TRACE_ZONE_COUNT][PERF_EVENT_COUNT];
+};
+
+std::mutex traceMutex;
+std::vector<ThreadTrace*> threadTraces;
+uint64_t traceGeneration = 0;
+bool traceCounters = false;
+std::chrono::steady_clock::time_point traceOrigin;
+
+thread_local ThreadTrace* currentTrace = NULL;
+thread_local uint64_t currentGeneration = 0;
+
+uint64_t traceClock()
+{
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                         traceOrigin).count();
+}
+
+/* The calling thread's trace, created the first time it enters a zone after tracing started */
+ThreadTrace* getThreadTrace()
+{
+    if (currentTrace != NULL && currentGeneration == traceGeneration) {
+        return currentTrace;
+    }
+
+    ThreadTrace* trace = new ThreadTrace();
+    memset(trace->calls, 0, sizeof(trace->calls));
+    memset(trace->total, 0, sizeof(trace->total));
+    memset(trace->self, 0, sizeof(trace->self));
+    memset(trace->selfCounters, 0, sizeof(trace->selfCounters));
+    trace->dropped = 0;
+    trace->depth = trace->skipped = 0;
+    trace->counters = NULL;
+
+    if (traceCounters) {
+        trace->counters = new PerfCounters();
+        trace->counters->open(false);
+        trace->counters->start();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        trace->track = (int) threadTraces.size();
+        threadTraces.push_back(trace);
+    }
+
+    currentTrace = trace;
+    currentGeneration = traceGeneration;
+
+    return trace;
+}
+
+void clearTraces()
+{
+    std::lock_guard<std::mutex> lock(traceMutex);
+
+    for (int i = 0; i < threadTraces.size(); i++) {
+        delete threadTraces[i]->counters;
+        delete threadTraces[i];
+    }
+
+    threadTraces.clear();
+}
+
+}
+
+void startTracing(bool withCounters)
+{
+    clearTraces();
+    traceGeneration++;
+    traceCounters = withCounters;
+    traceOrigin = std::chrono::steady_clock::now();
+    tracingEnabled = true;
+}
+
+void stopTracing()
+{
+    tracingEnabled = false;
+}
+
+const char* getTraceZoneName(TraceZoneId zone)
+{
+    const char* names[] = { "scene build", "accelerator build", "render", "tile", "frustum cull", "camera rays",
+                            "intersection", "shadowing", "shading", "reflection", "deferred pixels", "cost prepass", "denoise",
+                            "output" };
+
+    return names[zone];
+}
+
+void beginTraceZone(TraceZoneId zone)
+{
+    ThreadTrace* trace = getThreadTrace();
+
+    if (trace->depth == TRACE_MAX_DEPTH) {
+        trace->skipped++;
+        return;
+    }
+
+    int depth = trace->depth++;
+    trace->childTime[depth] = 0;
+
+    if (trace->counters != NULL) {
+        memset(trace->childCounters[depth], 0, sizeof(trace->childCounters[depth]));
+        trace->counters->read(trace->openCounters[depth]);
+    }
+
+    trace->openStart[depth] = traceClock();     /* Last, so the counter reads are not timed */
+}
+
+void endTraceZone(TraceZoneId zone)
+{
+    uint64_t end = traceClock();
+    ThreadTrace* trace = getThreadTrace();
+
+    if (trace->skipped > 0) {
+        trace->skipped--;
+        return;
+    }
+
+    int depth = --trace->depth;
+    uint64_t duration = end - trace->openStart[depth];
+
+    trace->calls[zone]++;
+    trace->total[zone] += duration;
+    trace->self[zone] += duration - trace->childTime[depth];
+
+    if (depth > 0) {
+        trace->childTime[depth - 1] += duration;
+    }
+
+    uint64_t spanned[PERF_EVENT_COUNT];
+
+    if (trace->counters != NULL) {
+        trace->counters->read(spanned);
+
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            spanned[e] -= trace->openCounters[depth][e];
+            trace->selfCounters[zone][e] += spanned[e] - trace->childCounters[depth][e];
+
+            if (depth > 0) {
+                trace->childCounters[depth - 1][e] += spanned[e];
+            }
+        }
+    }
+
+    if (trace->events.size() == TRACE_MAX_EVENTS) {
+        trace->dropped++;
+        return;
+    }
+
+    TraceEvent event = { trace->openStart[depth], duration, (uint32_t) zone };
+    trace->events.push_back(event);
+
+    if (trace->counters != NULL) {
+        trace->eventCounters.insert(trace->eventCounters.end(), spanned, spanned + PERF_EVENT_COUNT);
+    }
+}
+
+/* Complete ("X") events with microsecond timestamps, and a name for every thread's track */
+bool writeChromeTrace(const char* path)
+{
+    FILE* file = fopen(path, "w");
+
+    if (file == NULL) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(traceMutex);
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"ray tracer\"}}");
+
+    for (int t = 0; t < threadTraces.size(); t++) {
+        const ThreadTrace* trace = threadTraces[t];
+
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                trace->track, trace->track);
+        fprintf(file, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}}",
+                trace->track, trace->track);
+
+        for (int i = 0; i < trace->events.size(); i++) {
+            const TraceEvent& event = trace->events[i];
+
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"render\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                    getTraceZoneName((TraceZoneId) event.zone), trace->track, event.start * 1e-3, event.duration * 1e-3);
+
+            if (trace->counters != NULL) {
+                bool hasArguments = false;
+
+                for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+                    if (trace->counters->isAvailable((PerfEvent) e)) {
+                        fprintf(file, "%s\"%s\":%llu", hasArguments ? "," : ",\"args\":{",
+                                PerfCounters::getName((PerfEvent) e),
+                                (unsigned long long) trace->eventCounters[i * PERF_EVENT_COUNT + e]);
+                        hasArguments = true;
+                    }
+                }
+
+                if (hasArguments) {
+                    fprintf(file, "}");
+                }
+            }
+
+            fprintf(file, "}");
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+
+    return fclose(file) == 0;
+}
+
+void printTraceSummary()
+{
+    std::lock_guard<std::mutex> lock(traceMutex);
+
+    uint64_t calls[TRACE_ZONE_COUNT] = { 0 }, total[TRACE_ZONE_COUNT] = { 0 }, self[TRACE_ZONE_COUNT] = { 0 };
+    uint64_t selfCounters[TRACE_ZONE_COUNT][PERF_EVENT_COUNT];
+    bool available[PERF_EVENT_COUNT] = { false };
+    uint64_t allSelf = 0, recorded = 0, dropped = 0;
+
+    memset(selfCounters, 0, sizeof(selfCounters));
+
+    for (int t = 0; t < threadTraces.size(); t++) {
+        const ThreadTrace* trace = threadTraces[t];
+
+        for (int z = 0; z < TRACE_ZONE_COUNT; z++) {
+            calls[z] += trace->calls[z];
+            total[z] += trace->total[z];
+            self[z] += trace->self[z];
+            allSelf += trace->self[z];
+
+            for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+                selfCounters[z][e] += trace->selfCounters[z][e];
+            }
+        }
+
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            available[e] = available[e] || (trace->counters != NULL && trace->counters->isAvailable((PerfEvent) e));
+        }
+
+        recorded += trace->events.size();
+        dropped += trace->dropped;
+    }
+
+    printf("Trace, %d threads, %llu zones recorded", (int) threadTraces.size(), (unsigned long long) recorded);
+
+    if (dropped > 0) {
+        printf(", %llu more only summed (over %d per thread)", (unsigned long long) dropped, TRACE_MAX_EVENTS);
+    }
+
+    printf("\n  %-18s %10s %12s %12s %7s", "zone", "calls", "total ms", "self ms", "self");
+
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        if (available[e]) {
+            printf(" %16s", PerfCounters::getName((PerfEvent) e));
+        }
+    }
+
+    printf("\n");
+
+    for (int z = 0; z < TRACE_ZONE_COUNT; z++) {
+        if (calls[z] == 0) {
+            continue;
+        }
+
+        printf("  %-18s %10llu %12.3f %12.3f %6.1f%%", getTraceZoneName((TraceZoneId) z), (unsigned long long) calls[z],
+               total[z] * 1e-6, self[z] * 1e-6, (allSelf > 0) ? 100.0 * self[z] / allSelf : 0.0);
+
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            if (available[e]) {
+                printf(" %16llu", (unsigned long long) selfCounters[z][e]);
+            }
+        }
+
+        printf("\n");
+    }
+}
@@ -0,0 +1,87 @@
+/************************************************************************************************
+ File: Trace.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____Trace__
+#define __Ray_Tracer__C_____Trace__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "PerfCounters.h"
+
+#define TRACE_MAX_EVENTS 1000000    /* Zones recorded per thread; later ones still count in the summary */
+#define TRACE_MAX_DEPTH 32          /* Nesting of zones on one thread */
+
+/************************************************************************************************
+ Scoped trace zones around the phases of a render. While tracing, every zone records its start and
+ duration on the calling thread, and optionally the hardware counters it spanned, into that
+ thread's own buffer, so zones never contend. The buffers are exported in the Chrome trace event
+ format (chrome://tracing, ui.perfetto.dev) with one track per thread, and summed per zone with
+ self time, the time not spent in nested zones, so the phases add up to the traced wall time.
+
+ Tracing is switched on before a render and off after it, never during one. While it is off a zone
+ costs one test of a global flag; compiling with RAY_TRACER_NO_TRACING removes zones altogether.
+ Reading counters costs a read() per event at both ends of every zone, which slows the ray-level
+ zones down noticeably, so counters are off unless asked for
+************************************************************************************************/
+
+enum TraceZoneId { TRACE_SCENE_BUILD, TRACE_ACCELERATOR_BUILD, TRACE_RENDER, TRACE_TILE, TRACE_FRUSTUM_CULL,
+                   TRACE_CAMERA_RAYS, TRACE_INTERSECTION, TRACE_SHADOWING, TRACE_SHADING, TRACE_REFLECTION,
+                   TRACE_DEFERRED_PIXELS, TRACE_COST_PREPASS, TRACE_DENOISE, TRACE_OUTPUT, TRACE_ZONE_COUNT };
+
+extern bool tracingEnabled;
+
+inline bool isTracing() { return tracingEnabled; }
+
+/* Drops everything traced so far and starts tracing. With 'withCounters' every thread opens its own
+    hardware counters the first time it enters a zone */
+void startTracing(bool withCounters);
+void stopTracing();
+
+/* Writes the recorded zones as a Chrome trace. Returns false if the file cannot be written */
+bool writeChromeTrace(const char* path);
+
+/* Prints calls, total and self time per zone over all threads, and the counters where they were read */
+void printTraceSummary();
+
+const char* getTraceZoneName(TraceZoneId zone);
+
+/* Out-of-line halves of TraceZone, only called while tracing */
+void beginTraceZone(TraceZoneId zone);
+void endTraceZone(TraceZoneId zone);
+
+/* Traces the enclosing scope as 'zone' */
+class TraceZone {
+public:
+    TraceZone(TraceZoneId _zone) : zone(_zone), active(tracingEnabled) {
+        if (active) {
+            beginTraceZone(zone);
+        }
+    }
+
+    ~TraceZone() {
+        if (active) {
+            endTraceZone(zone);
+        }
+    }
+
+private:
+    TraceZone(const TraceZone& traceZone);
+
+    TraceZoneId zone;
+    bool active;
+};
+
+#if defined(RAY_TRACER_NO_TRACING)
+#define TRACE_ZONE(zone)
+#else
+#define TRACE_ZONE_NAME(line) traceZone##line
+#define TRACE_ZONE_AT(zone, line) TraceZone TRACE_ZONE_NAME(line)(zone)
+#define TRACE_ZONE(zone) TRACE_ZONE_AT(zone, __LINE__)
+#endif
+
+#endif /* defined(__Ray_Tracer__C_____Trace__) */
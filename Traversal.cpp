@@ -0,0 +1,132 @@
+/************************************************************************************************
+ File: Traversal.cpp
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#include "Traversal.h"
+#include <string.h>
+#include <algorithm>
+
+/* Spreads the low 16 bits of 'v' to the even bit positions */
+static uint32_t spreadBits(uint32_t v)
+{
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+
+    return v;
+}
+
+uint32_t mortonIndex(uint32_t x, uint32_t y)
+{
+    return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+/* Spreads the low 10 bits of 'v' so that there are two zero bits between each */
+static uint32_t spreadBits3(uint32_t v)
+{
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+
+    return v;
+}
+
+uint32_t mortonKey(const float point[3], const float low[3], const float high[3])
+{
+    uint32_t code = 0;
+
+    for (int k = 0; k < 3; k++) {
+        float extent = high[k] - low[k];
+        float cell = (extent > 0.0f) ? (point[k] - low[k]) / extent * 1023.0f : 0.0f;
+        code |= spreadBits3((uint32_t) cell) << k;
+    }
+
+    return code;
+}
+
+/* The classic quadrant walk: at each level, pick the quadrant and rotate the remaining coordinates
+    into that quadrant's frame */
+uint32_t hilbertIndex(uint32_t size, uint32_t x, uint32_t y)
+{
+    uint32_t index = 0;
+
+    for (uint32_t s = size / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) ? 1 : 0;
+        uint32_t ry = (y & s) ? 1 : 0;
+
+        index += s * s * ((3 * rx) ^ ry);
+
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - (x & (s - 1));
+                y = s - 1 - (y & (s - 1));
+            }
+
+            std::swap(x, y);
+        }
+    }
+
+    return index;
+}
+
+void getTraversalOrder(TraversalOrder order, int width, int height, std::vector<int>& cells)
+{
+    cells.resize(width * height);
+
+    for (int i = 0; i < cells.size(); i++) {
+        cells[i] = i;
+    }
+
+    if (order == TRAVERSAL_SCANLINE) {
+        return;
+    }
+
+    uint32_t size = 1;
+
+    while (size < width || size < height) {
+        size *= 2;
+    }
+
+    std::vector<std::pair<uint32_t, int> > keyed(cells.size());
+
+    for (int i = 0; i < cells.size(); i++) {
+        uint32_t x = i % width, y = i / width;
+        keyed[i] = std::make_pair( (order == TRAVERSAL_MORTON) ? mortonIndex(x, y) : hilbertIndex(size, x, y), i );
+    }
+
+    std::sort(keyed.begin(), keyed.end());
+
+    for (int i = 0; i < cells.size(); i++) {
+        cells[i] = keyed[i].second;
+    }
+}
+
+bool parseTraversalOrder(const char* name, TraversalOrder& order)
+{
+    if (strcmp(name, "scanline") == 0) {
+        order = TRAVERSAL_SCANLINE;
+    } else if (strcmp(name, "morton") == 0) {
+        order = TRAVERSAL_MORTON;
+    } else if (strcmp(name, "hilbert") == 0) {
+        order = TRAVERSAL_HILBERT;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+const char* getTraversalOrderName(TraversalOrder order)
+{
+    const char* names[] = { "scanline", "morton", "hilbert" };
+
+    return names[order];
+}
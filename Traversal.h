@@ -0,0 +1,39 @@
+/************************************************************************************************
+ File: Traversal.h
+ Project: Ray Tracer [C++]
+
+ Created by: Adrien Caristan on 9/14/15.
+ Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
+************************************************************************************************/
+
+#ifndef __Ray_Tracer__C_____Traversal__
+#define __Ray_Tracer__C_____Traversal__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+/* Orders in which the renderer visits tiles, and pixels within a tile. Morton (Z-order) and Hilbert
+    curves keep consecutive rays close together on screen, and so in the acceleration structure and
+    the caches; Hilbert never jumps, Morton is cheaper to compute */
+enum TraversalOrder { TRAVERSAL_SCANLINE, TRAVERSAL_MORTON, TRAVERSAL_HILBERT };
+
+/* Interleaves the bits of 'x' and 'y' (x in the even bits) */
+uint32_t mortonIndex(uint32_t x, uint32_t y);
+
+/* Morton code of 'point' within the box from 'low' to 'high': each coordinate is quantized to 10 bits
+    and x, y and z take every third bit, x lowest. Sorting by it keeps points close in space together */
+uint32_t mortonKey(const float point[3], const float low[3], const float high[3]);
+
+/* Distance of (x, y) along the Hilbert curve filling a 'size' x 'size' square, 'size' a power of two */
+uint32_t hilbertIndex(uint32_t size, uint32_t x, uint32_t y);
+
+/* Fills 'cells' with the cells of a 'width' x 'height' grid, as y * width + x, in the given order.
+    Grids that are not square powers of two follow the curve of the enclosing square */
+void getTraversalOrder(TraversalOrder order, int width, int height, std::vector<int>& cells);
+
+/* Parses "scanline", "morton" or "hilbert"; returns false for anything else */
+bool parseTraversalOrder(const char* name, TraversalOrder& order);
+const char* getTraversalOrderName(TraversalOrder order);
+
+#endif /* defined(__Ray_Tracer__C_____Traversal__) */
@@ -6,19 +6,41 @@
  Copyright (c) 2015 Adrien Mombo-Caristan. All rights reserved.
 ************************************************************************************************/
 
-#define ImageW 800
-#define ImageH 800
-#define BG_COLOR Color (0.1, 0.1, 0.1)
-#define DEPTH_LIMIT 2
+#define DEFAULT_IMAGE_W 800
+#define DEFAULT_IMAGE_H 800
+#define DEFAULT_TEXTURE_BUDGET_MB 64
+#define UPLOAD_INTERVAL_MS 33   /* How often the viewer uploads finished tiles, about 30 times a second */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <utility>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
 #include "Scene.h"
 #include "Color.h"
+#include "Camera.h"
+#include "FrameBuffer.h"
+#include "Renderer.h"
+#include "Benchmark.h"
+#include "SceneCache.h"
+#include "SceneLibrary.h"
+#include "RenderServer.h"
+#include "Texture.h"
+#include "TextureCache.h"
+#include "FastMath.h"
+#include "Precision.h"
+#include "SceneStore.h"
+#include "Trace.h"
+#include "Denoiser.h"
+#include "EnvironmentMap.h"
+#include "Numa.h"
 
 /* For Mac */
 #include <OpenGL/gl.h>
@@ -32,59 +54,91 @@
 using namespace std;
 
 /************************************************************************************************
- Notes: Window size is 800 x 800 by default.
+ Notes: Window size is 800 x 800 by default and can be changed with --width and --height.
 ************************************************************************************************/
-float framebuffer[ImageH][ImageW][3];
-float pixelPositions[ImageH][ImageW][3];
+int imageWidth = DEFAULT_IMAGE_W;
+int imageHeight = DEFAULT_IMAGE_H;
+int threadCount = 1;
+int samplesPerPixel = 1;
+uint32_t seed = 0;
+const char* sceneCacheDirectory = NULL;
+const char* texturePath = NULL;
+int textureBudgetMB = DEFAULT_TEXTURE_BUDGET_MB;
+AcceleratorType acceleratorType = ACCELERATOR_AUTO;
+float contributionCutoff = 0.0;
+float rouletteThreshold = 0.0;
+TraversalOrder traversalOrder = TRAVERSAL_SCANLINE;
+int shadowProbes = SHADOW_PROBES;
+int maxShadowSamples = SHADOW_MAX_SAMPLES;
+int shadowRayBudget = SHADOW_RAY_BUDGET;
+bool denoise = false;
+bool frustumCulling = true;
+PixelFormat outputFormat = PIXEL_RGB_FLOAT;
+const char* environmentPath = NULL;
+int environmentSamples = ENVIRONMENT_SAMPLES;
+int simulatedNumaNodes = 0;
+bool replicateScene = false;
+bool costOrdering = false;
+const char* previewPath = NULL;
 
-Point eyePosition(0.0, 0.0, -5.0);
-Point normalizedEyePosition = eyePosition.normalize();
+/* The machine's NUMA nodes, or the simulated ones of --numa-nodes */
+NumaTopology numaTopology;
+
+/* Lights every scene when --environment is given */
+EnvironmentMap environmentMap;
+
+/* Image textures of every scene share one cache, created by init() */
+TextureCache* textureCache = NULL;
+
+FrameBuffer framebuffer;
+vector<float> displayPixels;    /* Scanline copy of the framebuffer handed to OpenGL */
+
+/* Primary rays are generated analytically from the camera, so no per-pixel table is kept */
+Camera camera;
 
 /* Representing a scene as a vector of surfaces that are present within scene */
 vector<Scene> scenes;
-Scene currentActiveScene;
-
-void clearFramebuffer() {
-    for(int i = 0; i < ImageH; i++) {
-        for (int j = 0; j < ImageW; j++) {
-            framebuffer[i][j][0] = 0.0;
-            framebuffer[i][j][1] = 0.0;
-            framebuffer[i][j][2] = 0.0;
-        }
-    }
-}
 
-/* Sets pixel x,y to the color RGB I've made a small change to this function to make the pixels 
-    match those returned by the glutMouseFunc exactly - Scott Schaefer */
-void setFramebuffer(int x, int y, float R, float G, float B) {
-    /* Changes the origin from the lower-left corner to the upper-left corner */
-    y = ImageH - 1 - y;
-    if (R<=1.0)
-        if (R>=0.0)
-            framebuffer[y][x][0]=R;
-        else
-            framebuffer[y][x][0]=0.0;
-        else
-            framebuffer[y][x][0]=1.0;
-    if (G<=1.0)
-        if (G>=0.0)
-            framebuffer[y][x][1]=G;
-        else
-            framebuffer[y][x][1]=0.0;
-        else
-            framebuffer[y][x][1]=1.0;
-    if (B<=1.0)
-        if (B>=0.0)
-            framebuffer[y][x][2]=B;
-        else
-            framebuffer[y][x][2]=0.0;
-        else
-            framebuffer[y][x][2]=1.0;
+/* The viewer renders snapshots of these, so scenes can be edited while a render is running */
+vector<SceneStore*> sceneStores;
+
+/* The viewer renders on a background thread so the GLUT loop stays responsive. Workers report each
+    finished tile and a GLUT timer uploads those tiles into 'displayTexture' as they come in */
+Renderer* backgroundRenderer = NULL;
+thread backgroundThread;
+atomic<bool> backgroundDone(false);
+int backgroundScene = 0;
+chrono::steady_clock::time_point backgroundStart;
+
+mutex finishedTilesMutex;
+vector<int> finishedTiles;      /* Tiles finished since the last upload */
+vector<float> previewPixels;    /* With --cost-order, the prepass image scaled up to the window, until uploaded */
+GLuint displayTexture = 0;
+
+/* Prints the texture cache statistics of the last render, if any scene uses image textures */
+void printTextureStats(void) {
+    if (textureCache->getTextureCount() > 0) {
+        printf("Texture cache: %.2f%% hit rate, %llu misses, %llu evictions, %.1f of %.1f MB resident\n",
+               100.0 * textureCache->getHitRate(), (unsigned long long) textureCache->getMisses(),
+               (unsigned long long) textureCache->getEvictions(), textureCache->getResidentBytes() / 1048576.0,
+               textureCache->getMemoryBudget() / 1048576.0);
+    }
 }
 
-/* Draws the scene */
+/* Draws the scene as one textured quad; texture row 0 is the top of the image */
 void drawit(void) {
-    glDrawPixels(ImageW,ImageH,GL_RGB,GL_FLOAT,framebuffer);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, displayTexture);
+    
+    glBegin(GL_QUADS);
+    glTexCoord2f(0.0, 1.0); glVertex2f(-1.0, -1.0);
+    glTexCoord2f(1.0, 1.0); glVertex2f(1.0, -1.0);
+    glTexCoord2f(1.0, 0.0); glVertex2f(1.0, 1.0);
+    glTexCoord2f(0.0, 0.0); glVertex2f(-1.0, 1.0);
+    glEnd();
+    
+    glDisable(GL_TEXTURE_2D);
     glFlush();
 }
 
@@ -92,142 +146,330 @@ void display(void) {
     drawit();
 }
 
-/* Calculates pixel positions in screen space */
-void calcPixelPositions()
-{
-    for (int i = 0; i < ImageH; i++) {
-        for (int j = 0; j < ImageW; j++) {
-            pixelPositions[i][j][0] = (float) ((2.0 * j) / (ImageW - 1.0)) - 1.0 ;
-            pixelPositions[i][j][1] = (float) 1.0 - ((2.0 * i) / (ImageH - 1.0)) ;
-            pixelPositions[i][j][2] = 0.0;
-        }
+/* Allocates the display texture and fills it with the current framebuffer */
+void uploadFramebuffer(void) {
+    if (displayTexture == 0) {
+        glGenTextures(1, &displayTexture);
+        glBindTexture(GL_TEXTURE_2D, displayTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     }
+    
+    framebuffer.toScanlines(displayPixels, false);
+    
+    glBindTexture(GL_TEXTURE_2D, displayTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imageWidth, imageHeight, 0, GL_RGB, GL_FLOAT, &displayPixels[0]);
 }
 
+/* The command line's render settings, shared by every mode that renders a scene */
+void applyRenderSettings(Renderer& renderer) {
+    renderer.setThreadCount(threadCount);
+    renderer.setSamplesPerPixel(samplesPerPixel);
+    renderer.setSeed(seed);
+    renderer.setContributionCutoff(contributionCutoff);
+    renderer.setRouletteThreshold(rouletteThreshold);
+    renderer.setTileOrder(traversalOrder);
+    renderer.setPixelOrder(traversalOrder);
+    renderer.setShadowProbes(shadowProbes);
+    renderer.setMaxShadowSamples(maxShadowSamples);
+    renderer.setShadowRayBudget(shadowRayBudget);
+    renderer.setFrustumCulling(frustumCulling);
+    renderer.setEnvironmentSamples(environmentSamples);
+    renderer.setNumaTopology(&numaTopology);
+    renderer.setCostOrdering(costOrdering);
+}
 
-/************************************************************************************************
- RayTracing functions
-************************************************************************************************/
-Color calcAmbience(Surface* surface) {
-    Color surfaceAmbience = surface->getAmbientCoefficients();
-    Color sceneAmbience = currentActiveScene.getAmbientIntensity();
+/* With --replicate-scene on several NUMA nodes, a copy of 'scene' per node; NULL otherwise */
+SceneReplicas* makeSceneReplicas(const Scene& scene) {
+    if (!replicateScene || numaTopology.getNodeCount() < 2) {
+        return NULL;
+    }
+    
+    SceneReplicas* replicas = new SceneReplicas(scene, numaTopology);
+    printf("Scene copied to %d NUMA nodes in %.3f s.\n", replicas->getNodeCount(), replicas->getBuildSeconds());
     
-    return Color(surfaceAmbience.getR() * sceneAmbience.getR(),
-                 surfaceAmbience.getG() * sceneAmbience.getG(),
-                 surfaceAmbience.getB() * sceneAmbience.getB());
+    return replicas;
 }
 
-Color calcIllumination(Surface* surface, Ray normal, Light lightSource, bool calcAmb) {
-    /* Illum = kaA + C( kd(L.N) + ks(R.E)^n ) */
+/* Stops the background render, if one is running, and waits for its workers to finish their tiles */
+void cancelBackgroundRender(void) {
+    if (backgroundRenderer == NULL) {
+        return;
+    }
     
-    Color final;
+    backgroundRenderer->cancel();
+    backgroundThread.join();
     
-    if (calcAmb) {
-        final += calcAmbience(surface);
+    if (!backgroundDone) {
+        cout << "Scene " << (backgroundScene + 1) << " cancelled.\n";
     }
     
-    /* Evaluate illumination contributions from light source and add to final color */
-    Ray surfaceToLightRay(normal.getStartPoint(), lightSource.getPosition());  /* == L */
+    delete backgroundRenderer;
+    backgroundRenderer = NULL;
     
-    /* surfaceToLightRay is used for calculating the reflected ray as the getReflectedRay function
-       assumes tha the ray is pointing from teh light source to the surface */
-    Ray lightToSurfaceRay(lightSource.getPosition(), normal.getStartPoint());
+    lock_guard<mutex> lock(finishedTilesMutex);
+    finishedTiles.clear();
+    previewPixels.clear();
+}
+
+/* Cancels any render in flight and starts rendering 'sceneIndex' in the background */
+void startBackgroundRender(int sceneIndex) {
+    cancelBackgroundRender();
+    
+    framebuffer.clear();
+    uploadFramebuffer();
+    glutPostRedisplay();
+    
+    backgroundScene = sceneIndex;
+    backgroundDone = false;
+    backgroundStart = chrono::steady_clock::now();
+    
+    cout << "Drawing scene " << (sceneIndex + 1) << "...\n";
     
-    float LN = dotProduct(surfaceToLightRay.normalize(), normal.normalize());
+    backgroundRenderer = new Renderer(NULL, camera);
+    applyRenderSettings(*backgroundRenderer);
+    backgroundRenderer->setTileCallback([](int tile) {
+        lock_guard<mutex> lock(finishedTilesMutex);
+        finishedTiles.push_back(tile);
+    });
     
-    if (LN <= 0.0) {    /* Light is hitting non-visible side of the surface */
+    /* The cost prepass fills the window with blocks of its pixels before the first tile arrives */
+    backgroundRenderer->setPreviewCallback([](const FrameBuffer& preview) {
+        vector<float> small;
+        preview.toScanlines(small, false);
         
-        return final;
+        lock_guard<mutex> lock(finishedTilesMutex);
+        previewPixels.resize((size_t) imageWidth * imageHeight * 3);
         
-    } else {    /* Calculate color on visible side of the surface */
+        for (int y = 0; y < imageHeight; y++) {
+            for (int x = 0; x < imageWidth; x++) {
+                size_t source = ((size_t) (y / PREPASS_STRIDE) * preview.getWidth() + x / PREPASS_STRIDE) * 3;
+                
+                for (int c = 0; c < 3; c++) {
+                    previewPixels[((size_t) y * imageWidth + x) * 3 + c] = small[source + c];
+                }
+            }
+        }
+    });
+    
+    Renderer* renderer = backgroundRenderer;
+    
+    SceneStore* store = sceneStores[sceneIndex];
+    
+    backgroundThread = thread([renderer, store]() {
+        SceneSnapshot snapshot(*store);
+        renderer->setScene(snapshot.get());
+        renderer->render(framebuffer);
+        backgroundDone = true;
+    });
+}
+
+/* GLUT timer: uploads the tiles finished since the last call, straight from their tile blocks */
+void uploadFinishedTiles(int value) {
+    bool done = backgroundDone;     /* Read first, so every tile of a finished render is in the list */
+    vector<int> tiles;
+    vector<float> preview;
+    
+    {
+        lock_guard<mutex> lock(finishedTilesMutex);
+        tiles.swap(finishedTiles);
+        preview.swap(previewPixels);
+    }
+    
+    /* The preview comes before every tile, so it goes up first */
+    if (!preview.empty()) {
+        glBindTexture(GL_TEXTURE_2D, displayTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, imageWidth, imageHeight, GL_RGB, GL_FLOAT, &preview[0]);
+        glutPostRedisplay();
+    }
+    
+    if (!tiles.empty()) {
+        glBindTexture(GL_TEXTURE_2D, displayTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, TILE_SIZE);
         
-        Color diffuseComponent = surface->getDiffuseCoefficients() * LN;
+        for (int i = 0; i < tiles.size(); i++) {
+            int x0, y0, x1, y1;
+            camera.getTileBounds(tiles[i], x0, y0, x1, y1);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x0, y0, x1 - x0, y1 - y0, GL_RGB, GL_FLOAT,
+                            framebuffer.getTile(x0 / TILE_SIZE, y0 / TILE_SIZE));
+        }
         
-        Ray eyeRay(normal.getStartPoint(), eyePosition);
-        float RE = dotProduct(lightToSurfaceRay.getReflectedRay(normal).normalize(), eyeRay.normalize());
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glutPostRedisplay();
+    }
+    
+    if (done && backgroundRenderer != NULL) {
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - backgroundStart).count();
+        printf("Scene %d done in %.3f s.\n", backgroundScene + 1, seconds);
+        printTextureStats();
+        cancelBackgroundRender();
+    }
+    
+    glutTimerFunc(UPLOAD_INTERVAL_MS, uploadFinishedTiles, 0);
+}
+
+/* Renders the region of interest of the camera with 'threadCount' threads that each own whole tiles */
+void renderScene(int sceneIndex) {
+    framebuffer.clear();
+    
+    unique_ptr<SceneReplicas> replicas(makeSceneReplicas(scenes[sceneIndex]));
+    
+    cout << "Drawing scene " << (sceneIndex + 1) << "... ";
+    
+    Renderer renderer(&scenes[sceneIndex], camera);
+    applyRenderSettings(renderer);
+    renderer.setSceneReplicas(replicas.get());
+    
+    FeatureBuffer features;
+    
+    if (denoise) {
+        features.resize(framebuffer.getWidth(), framebuffer.getHeight());
+        renderer.setFeatureBuffer(&features);
+    }
+    
+    renderer.render(framebuffer);
+    
+    cout << "Done.\n";
+    
+    if (previewPath != NULL && !renderer.getPreview().writePPM(previewPath)) {
+        cerr << "Could not write " << previewPath << "\n";
+    }
+    
+    if (denoise) {
+        Denoiser denoiser;
+        denoiser.setThreadCount(threadCount);
         
-        Color specularComponent = surface->getSpecularCoefficients() * powf(RE, 5);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        denoiser.denoise(framebuffer, features, framebuffer);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
         
-        final += lightSource.getRGBIntensity() * (diffuseComponent + specularComponent);
+        printf("Denoised in %.3f s.\n", seconds);
     }
+    
+    printTextureStats();
+}
 
-    return final;
+
+/* Renders into the framebuffer and returns the best wall-clock time of 'repeats' runs */
+double timeRender(Renderer& renderer, int repeats) {
+    double best = INFINITY;
+    
+    for (int i = 0; i < repeats; i++) {
+        framebuffer.clear();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        renderer.render(framebuffer);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        best = (seconds < best) ? seconds : best;
+    }
+    
+    return best;
 }
 
-Color rayTrace(Ray ray, int depth) {
+/* Renders 'sceneIndex' with 1, 4 and all hardware threads, under every render setting of the command
+    line, and checks that the images hash the same. The cost of determinism is measured against the
+    same single-threaded render drawing its random numbers from a free-running per-thread generator.
+    Returns true when every image matched */
+bool runDeterminismCheck(int sceneIndex) {
+    int counts[3] = { 1, 4, (int) thread::hardware_concurrency() };
+    uint64_t referenceHash = 0;
+    bool match = true;
     
-    vector<Surface*> surfaces = currentActiveScene.getSurfaces();
-    Surface* closestSurface = NULL;
-    Ray closestSurfaceNormal;
-    float closestIntersection = INFINITY;
-    int closestSurfaceIndex = INFINITY;
+    const Scene* scene = &scenes[sceneIndex];
     
-    /* Find the surface that has the closest intersection with 'ray' */
-    for (int i = 0; i < surfaces.size(); i++) {
-        Ray surfaceNormal;
-        float intersection = surfaces[i]->intersect(ray, surfaceNormal);
+    cout << "Determinism check on scene " << (sceneIndex + 1) << ", " << imageWidth << "x" << imageHeight
+         << ", " << samplesPerPixel << " spp\n";
+    
+    for (int i = 0; i < 3; i++) {
+        Renderer renderer(scene, camera);
+        applyRenderSettings(renderer);
+        renderer.setThreadCount(counts[i]);
         
-        if (intersection < 1) { /* No intersection or intersection not visible */
-            continue;
-        } else if (intersection < closestIntersection) {    /* Store intersection information */
-            closestSurfaceIndex = i;
-            closestIntersection = intersection;
-            closestSurface = surfaces[i];
-            closestSurfaceNormal = surfaceNormal;
+        double seconds = timeRender(renderer, 1);
+        uint64_t hash = framebuffer.getHash();
+        
+        if (i == 0) {
+            referenceHash = hash;
+        } else if (hash != referenceHash) {
+            match = false;
         }
+        
+        printf("  %3d threads: hash %016llx  %8.3f s  %10.0f samples/s\n", counts[i], (unsigned long long) hash,
+               seconds, (double) imageWidth * imageHeight * samplesPerPixel / seconds);
     }
     
-    Color finalColor;
+    Renderer deterministic(scene, camera);
+    applyRenderSettings(deterministic);
+    deterministic.setThreadCount(1);
+    
+    Renderer freeRunning(deterministic);
+    freeRunning.setDeterministic(false);
+    
+    double freeSeconds = timeRender(freeRunning, 3);
+    double deterministicSeconds = timeRender(deterministic, 3);
+    double overhead = 100.0 * (deterministicSeconds - freeSeconds) / freeSeconds;
+    
+    printf("  deterministic %.3f s vs free-running %.3f s: overhead %+.2f%% (budget 5%%)\n",
+           deterministicSeconds, freeSeconds, overhead);
+    cout << (match ? "  PASS: images are bit-identical\n" : "  FAIL: images differ between thread counts\n");
+    
+    return match;
+}
+
+
+/* Loader for the render server's scene library: a fresh, library-owned copy of scene 'id' (1-based),
+    taken from the scene cache when one is configured and up to date */
+bool loadScene(int id, Scene& scene) {
+    if (id < 1 || id > scenes.size()) {
+        return false;
+    }
     
-    if (closestSurface == NULL) {   /* If there are no intersections return background color */
+    /* Textures cannot be packed, so textured scenes are copied surface by surface instead */
+    if (scenes[id - 1].isTextured()) {
+        vector<Surface*> surfaces = scenes[id - 1].getSurfaces();
         
-        return BG_COLOR;
+        scene = Scene(scenes[id - 1].getAmbientIntensity());
         
-    } else {
+        for (int i = 0; i < scenes[id - 1].getLights().size(); i++) {
+            scene.addLight(scenes[id - 1].getLights()[i]);
+        }
         
-        Point adjustedIntersectionPoint = closestSurfaceNormal.getStartPoint();
+        for (int i = 0; i < surfaces.size(); i++) {
+            scene.addSurface(surfaces[i]->Clone());
+        }
         
-        vector<Light> sceneLights = currentActiveScene.getLights();
+        scene.buildAccelerator(acceleratorType, threadCount);
         
-        /* Cast shadow ray from surface to each light source to determine if point is in shadow */
-        bool calcAmb = true;
-        for (int j = 0; j < sceneLights.size(); j++) {
-            Ray lightRay(sceneLights[j].getPosition(), adjustedIntersectionPoint);
-            
-            Ray tempNormal;
-            closestIntersection = surfaces[closestSurfaceIndex]->intersect(lightRay, tempNormal);
-            
-            bool inShadow = false;
-            
-            for (int k = 0; k < surfaces.size(); k++) {
-                float intersection = surfaces[k]->intersect(lightRay, tempNormal);
-                
-                if (intersection > 1 && intersection < closestIntersection) {
-                    inShadow = true;
-                }
-            }
+        return true;
+    }
+    
+    PackedScene packed(scenes[id - 1]);
+    
+    if (sceneCacheDirectory != NULL) {
+        ostringstream path;
+        path << sceneCacheDirectory << "/scene" << id << ".rtsc";
+        
+        SceneCache cache;
+        
+        if (cache.open(path.str().c_str(), packed.getContentHash())) {
+            scene = cache.buildScene(acceleratorType);
             
-            if (inShadow) {
-                if (calcAmb) {
-                    finalColor += calcAmbience(closestSurface);
-                    calcAmb = false;
-                }
-            } else {
-                /* Calculate illumination at intersection point */
-                finalColor += calcIllumination(closestSurface, closestSurfaceNormal, sceneLights[j], calcAmb);
-                calcAmb = false;
+            if (!scene.getAccelerator()) {
+                scene.buildAccelerator(acceleratorType, threadCount);
             }
+            return true;
         }
-
-        /* Cast reflection ray if object is reflective */
-        if (depth <= DEPTH_LIMIT && closestSurface->getReflectivity() > 0.0) {
-            Ray reflectedRay = ray.getReflectedRay(closestSurfaceNormal);
-            finalColor += (rayTrace(reflectedRay, depth + 1) * closestSurface->getReflectivity());
-        }
-        
     }
     
-    return finalColor;
+    scene = packed.buildScene();
+    scene.buildAccelerator(acceleratorType, threadCount);
+    
+    return true;
 }
 
 
@@ -237,130 +479,15 @@ Color rayTrace(Ray ray, int depth) {
 void keyboard ( unsigned char key, int x, int y ) {
     switch (key) {
         case '1':
-        {
-            clearFramebuffer();
-            
-            currentActiveScene = scenes[0];
-            
-            cout << "Drawing scene 1... ";
-            
-            for (int i = 0; i < ImageH; i++) {
-                
-                for (int j = 0; j < ImageW; j++) {
-                    
-                    /* For testing purposes: stop at center of display window or draw single white pixel there */
-                    if (i == 462 && j == 400) {
-                        int k = 0; k++;
-                        setFramebuffer(j, i, 1,0,0);
-                        //continue;
-                    }/**/
-                    
-                    Point pixelPoint(pixelPositions[i][j][0], pixelPositions[i][j][1], pixelPositions[i][j][2]);
-                    Color pixelColor = rayTrace( Ray(eyePosition, pixelPoint), 0 );
-                    
-                    setFramebuffer(j, i, pixelColor.getR(), pixelColor.getG(), pixelColor.getB());
-                    
-                    pixelColor.resetRGB();
-                    
-                }
-                
-            }
-            
-            display();
-            
-            cout << "Done.\n";
-            
-            break;
-        }
-            
         case '2':
-        {
-            clearFramebuffer();
-            
-            currentActiveScene = scenes[1];
-            
-            cout << "Drawing scene 2... ";
-            
-            for (int i = 0; i < ImageH; i++) {
-                
-                for (int j = 0; j < ImageW; j++) {
-                    
-                    Point pixelPoint(pixelPositions[i][j][0], pixelPositions[i][j][1], pixelPositions[i][j][2]);
-                    Color pixelColor = rayTrace( Ray(eyePosition, pixelPoint), 0 );
-                    
-                    setFramebuffer(j, i, pixelColor.getR(), pixelColor.getG(), pixelColor.getB());
-                    
-                    pixelColor.resetRGB();
-                    
-                }
-                
-            }
-            
-            display();
-            
-            cout << "Done.\n";
-            
-            break;
-        }
-            
         case '3':
-        {
-            clearFramebuffer();
-            
-            currentActiveScene = scenes[2];
-            
-            cout << "Drawing scene 3... ";
-            
-            for (int i = 0; i < ImageH; i++) {
-                
-                for (int j = 0; j < ImageW; j++) {
-                    
-                    Point pixelPoint(pixelPositions[i][j][0], pixelPositions[i][j][1], pixelPositions[i][j][2]);
-                    Color pixelColor = rayTrace( Ray(eyePosition, pixelPoint), 0 );
-                    
-                    setFramebuffer(j, i, pixelColor.getR(), pixelColor.getG(), pixelColor.getB());
-                    
-                    pixelColor.resetRGB();
-                    
-                }
-                
-            }
-            
-            display();
-            
-            cout << "Done.\n";
-            
-            break;
-        }
-            
         case '4':
-        {
-            clearFramebuffer();
-            
-            currentActiveScene = scenes[3];
-            
-            cout << "Drawing scene 4... ";
-            
-            for (int i = 0; i < ImageH; i++) {
-                
-                for (int j = 0; j < ImageW; j++) {
-                    
-                    Point pixelPoint(pixelPositions[i][j][0], pixelPositions[i][j][1], pixelPositions[i][j][2]);
-                    Color pixelColor = rayTrace( Ray(eyePosition, pixelPoint), 0 );
-                    
-                    setFramebuffer(j, i, pixelColor.getR(), pixelColor.getG(), pixelColor.getB());
-                    
-                    pixelColor.resetRGB();
-                }
-                
-            }
-            
-            display();
-            
-            cout << "Done.\n";
+            startBackgroundRender(key - '1');
+            break;
             
+        case 27:    /* Escape */
+            cancelBackgroundRender();
             break;
-        }
             
         default:
             break;
@@ -368,12 +495,39 @@ void keyboard ( unsigned char key, int x, int y ) {
     
 }
 
+/* Swaps each scene for its cached copy, accelerator included, when the cache in 'sceneCacheDirectory'
+    was built from the same scene content, and (re)writes the cache otherwise */
+void loadSceneCaches(void) {
+    for (int i = 0; i < scenes.size(); i++) {
+        if (scenes[i].isTextured()) {
+            continue;
+        }
+        
+        ostringstream path;
+        path << sceneCacheDirectory << "/scene" << (i + 1) << ".rtsc";
+        
+        PackedScene packed(scenes[i]);
+        SceneCache cache;
+        
+        if (cache.open(path.str().c_str(), packed.getContentHash())) {
+            scenes[i] = cache.buildScene(acceleratorType);
+            continue;
+        }
+        
+        packed.buildGrid(threadCount);
+        
+        if (!SceneCache::write(path.str().c_str(), packed)) {
+            cerr << "Could not write scene cache " << path.str() << "\n";
+        }
+    }
+}
+
 /* Set up all scenes */
 void init(void) {
-    clearFramebuffer();
-    
-    /* Calculating pixel positions in 3D space */
-    calcPixelPositions();
+    TRACE_ZONE(TRACE_SCENE_BUILD);
+    camera.setResolution(imageWidth, imageHeight);
+    framebuffer.resize(imageWidth, imageHeight);
+    textureCache = new TextureCache((size_t) textureBudgetMB << 20);
     
     /* Building scene 1 */
     scenes.push_back( Scene() );
@@ -407,8 +561,32 @@ void init(void) {
     //scenes.back().addInfinitePlane( new InfinitePlane(planePoint, planeNorm, planeAmbience, planeDiffuse, planeSpecular, 0.0) );
     
     
-    /* Building scene 2 */
+    /* Building scene 2: procedural and image textures */
     scenes.push_back( Scene() );
+    scenes.back().addLight( Light( Point(2.0, 4.0, -2.0), Color(1.0, 1.0, 1.0) ) );
+    
+    InfinitePlane* floor = new InfinitePlane(Point(0.0, -1.0, 0.0), Ray(Point(0.0, -1.0, 0.0), Point(0.0, 0.0, 0.0)),
+                                             Color(0.1, 0.1, 0.1), Color(0.8, 0.8, 0.8), Color(0.0, 0.0, 0.0), 0.0);
+    floor->setTexture( new CheckerTexture(Color(0.9, 0.9, 0.9), Color(0.15, 0.15, 0.15), 1.0) );
+    scenes.back().addInfinitePlane(floor);
+    
+    Sphere* marble = new Sphere(Point(-0.6, -0.4, 3.0), 0.6, Color(0.1, 0.1, 0.1), Color(0.9, 0.9, 0.9),
+                                Color(0.5, 0.5, 0.5), 0.0);
+    marble->setTexture( new NoiseTexture(Color(0.2, 0.25, 0.6), Color(0.95, 0.9, 0.8), 8.0, 6, 7) );
+    scenes.back().addSphere(marble);
+    
+    /* The image given with --texture, or a fine checker when there is none */
+    int imageTexture = (texturePath != NULL) ? textureCache->load(texturePath) : -1;
+    
+    if (texturePath != NULL && imageTexture < 0) {
+        cerr << "Could not load texture " << texturePath << "\n";
+    }
+    
+    Sphere* globe = new Sphere(Point(0.7, -0.5, 2.5), 0.5, Color(0.1, 0.1, 0.1), Color(0.9, 0.9, 0.9),
+                               Color(0.3, 0.3, 0.3), 0.0);
+    globe->setTexture( (imageTexture >= 0) ? (Texture*) new ImageTexture(textureCache, imageTexture) :
+                                             (Texture*) new CheckerTexture(Color(0.8, 0.1, 0.1), Color(0.9, 0.9, 0.9), 8.0) );
+    scenes.back().addSphere(globe);
     
     
     /* Building scene 3 */
@@ -417,6 +595,39 @@ void init(void) {
     
     /* Building scene 4 */
     scenes.push_back( Scene() );
+    
+    if (sceneCacheDirectory != NULL) {
+        loadSceneCaches();
+    }
+    
+    /* The map given with --environment, or a sky with a sun for "sky" */
+    if (environmentPath != NULL) {
+        bool loaded = true;
+        
+        if (strcmp(environmentPath, "sky") == 0) {
+            const float sunDirection[3] = { -0.4, 0.7, -0.6 };
+            environmentMap.makeSky(1024, sunDirection, 0.04, Color(600.0, 560.0, 500.0));
+        } else {
+            loaded = environmentMap.loadPFM(environmentPath);
+        }
+        
+        if (loaded) {
+            environmentMap.build(threadCount);
+            
+            for (int i = 0; i < scenes.size(); i++) {
+                scenes[i].setEnvironment(&environmentMap);
+            }
+        } else {
+            cerr << "Could not load environment map " << environmentPath << "\n";
+        }
+    }
+    
+    for (int i = 0; i < scenes.size(); i++) {
+        if (!scenes[i].getAccelerator()) {     /* Cached scenes come with theirs */
+            scenes[i].buildAccelerator(acceleratorType, threadCount);
+        }
+        sceneStores.push_back( new SceneStore(scenes[i], acceleratorType, threadCount) );
+    }
 }
 
 
@@ -424,16 +635,256 @@ void init(void) {
  Main function
 ************************************************************************************************/
 int main(int argc, char* argv[]) {
+    int sceneArgument = 0;
+    const char* outputPath = NULL;
+    bool checkDeterminism = false;
+    const char* benchmark = NULL;
+    int serverPort = 0;
+    int clientPort = 0;
+    const char* clientRequest = NULL;
+    const char* tracePath = NULL;
+    bool traceCounters = false;
+    
+    threadCount = thread::hardware_concurrency();
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+            imageWidth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc) {
+            imageHeight = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            samplesPerPixel = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            sceneArgument = atoi(argv[++i]) - 1;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (strcmp(argv[i], "--deterministic") == 0) {
+            checkDeterminism = true;
+        } else if (strcmp(argv[i], "--scene-cache") == 0 && i + 1 < argc) {
+            sceneCacheDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--accel") == 0 && i + 1 < argc) {
+            if (!parseAcceleratorType(argv[++i], acceleratorType)) {
+                cerr << "Unknown accelerator " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cutoff") == 0 && i + 1 < argc) {
+            contributionCutoff = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--roulette") == 0 && i + 1 < argc) {
+            rouletteThreshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--shadow-probes") == 0 && i + 1 < argc) {
+            shadowProbes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--shadow-samples") == 0 && i + 1 < argc) {
+            maxShadowSamples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--shadow-budget") == 0 && i + 1 < argc) {
+            shadowRayBudget = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--denoise") == 0) {
+            denoise = true;
+        } else if (strcmp(argv[i], "--no-frustum-culling") == 0) {
+            frustumCulling = false;
+        } else if (strcmp(argv[i], "--framebuffer-format") == 0 && i + 1 < argc) {
+            if (!parsePixelFormat(argv[++i], outputFormat)) {
+                cerr << "Unknown framebuffer format " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--order") == 0 && i + 1 < argc) {
+            if (!parseTraversalOrder(argv[++i], traversalOrder)) {
+                cerr << "Unknown traversal order " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--trace-counters") == 0) {
+            traceCounters = true;
+        } else if (strcmp(argv[i], "--fast-math") == 0) {
+            setFastMath(true);
+        } else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+            IntersectionPrecision precision;
+            
+            if (!parseIntersectionPrecision(argv[++i], precision)) {
+                cerr << "Unknown intersection precision " << argv[i] << "\n";
+                return 1;
+            }
+            setIntersectionPrecision(precision);
+        } else if (strcmp(argv[i], "--environment") == 0 && i + 1 < argc) {
+            environmentPath = argv[++i];
+        } else if (strcmp(argv[i], "--environment-samples") == 0 && i + 1 < argc) {
+            environmentSamples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--numa-nodes") == 0 && i + 1 < argc) {
+            simulatedNumaNodes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--replicate-scene") == 0) {
+            replicateScene = true;
+        } else if (strcmp(argv[i], "--cost-order") == 0) {
+            costOrdering = true;
+        } else if (strcmp(argv[i], "--preview") == 0 && i + 1 < argc) {
+            previewPath = argv[++i];
+            costOrdering = true;
+        } else if (strcmp(argv[i], "--texture") == 0 && i + 1 < argc) {
+            texturePath = argv[++i];
+        } else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc) {
+            textureBudgetMB = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+            serverPort = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--client") == 0 && i + 2 < argc) {
+            clientPort = atoi(argv[++i]);
+            clientRequest = argv[++i];
+        } else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+            benchmark = argv[++i];
+        }
+    }
+    
+    numaTopology.detect();
+    
+    if (simulatedNumaNodes > 0) {
+        numaTopology.simulate(simulatedNumaNodes);
+    }
+    
+    if (benchmark != NULL) {
+        if (strcmp(benchmark, "shading") == 0) {
+            runShadingBenchmark();
+        } else if (strcmp(benchmark, "scene-cache") == 0) {
+            runSceneCacheBenchmark();
+        } else if (strcmp(benchmark, "out-of-core") == 0) {
+            runOutOfCoreBenchmark();
+        } else if (strcmp(benchmark, "texture-cache") == 0) {
+            runTextureCacheBenchmark();
+        } else if (strcmp(benchmark, "accelerators") == 0) {
+            runAcceleratorBenchmark();
+        } else if (strcmp(benchmark, "fast-math") == 0) {
+            return runFastMathBenchmark() ? 0 : 1;
+        } else if (strcmp(benchmark, "roulette") == 0) {
+            runRouletteBenchmark();
+        } else if (strcmp(benchmark, "scene-updates") == 0) {
+            return runSceneUpdateStress() ? 0 : 1;
+        } else if (strcmp(benchmark, "traversal") == 0) {
+            runTraversalBenchmark();
+        } else if (strcmp(benchmark, "tracing") == 0) {
+            runTracingBenchmark();
+        } else if (strcmp(benchmark, "soft-shadows") == 0) {
+            runSoftShadowBenchmark();
+        } else if (strcmp(benchmark, "denoise") == 0) {
+            runDenoiseBenchmark();
+        } else if (strcmp(benchmark, "compact-formats") == 0) {
+            runCompactFormatBenchmark();
+        } else if (strcmp(benchmark, "frustum") == 0) {
+            runFrustumBenchmark();
+        } else if (strcmp(benchmark, "environment") == 0) {
+            runEnvironmentBenchmark();
+        } else if (strcmp(benchmark, "precision") == 0) {
+            return runPrecisionBenchmark() ? 0 : 1;
+        } else if (strcmp(benchmark, "tile-cost") == 0) {
+            runTileCostBenchmark();
+        } else if (strcmp(benchmark, "numa") == 0) {
+            return runNumaBenchmark() ? 0 : 1;
+        } else if (strcmp(benchmark, "library") == 0) {
+            return runLibraryCheck() ? 0 : 1;
+        } else {
+            cerr << "Unknown benchmark " << benchmark << "\n";
+            return 1;
+        }
+        
+        return 0;
+    }
+    
+    if (clientRequest != NULL) {
+        string reply;
+        vector<unsigned char> image;
+        
+        if (!RenderServer::sendRequest(clientPort, clientRequest, reply, image)) {
+            cerr << "Request failed\n";
+            return 1;
+        }
+        
+        cout << reply << "\n";
+        
+        if (outputPath != NULL && !image.empty()) {
+            FILE* file = fopen(outputPath, "wb");
+            
+            if (file == NULL || fwrite(&image[0], 1, image.size(), file) != image.size()) {
+                cerr << "Could not write " << outputPath << "\n";
+                return 1;
+            }
+            
+            fclose(file);
+        }
+        
+        return (reply.compare(0, 5, "ERROR") == 0) ? 1 : 0;
+    }
+    
+    if (serverPort != 0) {
+        init();
+        
+        ThreadPool pool(threadCount);
+        SceneLibrary library(loadScene, 8);
+        RenderServer server(&library, &pool);
+        
+        cout << "Serving on 127.0.0.1:" << serverPort << " with " << pool.getThreadCount() << " threads" << endl;
+        
+        if (!server.run(serverPort)) {
+            cerr << "Could not listen on port " << serverPort << "\n";
+            return 1;
+        }
+        
+        return 0;
+    }
+    
+    /* Headless modes run without opening a window */
+    if (checkDeterminism || outputPath != NULL) {
+        if (tracePath != NULL) {
+            startTracing(traceCounters);
+        }
+        
+        init();
+        
+        if (sceneArgument < 0 || sceneArgument >= scenes.size()) {
+            cerr << "Unknown scene " << (sceneArgument + 1) << "\n";
+            return 1;
+        }
+        
+        if (checkDeterminism) {
+            return runDeterminismCheck(sceneArgument) ? 0 : 1;
+        }
+        
+        framebuffer.resize(imageWidth, imageHeight, outputFormat);    /* The viewer uploads float tiles, --output may not */
+        renderScene(sceneArgument);
+        
+        {
+            TRACE_ZONE(TRACE_OUTPUT);
+            
+            if (!framebuffer.writePPM(outputPath)) {
+                cerr << "Could not write " << outputPath << "\n";
+                return 1;
+            }
+        }
+        
+        if (tracePath != NULL) {
+            stopTracing();
+            printTraceSummary();
+            
+            if (!writeChromeTrace(tracePath)) {
+                cerr << "Could not write " << tracePath << "\n";
+                return 1;
+            }
+        }
+        
+        return 0;
+    }
+    
     cout << "Testing...\n\n";
     
     glutInit(&argc,argv);
     glutInitDisplayMode(GLUT_SINGLE|GLUT_RGB);
-    glutInitWindowSize(ImageW,ImageH);
+    glutInitWindowSize(imageWidth,imageHeight);
     glutInitWindowPosition(100,100);
     glutCreateWindow("Adrien Mombo-Caristan - Homework 5");
     init();
+    uploadFramebuffer();
     glutDisplayFunc(display);
     glutKeyboardFunc(keyboard);
+    glutTimerFunc(UPLOAD_INTERVAL_MS, uploadFinishedTiles, 0);
     glutMainLoop();
     
     